@@ -9,6 +9,7 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stdio.h>
 #include "type.h"
 #include "token.h"
 #include "symbol.h"
@@ -23,9 +24,17 @@ typedef enum
     AST_IDENTIFIER,  ///< Identifier
     AST_BINARY_EXPR, ///< Binary expression
     AST_UNARY_EXPR,  ///< Unary expression
-    AST_IF_STATEMENT ///< If statement
+    AST_IF_STATEMENT, ///< If statement
+    AST_LOOP,         ///< While or for loop
+    AST_ARRAY_DECL,   ///< Array declaration
+    AST_INDEX,        ///< Array element read
+    AST_ELEMENT_ASSIGN, ///< Array element write
+    AST_ADDRESS       ///< Address of an array element (added by ivopt)
 } ASTNodeType;
 
+/** Unroll hint of a loop preceded by "#pragma unroll" without a count. */
+#define LOOP_UNROLL_FULL (-1)
+
 /**
  * @brief Structure representing an AST node.
  */
@@ -33,6 +42,8 @@ typedef struct ASTNode
 {
     ASTNodeType type;     ///< Type of the AST node
     VarType result_type;  ///< Resulting type after evaluation
+    int line;             ///< Source line the node was parsed from (0 if synthesized)
+    int column;           ///< Source column the node was parsed from (0 if synthesized)
     struct ASTNode *next; ///< Pointer to the next AST node (for sequences)
 
     union
@@ -73,9 +84,52 @@ typedef struct ASTNode
             struct ASTNode *then_branch; ///< Then branch block
             struct ASTNode *else_branch; ///< Else branch block
         } if_statement;
+
+        struct
+        {
+            struct ASTNode *init;      ///< Statement run once before the loop (for loops, else NULL)
+            struct ASTNode *condition; ///< Condition tested before every iteration
+            struct ASTNode *update;    ///< Statement run after every iteration (for loops, else NULL)
+            struct ASTNode *body;      ///< Loop body block
+            struct ASTNode *preheader; ///< Statements run once before the first test (added by licm), or NULL
+            struct ASTNode *exit;      ///< Statements run once after the last test (added by licm), or NULL
+            struct ASTNode *latch;     ///< Condition tested after each iteration instead of condition (added by ivopt), or NULL
+            int unroll;                ///< #pragma unroll hint: 0 if none, 1 never, N times, or LOOP_UNROLL_FULL
+        } loop;
+
+        struct
+        {
+            VarType var_type;        ///< Element type
+            char *name;              ///< Name of the array
+            int length;              ///< Number of elements
+            struct ASTNode **values; ///< Initializers of the first value_count elements
+            int value_count;         ///< Number of initializers (the other elements are zero)
+        } array_decl;
+
+        struct
+        {
+            char *name;            ///< Name of the array (of the element for AST_ADDRESS)
+            struct ASTNode *index; ///< Element index, or its offset from pointer
+            char *pointer;         ///< Variable holding the address of an element (set by ivopt), or NULL
+        } index;
+
+        struct
+        {
+            char *name;            ///< Name of the array
+            struct ASTNode *index; ///< Element index, or its offset from pointer
+            struct ASTNode *value; ///< Value stored
+            char *pointer;         ///< Variable holding the address of an element (set by ivopt), or NULL
+        } element_assign;
     };
 } ASTNode;
 
+/**
+ * @brief Copies a string.
+ * @param s The string, or NULL.
+ * @return A malloc'ed copy, or NULL if s is NULL or allocation fails.
+ */
+char *strdup_safe(const char *s);
+
 /**
  * @brief Creates a variable declaration AST node.
  * @param var_type The type of the variable.
@@ -126,10 +180,129 @@ ASTNode *create_unary_expr_node(TokenType op, ASTNode *operand);
  */
 ASTNode *create_if_statement_node(ASTNode *condition, ASTNode *then_branch, ASTNode *else_branch);
 
+/**
+ * @brief Creates a loop AST node. A while loop has no init or update statement.
+ * @param init Statement run once before the loop, or NULL.
+ * @param condition The condition expression.
+ * @param update Statement run after every iteration, or NULL.
+ * @param body The loop body block.
+ * @return Pointer to the created ASTNode.
+ */
+ASTNode *create_loop_node(ASTNode *init, ASTNode *condition, ASTNode *update, ASTNode *body);
+
+/**
+ * @brief Creates an array declaration AST node.
+ * @param var_type The element type.
+ * @param name The name of the array.
+ * @param length The number of elements.
+ * @param values Initializers of the first elements (taken over by the node), or NULL.
+ * @param value_count The number of initializers.
+ * @return Pointer to the created ASTNode.
+ */
+ASTNode *create_array_decl_node(VarType var_type, const char *name, int length, ASTNode **values, int value_count);
+
+/**
+ * @brief Creates an array element read AST node.
+ * @param name The name of the array.
+ * @param index The element index.
+ * @return Pointer to the created ASTNode.
+ */
+ASTNode *create_index_node(const char *name, ASTNode *index);
+
+/**
+ * @brief Creates an array element assignment AST node.
+ * @param name The name of the array.
+ * @param index The element index.
+ * @param value The value stored.
+ * @return Pointer to the created ASTNode.
+ */
+ASTNode *create_element_assign_node(const char *name, ASTNode *index, ASTNode *value);
+
+/**
+ * @brief Creates an AST node for the address of an array element.
+ * @param name The name of the array.
+ * @param index The element index.
+ * @return Pointer to the created ASTNode.
+ */
+ASTNode *create_address_node(const char *name, ASTNode *index);
+
+/**
+ * @brief Records the source position of the token a node was parsed from.
+ * @param node Pointer to the ASTNode.
+ * @param line Source line.
+ * @param column Source column.
+ * @return The node, for chaining.
+ */
+ASTNode *set_node_location(ASTNode *node, int line, int column);
+
+struct Symbol;
+
+/**
+ * @brief Reports whether an expression always evaluates to 0 or 1: a boolean or 0/1 literal, a
+ *        bool variable, a comparison, a negation, or &, | and ^ of such expressions.
+ * @param node Pointer to the expression node.
+ * @param symbols Symbol table giving the types of variables, or NULL to rely on result types.
+ * @return 1 if the value is boolean, 0 otherwise.
+ */
+int is_boolean_value(const ASTNode *node, struct Symbol *symbols);
+
+/**
+ * @brief Reports whether evaluating an expression may fault: a division or remainder by
+ *        anything but a literal other than 0 and -1, a load through a pointer, or a load
+ *        at a computed index. Such expressions must not be computed speculatively.
+ * @param node Pointer to the expression node, or NULL.
+ * @return 1 if the expression may trap, 0 otherwise.
+ */
+int may_trap(const ASTNode *node);
+
+/**
+ * @brief Compares two side-effect-free expressions structurally.
+ * @param a First expression, or NULL.
+ * @param b Second expression, or NULL.
+ * @return 1 if both compute the same value from the same operands, 0 otherwise.
+ */
+int same_expression(const ASTNode *a, const ASTNode *b);
+
+/**
+ * @brief Measures the name a variable has in the source; block variables end in ".N".
+ * @param name Variable name.
+ * @return Length of the source name, for printing with "%.*s".
+ */
+int source_length(const char *name);
+
+/**
+ * @brief Appends a statement to the end of a statement list.
+ * @param list Pointer to the list head, which may be NULL.
+ * @param statement Statement to append.
+ */
+void append_statement(ASTNode **list, ASTNode *statement);
+
+/**
+ * @brief Creates a fresh variable name for a temporary introduced by an optimization.
+ *        The parser only appends digits to block variables, so "<pass>.tN" never clashes.
+ * @param pass Name of the pass, used as the prefix.
+ * @return A malloc'ed name.
+ */
+char *new_temp(const char *pass);
+
 /**
  * @brief Frees the memory allocated for an AST node and its children.
  * @param node Pointer to the ASTNode to be freed.
  */
 void free_ast(ASTNode *node);
 
+/**
+ * @brief Prints an expression in fully parenthesized form.
+ * @param node Pointer to the expression node.
+ * @param output Stream to write to.
+ */
+void print_expression(ASTNode *node, FILE *output);
+
+/**
+ * @brief Prints a statement list, one statement per line.
+ * @param node Pointer to the first statement.
+ * @param output Stream to write to.
+ */
+void print_ast(ASTNode *node, FILE *output);
+
 #endif // AST_H
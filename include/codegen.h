@@ -11,12 +11,28 @@
 
 #include <stdio.h>
 #include "ast.h"
+#include "passes.h"
+
+/**
+ * @brief Options controlling what the code generator emits besides the program itself.
+ */
+typedef struct
+{
+    int debug_info;          ///< Emit .file/.loc line tables and a DWARF compile unit (-g)
+    int line_table;          ///< Emit statement addresses in the JIT line table section (see jit.h)
+    const char *source_path; ///< Source file name recorded in debug info
+    const char *profile_path; ///< Count statement executions and write them here at exit (NULL: off)
+    int superopt;            ///< Select superoptimized sequences for expression kernels (see superopt.h)
+    int optimize_size;       ///< Prefer smaller code over fewer executed instructions (-Os)
+} CodegenOptions;
 
 /**
  * @brief Generates x86-64 assembly code for a SEG program.
  * @param program Pointer to the AST root (linked list of statements).
  * @param output File pointer to write the assembly output (e.g., output.s).
+ * @param passes Pass manager whose IR-level passes run on the generated code (may be NULL).
+ * @param options Code generation options (may be NULL for defaults).
  */
-void generate_program(ASTNode *program, FILE *output);
+void generate_program(ASTNode *program, FILE *output, PassManager *passes, const CodegenOptions *options);
 
 #endif // CODEGEN_H
@@ -0,0 +1,44 @@
+/**
+ * @file isel.h
+ * @brief Tree-pattern instruction selection for the SEG language compiler.
+ *        Integer and boolean expressions are tiled bottom-up with the cheapest
+ *        combination of the selector's patterns (BURS-style labeling over a cost
+ *        table), then the chosen tiles are emitted top-down as machine IR.
+ * @author Dario Romandini
+ */
+
+#ifndef ISEL_H
+#define ISEL_H
+
+#include "ast.h"
+#include "mir.h"
+#include "symbol.h"
+
+/**
+ * @brief Lowers an operand the selector has no pattern for (float and string values).
+ */
+typedef void (*IselLeafGenerator)(ASTNode *node, MFunction *fn, Symbol *symbols);
+
+/**
+ * @brief Splits an array index into a variable part and a constant element offset, so that
+ *        a[i + 1] is addressed as [base + i*8 + 8]. A constant index out of the bounds of the
+ *        array is an error.
+ * @param index Index expression.
+ * @param array Symbol of the array.
+ * @param line Source line, for the error message.
+ * @param offset Receives the constant offset, in elements.
+ * @return The variable part, or NULL when the whole index is a constant.
+ */
+ASTNode *isel_split_index(ASTNode *index, const Symbol *array, int line, long long *offset);
+
+/**
+ * @brief Selects and emits instructions computing an expression into rax (xmm0 for floats).
+ * @param node Expression to lower.
+ * @param fn Function to append the instructions to.
+ * @param symbols Symbol table of the program.
+ * @param kernels Also use the superoptimized kernels of superopt.h as tiles.
+ * @param leaf Lowers the operands that are not integer or boolean values.
+ */
+void isel_expression(ASTNode *node, MFunction *fn, Symbol *symbols, int kernels, IselLeafGenerator leaf);
+
+#endif // ISEL_H
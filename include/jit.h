@@ -0,0 +1,37 @@
+/**
+ * @file jit.h
+ * @brief In-process execution of compiled SEG programs.
+ *        The generated assembly is assembled into a relocatable object, loaded into
+ *        anonymous executable memory and run without a backing ELF file. Because such
+ *        code is invisible to Linux perf, the loader can describe it in the
+ *        /tmp/perf-<pid>.map symbol map and in the jitdump format (code bytes and
+ *        source line information).
+ * @author Dario Romandini
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+/** Name of the allocatable section holding (address, line, column) entries for the JIT. */
+#define JIT_LINE_TABLE_SECTION ".seg.lines"
+
+/**
+ * @brief Options for in-process execution.
+ */
+typedef struct
+{
+    int perf_map;            ///< Append symbols to /tmp/perf-<pid>.map
+    int jitdump;             ///< Write jit-<pid>.dump (in $JITDUMPDIR or the current directory)
+    const char *source_path; ///< SEG source file named in symbols and line records
+} JitOptions;
+
+/**
+ * @brief Assembles, loads and runs a generated program in the current process.
+ * @param asm_path Path of the generated assembly file.
+ * @param options Profiling options.
+ * @param exit_code Receives the value returned by main.
+ * @return 1 on success, 0 if the program could not be assembled or loaded.
+ */
+int jit_run(const char *asm_path, const JitOptions *options, int *exit_code);
+
+#endif // JIT_H
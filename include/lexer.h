@@ -14,12 +14,13 @@
 
 /**
  * @brief Lexer state structure.
- * Holds the source file and current line number for error reporting.
+ * Holds the source file and current position for error reporting and debug info.
  */
 typedef struct
 {
     FILE *source; /**< Input file pointer */
     int line;     /**< Current line number (starts at 1) */
+    int column;   /**< Column of the next character (starts at 1) */
 } Lexer;
 
 /**
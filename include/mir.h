@@ -0,0 +1,404 @@
+/**
+ * @file mir.h
+ * @brief Machine-level intermediate representation for the SEG language compiler.
+ *        The code generator lowers the AST into a doubly linked list of x86-64
+ *        instructions, which the IR-level optimization passes rewrite before the
+ *        list is printed as Intel-syntax assembly.
+ * @author Dario Romandini
+ */
+
+#ifndef MIR_H
+#define MIR_H
+
+#include <stdio.h>
+
+/**
+ * @brief x86-64 registers. General-purpose registers are sized per operand.
+ */
+typedef enum
+{
+    MREG_NONE,
+    MREG_RAX,
+    MREG_RBX,
+    MREG_RCX,
+    MREG_RDX,
+    MREG_RSI,
+    MREG_RDI,
+    MREG_RBP,
+    MREG_RSP,
+    MREG_R8,
+    MREG_R9,
+    MREG_R10,
+    MREG_R11,
+    MREG_R12,
+    MREG_R13,
+    MREG_R14,
+    MREG_R15,
+    MREG_XMM0,
+    MREG_XMM1,
+    MREG_XMM2,
+    MREG_XMM3,
+    MREG_XMM4,
+    MREG_XMM5,
+    MREG_XMM6,
+    MREG_XMM7,
+    MREG_XMM8,
+    MREG_XMM9,
+    MREG_XMM10,
+    MREG_XMM11,
+    MREG_XMM12,
+    MREG_XMM13,
+    MREG_XMM14,
+    MREG_XMM15,
+    MREG_RIP,
+    MREG_COUNT
+} MReg;
+
+/**
+ * @brief Kinds of instruction operands.
+ */
+typedef enum
+{
+    MOPND_NONE,  ///< Unused operand slot
+    MOPND_REG,   ///< Register
+    MOPND_IMM,   ///< Immediate value
+    MOPND_MEM,   ///< Memory reference
+    MOPND_LABEL  ///< Branch target
+} MOperandKind;
+
+/**
+ * @brief A single instruction operand.
+ *
+ * Memory operands address either [rip + symbol + disp] (symbol set) or
+ * [base + index*scale + disp].
+ */
+typedef struct
+{
+    MOperandKind kind; ///< Operand kind
+    int size;          ///< Access width in bytes (1, 2, 4 or 8)
+    MReg reg;          ///< Register, or base register of a memory operand
+    MReg index;        ///< Index register of a memory operand
+    int scale;         ///< Index scale (1, 2, 4 or 8)
+    long long imm;     ///< Immediate value, or displacement of a memory operand
+    char *symbol;      ///< Symbol of a RIP-relative memory operand, or label name
+} MOperand;
+
+/**
+ * @brief Condition codes used by jcc/setcc/cmovcc.
+ */
+typedef enum
+{
+    MCOND_NONE,
+    MCOND_E,
+    MCOND_NE,
+    MCOND_L,
+    MCOND_LE,
+    MCOND_G,
+    MCOND_GE,
+    MCOND_B,
+    MCOND_BE,
+    MCOND_A,
+    MCOND_AE,
+    MCOND_S,
+    MCOND_NS
+} MCond;
+
+/**
+ * @brief Instruction opcodes. MI_LABEL and MI_DIRECTIVE carry their text in MInstr.text.
+ */
+typedef enum
+{
+    MI_LABEL,
+    MI_DIRECTIVE,
+    MI_MOV,
+    MI_MOVZX,
+    MI_MOVSD,
+    MI_MOVQ,
+    MI_LEA,
+    MI_ADD,
+    MI_SUB,
+    MI_ADC,
+    MI_SBB,
+    MI_IMUL,
+    MI_CQO,
+    MI_IDIV,
+    MI_NEG,
+    MI_NOT,
+    MI_AND,
+    MI_OR,
+    MI_XOR,
+    MI_SHL,
+    MI_SAR,
+    MI_SHR,
+    MI_INC,
+    MI_DEC,
+    MI_CMP,
+    MI_TEST,
+    MI_SETCC,
+    MI_CMOVCC,
+    MI_JCC,
+    MI_JMP,
+    MI_PUSH,
+    MI_POP,
+    MI_CALL,
+    MI_RET,
+    MI_CVTTSD2SI,
+    MI_CVTSI2SD,
+    MI_ADDSD,
+    MI_SUBSD,
+    MI_MULSD,
+    MI_DIVSD,
+    MI_UCOMISD,
+    MI_OPCODE_COUNT
+} MOpcode;
+
+/**
+ * @brief A machine instruction, label or assembler directive.
+ */
+typedef struct MInstr
+{
+    MOpcode op;           ///< Opcode
+    MCond cond;           ///< Condition for MI_JCC, MI_SETCC and MI_CMOVCC
+    MOperand ops[3];      ///< Operands in Intel order (destination first)
+    int nops;             ///< Number of operands in use
+    char *text;           ///< Label name or directive text
+    int line;             ///< Source line the instruction was generated for (0 if none)
+    int column;           ///< Source column the instruction was generated for (0 if none)
+    struct MInstr *prev;  ///< Previous instruction
+    struct MInstr *next;  ///< Next instruction
+} MInstr;
+
+/**
+ * @brief A function body as an instruction list.
+ */
+typedef struct
+{
+    char *name;         ///< Symbol name of the function
+    MInstr *head;       ///< First instruction
+    MInstr *tail;       ///< Last instruction
+    int current_line;   ///< Source line stamped on newly emitted instructions
+    int current_column; ///< Source column stamped on newly emitted instructions
+    int frame_size;     ///< Bytes of [rbp - n] local slots; the code generator sets up the frame
+} MFunction;
+
+/* Operand constructors */
+MOperand mop_reg(MReg reg);
+MOperand mop_reg_sized(MReg reg, int size);
+MOperand mop_imm(long long value);
+MOperand mop_sym(const char *symbol, int size);
+MOperand mop_mem(MReg base, long long disp, int size);
+MOperand mop_label(const char *label);
+
+/**
+ * @brief Creates an empty function.
+ * @param name Symbol name of the function.
+ * @return Pointer to the created MFunction.
+ */
+MFunction *mir_function_create(const char *name);
+
+/**
+ * @brief Frees a function and all of its instructions.
+ * @param fn Pointer to the MFunction to be freed.
+ */
+void mir_function_free(MFunction *fn);
+
+/**
+ * @brief Appends an instruction with up to two operands.
+ * @param fn Function to append to.
+ * @param op Opcode.
+ * @param nops Number of operands that follow (0, 1 or 2).
+ * @return Pointer to the appended MInstr.
+ */
+MInstr *mir_emit(MFunction *fn, MOpcode op, int nops, ...);
+
+/**
+ * @brief Appends a conditional instruction (jcc, setcc, cmovcc).
+ * @param fn Function to append to.
+ * @param op MI_JCC, MI_SETCC or MI_CMOVCC.
+ * @param cond Condition code.
+ * @param nops Number of operands that follow.
+ * @return Pointer to the appended MInstr.
+ */
+MInstr *mir_emit_cond(MFunction *fn, MOpcode op, MCond cond, int nops, ...);
+
+/**
+ * @brief Appends a label definition.
+ * @param fn Function to append to.
+ * @param name Label name.
+ * @return Pointer to the appended MInstr.
+ */
+MInstr *mir_emit_label(MFunction *fn, const char *name);
+
+/**
+ * @brief Appends an assembler directive (printf-style).
+ * @param fn Function to append to.
+ * @param format Directive text format.
+ * @return Pointer to the appended MInstr.
+ */
+MInstr *mir_emit_directive(MFunction *fn, const char *format, ...);
+
+/**
+ * @brief Creates a detached instruction copy; operands and text are duplicated.
+ * @param instr Instruction to copy.
+ * @return Pointer to the new MInstr.
+ */
+MInstr *mir_clone(const MInstr *instr);
+
+/**
+ * @brief Inserts a detached instruction before another one.
+ * @param fn Owning function.
+ * @param before Instruction to insert before (NULL appends).
+ * @param instr Instruction to insert.
+ */
+void mir_insert_before(MFunction *fn, MInstr *before, MInstr *instr);
+
+/**
+ * @brief Unlinks and frees an instruction.
+ * @param fn Owning function.
+ * @param instr Instruction to remove.
+ * @return The instruction that followed the removed one.
+ */
+MInstr *mir_remove(MFunction *fn, MInstr *instr);
+
+/**
+ * @brief Unlinks an instruction without freeing it.
+ * @param fn Owning function.
+ * @param instr Instruction to unlink.
+ */
+void mir_unlink(MFunction *fn, MInstr *instr);
+
+/**
+ * @brief Frees a detached instruction.
+ * @param instr Instruction to free.
+ */
+void mir_instr_free(MInstr *instr);
+
+/**
+ * @brief Compares two operands for equality.
+ * @return 1 if both operands denote the same register, value or location.
+ */
+int mir_operand_equal(const MOperand *a, const MOperand *b);
+
+/**
+ * @brief Reports whether an operand is a full 64-bit general-purpose register other than rsp.
+ */
+int mir_is_gpr64(const MOperand *op);
+
+/**
+ * @brief Reports whether a memory operand is an 8-byte access of a whole global, [rip + name].
+ */
+int mir_is_plain_global(const MOperand *op);
+
+/**
+ * @brief Reports whether an instruction is a mov or movsd storing a whole global.
+ */
+int mir_is_plain_store(const MInstr *instr);
+
+/**
+ * @brief Reports whether an instruction reads a register (including as address component).
+ */
+int mir_reads_reg(const MInstr *instr, MReg reg);
+
+/**
+ * @brief Reports whether an instruction writes a register.
+ */
+int mir_writes_reg(const MInstr *instr, MReg reg);
+
+/**
+ * @brief Reports whether an instruction writes the flags register.
+ */
+int mir_writes_flags(const MInstr *instr);
+
+/**
+ * @brief Reports whether an instruction reads the flags register.
+ */
+int mir_reads_flags(const MInstr *instr);
+
+/**
+ * @brief Reports whether an instruction reads or writes memory (including the stack).
+ * @param writes Set to 1 if the instruction stores to memory (may be NULL).
+ * @return 1 if memory is loaded or stored.
+ */
+int mir_accesses_memory(const MInstr *instr, int *writes);
+
+/**
+ * @brief Finds the global that a memory access through a register reaches, when the base
+ *        register was last set by lea reg, [rip + name], or loaded from a pointer variable of
+ *        ivopt (see symbol_pointer_target), in the same straight-line run.
+ * @param instr The accessing instruction (must be linked into its function).
+ * @param op Its memory operand.
+ * @return The global's name, or NULL if the access may reach any memory.
+ */
+const char *mir_addressed_symbol(const MInstr *instr, const MOperand *op);
+
+/**
+ * @brief Reports whether a control-flow instruction ends the straight-line run of code.
+ */
+int mir_is_terminator(const MInstr *instr);
+
+/**
+ * @brief Finds the definition of a label.
+ * @return Pointer to the MI_LABEL instruction, or NULL.
+ */
+MInstr *mir_find_label(MFunction *fn, const char *name);
+
+/**
+ * @brief Checks whether a register's value is unused after an instruction.
+ *        Follows jumps; gives up (returns 0) on calls and long paths. At a return only
+ *        rax is live: callee-saved registers are preserved by the code generator after
+ *        the passes have run.
+ * @param fn Owning function.
+ * @param after Instruction after which the register is examined.
+ * @param reg Register (general-purpose or the flags when MREG_NONE).
+ * @return 1 if the register is certainly dead.
+ */
+int mir_reg_dead_after(MFunction *fn, MInstr *after, MReg reg);
+
+/**
+ * @brief Reports whether a jump or conditional jump targets a label.
+ */
+int mir_label_is_referenced(MFunction *fn, const MInstr *label);
+
+/**
+ * @brief Computes the loop nesting depth of every instruction: the number of back edges (jumps
+ *        to a label at or before the jump) whose range from the label to the jump contains it.
+ *        Code after a .pushsection (the out-of-line cold part) belongs to no loop.
+ * @param fn Function to analyze.
+ * @return Array indexed by instruction position in the list; the caller frees it.
+ */
+int *mir_loop_depths(MFunction *fn);
+
+/**
+ * @brief Removes register definitions whose results are never read, and turns adjacent
+ *        push/pop pairs into a move (or nothing when the popped register is dead).
+ *        Stores, calls, division and stack-adjusting instructions are always kept.
+ * @return Number of removed instructions.
+ */
+int mir_remove_dead_code(MFunction *fn);
+
+/**
+ * @brief Returns the inverse of a condition code.
+ */
+MCond mcond_invert(MCond cond);
+
+/**
+ * @brief Returns the suffix of a condition code ("e", "ne", ...).
+ */
+const char *mcond_suffix(MCond cond);
+
+/**
+ * @brief Returns the name of a register for an access width.
+ */
+const char *mreg_name(MReg reg, int size);
+
+/**
+ * @brief Writes a single instruction as Intel-syntax assembly.
+ */
+void mir_print_instr(const MInstr *instr, FILE *output);
+
+/**
+ * @brief Writes a function (label and body) as Intel-syntax assembly.
+ */
+void mir_print_function(const MFunction *fn, FILE *output);
+
+#endif // MIR_H
@@ -0,0 +1,193 @@
+/**
+ * @file optimize.h
+ * @brief Entry points of the optimization passes registered with the pass manager.
+ *        AST passes rewrite the program before code generation; MIR passes rewrite
+ *        the instruction list of main afterwards.
+ * @author Dario Romandini
+ */
+
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "passes.h"
+
+/**
+ * @brief Folds operators whose operands are integer or boolean literals.
+ * @return Number of folded expressions.
+ */
+int run_constant_folding(ASTNode **program, PassContext *ctx);
+
+/**
+ * @brief Evaluates a binary operator on constants with the 64-bit wrap-around semantics of
+ *        the generated code.
+ * @return 1 with the value in *result, or 0 when the operation traps at run time.
+ */
+int fold_binary_operator(TokenType op, long long left, long long right, long long *result);
+
+/**
+ * @brief Whether the condition of a loop is known to hold before the first iteration, so
+ *        the body runs at least once.
+ */
+int loop_condition_holds_on_entry(ASTNode *loop);
+
+/**
+ * @brief Replaces if-statements with a constant condition by the branch that is taken.
+ * @return Number of removed if-statements.
+ */
+int run_branch_folding(ASTNode **program, PassContext *ctx);
+
+/**
+ * @brief Loop-invariant code motion: hoists expressions and array element loads whose
+ *        operands the loop never writes into temporaries set in the loop preheader, and keeps
+ *        array elements stored at a constant index in a temporary stored back at the loop exit.
+ * @return Number of hoisted expressions and promoted elements.
+ */
+int run_licm(ASTNode **program, PassContext *ctx);
+
+/**
+ * @brief Loop unrolling: replaces counted loops with a small constant trip count by copies
+ *        of their body, and at -O3 runs small innermost bodies several times per test, with
+ *        a remainder loop for the iterations left over. A "#pragma unroll" hint overrides
+ *        the cost model; -Os only unrolls hinted loops.
+ * @return Number of unrolled loops.
+ */
+int run_unroll(ASTNode **program, PassContext *ctx);
+
+/**
+ * @brief Induction-variable optimization: array accesses whose index is an affine function of
+ *        the variable of a counted loop go through pointers the loop advances, and a loop
+ *        variable left only counting iterations is replaced by a countdown to zero.
+ * @return Number of introduced pointers and counted-down loops.
+ */
+int run_ivopt(ASTNode **program, PassContext *ctx);
+
+/** A loop counting a variable towards a bound, as recognized for unroll and ivopt. */
+typedef struct
+{
+    ASTNode *node;         ///< The AST_LOOP
+    const char *counter;   ///< Loop variable
+    ASTNode *update;       ///< Statement stepping it: the for update, or the last statement of a while body
+    ASTNode **update_link; ///< Link holding update, for passes that move it
+    TokenType op;          ///< Comparison in the condition, with the variable on the left
+    ASTNode *bound;        ///< The other operand of the comparison, an integer expression
+    long long step;        ///< Added to the variable by the update; nonzero and at most 2^20 in magnitude
+    int known_start;       ///< Set when the variable starts at a constant
+    long long start;
+    int size;              ///< AST nodes of the body, without a while loop's update (set by unroll)
+    int nested;            ///< The body contains another loop (set by unroll)
+} CountedLoop;
+
+/**
+ * @brief Recognizes a counted loop: the variable steps by a constant in the for update, or in
+ *        the last statement of a while body, nothing else in the body writes it, and the
+ *        condition compares it with an integer bound the loop never changes. The start value
+ *        is known when the init statement, or for a loop without one the previous statement,
+ *        sets the variable to a constant.
+ * @param node The AST_LOOP.
+ * @param previous Statement before the loop, or NULL.
+ * @param loop Filled in on success.
+ * @return NULL for a counted loop, otherwise why it is not one.
+ */
+const char *recognize_counted_loop(ASTNode *node, const ASTNode *previous, CountedLoop *loop);
+
+/**
+ * @brief Reads an integer literal.
+ * @return 1 with the value in *value, 0 if node is not an integer literal.
+ */
+int integer_literal_value(const ASTNode *node, long long *value);
+
+/** @brief Whether node reads the variable counter and nothing else. */
+int is_counter(const ASTNode *node, const char *counter);
+
+/** @brief Whether the statements from node up to stop assign the variable or store to the array name. */
+int writes_variable(const ASTNode *node, const ASTNode *stop, const char *name);
+
+/** @brief Whether an expression only reads variables and arrays, not via pointers, that the loop never writes. */
+int is_loop_invariant(const ASTNode *node, const ASTNode *loop);
+
+/** @brief Number of times the statements or expression from node up to stop read a variable. */
+int count_reads(const ASTNode *node, const ASTNode *stop, const char *name);
+
+/** @brief Whether a name is used anywhere in the list from node except inside skip. */
+int occurs_outside(const ASTNode *node, const ASTNode *skip, const char *name);
+
+/**
+ * @brief Algebraic simplification with the rewrite rules of src/simplify.rules:
+ *        identities, boolean normalization, comparison canonicalization and
+ *        reassociation of integer constants.
+ * @return Number of applied rewrites.
+ */
+int run_simplify(ASTNode **program, PassContext *ctx);
+
+/**
+ * @brief Equality saturation (-O3): grows an e-graph of every integer and boolean
+ *        expression under arithmetic and boolean rewrite rules within node, iteration and
+ *        time limits, and replaces the expression by the cheapest form under an x86 cost
+ *        model when it beats the original.
+ * @return Number of replaced expressions.
+ */
+int run_egraph(ASTNode **program, PassContext *ctx);
+
+/**
+ * @brief Local peephole cleanups on the instruction list: folds push/pop pairs
+ *        around single loads, forwards copies, and fuses compare-and-branch.
+ * @return Number of rewrites.
+ */
+int run_peephole(MFunction *fn, PassContext *ctx);
+
+/**
+ * @brief Global value numbering: reuses values already available in a register, a global
+ *        or as a constant instead of recomputing them, drops redundant loads, and removes
+ *        the computations left unused.
+ * @return Number of rewritten and removed instructions.
+ */
+int run_gvn(MFunction *fn, PassContext *ctx);
+
+/**
+ * @brief Redundant load and dead store elimination for globals over the control-flow
+ *        graph: loads read the register or constant known to hold the global, and stores
+ *        that are overwritten or reach the return before any read are removed.
+ * @return Number of forwarded loads and removed stores.
+ */
+int run_memopt(MFunction *fn, PassContext *ctx);
+
+/**
+ * @brief Strength reduction: multiplies by constants become lea/shift/add sequences,
+ *        divides and remainders by powers of two become shifts with a sign fix-up, and
+ *        divides by other constants become multiply-high sequences.
+ * @return Number of rewritten operations.
+ */
+int run_strength_reduction(MFunction *fn, PassContext *ctx);
+
+/**
+ * @brief Promotes globals whose address never escapes to locals of main: the most used
+ *        integer variables take registers main leaves free, the others [rbp - n] slots.
+ *        Sets fn->frame_size for the frame the code generator builds.
+ * @return Number of rewritten accesses.
+ */
+int run_promote(MFunction *fn, PassContext *ctx);
+
+/**
+ * @brief Reorders basic blocks for fall-through on the likely path, removes jumps to the
+ *        next block, and aligns hot join points and loop heads within a padding budget.
+ * @return Number of moved blocks, removed jumps, inverted branches and aligned blocks.
+ */
+int run_block_layout(MFunction *fn, PassContext *ctx);
+
+/**
+ * @brief Picks shorter encodings: xor for zeroing moves, test for comparisons with zero,
+ *        and 32-bit forms of moves and logic operations whose upper bits are known zero.
+ * @return Number of rewritten instructions.
+ */
+int run_shrink(MFunction *fn, PassContext *ctx);
+
+/**
+ * @brief List scheduling of each straight-line run of instructions under the latency and
+ *        port model of ctx->tune: independent computations are interleaved so that loads,
+ *        multiplies and divides start early. A run is only reordered when the model
+ *        predicts fewer cycles.
+ * @return Number of reordered runs.
+ */
+int run_schedule(MFunction *fn, PassContext *ctx);
+
+#endif // OPTIMIZE_H
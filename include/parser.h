@@ -22,6 +22,9 @@ typedef struct
 {
     Lexer *lexer;        /**< Pointer to the associated lexer */
     Token current_token; /**< The current token being processed */
+    Symbol *symbols;     /**< Variables in scope, innermost first, used to type identifiers */
+    int block_depth;     /**< Number of enclosing blocks of the current statement */
+    int block_variables; /**< Block-scoped variables declared so far, numbers their unique names */
 } Parser;
 
 /**
@@ -40,7 +43,8 @@ ASTNode *parse_program(Parser *parser);
 
 /**
  * @brief Parses a single variable declaration.
- *        Expects a type keyword (int, float, bool, char, string) followed by an identifier and an assignment.
+ *        Expects a type keyword (int, float, bool, char, string) followed by an identifier and an assignment,
+ *        or an int or float array declaration "type name[length];" with an optional "= { values }".
  * @param parser Pointer to the parser state.
  * @return Pointer to the AST node representing the variable declaration.
  */
@@ -54,7 +58,41 @@ ASTNode *parse_var_decl(Parser *parser);
 ASTNode *parse_if_statement(Parser *parser);
 
 /**
- * @brief Parses a single statement (variable declaration or if-statement).
+ * @brief Parses an assignment "name = expression;" to a variable in scope.
+ *        The result is a declaration node of the variable, which assigns it. An assignment
+ *        "name[index] = expression;" to an array element becomes an element assignment node.
+ * @param parser Pointer to the parser state.
+ * @return Pointer to the AST node representing the assignment.
+ */
+ASTNode *parse_assignment(Parser *parser);
+
+/**
+ * @brief Parses a while loop: "while (condition) { ... }".
+ * @param parser Pointer to the parser state.
+ * @return Pointer to the AST node representing the loop.
+ */
+ASTNode *parse_while_statement(Parser *parser);
+
+/**
+ * @brief Parses a for loop: "for (init; condition; update) { ... }". The init statement is a
+ *        declaration or an assignment, the update an assignment without the semicolon; both
+ *        may be empty. A variable the init statement declares is in scope only in the loop.
+ * @param parser Pointer to the parser state.
+ * @return Pointer to the AST node representing the loop.
+ */
+ASTNode *parse_for_statement(Parser *parser);
+
+/**
+ * @brief Parses a "#pragma" directive and the statement it applies to. "#pragma unroll",
+ *        "#pragma unroll(N)" and "#pragma nounroll" set the unroll hint of the loop that must
+ *        follow; other pragmas are ignored with a warning.
+ * @param parser Pointer to the parser state.
+ * @return Pointer to the AST node of the statement after the directive.
+ */
+ASTNode *parse_pragma_statement(Parser *parser);
+
+/**
+ * @brief Parses a single statement (variable declaration, assignment, if-statement or loop).
  * @param parser Pointer to the parser state.
  * @return Pointer to the AST node representing the statement.
  */
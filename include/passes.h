@@ -0,0 +1,176 @@
+/**
+ * @file passes.h
+ * @brief Optimization pass manager for the SEG language compiler.
+ *        Registers AST-level and IR-level (MIR) passes, builds the pipelines for
+ *        -O0/-O1/-O2/-O3/-Os, and records per-pass timing and change counts.
+ * @author Dario Romandini
+ */
+
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <stdio.h>
+#include "ast.h"
+#include "mir.h"
+
+#define MAX_PIPELINE_PASSES 32
+
+/**
+ * @brief Optimization levels selectable on the command line.
+ */
+typedef enum
+{
+    OPT_O0, ///< No optimization, fastest compile
+    OPT_O1, ///< Cheap local cleanups
+    OPT_O2, ///< All optimizations
+    OPT_O3, ///< -O2 plus equality saturation of expressions and partial loop unrolling
+    OPT_OS  ///< Like -O2, but never trades size for speed
+} OptLevel;
+
+/**
+ * @brief Microarchitectures the instruction scheduler can tune for (-mtune=).
+ */
+typedef enum
+{
+    TUNE_GENERIC, ///< Blend of recent Intel and AMD cores
+    TUNE_SKYLAKE, ///< Intel Skylake
+    TUNE_ZNVER3,  ///< AMD Zen 3
+    TUNE_COUNT
+} TuneTarget;
+
+/**
+ * @brief IR level a pass operates on.
+ */
+typedef enum
+{
+    PASS_AST, ///< Runs on the AST before code generation
+    PASS_MIR  ///< Runs on the machine IR after code generation
+} PassKind;
+
+/**
+ * @brief State shared with every pass invocation.
+ */
+typedef struct
+{
+    OptLevel level;  ///< Active optimization level
+    TuneTarget tune; ///< Latency and port model used by the instruction scheduler
+} PassContext;
+
+/**
+ * @brief A registered optimization pass.
+ *
+ * Each run function returns the number of changes it made, 0 when the input
+ * was left untouched.
+ */
+typedef struct
+{
+    const char *name;        ///< Name used by --disable-pass= and --print-after=
+    PassKind kind;           ///< IR level the pass operates on
+    const char *description; ///< One-line summary
+    int (*run_ast)(ASTNode **program, PassContext *ctx);
+    int (*run_mir)(MFunction *fn, PassContext *ctx);
+} Pass;
+
+/**
+ * @brief Statistics gathered for one pipeline entry.
+ */
+typedef struct
+{
+    double seconds; ///< Accumulated wall time
+    int changes;    ///< Accumulated change count
+    int runs;       ///< Number of invocations
+} PassStats;
+
+/**
+ * @brief Pass manager state: the pipeline and its debugging options.
+ */
+typedef struct
+{
+    PassContext context;                          ///< Context handed to every pass
+    const Pass *pipeline[MAX_PIPELINE_PASSES];    ///< Passes in execution order
+    int disabled[MAX_PIPELINE_PASSES];            ///< Set for passes skipped via --disable-pass=
+    int print_after[MAX_PIPELINE_PASSES];         ///< Set for passes dumped via --print-after=
+    PassStats stats[MAX_PIPELINE_PASSES];         ///< Per-pass statistics
+    int count;                                    ///< Number of passes in the pipeline
+    FILE *dump;                                   ///< Stream for --print-after= output
+} PassManager;
+
+/**
+ * @brief Builds the pipeline for an optimization level.
+ * @param pm Pointer to the pass manager.
+ * @param level Optimization level.
+ */
+void pass_manager_init(PassManager *pm, OptLevel level);
+
+/**
+ * @brief Parses an optimization level flag ("-O0", "-O1", "-O2", "-O3", "-Os").
+ * @param flag Command-line argument.
+ * @param level Receives the parsed level.
+ * @return 1 if the flag was an optimization level, 0 otherwise.
+ */
+int parse_opt_level(const char *flag, OptLevel *level);
+
+/**
+ * @brief Parses a -mtune= value ("generic", "skylake", "znver3").
+ * @param name Microarchitecture name.
+ * @param tune Receives the parsed target.
+ * @return 1 if the name is a known target, 0 otherwise.
+ */
+int parse_tune(const char *name, TuneTarget *tune);
+
+/**
+ * @brief Looks up a registered pass by name.
+ * @return Pointer to the Pass, or NULL if no such pass exists.
+ */
+const Pass *find_pass(const char *name);
+
+/**
+ * @brief Disables a pass of the pipeline (--disable-pass=).
+ * @param pm Pointer to the pass manager.
+ * @param name Pass name.
+ * @return 1 on success, 0 if the name is not a registered pass.
+ */
+int pass_manager_disable(PassManager *pm, const char *name);
+
+/**
+ * @brief Requests an IR dump after a pass (--print-after=), or after every pass for "all".
+ * @param pm Pointer to the pass manager.
+ * @param name Pass name or "all".
+ * @return 1 on success, 0 if the name is not a registered pass.
+ */
+int pass_manager_print_after(PassManager *pm, const char *name);
+
+/**
+ * @brief Runs the AST-level passes of the pipeline.
+ * @param pm Pointer to the pass manager.
+ * @param program Pointer to the AST root; passes may replace it.
+ */
+void pass_manager_run_ast(PassManager *pm, ASTNode **program);
+
+/**
+ * @brief Runs the IR-level passes of the pipeline.
+ * @param pm Pointer to the pass manager (may be NULL).
+ * @param fn Function to optimize.
+ */
+void pass_manager_run_mir(PassManager *pm, MFunction *fn);
+
+/**
+ * @brief Writes the per-pass timing and change-count report.
+ * @param pm Pointer to the pass manager.
+ * @param output Stream to write to.
+ */
+void pass_manager_report(const PassManager *pm, FILE *output);
+
+/**
+ * @brief Reads the monotonic clock the pass timings use.
+ * @return Seconds since an arbitrary fixed point.
+ */
+double pass_now_seconds(void);
+
+/**
+ * @brief Lists all registered passes with their descriptions.
+ * @param output Stream to write to.
+ */
+void list_passes(FILE *output);
+
+#endif // PASSES_H
@@ -0,0 +1,49 @@
+/**
+ * @file profile.h
+ * @brief Execution profiles for the SEG language compiler.
+ *        Programs built with -finstrument-statements or -fprofile-generate write one
+ *        counter per top-level statement and per if-arm; -fprofile-use reads such a file
+ *        back so that code generation can favour the arms that actually run.
+ *        Sites are matched by kind and source line, so a profile survives changes of
+ *        optimization level.
+ * @author Dario Romandini
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "ast.h"
+
+/** First line of every profile file. */
+#define PROFILE_MAGIC "# seg-profile v1"
+
+/** Default profile file of -finstrument-statements, -fprofile-generate and -fprofile-use. */
+#define PROFILE_DEFAULT_PATH "seg.profile"
+
+/**
+ * @brief Loads a profile written by an instrumented program.
+ * @param path Profile file.
+ * @return 1 on success, 0 if the file is missing or not a SEG profile.
+ */
+int profile_load(const char *path);
+
+/**
+ * @brief Reports whether a profile is loaded.
+ */
+int profile_loaded(void);
+
+/**
+ * @brief Looks up the arm counts of an if statement.
+ * @param node AST_IF_STATEMENT node.
+ * @param then_count Receives how often the then-arm ran.
+ * @param else_count Receives how often the (possibly implicit) else-arm ran.
+ * @return 1 if both arms were found exactly once in the profile.
+ */
+int profile_branch_counts(const ASTNode *node, long long *then_count, long long *else_count);
+
+/**
+ * @brief Releases the loaded profile.
+ */
+void profile_free(void);
+
+#endif // PROFILE_H
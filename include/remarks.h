@@ -0,0 +1,76 @@
+/**
+ * @file remarks.h
+ * @brief Optimization remarks for the SEG language compiler.
+ *        Passes report what they optimized (passed), what they could not optimize and
+ *        why (missed), and facts about the code (analysis). Remarks are printed as text
+ *        when selected with -Rpass=/-Rpass-missed=/-Rpass-analysis= and can be saved
+ *        as a machine-readable YAML or JSON record.
+ * @author Dario Romandini
+ */
+
+#ifndef REMARKS_H
+#define REMARKS_H
+
+/**
+ * @brief Remark categories, matching the -Rpass* flag families.
+ */
+typedef enum
+{
+    REMARK_PASSED,   ///< An optimization was applied (-Rpass=)
+    REMARK_MISSED,   ///< An optimization was not applied (-Rpass-missed=)
+    REMARK_ANALYSIS, ///< Additional information (-Rpass-analysis=)
+    REMARK_KIND_COUNT
+} RemarkKind;
+
+/**
+ * @brief Output formats of the optimization record file.
+ */
+typedef enum
+{
+    RECORD_YAML,
+    RECORD_JSON
+} RecordFormat;
+
+/**
+ * @brief Sets the source file name reported in remark locations.
+ * @param path Path of the SEG source being compiled.
+ */
+void remarks_set_source(const char *path);
+
+/**
+ * @brief Selects which remarks are printed, by pass name (POSIX extended regex).
+ * @param kind Remark category.
+ * @param pattern Regex matched against pass names.
+ * @return 1 on success, 0 if the pattern does not compile.
+ */
+int remarks_enable(RemarkKind kind, const char *pattern);
+
+/**
+ * @brief Saves every remark to a record file.
+ * @param path File to write.
+ * @param format YAML or JSON.
+ * @return 1 on success, 0 if the file cannot be opened.
+ */
+int remarks_open_record(const char *path, RecordFormat format);
+
+/**
+ * @brief Reports whether a remark would be printed or recorded; lets callers skip formatting.
+ */
+int remarks_wanted(RemarkKind kind, const char *pass);
+
+/**
+ * @brief Emits a remark.
+ * @param kind Remark category.
+ * @param pass Name of the emitting pass.
+ * @param name Short machine-readable remark identifier (e.g. "ConstantFolded").
+ * @param line Source line (0 if unknown).
+ * @param format printf-style message.
+ */
+void remark(RemarkKind kind, const char *pass, const char *name, int line, const char *format, ...);
+
+/**
+ * @brief Finishes the record file and releases the filters.
+ */
+void remarks_finish(void);
+
+#endif // REMARKS_H
@@ -0,0 +1,42 @@
+/**
+ * @file superopt.h
+ * @brief Superoptimized expression kernels for the instruction selector of the SEG compiler.
+ *        The kernels and their instruction sequences live in src/superopt.def, a table
+ *        written offline by tools/superopt.c.
+ * @author Dario Romandini
+ */
+
+#ifndef SUPEROPT_H
+#define SUPEROPT_H
+
+#include "ast.h"
+#include "mir.h"
+#include "symbol.h"
+
+typedef struct SuperoptKernel SuperoptKernel;
+
+/**
+ * @brief Looks up an expression in the kernel table.
+ * @param node Expression to match.
+ * @param symbols Symbol table, used to check the types of the operands.
+ * @param x Set to the operand the kernel expects in rax.
+ * @param y Set to the operand the kernel expects in rbx, or NULL when it has none.
+ * @return The matching kernel, or NULL if there is none.
+ */
+const SuperoptKernel *superopt_match(ASTNode *node, Symbol *symbols, ASTNode **x, ASTNode **y);
+
+/**
+ * @brief Number of instructions in the sequence of a kernel.
+ */
+int superopt_length(const SuperoptKernel *kernel);
+
+/**
+ * @brief Emits the instruction sequence of a kernel. The result is left in rax; rbx and
+ *        rcx are clobbered.
+ * @param kernel Kernel returned by superopt_match().
+ * @param fn Function to append the instructions to.
+ * @param line Source line of the matched expression, for remarks.
+ */
+void superopt_emit(const SuperoptKernel *kernel, MFunction *fn, int line);
+
+#endif // SUPEROPT_H
@@ -18,7 +18,9 @@
 typedef struct Symbol
 {
     char *name;          /**< Variable name */
-    VarType type;        /**< Variable type */
+    VarType type;        /**< Variable type (element type of an array) */
+    int length;          /**< Number of elements of an array, 0 for a scalar */
+    int frame_offset;    /**< Offset below rbp of a block-scoped variable's stack slot, 0 for a global */
     struct Symbol *next; /**< Pointer to the next symbol in the table (linked list) */
 } Symbol;
 
@@ -45,4 +47,35 @@ Symbol *lookup_symbol(Symbol *table, const char *name);
  */
 void free_symbol_table(Symbol *table);
 
+/**
+ * @brief Storage size of a variable: one byte for bool and char, eight for int, float and string.
+ * @param type The variable type.
+ * @return Size in bytes, which is also the alignment.
+ */
+int symbol_size(VarType type);
+
+/**
+ * @brief Storage size of a variable or array: an array takes eight bytes per element.
+ * @param sym The symbol.
+ * @return Size in bytes.
+ */
+int symbol_storage_size(const Symbol *sym);
+
+/**
+ * @brief Whether a variable is scoped to a block. The parser gives such variables the unique
+ *        name "name.N", which no identifier can spell.
+ * @param name The variable name.
+ * @return 1 for a block-scoped variable, 0 for a global.
+ */
+int symbol_is_block_scoped(const char *name);
+
+/**
+ * @brief The array a pointer variable created by ivopt points into. Such pointers are named
+ *        "ivoptN.array", which no identifier can spell either, and only ever hold the address
+ *        of an element of that array.
+ * @param name The variable name.
+ * @return The name of the array, a suffix of name, or NULL for any other variable.
+ */
+const char *symbol_pointer_target(const char *name);
+
 #endif // SYMBOL_H
@@ -31,6 +31,7 @@ typedef enum
     TOKEN_MINUS,
     TOKEN_STAR,
     TOKEN_SLASH,
+    TOKEN_PERCENT,
 
     TOKEN_AND,
     TOKEN_OR,
@@ -46,12 +47,19 @@ typedef enum
 
     TOKEN_IF,
     TOKEN_ELSE,
+    TOKEN_WHILE,
+    TOKEN_FOR,
 
     TOKEN_SEMICOLON,
+    TOKEN_COMMA,
     TOKEN_LPAREN,
     TOKEN_RPAREN,
     TOKEN_LBRACE,
     TOKEN_RBRACE,
+    TOKEN_LBRACKET,
+    TOKEN_RBRACKET,
+
+    TOKEN_PRAGMA,
 
     TOKEN_ERROR
 } TokenType;
@@ -64,6 +72,7 @@ typedef struct
     TokenType type; /**< Type of token */
     char *lexeme;   /**< Textual value of the token */
     int line;       /**< Line number for error reporting */
+    int column;     /**< Column of the first character (starts at 1) */
 } Token;
 
 /**
@@ -73,6 +82,13 @@ typedef struct
  */
 const char *token_type_to_string(TokenType type);
 
+/**
+ * @brief Gives the comparison with its operands exchanged: a < b is b > a.
+ * @param op A comparison operator.
+ * @return The mirrored operator; == and != are their own mirror.
+ */
+TokenType mirror_comparison(TokenType op);
+
 /**
  * @brief Frees memory allocated by a token's lexeme.
  * @param token The token whose lexeme is to be freed.
@@ -6,11 +6,12 @@
  * @author Dario Romandini
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "ast.h"
 
-static char *strdup_safe(const char *s)
+char *strdup_safe(const char *s)
 {
     if (s == NULL)
         return NULL;
@@ -28,6 +29,8 @@ ASTNode *create_var_decl_node(VarType var_type, const char *name, ASTNode *value
     ASTNode *node = malloc(sizeof(ASTNode));
     node->type = AST_VAR_DECL;
     node->result_type = var_type;
+    node->line = 0;
+    node->column = 0;
     node->next = NULL;
     node->var_decl.var_type = var_type;
     node->var_decl.name = strdup_safe(name);
@@ -40,6 +43,8 @@ ASTNode *create_literal_node(const char *value, VarType type)
     ASTNode *node = malloc(sizeof(ASTNode));
     node->type = AST_LITERAL;
     node->result_type = type;
+    node->line = 0;
+    node->column = 0;
     node->next = NULL;
     node->literal.value = strdup_safe(value);
     return node;
@@ -50,6 +55,8 @@ ASTNode *create_identifier_node(const char *name)
     ASTNode *node = malloc(sizeof(ASTNode));
     node->type = AST_IDENTIFIER;
     node->result_type = TYPE_UNKNOWN;
+    node->line = 0;
+    node->column = 0;
     node->next = NULL;
     node->identifier.name = strdup_safe(name);
     return node;
@@ -60,6 +67,8 @@ ASTNode *create_binary_expr_node(TokenType op, ASTNode *left, ASTNode *right)
     ASTNode *node = malloc(sizeof(ASTNode));
     node->type = AST_BINARY_EXPR;
     node->result_type = TYPE_UNKNOWN;
+    node->line = 0;
+    node->column = 0;
     node->next = NULL;
     node->binary_expr.op = op;
     node->binary_expr.left = left;
@@ -72,6 +81,8 @@ ASTNode *create_unary_expr_node(TokenType op, ASTNode *operand)
     ASTNode *node = malloc(sizeof(ASTNode));
     node->type = AST_UNARY_EXPR;
     node->result_type = TYPE_UNKNOWN;
+    node->line = 0;
+    node->column = 0;
     node->next = NULL;
     node->unary_expr.op = op;
     node->unary_expr.operand = operand;
@@ -83,6 +94,8 @@ ASTNode *create_if_statement_node(ASTNode *condition, ASTNode *then_branch, ASTN
     ASTNode *node = malloc(sizeof(ASTNode));
     node->type = AST_IF_STATEMENT;
     node->result_type = TYPE_UNKNOWN;
+    node->line = 0;
+    node->column = 0;
     node->next = NULL;
     node->if_statement.condition = condition;
     node->if_statement.then_branch = then_branch;
@@ -90,6 +103,85 @@ ASTNode *create_if_statement_node(ASTNode *condition, ASTNode *then_branch, ASTN
     return node;
 }
 
+ASTNode *create_loop_node(ASTNode *init, ASTNode *condition, ASTNode *update, ASTNode *body)
+{
+    ASTNode *node = malloc(sizeof(ASTNode));
+    node->type = AST_LOOP;
+    node->result_type = TYPE_UNKNOWN;
+    node->line = 0;
+    node->column = 0;
+    node->next = NULL;
+    node->loop.init = init;
+    node->loop.condition = condition;
+    node->loop.update = update;
+    node->loop.body = body;
+    node->loop.preheader = NULL;
+    node->loop.exit = NULL;
+    node->loop.latch = NULL;
+    node->loop.unroll = 0;
+    return node;
+}
+
+ASTNode *create_array_decl_node(VarType var_type, const char *name, int length, ASTNode **values, int value_count)
+{
+    ASTNode *node = malloc(sizeof(ASTNode));
+    node->type = AST_ARRAY_DECL;
+    node->result_type = var_type;
+    node->line = 0;
+    node->column = 0;
+    node->next = NULL;
+    node->array_decl.var_type = var_type;
+    node->array_decl.name = strdup_safe(name);
+    node->array_decl.length = length;
+    node->array_decl.values = values;
+    node->array_decl.value_count = value_count;
+    return node;
+}
+
+ASTNode *create_index_node(const char *name, ASTNode *index)
+{
+    ASTNode *node = malloc(sizeof(ASTNode));
+    node->type = AST_INDEX;
+    node->result_type = TYPE_UNKNOWN;
+    node->line = 0;
+    node->column = 0;
+    node->next = NULL;
+    node->index.name = strdup_safe(name);
+    node->index.index = index;
+    node->index.pointer = NULL;
+    return node;
+}
+
+ASTNode *create_element_assign_node(const char *name, ASTNode *index, ASTNode *value)
+{
+    ASTNode *node = malloc(sizeof(ASTNode));
+    node->type = AST_ELEMENT_ASSIGN;
+    node->result_type = TYPE_UNKNOWN;
+    node->line = 0;
+    node->column = 0;
+    node->next = NULL;
+    node->element_assign.name = strdup_safe(name);
+    node->element_assign.index = index;
+    node->element_assign.value = value;
+    node->element_assign.pointer = NULL;
+    return node;
+}
+
+ASTNode *create_address_node(const char *name, ASTNode *index)
+{
+    ASTNode *node = create_index_node(name, index);
+    node->type = AST_ADDRESS;
+    node->result_type = TYPE_INT;
+    return node;
+}
+
+ASTNode *set_node_location(ASTNode *node, int line, int column)
+{
+    node->line = line;
+    node->column = column;
+    return node;
+}
+
 void free_ast(ASTNode *node)
 {
     if (!node)
@@ -119,6 +211,33 @@ void free_ast(ASTNode *node)
         free_ast(node->if_statement.then_branch);
         free_ast(node->if_statement.else_branch);
         break;
+    case AST_LOOP:
+        free_ast(node->loop.init);
+        free_ast(node->loop.condition);
+        free_ast(node->loop.update);
+        free_ast(node->loop.body);
+        free_ast(node->loop.preheader);
+        free_ast(node->loop.exit);
+        free_ast(node->loop.latch);
+        break;
+    case AST_ARRAY_DECL:
+        free(node->array_decl.name);
+        for (int i = 0; i < node->array_decl.value_count; i++)
+            free_ast(node->array_decl.values[i]);
+        free(node->array_decl.values);
+        break;
+    case AST_INDEX:
+    case AST_ADDRESS:
+        free(node->index.name);
+        free_ast(node->index.index);
+        free(node->index.pointer);
+        break;
+    case AST_ELEMENT_ASSIGN:
+        free(node->element_assign.name);
+        free_ast(node->element_assign.index);
+        free_ast(node->element_assign.value);
+        free(node->element_assign.pointer);
+        break;
     default:
         break;
     }
@@ -126,3 +245,245 @@ void free_ast(ASTNode *node)
     free_ast(node->next);
     free(node);
 }
+
+void print_expression(ASTNode *node, FILE *output)
+{
+    if (!node)
+        return;
+
+    switch (node->type)
+    {
+    case AST_LITERAL:
+        fprintf(output, "%s", node->literal.value);
+        break;
+    case AST_IDENTIFIER:
+        fprintf(output, "%s", node->identifier.name);
+        break;
+    case AST_BINARY_EXPR:
+        fprintf(output, "(");
+        print_expression(node->binary_expr.left, output);
+        fprintf(output, " %s ", token_type_to_string(node->binary_expr.op));
+        print_expression(node->binary_expr.right, output);
+        fprintf(output, ")");
+        break;
+    case AST_UNARY_EXPR:
+        fprintf(output, "(%s ", token_type_to_string(node->unary_expr.op));
+        print_expression(node->unary_expr.operand, output);
+        fprintf(output, ")");
+        break;
+    case AST_INDEX:
+        fprintf(output, "%s[", node->index.name);
+        if (node->index.pointer)
+            fprintf(output, "*%s + ", node->index.pointer);
+        print_expression(node->index.index, output);
+        fprintf(output, "]");
+        break;
+    case AST_ADDRESS:
+        fprintf(output, "&%s[", node->index.name);
+        print_expression(node->index.index, output);
+        fprintf(output, "]");
+        break;
+    default:
+        fprintf(output, "[Unknown Expression]");
+    }
+}
+
+void print_ast(ASTNode *node, FILE *output)
+{
+    while (node)
+    {
+        switch (node->type)
+        {
+        case AST_VAR_DECL:
+            fprintf(output, "VarDecl: type=%d name=%s value=", node->var_decl.var_type, node->var_decl.name);
+            print_expression(node->var_decl.value, output);
+            fprintf(output, "\n");
+            break;
+        case AST_IF_STATEMENT:
+            fprintf(output, "IfStatement: condition=");
+            print_expression(node->if_statement.condition, output);
+            fprintf(output, "\nThen:\n");
+            print_ast(node->if_statement.then_branch, output);
+            if (node->if_statement.else_branch)
+            {
+                fprintf(output, "Else:\n");
+                print_ast(node->if_statement.else_branch, output);
+            }
+            break;
+        case AST_LOOP:
+            fprintf(output, "Loop: condition=");
+            print_expression(node->loop.condition, output);
+            if (node->loop.latch)
+            {
+                fprintf(output, " latch=");
+                print_expression(node->loop.latch, output);
+            }
+            if (node->loop.unroll == LOOP_UNROLL_FULL)
+                fprintf(output, " unroll=full");
+            else if (node->loop.unroll)
+                fprintf(output, " unroll=%d", node->loop.unroll);
+            fprintf(output, "\n");
+            if (node->loop.init)
+            {
+                fprintf(output, "Init:\n");
+                print_ast(node->loop.init, output);
+            }
+            if (node->loop.preheader)
+            {
+                fprintf(output, "Preheader:\n");
+                print_ast(node->loop.preheader, output);
+            }
+            if (node->loop.update)
+            {
+                fprintf(output, "Update:\n");
+                print_ast(node->loop.update, output);
+            }
+            fprintf(output, "Body:\n");
+            print_ast(node->loop.body, output);
+            if (node->loop.exit)
+            {
+                fprintf(output, "Exit:\n");
+                print_ast(node->loop.exit, output);
+            }
+            fprintf(output, "EndLoop\n");
+            break;
+        case AST_ARRAY_DECL:
+            fprintf(output, "ArrayDecl: type=%d name=%s length=%d values=", node->array_decl.var_type,
+                    node->array_decl.name, node->array_decl.length);
+            for (int i = 0; i < node->array_decl.value_count; i++)
+            {
+                fprintf(output, i ? ", " : "");
+                print_expression(node->array_decl.values[i], output);
+            }
+            fprintf(output, "\n");
+            break;
+        case AST_ELEMENT_ASSIGN:
+            fprintf(output, "ElementAssign: name=%s index=", node->element_assign.name);
+            if (node->element_assign.pointer)
+                fprintf(output, "*%s + ", node->element_assign.pointer);
+            print_expression(node->element_assign.index, output);
+            fprintf(output, " value=");
+            print_expression(node->element_assign.value, output);
+            fprintf(output, "\n");
+            break;
+        default:
+            fprintf(output, "[Unknown Node]\n");
+        }
+        node = node->next;
+    }
+}
+
+int is_boolean_value(const ASTNode *node, struct Symbol *symbols)
+{
+    switch (node->type)
+    {
+    case AST_LITERAL:
+        return node->result_type == TYPE_BOOL || strcmp(node->literal.value, "true") == 0 ||
+               strcmp(node->literal.value, "false") == 0 || strcmp(node->literal.value, "1") == 0 ||
+               strcmp(node->literal.value, "0") == 0;
+    case AST_IDENTIFIER:
+    {
+        if (node->result_type == TYPE_BOOL)
+            return 1;
+        Symbol *sym = symbols ? lookup_symbol(symbols, node->identifier.name) : NULL;
+        return sym && sym->type == TYPE_BOOL;
+    }
+    case AST_UNARY_EXPR:
+        return node->unary_expr.op == TOKEN_NOT;
+    case AST_BINARY_EXPR:
+        switch (node->binary_expr.op)
+        {
+        case TOKEN_EQ:
+        case TOKEN_NEQ:
+        case TOKEN_LT:
+        case TOKEN_LEQ:
+        case TOKEN_GT:
+        case TOKEN_GEQ:
+            return 1;
+        case TOKEN_AND:
+        case TOKEN_OR:
+        case TOKEN_XOR:
+            return is_boolean_value(node->binary_expr.left, symbols) &&
+                   is_boolean_value(node->binary_expr.right, symbols);
+        default:
+            return 0;
+        }
+    default:
+        return 0;
+    }
+}
+
+int may_trap(const ASTNode *node)
+{
+    if (!node)
+        return 0;
+    switch (node->type)
+    {
+    case AST_BINARY_EXPR:
+    {
+        const ASTNode *divisor = node->binary_expr.right;
+        if (node->binary_expr.op == TOKEN_SLASH || node->binary_expr.op == TOKEN_PERCENT)
+        {
+            if (divisor->type != AST_LITERAL || divisor->result_type != TYPE_INT)
+                return 1;
+            long long value = strtoll(divisor->literal.value, NULL, 10);
+            if (value == 0 || value == -1)
+                return 1;
+        }
+        return may_trap(node->binary_expr.left) || may_trap(divisor);
+    }
+    case AST_UNARY_EXPR:
+        return may_trap(node->unary_expr.operand);
+    case AST_INDEX:
+        return node->index.pointer || node->index.index->type != AST_LITERAL || may_trap(node->index.index);
+    default:
+        return 0;
+    }
+}
+
+int same_expression(const ASTNode *a, const ASTNode *b)
+{
+    if (!a || !b)
+        return a == b;
+    if (a->type != b->type || a->result_type != b->result_type)
+        return 0;
+    switch (a->type)
+    {
+    case AST_LITERAL:
+        return strcmp(a->literal.value, b->literal.value) == 0;
+    case AST_IDENTIFIER:
+        return strcmp(a->identifier.name, b->identifier.name) == 0;
+    case AST_BINARY_EXPR:
+        return a->binary_expr.op == b->binary_expr.op && same_expression(a->binary_expr.left, b->binary_expr.left) &&
+               same_expression(a->binary_expr.right, b->binary_expr.right);
+    case AST_UNARY_EXPR:
+        return a->unary_expr.op == b->unary_expr.op && same_expression(a->unary_expr.operand, b->unary_expr.operand);
+    case AST_INDEX:
+        if (!a->index.pointer != !b->index.pointer ||
+            (a->index.pointer && strcmp(a->index.pointer, b->index.pointer) != 0))
+            return 0;
+        return strcmp(a->index.name, b->index.name) == 0 && same_expression(a->index.index, b->index.index);
+    default:
+        return 0;
+    }
+}
+
+int source_length(const char *name)
+{
+    return (int)strcspn(name, ".");
+}
+
+void append_statement(ASTNode **list, ASTNode *statement)
+{
+    while (*list)
+        list = &(*list)->next;
+    *list = statement;
+}
+
+char *new_temp(const char *pass)
+{
+    static int counter = 0;
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%s.t%d", pass, ++counter);
+    return strdup_safe(buffer);
+}
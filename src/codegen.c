@@ -2,14 +2,22 @@
  * @file codegen.c
  * @brief Code generator implementation for the SEG compiler.
  *        Translates AST into x86-64 assembly, handling literals, variables, expressions, and control flow.
- *        Supports printf for runtime output and type-safe code generation for int, float, bool, char, and string types.
+ *        Supports printf for runtime output and type-safe code generation for int, float, bool, char, and string types,
+ *        and int and float arrays in 32-byte aligned .bss storage.
  * @author Dario Romandini
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "codegen.h"
+#include "isel.h"
+#include "jit.h"
+#include "mir.h"
+#include "optimize.h"
+#include "profile.h"
+#include "remarks.h"
 #include "symbol.h"
 #include "token.h" // For token_type_to_string()
 
@@ -25,11 +33,22 @@ typedef struct LiteralEntry
 
 static LiteralEntry *literals = NULL;
 
+/* Doubles are the same literal when their bits are ("2.5" and "2.50"). */
+static int same_literal(const LiteralEntry *lit, const char *value, VarType type)
+{
+    if (lit->type != type)
+        return 0;
+    if (type != TYPE_FLOAT)
+        return strcmp(lit->value, value) == 0;
+    double a = strtod(lit->value, NULL), b = strtod(value, NULL);
+    return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
 static void add_literal(const char *value, VarType type)
 {
     for (LiteralEntry *lit = literals; lit; lit = lit->next)
     {
-        if (strcmp(lit->value, value) == 0 && lit->type == type)
+        if (same_literal(lit, value, type))
             return;
     }
     LiteralEntry *lit = malloc(sizeof(LiteralEntry));
@@ -45,7 +64,7 @@ static const char *get_literal_label(const char *value, VarType type)
 {
     for (LiteralEntry *lit = literals; lit; lit = lit->next)
     {
-        if (strcmp(lit->value, value) == 0 && lit->type == type)
+        if (same_literal(lit, value, type))
         {
             return lit->label;
         }
@@ -61,8 +80,7 @@ static void collect_literals(ASTNode *node)
     switch (node->type)
     {
     case AST_LITERAL:
-        if (node->result_type == TYPE_FLOAT || node->result_type == TYPE_BOOL ||
-            node->result_type == TYPE_CHAR || node->result_type == TYPE_STRING)
+        if (node->result_type == TYPE_FLOAT || node->result_type == TYPE_STRING)
         {
             add_literal(node->literal.value, node->result_type);
         }
@@ -82,241 +100,1258 @@ static void collect_literals(ASTNode *node)
         collect_literals(node->if_statement.then_branch);
         collect_literals(node->if_statement.else_branch);
         break;
+    case AST_LOOP:
+        collect_literals(node->loop.init);
+        collect_literals(node->loop.condition);
+        collect_literals(node->loop.update);
+        collect_literals(node->loop.body);
+        collect_literals(node->loop.preheader);
+        collect_literals(node->loop.exit);
+        collect_literals(node->loop.latch);
+        break;
+    case AST_ARRAY_DECL:
+        for (int i = 0; i < node->array_decl.value_count; i++)
+            collect_literals(node->array_decl.values[i]);
+        break;
+    case AST_INDEX:
+    case AST_ADDRESS:
+        collect_literals(node->index.index);
+        break;
+    case AST_ELEMENT_ASSIGN:
+        collect_literals(node->element_assign.index);
+        collect_literals(node->element_assign.value);
+        break;
     default:
         break;
     }
     collect_literals(node->next);
 }
 
-static void generate_expression(ASTNode *node, FILE *output, Symbol *symbols);
-static void generate_data_section(ASTNode *program, FILE *output, Symbol **symbols);
+static int label_counter = 0;
+static int line_label_counter = 0;
+
+#define CACHE_LINE_SIZE 64
+/* Arrays are aligned for 32-byte vector loads and stores. */
+#define ARRAY_ALIGNMENT 32
+/* Clearing a block's array takes one store per element up to this many, a loop beyond. */
+#define ARRAY_UNROLLED_CLEAR 8
+
+typedef struct
+{
+    const char *name; ///< Variable name
+    int size;         ///< Storage size in bytes, also its alignment
+    int references;   ///< Accesses left in main after the IR passes
+    int order;        ///< Declaration order
+    int hot;          ///< Placed in the cache line of the most referenced variables
+    int array;        ///< An array, placed after the variables at ARRAY_ALIGNMENT
+} DataEntry;
+
+/* Statement instrumentation (-finstrument-statements): one .bss counter per site. */
+#define PROFILE_COUNTERS "__seg_counters"
+
+typedef struct
+{
+    const char *kind; ///< "stmt" (top-level statement), "then" or "else" (if-arm)
+    int line;         ///< Source line of the site
+} CounterSite;
+
+static int instrument_statements = 0;
+static int select_kernels = 0;
+static int optimize_size = 0;
+
+/* Cold if-arms (-fprofile-use), emitted after main in .text.unlikely as main.cold. */
+static MFunction *cold_code = NULL;
+static CounterSite *counter_sites = NULL;
+static int counter_count = 0;
+static int counter_capacity = 0;
+
+static void generate_expression(ASTNode *node, MFunction *fn, Symbol *symbols);
+static void generate_statements(ASTNode *node, MFunction *fn, Symbol *symbols, int top_level);
+static void generate_if(ASTNode *node, MFunction *fn, Symbol *symbols);
+static void generate_loop(ASTNode *node, MFunction *fn, Symbol *symbols);
+static void generate_array_decl(ASTNode *node, MFunction *fn, Symbol *symbols);
+static void generate_element_store(ASTNode *node, MFunction *fn, Symbol *symbols);
+static void append_code(MFunction *dst, MFunction *src);
+static void generate_exit_code(ASTNode *program, MFunction *fn, Symbol *symbols);
+static int declare_variables(ASTNode *program, Symbol **symbols, int depth);
+static void allocate_block_variables(MFunction *fn, Symbol *symbols);
+static void generate_data_section(MFunction *fn, FILE *output, Symbol *symbols);
 static void generate_literals_section(FILE *output);
+static void save_callee_saved(MFunction *fn);
+static void build_frame(MFunction *fn);
+static void insert_line_directives(MFunction *fn, const CodegenOptions *options);
+static void generate_line_table(MFunction *fn, FILE *output);
+static void generate_debug_info(FILE *output, const CodegenOptions *options);
+static void generate_profile_runtime(FILE *output, const CodegenOptions *options);
 
-void generate_program(ASTNode *program, FILE *output)
+void generate_program(ASTNode *program, FILE *output, PassManager *passes, const CodegenOptions *options)
 {
+    static const CodegenOptions default_options = {0};
     Symbol *symbols = NULL;
 
+    if (!options)
+        options = &default_options;
+    instrument_statements = options->profile_path != NULL;
+    select_kernels = options->superopt;
+    optimize_size = options->optimize_size;
+
     collect_literals(program);
 
     fprintf(output, "    .intel_syntax noprefix\n");
-    fprintf(output, "    .section .rodata\n");
+    if (options->debug_info)
+        fprintf(output, "    .file 1 \"%s\"\n", options->source_path);
     generate_literals_section(output);
+    declare_variables(program, &symbols, 0);
 
-    fprintf(output, "    .data\n");
-    generate_data_section(program, output, &symbols);
+    MFunction *fn = mir_function_create("main");
+    cold_code = mir_function_create("main.cold");
+    generate_statements(program, fn, symbols, 1);
+    generate_exit_code(program, fn, symbols);
+    mir_emit(fn, MI_RET, 0);
+    if (cold_code->head)
+    {
+        fn->current_line = fn->current_column = 0;
+        mir_emit_directive(fn, ".pushsection .text.unlikely,\"ax\",@progbits");
+        mir_emit_directive(fn, ".type main.cold, @function");
+        mir_emit_label(fn, "main.cold");
+        append_code(fn, cold_code);
+        mir_emit_label(fn, ".Lmain_cold_end");
+        mir_emit_directive(fn, ".size main.cold, .Lmain_cold_end - main.cold");
+        mir_emit_directive(fn, ".popsection");
+    }
+    mir_function_free(cold_code);
+    cold_code = NULL;
+
+    pass_manager_run_mir(passes, fn);
+    allocate_block_variables(fn, symbols);
+    save_callee_saved(fn);
+    build_frame(fn);
+    if (options->debug_info || options->line_table)
+        insert_line_directives(fn, options);
 
+    generate_data_section(fn, output, symbols);
     fprintf(output, "    .text\n");
     fprintf(output, "    .global main\n");
-    fprintf(output, "main:\n");
+    fprintf(output, "    .type main, @function\n");
+    mir_print_function(fn, output);
+    fprintf(output, ".Lmain_end:\n");
+    fprintf(output, "    .size main, .Lmain_end - main\n");
+    if (instrument_statements)
+        generate_profile_runtime(output, options);
+    if (options->line_table)
+        generate_line_table(fn, output);
+    if (options->debug_info)
+        generate_debug_info(output, options);
+    fprintf(output, "    .section .note.GNU-stack,\"\",@progbits\n");
+
+    mir_function_free(fn);
+    free_symbol_table(symbols);
+    free(counter_sites);
+    counter_sites = NULL;
+    counter_count = counter_capacity = 0;
+
+    while (literals)
+    {
+        LiteralEntry *next = literals->next;
+        free(literals->label);
+        free(literals->value);
+        free(literals);
+        literals = next;
+    }
+}
+
+/* Non-atomic: SEG programs are single-threaded, and a plain inc keeps the overhead to one instruction. */
+static void emit_counter(MFunction *fn, const char *kind, int line)
+{
+    if (!instrument_statements)
+        return;
+    if (counter_count == counter_capacity)
+    {
+        counter_capacity = counter_capacity ? counter_capacity * 2 : 16;
+        counter_sites = realloc(counter_sites, counter_capacity * sizeof(CounterSite));
+    }
+    counter_sites[counter_count].kind = kind;
+    counter_sites[counter_count].line = line;
+
+    MOperand counter = mop_sym(PROFILE_COUNTERS, 8);
+    counter.imm = 8LL * counter_count++;
+    mir_emit(fn, MI_INC, 1, counter);
+}
+
+/* Whether an expression is already 0 or 1, so a bool variable can store it as is. */
+static int is_char_value(ASTNode *node, Symbol *symbols)
+{
+    if (node->type == AST_LITERAL)
+        return node->result_type == TYPE_CHAR;
+    if (node->type != AST_IDENTIFIER)
+        return 0;
+    Symbol *sym = lookup_symbol(symbols, node->identifier.name);
+    return sym && sym->type == TYPE_CHAR;
+}
+
+static void load_variable(MFunction *fn, Symbol *sym)
+{
+    if (sym->type == TYPE_FLOAT)
+        mir_emit(fn, MI_MOVSD, 2, mop_reg(MREG_XMM0), mop_sym(sym->name, 8));
+    else
+        mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_sym(sym->name, 8));
+}
 
-    ASTNode *current = program;
-    while (current)
+/*
+ * Stores rax (xmm0 for floats) to a variable. A bool stores rax != 0 and a char the low byte
+ * of rax, zero-extended, unless the value is known to be one already: a bool or char variable
+ * then always holds a value that fits its one-byte storage (see narrow_variable).
+ */
+static void store_variable(MFunction *fn, Symbol *sym, int in_range)
+{
+    if (sym->type == TYPE_FLOAT)
+    {
+        mir_emit(fn, MI_MOVSD, 2, mop_sym(sym->name, 8), mop_reg(MREG_XMM0));
+        return;
+    }
+    if (sym->type == TYPE_BOOL && !in_range)
     {
+        mir_emit(fn, MI_TEST, 2, mop_reg(MREG_RAX), mop_reg(MREG_RAX));
+        mir_emit_cond(fn, MI_SETCC, MCOND_NE, 1, mop_reg_sized(MREG_RAX, 1));
+    }
+    if (symbol_size(sym->type) == 1 && !in_range)
+        mir_emit(fn, MI_MOVZX, 2, mop_reg(MREG_RAX), mop_reg_sized(MREG_RAX, 1));
+    mir_emit(fn, MI_MOV, 2, mop_sym(sym->name, 8), mop_reg(MREG_RAX));
+}
+
+/* Whether an expression needs no conversion to be stored to a variable of the given type. */
+static int fits_variable(ASTNode *value, Symbol *sym, Symbol *symbols)
+{
+    if (sym->type == TYPE_BOOL)
+        return is_boolean_value(value, symbols);
+    if (sym->type == TYPE_CHAR)
+        return is_char_value(value, symbols) || is_boolean_value(value, symbols);
+    return 1;
+}
+
+static void generate_statements(ASTNode *node, MFunction *fn, Symbol *symbols, int top_level)
+{
+    for (ASTNode *current = node; current; current = current->next)
+    {
+        fn->current_line = current->line;
+        fn->current_column = current->column;
+        if (top_level)
+            emit_counter(fn, "stmt", current->line);
         if (current->type == AST_VAR_DECL)
         {
-            generate_expression(current->var_decl.value, output, symbols);
-            if (current->var_decl.var_type == TYPE_FLOAT)
-            {
-                fprintf(output, "    movsd [rip + %s], xmm0\n", current->var_decl.name);
-            }
-            else
-            {
-                fprintf(output, "    mov [rip + %s], rax\n", current->var_decl.name);
-            }
+            Symbol *sym = lookup_symbol(symbols, current->var_decl.name);
+            generate_expression(current->var_decl.value, fn, symbols);
+            store_variable(fn, sym, fits_variable(current->var_decl.value, sym, symbols));
         }
         else if (current->type == AST_IF_STATEMENT)
         {
-            static int if_counter = 0;
-            int label_num = if_counter++;
-            char label_true[32], label_end[32], label_else[32];
-            sprintf(label_true, "L_if_true_%d", label_num);
-            sprintf(label_end, "L_if_end_%d", label_num);
-            sprintf(label_else, "L_if_else_%d", label_num);
-
-            generate_expression(current->if_statement.condition, output, symbols);
-            fprintf(output, "    cmp rax, 0\n");
-            fprintf(output, "    je %s\n", current->if_statement.else_branch ? label_else : label_end);
-            fprintf(output, "%s:\n", label_true);
-            generate_program(current->if_statement.then_branch, output);
-            fprintf(output, "    jmp %s\n", label_end);
-            if (current->if_statement.else_branch)
-            {
-                fprintf(output, "%s:\n", label_else);
-                generate_program(current->if_statement.else_branch, output);
-            }
-            fprintf(output, "%s:\n", label_end);
+            generate_if(current, fn, symbols);
+        }
+        else if (current->type == AST_LOOP)
+        {
+            generate_loop(current, fn, symbols);
+        }
+        else if (current->type == AST_ARRAY_DECL)
+        {
+            generate_array_decl(current, fn, symbols);
+        }
+        else if (current->type == AST_ELEMENT_ASSIGN)
+        {
+            generate_element_store(current, fn, symbols);
         }
-        current = current->next;
     }
+}
 
-    fprintf(output, "    mov rax, 0\n");
-    fprintf(output, "    ret\n");
+/* Moves the instructions of src to the end of dst. */
+static void append_code(MFunction *dst, MFunction *src)
+{
+    while (src->head)
+    {
+        MInstr *instr = src->head;
+        mir_unlink(src, instr);
+        mir_insert_before(dst, NULL, instr);
+    }
+}
 
-    free_symbol_table(symbols);
+/*
+ * Emits an if-arm into the cold code that is placed in .text.unlikely after main. The arm
+ * is generated on its own first, so that cold arms nested inside it end up as separate
+ * blocks rather than in the middle of its code.
+ */
+static void generate_cold_arm(ASTNode *node, ASTNode *arm, const char *label, const char *kind,
+                              const char *resume, Symbol *symbols)
+{
+    MFunction *arm_code = mir_function_create("cold");
+    arm_code->current_line = node->line;
+    arm_code->current_column = node->column;
+    mir_emit_label(arm_code, label);
+    emit_counter(arm_code, kind, arm ? arm->line : node->line);
+    generate_statements(arm, arm_code, symbols, 0);
+    mir_emit(arm_code, MI_JMP, 1, mop_label(resume));
+    append_code(cold_code, arm_code);
+    mir_function_free(arm_code);
+}
 
-    while (literals)
+/* An arm that is a single integer-register declaration can be computed unconditionally. */
+static int is_select_arm(ASTNode *arm)
+{
+    return arm && !arm->next && arm->type == AST_VAR_DECL && arm->var_decl.var_type != TYPE_FLOAT &&
+           arm->var_decl.var_type != TYPE_STRING && arm->var_decl.value->result_type != TYPE_FLOAT &&
+           !may_trap(arm->var_decl.value);
+}
+
+/* Loads a value into rax: an arm's expression, or the current value of a variable (value NULL). */
+static void generate_select_value(ASTNode *value, const char *name, MFunction *fn, Symbol *symbols)
+{
+    if (value)
+        generate_expression(value, fn, symbols);
+    else
+        load_variable(fn, lookup_symbol(symbols, name));
+}
+
+/*
+ * Lowers "if (c) { x = a; } else { y = b; }" to conditional moves: each assigned variable
+ * gets "c ? new : old" (or a/b when both arms assign the same variable). The condition is
+ * kept on the stack while the values are computed.
+ */
+static void generate_select(ASTNode *node, MFunction *fn, Symbol *symbols)
+{
+    ASTNode *then_decl = node->if_statement.then_branch;
+    ASTNode *else_decl = node->if_statement.else_branch;
+    int same = else_decl && strcmp(then_decl->var_decl.name, else_decl->var_decl.name) == 0;
+
+    struct
     {
-        LiteralEntry *next = literals->next;
-        free(literals->label);
-        free(literals->value);
-        free(literals);
-        literals = next;
+        const char *name;
+        ASTNode *if_true;
+        ASTNode *if_false;
+    } targets[2];
+    int count = 0;
+    targets[count].name = then_decl->var_decl.name;
+    targets[count].if_true = then_decl->var_decl.value;
+    targets[count++].if_false = same ? else_decl->var_decl.value : NULL;
+    if (else_decl && !same)
+    {
+        targets[count].name = else_decl->var_decl.name;
+        targets[count].if_true = NULL;
+        targets[count++].if_false = else_decl->var_decl.value;
     }
+
+    generate_expression(node->if_statement.condition, fn, symbols);
+    mir_emit(fn, MI_PUSH, 1, mop_reg(MREG_RAX));
+    for (int i = 0; i < count; i++)
+    {
+        generate_select_value(targets[i].if_true, targets[i].name, fn, symbols);
+        mir_emit(fn, MI_PUSH, 1, mop_reg(MREG_RAX));
+        generate_select_value(targets[i].if_false, targets[i].name, fn, symbols);
+        mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RCX), mop_reg(MREG_RAX));
+        mir_emit(fn, MI_POP, 1, mop_reg(MREG_RAX));
+        mir_emit(fn, MI_CMP, 2, mop_mem(MREG_RSP, 0, 8), mop_imm(0));
+        mir_emit_cond(fn, MI_CMOVCC, MCOND_E, 2, mop_reg(MREG_RAX), mop_reg(MREG_RCX));
+        Symbol *sym = lookup_symbol(symbols, targets[i].name);
+        store_variable(fn, sym, (!targets[i].if_true || fits_variable(targets[i].if_true, sym, symbols)) &&
+                                    (!targets[i].if_false || fits_variable(targets[i].if_false, sym, symbols)));
+    }
+    mir_emit(fn, MI_POP, 1, mop_reg(MREG_RCX));
 }
 
-static void generate_data_section(ASTNode *program, FILE *output, Symbol **symbols)
+/*
+ * With -fprofile-use, an unpredictable branch (each arm taken at least 20% of the time)
+ * over two cheap arms is replaced by conditional moves.
+ */
+static int try_if_conversion(ASTNode *node, MFunction *fn, Symbol *symbols, long long then_count,
+                             long long else_count)
 {
-    ASTNode *current = program;
-    while (current)
+    ASTNode *then_branch = node->if_statement.then_branch;
+    ASTNode *else_branch = node->if_statement.else_branch;
+    long long total = then_count + else_count;
+    long long minority = then_count < else_count ? then_count : else_count;
+
+    if (total == 0 || minority * 5 < total)
+    {
+        remark(REMARK_MISSED, "ifconvert", "BiasedBranch", node->line,
+               "branch kept: arms ran %lld and %lld times, so it is predictable", then_count, else_count);
+        return 0;
+    }
+    if (instrument_statements || !is_select_arm(then_branch) || (else_branch && !is_select_arm(else_branch)))
+    {
+        remark(REMARK_MISSED, "ifconvert", "ArmsNotSelectable", node->line,
+               "branch kept: arms must be a single non-float declaration without division");
+        return 0;
+    }
+
+    generate_select(node, fn, symbols);
+    remark(REMARK_PASSED, "ifconvert", "IfConverted", node->line,
+           "if-converted to conditional moves (arms ran %lld and %lld times)", then_count, else_count);
+    return 1;
+}
+
+/*
+ * Without a profile the then-arm falls through and the else-arm is jumped to. With
+ * -fprofile-use, an arm that never ran moves out of line to .text.unlikely, and a hotter
+ * else-arm becomes the fall-through path.
+ */
+static void generate_if(ASTNode *node, MFunction *fn, Symbol *symbols)
+{
+    int label_num = label_counter++;
+    char label_true[32], label_end[32], label_else[32];
+    sprintf(label_true, "L_if_true_%d", label_num);
+    sprintf(label_end, "L_if_end_%d", label_num);
+    sprintf(label_else, "L_if_else_%d", label_num);
+
+    ASTNode *then_branch = node->if_statement.then_branch;
+    ASTNode *else_branch = node->if_statement.else_branch;
+    int then_line = then_branch ? then_branch->line : node->line;
+    int else_line = else_branch ? else_branch->line : node->line;
+    /* Instrumented code counts the implicit else arm too, so both arm counts are known. */
+    int has_else = else_branch || instrument_statements;
+
+    long long then_count = 0, else_count = 0;
+    int profiled = profile_loaded() && profile_branch_counts(node, &then_count, &else_count);
+    if (profile_loaded() && !profiled)
+        remark(REMARK_MISSED, "pgo", "NoProfileData", node->line, "no profile data for this if statement");
+    if (profiled && try_if_conversion(node, fn, symbols, then_count, else_count))
+        return;
+
+    generate_expression(node->if_statement.condition, fn, symbols);
+    mir_emit(fn, MI_CMP, 2, mop_reg(MREG_RAX), mop_imm(0));
+
+    if (profiled && then_count == 0 && else_count > 0)
+    {
+        mir_emit_cond(fn, MI_JCC, MCOND_NE, 1, mop_label(label_true));
+        if (has_else)
+        {
+            mir_emit_label(fn, label_else);
+            emit_counter(fn, "else", else_line);
+            generate_statements(else_branch, fn, symbols, 0);
+        }
+        mir_emit_label(fn, label_end);
+        generate_cold_arm(node, then_branch, label_true, "then", label_end, symbols);
+        remark(REMARK_PASSED, "pgo", "ColdArmOutlined", node->line,
+               "then-arm never ran (else-arm ran %lld times); moved to .text.unlikely", else_count);
+        return;
+    }
+
+    if (profiled && has_else && else_count == 0 && then_count > 0)
+    {
+        mir_emit_cond(fn, MI_JCC, MCOND_E, 1, mop_label(label_else));
+        mir_emit_label(fn, label_true);
+        emit_counter(fn, "then", then_line);
+        generate_statements(then_branch, fn, symbols, 0);
+        mir_emit_label(fn, label_end);
+        generate_cold_arm(node, else_branch, label_else, "else", label_end, symbols);
+        remark(REMARK_PASSED, "pgo", "ColdArmOutlined", node->line,
+               "else-arm never ran (then-arm ran %lld times); moved to .text.unlikely", then_count);
+        return;
+    }
+
+    if (profiled && else_branch && else_count > then_count)
+    {
+        mir_emit_cond(fn, MI_JCC, MCOND_NE, 1, mop_label(label_true));
+        mir_emit_label(fn, label_else);
+        emit_counter(fn, "else", else_line);
+        generate_statements(else_branch, fn, symbols, 0);
+        mir_emit(fn, MI_JMP, 1, mop_label(label_end));
+        fn->current_line = node->line;
+        fn->current_column = node->column;
+        mir_emit_label(fn, label_true);
+        emit_counter(fn, "then", then_line);
+        generate_statements(then_branch, fn, symbols, 0);
+        mir_emit_label(fn, label_end);
+        remark(REMARK_PASSED, "pgo", "BranchInverted", node->line,
+               "else-arm is the fall-through path (ran %lld times, then-arm %lld)", else_count, then_count);
+        return;
+    }
+
+    mir_emit_cond(fn, MI_JCC, MCOND_E, 1, mop_label(has_else ? label_else : label_end));
+    mir_emit_label(fn, label_true);
+    emit_counter(fn, "then", then_line);
+    generate_statements(then_branch, fn, symbols, 0);
+    mir_emit(fn, MI_JMP, 1, mop_label(label_end));
+    if (has_else)
+    {
+        fn->current_line = node->line;
+        fn->current_column = node->column;
+        mir_emit_label(fn, label_else);
+        emit_counter(fn, "else", else_line);
+        generate_statements(else_branch, fn, symbols, 0);
+    }
+    mir_emit_label(fn, label_end);
+}
+
+/*
+ * Loops are rotated so that the condition is tested at the bottom, and each iteration takes a
+ * single conditional branch back to the body. A copy of the test guards the entry unless the
+ * first test is known to pass. With -Os the condition is not duplicated: the loop jumps to
+ * its test at the bottom instead. The body label is the loop head that blocklayout aligns.
+ * The statements licm hoists run before the entry test, the stores it sinks after the loop.
+ * A loop whose exit test ivopt rewrote keeps its condition as the entry test and branches back
+ * on the latch, so that test is not shared with -Os either.
+ */
+static void generate_loop(ASTNode *node, MFunction *fn, Symbol *symbols)
+{
+    int label_num = label_counter++;
+    char label_body[32], label_test[32], label_end[32];
+    sprintf(label_body, "L_loop_body_%d", label_num);
+    sprintf(label_test, "L_loop_test_%d", label_num);
+    sprintf(label_end, "L_loop_end_%d", label_num);
+
+    generate_statements(node->loop.init, fn, symbols, 0);
+    generate_statements(node->loop.preheader, fn, symbols, 0);
+    fn->current_line = node->line;
+    fn->current_column = node->column;
+    if (optimize_size && !node->loop.latch)
+    {
+        mir_emit(fn, MI_JMP, 1, mop_label(label_test));
+    }
+    else if (loop_condition_holds_on_entry(node))
+    {
+        remark(REMARK_PASSED, "looprotate", "GuardRemoved", node->line,
+               "loop condition holds on entry; no test before the first iteration");
+    }
+    else
+    {
+        generate_expression(node->loop.condition, fn, symbols);
+        mir_emit(fn, MI_CMP, 2, mop_reg(MREG_RAX), mop_imm(0));
+        mir_emit_cond(fn, MI_JCC, MCOND_E, 1, mop_label(label_end));
+    }
+
+    mir_emit_label(fn, label_body);
+    generate_statements(node->loop.body, fn, symbols, 0);
+    generate_statements(node->loop.update, fn, symbols, 0);
+
+    fn->current_line = node->line;
+    fn->current_column = node->column;
+    if (optimize_size && !node->loop.latch)
+        mir_emit_label(fn, label_test);
+    generate_expression(node->loop.latch ? node->loop.latch : node->loop.condition, fn, symbols);
+    mir_emit(fn, MI_CMP, 2, mop_reg(MREG_RAX), mop_imm(0));
+    mir_emit_cond(fn, MI_JCC, MCOND_NE, 1, mop_label(label_body));
+    mir_emit_label(fn, label_end);
+    generate_statements(node->loop.exit, fn, symbols, 0);
+}
+
+/* An element of an array: [rip + name + 8k] for a constant index, else [base + index*8 + 8k]. */
+static MOperand element_operand(Symbol *sym, MReg base, MReg index, long long offset)
+{
+    MOperand element;
+    if (index == MREG_NONE)
+    {
+        element = mop_sym(sym->name, 8);
+        element.imm = 8 * offset;
+        return element;
+    }
+    element = mop_mem(base, 8 * offset, 8);
+    element.index = index;
+    element.scale = 8;
+    return element;
+}
+
+static void store_element(MFunction *fn, Symbol *sym, MOperand element)
+{
+    if (sym->type == TYPE_FLOAT)
+        mir_emit(fn, MI_MOVSD, 2, element, mop_reg(MREG_XMM0));
+    else
+        mir_emit(fn, MI_MOV, 2, element, mop_reg(MREG_RAX));
+}
+
+/* Zeroes the elements first..length-1 of an array. */
+static void clear_elements(MFunction *fn, Symbol *sym, int first)
+{
+    if (sym->length - first <= ARRAY_UNROLLED_CLEAR)
+    {
+        for (int i = first; i < sym->length; i++)
+            mir_emit(fn, MI_MOV, 2, element_operand(sym, MREG_NONE, MREG_NONE, i), mop_imm(0));
+        return;
+    }
+
+    char label[32];
+    sprintf(label, "L_clear_%d", label_counter++);
+    mir_emit(fn, MI_LEA, 2, mop_reg(MREG_RDX), mop_sym(sym->name, 8));
+    mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RCX), mop_imm(first));
+    mir_emit_label(fn, label);
+    mir_emit(fn, MI_MOV, 2, element_operand(sym, MREG_RDX, MREG_RCX, 0), mop_imm(0));
+    mir_emit(fn, MI_ADD, 2, mop_reg(MREG_RCX), mop_imm(1));
+    mir_emit(fn, MI_CMP, 2, mop_reg(MREG_RCX), mop_imm(sym->length));
+    mir_emit_cond(fn, MI_JCC, MCOND_L, 1, mop_label(label));
+}
+
+/*
+ * A top-level array starts out zero in .bss. An array declared in a block is cleared each
+ * time the block runs, like a declaration that assigns zero to every element. Initializers
+ * are stored in order.
+ */
+static void generate_array_decl(ASTNode *node, MFunction *fn, Symbol *symbols)
+{
+    Symbol *sym = lookup_symbol(symbols, node->array_decl.name);
+    if (symbol_is_block_scoped(sym->name))
+        clear_elements(fn, sym, node->array_decl.value_count);
+    for (int i = 0; i < node->array_decl.value_count; i++)
+    {
+        generate_expression(node->array_decl.values[i], fn, symbols);
+        store_element(fn, sym, element_operand(sym, MREG_NONE, MREG_NONE, i));
+    }
+}
+
+/*
+ * The value is computed into rax (xmm0) and stored to [rdx + rcx*8 + 8k], with the array
+ * address in rdx and the variable part of the index in rcx. An index that is a variable is
+ * loaded after the value; any other index is computed first and kept on the stack meanwhile.
+ * A store through a pointer variable goes to [rdx + 8k] with the pointer in rdx.
+ */
+static void generate_element_store(ASTNode *node, MFunction *fn, Symbol *symbols)
+{
+    Symbol *sym = lookup_symbol(symbols, node->element_assign.name);
+    long long offset;
+    if (node->element_assign.pointer)
+    {
+        generate_expression(node->element_assign.value, fn, symbols);
+        mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RDX), mop_sym(node->element_assign.pointer, 8));
+        offset = strtoll(node->element_assign.index->literal.value, NULL, 10);
+        store_element(fn, sym, mop_mem(MREG_RDX, 8 * offset, 8));
+        return;
+    }
+
+    ASTNode *variable = isel_split_index(node->element_assign.index, sym, node->line, &offset);
+
+    if (!variable)
+    {
+        generate_expression(node->element_assign.value, fn, symbols);
+        store_element(fn, sym, element_operand(sym, MREG_NONE, MREG_NONE, offset));
+        return;
+    }
+
+    Symbol *index_sym = variable->type == AST_IDENTIFIER ? lookup_symbol(symbols, variable->identifier.name) : NULL;
+    if (index_sym && index_sym->type != TYPE_FLOAT && index_sym->type != TYPE_STRING)
+    {
+        generate_expression(node->element_assign.value, fn, symbols);
+        mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RCX), mop_sym(index_sym->name, 8));
+    }
+    else
+    {
+        generate_expression(variable, fn, symbols);
+        mir_emit(fn, MI_PUSH, 1, mop_reg(MREG_RAX));
+        generate_expression(node->element_assign.value, fn, symbols);
+        mir_emit(fn, MI_POP, 1, mop_reg(MREG_RCX));
+    }
+    mir_emit(fn, MI_LEA, 2, mop_reg(MREG_RDX), mop_sym(sym->name, 8));
+    store_element(fn, sym, element_operand(sym, MREG_RDX, MREG_RCX, offset));
+}
+
+/* The value of the last top-level declaration becomes the process exit code. */
+static void generate_exit_code(ASTNode *program, MFunction *fn, Symbol *symbols)
+{
+    ASTNode *last = NULL;
+    for (ASTNode *current = program; current; current = current->next)
+    {
+        if (current->type == AST_VAR_DECL)
+            last = current;
+    }
+
+    Symbol *sym = last ? lookup_symbol(symbols, last->var_decl.name) : NULL;
+    if (!sym || sym->type == TYPE_STRING)
+    {
+        mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_imm(0));
+    }
+    else if (sym->type == TYPE_FLOAT)
+    {
+        mir_emit(fn, MI_CVTTSD2SI, 2, mop_reg(MREG_RAX), mop_sym(sym->name, 8));
+    }
+    else
+    {
+        load_variable(fn, sym);
+    }
+}
+
+/*
+ * Block-scoped variables get stack slots: each block places its variables below the slots of
+ * the enclosing blocks (depth bytes), so the variables of sibling blocks, whose lifetimes never
+ * overlap, share slots. The frame only needs to be as deep as the deepest nesting. Returns the
+ * depth below the variables of the list.
+ */
+static int declare_variables(ASTNode *program, Symbol **symbols, int depth)
+{
+    for (ASTNode *current = program; current; current = current->next)
     {
         if (current->type == AST_VAR_DECL)
         {
+            if (lookup_symbol(*symbols, current->var_decl.name))
+                continue;
             *symbols = add_symbol(*symbols, current->var_decl.name, current->var_decl.var_type);
-            if (current->var_decl.var_type == TYPE_FLOAT)
+            if (symbol_is_block_scoped(current->var_decl.name))
             {
-                fprintf(output, "%s: .double 0.0\n", current->var_decl.name);
-            }
-            else
-            {
-                fprintf(output, "%s: .quad 0\n", current->var_decl.name);
+                depth += 8;
+                (*symbols)->frame_offset = depth;
             }
         }
-        current = current->next;
+        else if (current->type == AST_IF_STATEMENT)
+        {
+            declare_variables(current->if_statement.then_branch, symbols, depth);
+            declare_variables(current->if_statement.else_branch, symbols, depth);
+        }
+        else if (current->type == AST_LOOP)
+        {
+            /* The body's variables go below the one the init statement declares and the preheader's. */
+            int body_depth = declare_variables(current->loop.init, symbols, depth);
+            body_depth = declare_variables(current->loop.preheader, symbols, body_depth);
+            declare_variables(current->loop.update, symbols, body_depth);
+            declare_variables(current->loop.body, symbols, body_depth);
+        }
+        else if (current->type == AST_ARRAY_DECL)
+        {
+            /* Arrays stay in .bss, where they can be aligned, even when declared in a block. */
+            *symbols = add_symbol(*symbols, current->array_decl.name, current->array_decl.var_type);
+            (*symbols)->length = current->array_decl.length;
+        }
     }
+    return depth;
 }
 
-static void generate_literals_section(FILE *output)
+/*
+ * Runs after the IR passes, which treat block-scoped variables like globals: the ones still
+ * in memory move to their slots, below any slots the passes allocated themselves.
+ */
+static void allocate_block_variables(MFunction *fn, Symbol *symbols)
 {
-    for (LiteralEntry *lit = literals; lit; lit = lit->next)
+    int base = fn->frame_size;
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
     {
-        switch (lit->type)
+        for (int i = 0; i < instr->nops; i++)
         {
-        case TYPE_FLOAT:
-            fprintf(output, "%s: .double %s\n", lit->label, lit->value);
-            break;
-        case TYPE_BOOL:
-            fprintf(output, "%s: .quad %s\n", lit->label, strcmp(lit->value, "true") == 0 ? "1" : "0");
-            break;
-        case TYPE_CHAR:
-            fprintf(output, "%s: .byte '%s'\n", lit->label, lit->value);
-            break;
-        case TYPE_STRING:
-            fprintf(output, "%s: .string \"%s\"\n", lit->label, lit->value);
-            break;
-        default:
-            break;
+            MOperand *op = &instr->ops[i];
+            if (op->kind != MOPND_MEM || !op->symbol)
+                continue;
+            Symbol *sym = lookup_symbol(symbols, op->symbol);
+            if (!sym || !sym->frame_offset)
+                continue;
+            free(op->symbol);
+            *op = mop_mem(MREG_RBP, op->imm - base - sym->frame_offset, op->size);
+            if (base + sym->frame_offset > fn->frame_size)
+                fn->frame_size = base + sym->frame_offset;
         }
     }
 }
 
-static void generate_expression(ASTNode *node, FILE *output, Symbol *symbols)
+static int count_references(const MFunction *fn, const char *name)
 {
-    if (!node)
-        return;
-
-    switch (node->type)
+    int count = 0;
+    for (const MInstr *instr = fn->head; instr; instr = instr->next)
     {
-    case AST_LITERAL:
+        for (int i = 0; i < instr->nops; i++)
+        {
+            if (instr->ops[i].kind == MOPND_MEM && instr->ops[i].symbol && strcmp(instr->ops[i].symbol, name) == 0)
+                count++;
+        }
+    }
+    return count;
+}
+
+static int is_variable_access(const MOperand *op, const char *name)
+{
+    return op->kind == MOPND_MEM && op->symbol && strcmp(op->symbol, name) == 0;
+}
+
+/*
+ * Shrinks a bool or char global to one byte. The code generator keeps such variables
+ * zero-extended to 64 bits, so a whole-variable load becomes a zero-extending byte load and
+ * a store keeps the low byte. Any other access (an operand of arithmetic, a push) needs the
+ * full eight bytes, and then the variable keeps them.
+ */
+static int narrow_variable(MFunction *fn, const char *name)
+{
+    for (const MInstr *instr = fn->head; instr; instr = instr->next)
     {
-        const char *label = get_literal_label(node->literal.value, node->result_type);
-        if (node->result_type == TYPE_FLOAT)
+        for (int i = 0; i < instr->nops; i++)
         {
-            fprintf(output, "    movsd xmm0, [rip + %s]\n", label);
+            const MOperand *op = &instr->ops[i];
+            if (!is_variable_access(op, name))
+                continue;
+            const MOperand *other = &instr->ops[1 - i];
+            if (instr->op != MI_MOV || instr->nops != 2 || op->imm != 0 || op->index != MREG_NONE)
+                return 0;
+            if (other->kind == MOPND_REG ? other->size != 8 || other->reg > MREG_R15
+                                         : i != 0 || other->kind != MOPND_IMM || other->imm < 0 || other->imm > 255)
+                return 0;
         }
-        else if (node->result_type == TYPE_BOOL || node->result_type == TYPE_CHAR)
+    }
+
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        if (instr->nops != 2)
+            continue;
+        if (is_variable_access(&instr->ops[1], name))
         {
-            fprintf(output, "    mov rax, [rip + %s]\n", label);
+            instr->op = MI_MOVZX;
+            instr->ops[0] = mop_reg_sized(instr->ops[0].reg, 4);
+            instr->ops[1].size = 1;
         }
-        else if (node->result_type == TYPE_STRING)
+        else if (is_variable_access(&instr->ops[0], name))
         {
-            fprintf(output, "    lea rax, [rip + %s]\n", label);
+            instr->ops[0].size = 1;
+            if (instr->ops[1].kind == MOPND_REG)
+                instr->ops[1] = mop_reg_sized(instr->ops[1].reg, 1);
         }
+    }
+    return 1;
+}
+
+/* Hot variables first, then by decreasing size (and alignment), then in declaration order. */
+static int compare_data_entries(const void *a, const void *b)
+{
+    const DataEntry *x = a, *y = b;
+    if (x->hot != y->hot)
+        return y->hot - x->hot;
+    if (x->array != y->array)
+        return x->array - y->array;
+    if (x->array)
+        return x->order - y->order;
+    if (x->size != y->size)
+        return y->size - x->size;
+    return x->order - y->order;
+}
+
+static int by_references(const void *a, const void *b)
+{
+    const DataEntry *x = a, *y = b;
+    if (x->references != y->references)
+        return y->references - x->references;
+    return x->order - y->order;
+}
+
+/*
+ * Runs after the IR passes: variables promoted to registers or stack slots need no storage.
+ * Every variable starts out as zero, so all of them go to .bss; bools and chars take one byte
+ * where their accesses allow it (narrow_variable). The most
+ * referenced ones are packed into one cache line; within the hot group and the rest, larger
+ * (more aligned) variables come first so that no padding is needed between them. Arrays
+ * follow in declaration order, each aligned to ARRAY_ALIGNMENT bytes.
+ */
+static void generate_data_section(MFunction *fn, FILE *output, Symbol *symbols)
+{
+    int count = 0;
+    for (Symbol *sym = symbols; sym; sym = sym->next)
+        count++;
+    DataEntry *entries = malloc((count ? count : 1) * sizeof(DataEntry));
+
+    /* The symbol table lists variables newest first. */
+    int used = 0, order = count;
+    for (Symbol *sym = symbols; sym; sym = sym->next)
+    {
+        order--;
+        int references = count_references(fn, sym->name);
+        if (!references)
+            continue;
+        entries[used].name = sym->name;
+        entries[used].array = sym->length > 0;
+        if (sym->length)
+            entries[used].size = symbol_storage_size(sym);
         else
+            entries[used].size = symbol_size(sym->type) == 1 && narrow_variable(fn, sym->name) ? 1 : 8;
+        entries[used].references = references;
+        entries[used].order = order;
+        entries[used].hot = 0;
+        used++;
+    }
+
+    qsort(entries, used, sizeof(DataEntry), by_references);
+    int hot_size = 0;
+    for (int i = 0; i < used; i++)
+    {
+        if (entries[i].array || hot_size + entries[i].size > CACHE_LINE_SIZE)
+            continue;
+        entries[i].hot = 1;
+        hot_size += entries[i].size;
+    }
+    qsort(entries, used, sizeof(DataEntry), compare_data_entries);
+
+    if (used)
+        fprintf(output, "    .bss\n");
+    /* A hot group larger than one variable is aligned so that it does not straddle two lines. */
+    int line_aligned = hot_size > 8;
+    if (line_aligned)
+        fprintf(output, "    .p2align 6\n");
+    int offset = 0;
+    for (int i = 0; i < used; i++)
+    {
+        if (entries[i].array)
         {
-            fprintf(output, "    mov rax, %s\n", node->literal.value);
+            fprintf(output, "    .p2align 5\n");
+            offset = (offset + ARRAY_ALIGNMENT - 1) & ~(ARRAY_ALIGNMENT - 1);
         }
-        break;
+        else if (entries[i].size > 1 && (i == 0 ? !line_aligned : offset % entries[i].size != 0))
+        {
+            fprintf(output, "    .p2align 3\n");
+            offset = (offset + 7) & ~7;
+        }
+        fprintf(output, "%s: .zero %d\n", entries[i].name, entries[i].size);
+        offset += entries[i].size;
+    }
+    free(entries);
+}
+
+/*
+ * Literals go to mergeable sections (SHF_MERGE), so the linker folds identical strings and
+ * doubles across all objects of an image: strings into .rodata.str1.1 (SHF_STRINGS, one-byte
+ * units), doubles into .rodata.cst8 (eight-byte, eight-aligned entries).
+ */
+static void generate_literals_section(FILE *output)
+{
+    int strings = 0, doubles = 0;
+    for (LiteralEntry *lit = literals; lit; lit = lit->next)
+    {
+        strings += lit->type == TYPE_STRING;
+        doubles += lit->type == TYPE_FLOAT;
+    }
+
+    if (strings)
+        fprintf(output, "    .section .rodata.str1.1,\"aMS\",@progbits,1\n");
+    for (LiteralEntry *lit = literals; lit; lit = lit->next)
+    {
+        if (lit->type == TYPE_STRING)
+            fprintf(output, "%s: .string \"%s\"\n", lit->label, lit->value);
+    }
+    if (doubles)
+    {
+        fprintf(output, "    .section .rodata.cst8,\"aM\",@progbits,8\n");
+        fprintf(output, "    .p2align 3\n");
+    }
+    for (LiteralEntry *lit = literals; lit; lit = lit->next)
+    {
+        if (lit->type == TYPE_FLOAT)
+            fprintf(output, "%s: .double %s\n", lit->label, lit->value);
     }
-    case AST_IDENTIFIER:
+}
+
+/*
+ * main is called like any C function (by the C runtime, or directly by the JIT), so the
+ * callee-saved registers the body writes are preserved around it.
+ */
+static void save_callee_saved(MFunction *fn)
+{
+    static const MReg callee_saved[] = {MREG_RBX, MREG_RBP, MREG_R12, MREG_R13, MREG_R14, MREG_R15};
+    int count = sizeof(callee_saved) / sizeof(callee_saved[0]);
+
+    for (int i = count - 1; i >= 0; i--)
     {
-        Symbol *sym = lookup_symbol(symbols, node->identifier.name);
-        if (!sym)
+        int written = 0;
+        for (MInstr *instr = fn->head; instr && !written; instr = instr->next)
+            written = mir_writes_reg(instr, callee_saved[i]);
+        if (!written)
+            continue;
+
+        MInstr *push = mir_emit(fn, MI_PUSH, 1, mop_reg(callee_saved[i]));
+        mir_unlink(fn, push);
+        push->line = push->column = 0;
+        mir_insert_before(fn, fn->head, push);
+        for (MInstr *instr = fn->head; instr; instr = instr->next)
         {
-            fprintf(stderr, "[Codegen Error] Undefined variable: %s\n", node->identifier.name);
-            exit(1);
+            if (instr->op != MI_RET)
+                continue;
+            MInstr *pop = mir_emit(fn, MI_POP, 1, mop_reg(callee_saved[i]));
+            mir_unlink(fn, pop);
+            pop->line = instr->line;
+            pop->column = instr->column;
+            mir_insert_before(fn, instr, pop);
         }
-        if (sym->type == TYPE_FLOAT)
+    }
+}
+
+/*
+ * Block-scoped and promoted variables live below rbp. The frame is set up before the
+ * callee-saved pushes and torn down after the pops, so the slots stay at fixed offsets.
+ */
+static void build_frame(MFunction *fn)
+{
+    if (fn->frame_size == 0)
+        return;
+    /* The frame keeps rsp 16-byte aligned. */
+    fn->frame_size = (fn->frame_size + 15) & ~15;
+
+    MInstr *first = fn->head;
+    MInstr *setup[] = {mir_emit(fn, MI_PUSH, 1, mop_reg(MREG_RBP)),
+                       mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RBP), mop_reg(MREG_RSP)),
+                       mir_emit(fn, MI_SUB, 2, mop_reg(MREG_RSP), mop_imm(fn->frame_size))};
+    for (int i = 0; i < 3; i++)
+    {
+        mir_unlink(fn, setup[i]);
+        setup[i]->line = setup[i]->column = 0;
+        mir_insert_before(fn, first, setup[i]);
+    }
+
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        if (instr->op != MI_RET)
+            continue;
+        MInstr *teardown[] = {mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RSP), mop_reg(MREG_RBP)),
+                              mir_emit(fn, MI_POP, 1, mop_reg(MREG_RBP))};
+        for (int i = 0; i < 2; i++)
         {
-            fprintf(output, "    movsd xmm0, [rip + %s]\n", node->identifier.name);
+            mir_unlink(fn, teardown[i]);
+            teardown[i]->line = instr->line;
+            teardown[i]->column = instr->column;
+            mir_insert_before(fn, instr, teardown[i]);
         }
-        else
+    }
+}
+
+/*
+ * Runs after the IR passes so that reordering cannot separate a .loc from its instructions.
+ * The JIT line table gets a local label at the same points.
+ */
+static void insert_line_directives(MFunction *fn, const CodegenOptions *options)
+{
+    int line = 0, column = 0;
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        if (instr->op == MI_LABEL || instr->op == MI_DIRECTIVE || instr->line == 0)
+            continue;
+        if (instr->line == line && instr->column == column)
+            continue;
+
+        line = instr->line;
+        column = instr->column;
+        if (options->line_table)
         {
-            fprintf(output, "    mov rax, [rip + %s]\n", node->identifier.name);
+            char label[32];
+            sprintf(label, ".Lseg_line_%d", line_label_counter++);
+            MInstr *mark = mir_emit_label(fn, label);
+            mir_unlink(fn, mark);
+            mark->line = line;
+            mark->column = column;
+            mir_insert_before(fn, instr, mark);
+        }
+        if (options->debug_info)
+        {
+            MInstr *loc = mir_emit_directive(fn, ".loc 1 %d %d", line, column);
+            mir_unlink(fn, loc);
+            mir_insert_before(fn, instr, loc);
         }
-        break;
     }
-    case AST_BINARY_EXPR:
-        generate_expression(node->binary_expr.right, output, symbols);
-        fprintf(output, "    push rax\n");
-        generate_expression(node->binary_expr.left, output, symbols);
-        fprintf(output, "    pop rbx\n");
-        switch (node->binary_expr.op)
+}
+
+/*
+ * The counters live in .bss; a dump routine registered in .fini_array writes them at exit,
+ * one "id line kind count" line per site, to $SEG_PROFILE_FILE or the path given at compile
+ * time. Site kinds are four characters and stored inline next to the line, so the table
+ * needs no relocations.
+ */
+static void generate_profile_runtime(FILE *output, const CodegenOptions *options)
+{
+    fprintf(output, "    .bss\n");
+    fprintf(output, "    .p2align 3\n");
+    fprintf(output, "%s: .zero %d\n", PROFILE_COUNTERS, 8 * counter_count);
+
+    fprintf(output, "    .section .rodata.str1.1,\"aMS\",@progbits,1\n");
+    fprintf(output, "L_profile_env: .string \"SEG_PROFILE_FILE\"\n");
+    fprintf(output, "L_profile_path: .string \"%s\"\n", options->profile_path);
+    fprintf(output, "L_profile_mode: .string \"w\"\n");
+    fprintf(output, "L_profile_header: .string \"" PROFILE_MAGIC "\\n# source: %%s\\n# id line kind count\\n\"\n");
+    fprintf(output, "L_profile_source: .string \"%s\"\n", options->source_path ? options->source_path : "");
+    fprintf(output, "L_profile_record: .string \"%%ld %%d %%.4s %%lu\\n\"\n");
+    fprintf(output, "    .section .rodata\n");
+    fprintf(output, "    .p2align 2\n");
+    fprintf(output, "L_profile_sites:\n");
+    for (int i = 0; i < counter_count; i++)
+        fprintf(output, "    .long %d\n    .ascii \"%s\"\n", counter_sites[i].line, counter_sites[i].kind);
+
+    MFunction *dump = mir_function_create("__seg_profile_dump");
+    MOperand site_line = mop_mem(MREG_R13, 0, 4);
+    site_line.index = MREG_RBX;
+    site_line.scale = 8;
+    MOperand site_kind = site_line;
+    site_kind.imm = 4;
+    site_kind.size = 8;
+    MOperand count = mop_mem(MREG_RAX, 0, 8);
+    count.index = MREG_RBX;
+    count.scale = 8;
+
+    /* Three pushes realign the stack to 16 bytes for the calls. */
+    mir_emit(dump, MI_PUSH, 1, mop_reg(MREG_RBX));
+    mir_emit(dump, MI_PUSH, 1, mop_reg(MREG_R12));
+    mir_emit(dump, MI_PUSH, 1, mop_reg(MREG_R13));
+    mir_emit(dump, MI_LEA, 2, mop_reg(MREG_RDI), mop_sym("L_profile_env", 8));
+    mir_emit(dump, MI_CALL, 1, mop_label("getenv@PLT"));
+    mir_emit(dump, MI_TEST, 2, mop_reg(MREG_RAX), mop_reg(MREG_RAX));
+    mir_emit_cond(dump, MI_JCC, MCOND_NE, 1, mop_label("L_profile_open"));
+    mir_emit(dump, MI_LEA, 2, mop_reg(MREG_RAX), mop_sym("L_profile_path", 8));
+    mir_emit_label(dump, "L_profile_open");
+    mir_emit(dump, MI_MOV, 2, mop_reg(MREG_RDI), mop_reg(MREG_RAX));
+    mir_emit(dump, MI_LEA, 2, mop_reg(MREG_RSI), mop_sym("L_profile_mode", 8));
+    mir_emit(dump, MI_CALL, 1, mop_label("fopen@PLT"));
+    mir_emit(dump, MI_TEST, 2, mop_reg(MREG_RAX), mop_reg(MREG_RAX));
+    mir_emit_cond(dump, MI_JCC, MCOND_E, 1, mop_label("L_profile_done"));
+    mir_emit(dump, MI_MOV, 2, mop_reg(MREG_R12), mop_reg(MREG_RAX));
+    mir_emit(dump, MI_MOV, 2, mop_reg(MREG_RDI), mop_reg(MREG_R12));
+    mir_emit(dump, MI_LEA, 2, mop_reg(MREG_RSI), mop_sym("L_profile_header", 8));
+    mir_emit(dump, MI_LEA, 2, mop_reg(MREG_RDX), mop_sym("L_profile_source", 8));
+    mir_emit(dump, MI_XOR, 2, mop_reg_sized(MREG_RAX, 4), mop_reg_sized(MREG_RAX, 4));
+    mir_emit(dump, MI_CALL, 1, mop_label("fprintf@PLT"));
+    mir_emit(dump, MI_LEA, 2, mop_reg(MREG_R13), mop_sym("L_profile_sites", 8));
+    mir_emit(dump, MI_XOR, 2, mop_reg_sized(MREG_RBX, 4), mop_reg_sized(MREG_RBX, 4));
+    mir_emit_label(dump, "L_profile_loop");
+    mir_emit(dump, MI_MOV, 2, mop_reg(MREG_RDI), mop_reg(MREG_R12));
+    mir_emit(dump, MI_LEA, 2, mop_reg(MREG_RSI), mop_sym("L_profile_record", 8));
+    mir_emit(dump, MI_MOV, 2, mop_reg(MREG_RDX), mop_reg(MREG_RBX));
+    mir_emit(dump, MI_MOV, 2, mop_reg_sized(MREG_RCX, 4), site_line);
+    mir_emit(dump, MI_LEA, 2, mop_reg(MREG_R8), site_kind);
+    mir_emit(dump, MI_LEA, 2, mop_reg(MREG_RAX), mop_sym(PROFILE_COUNTERS, 8));
+    mir_emit(dump, MI_MOV, 2, mop_reg(MREG_R9), count);
+    mir_emit(dump, MI_XOR, 2, mop_reg_sized(MREG_RAX, 4), mop_reg_sized(MREG_RAX, 4));
+    mir_emit(dump, MI_CALL, 1, mop_label("fprintf@PLT"));
+    mir_emit(dump, MI_INC, 1, mop_reg(MREG_RBX));
+    mir_emit(dump, MI_CMP, 2, mop_reg(MREG_RBX), mop_imm(counter_count));
+    mir_emit_cond(dump, MI_JCC, MCOND_B, 1, mop_label("L_profile_loop"));
+    mir_emit(dump, MI_MOV, 2, mop_reg(MREG_RDI), mop_reg(MREG_R12));
+    mir_emit(dump, MI_CALL, 1, mop_label("fclose@PLT"));
+    mir_emit_label(dump, "L_profile_done");
+    mir_emit(dump, MI_POP, 1, mop_reg(MREG_R13));
+    mir_emit(dump, MI_POP, 1, mop_reg(MREG_R12));
+    mir_emit(dump, MI_POP, 1, mop_reg(MREG_RBX));
+    mir_emit(dump, MI_RET, 0);
+
+    fprintf(output, "    .text\n");
+    fprintf(output, "    .type __seg_profile_dump, @function\n");
+    mir_print_function(dump, output);
+    fprintf(output, "    .size __seg_profile_dump, . - __seg_profile_dump\n");
+    fprintf(output, "    .section .fini_array,\"aw\"\n");
+    fprintf(output, "    .p2align 3\n");
+    fprintf(output, "    .quad __seg_profile_dump\n");
+    mir_function_free(dump);
+}
+
+/* Entries match JitLine in jit.c: absolute address, line, column. */
+static void generate_line_table(MFunction *fn, FILE *output)
+{
+    fprintf(output, "    .section %s,\"a\",@progbits\n", JIT_LINE_TABLE_SECTION);
+    fprintf(output, "    .p2align 3\n");
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        if (instr->op != MI_LABEL || strncmp(instr->text, ".Lseg_line_", 11) != 0)
+            continue;
+        fprintf(output, "    .quad %s\n", instr->text);
+        fprintf(output, "    .long %d\n", instr->line);
+        fprintf(output, "    .long %d\n", instr->column);
+    }
+}
+
+/*
+ * A minimal DWARF 4 compile unit describing main. The assembler builds .debug_line
+ * from the .loc directives; this unit points at it so that addr2line, perf and gdb
+ * can map addresses back to SEG source lines without further flags.
+ */
+static void generate_debug_info(FILE *output, const CodegenOptions *options)
+{
+    char directory[1024];
+    if (!getcwd(directory, sizeof(directory)))
+        strcpy(directory, ".");
+
+    fprintf(output, "    .section .debug_abbrev,\"\",@progbits\n");
+    fprintf(output, ".Ldebug_abbrev0:\n");
+    fprintf(output, "    .uleb128 1\n    .uleb128 0x11\n    .byte 1\n");  /* DW_TAG_compile_unit, children */
+    fprintf(output, "    .uleb128 0x25\n    .uleb128 0x8\n");             /* DW_AT_producer, string */
+    fprintf(output, "    .uleb128 0x13\n    .uleb128 0x5\n");             /* DW_AT_language, data2 */
+    fprintf(output, "    .uleb128 0x3\n    .uleb128 0x8\n");              /* DW_AT_name, string */
+    fprintf(output, "    .uleb128 0x1b\n    .uleb128 0x8\n");             /* DW_AT_comp_dir, string */
+    fprintf(output, "    .uleb128 0x11\n    .uleb128 0x1\n");             /* DW_AT_low_pc, addr */
+    fprintf(output, "    .uleb128 0x12\n    .uleb128 0x7\n");             /* DW_AT_high_pc, data8 */
+    fprintf(output, "    .uleb128 0x10\n    .uleb128 0x17\n");            /* DW_AT_stmt_list, sec_offset */
+    fprintf(output, "    .byte 0\n    .byte 0\n");
+    fprintf(output, "    .uleb128 2\n    .uleb128 0x2e\n    .byte 0\n");  /* DW_TAG_subprogram, no children */
+    fprintf(output, "    .uleb128 0x3\n    .uleb128 0x8\n");              /* DW_AT_name, string */
+    fprintf(output, "    .uleb128 0x3f\n    .uleb128 0x19\n");            /* DW_AT_external, flag_present */
+    fprintf(output, "    .uleb128 0x11\n    .uleb128 0x1\n");             /* DW_AT_low_pc, addr */
+    fprintf(output, "    .uleb128 0x12\n    .uleb128 0x7\n");             /* DW_AT_high_pc, data8 */
+    fprintf(output, "    .byte 0\n    .byte 0\n");
+    fprintf(output, "    .byte 0\n");
+
+    fprintf(output, "    .section .debug_info,\"\",@progbits\n");
+    fprintf(output, "    .long .Ldebug_info_end - .Ldebug_info_start\n");
+    fprintf(output, ".Ldebug_info_start:\n");
+    fprintf(output, "    .value 4\n");
+    fprintf(output, "    .long .Ldebug_abbrev0\n");
+    fprintf(output, "    .byte 8\n");
+    fprintf(output, "    .uleb128 1\n");
+    fprintf(output, "    .string \"SEG compiler\"\n");
+    fprintf(output, "    .value 0xc\n"); /* DW_LANG_C99: closest standard language code */
+    fprintf(output, "    .string \"%s\"\n", options->source_path);
+    fprintf(output, "    .string \"%s\"\n", directory);
+    fprintf(output, "    .quad main\n");
+    fprintf(output, "    .quad .Lmain_end - main\n");
+    fprintf(output, "    .long .Ldebug_line0\n");
+    fprintf(output, "    .uleb128 2\n");
+    fprintf(output, "    .string \"main\"\n");
+    fprintf(output, "    .quad main\n");
+    fprintf(output, "    .quad .Lmain_end - main\n");
+    fprintf(output, "    .byte 0\n");
+    fprintf(output, ".Ldebug_info_end:\n");
+
+    fprintf(output, "    .section .debug_line,\"\",@progbits\n");
+    fprintf(output, ".Ldebug_line0:\n");
+}
+
+/* Values the instruction selector leaves to the code generator: floats and strings. */
+static void generate_leaf(ASTNode *node, MFunction *fn, Symbol *symbols)
+{
+    if (node->type == AST_LITERAL)
+    {
+        if (node->result_type == TYPE_FLOAT)
         {
-        case TOKEN_PLUS:
-            fprintf(output, "    add rax, rbx\n");
-            break;
-        case TOKEN_MINUS:
-            fprintf(output, "    sub rax, rbx\n");
-            break;
-        case TOKEN_STAR:
-            fprintf(output, "    imul rax, rbx\n");
-            break;
-        case TOKEN_SLASH:
-            fprintf(output, "    cqo\n    idiv rbx\n");
-            break;
-        case TOKEN_EQ:
-            fprintf(output, "    cmp rax, rbx\n    sete al\n    movzx rax, al\n");
-            break;
-        case TOKEN_NEQ:
-            fprintf(output, "    cmp rax, rbx\n    setne al\n    movzx rax, al\n");
-            break;
-        case TOKEN_LT:
-            fprintf(output, "    cmp rax, rbx\n    setl al\n    movzx rax, al\n");
-            break;
-        case TOKEN_LEQ:
-            fprintf(output, "    cmp rax, rbx\n    setle al\n    movzx rax, al\n");
-            break;
-        case TOKEN_GT:
-            fprintf(output, "    cmp rax, rbx\n    setg al\n    movzx rax, al\n");
-            break;
-        case TOKEN_GEQ:
-            fprintf(output, "    cmp rax, rbx\n    setge al\n    movzx rax, al\n");
-            break;
-        case TOKEN_AND:
-            fprintf(output, "    and rax, rbx\n");
-            break;
-        case TOKEN_OR:
-            fprintf(output, "    or rax, rbx\n");
-            break;
-        case TOKEN_XOR:
-            fprintf(output, "    xor rax, rbx\n");
-            break;
-        default:
-            fprintf(output, "    ; [unsupported binary op]\n");
-            break;
+            mir_emit(fn, MI_MOVSD, 2, mop_reg(MREG_XMM0),
+                     mop_sym(get_literal_label(node->literal.value, node->result_type), 8));
         }
-        break;
-    case AST_UNARY_EXPR:
-        generate_expression(node->unary_expr.operand, output, symbols);
-        if (node->unary_expr.op == TOKEN_NOT)
+        else
         {
-            fprintf(output, "    cmp rax, 0\n");
-            fprintf(output, "    sete al\n");
-            fprintf(output, "    movzx rax, al\n");
+            mir_emit(fn, MI_LEA, 2, mop_reg(MREG_RAX),
+                     mop_sym(get_literal_label(node->literal.value, node->result_type), 8));
         }
-        break;
-    default:
-        fprintf(output, "    ; [unsupported node type]\n");
-        break;
+        return;
+    }
+
+    Symbol *sym = lookup_symbol(symbols, node->identifier.name);
+    if (sym->type == TYPE_FLOAT)
+    {
+        mir_emit(fn, MI_MOVSD, 2, mop_reg(MREG_XMM0), mop_sym(node->identifier.name, 8));
+    }
+    else
+    {
+        mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_sym(node->identifier.name, 8));
+    }
+}
+
+/*
+ * lea rax, [rip + name + 8k] for a constant index, else the index is computed into rax and
+ * scaled onto the array address. The address is never dereferenced here, so an index out of
+ * the bounds of the array is not an error: a pointer may start before the first element.
+ */
+static void generate_address(ASTNode *node, MFunction *fn, Symbol *symbols)
+{
+    Symbol *sym = lookup_symbol(symbols, node->index.name);
+    ASTNode *index = node->index.index, *variable = NULL;
+    long long offset = 0;
+
+    if (index->type == AST_LITERAL)
+        offset = strtoll(index->literal.value, NULL, 10);
+    else
+        variable = isel_split_index(index, sym, node->line, &offset);
+    if (!variable)
+    {
+        mir_emit(fn, MI_LEA, 2, mop_reg(MREG_RAX), element_operand(sym, MREG_NONE, MREG_NONE, offset));
+        return;
+    }
+    generate_expression(variable, fn, symbols);
+    mir_emit(fn, MI_LEA, 2, mop_reg(MREG_RCX), mop_sym(sym->name, 8));
+    mir_emit(fn, MI_LEA, 2, mop_reg(MREG_RAX), element_operand(sym, MREG_RCX, MREG_RAX, offset));
+}
+
+/* An AST_ADDRESS is only ever the whole value of a declaration, never an operand. */
+static void generate_expression(ASTNode *node, MFunction *fn, Symbol *symbols)
+{
+    if (!node)
+        return;
+    if (node->type == AST_ADDRESS)
+    {
+        generate_address(node, fn, symbols);
+        return;
     }
+    isel_expression(node, fn, symbols, select_kernels, generate_leaf);
 }
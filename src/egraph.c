@@ -0,0 +1,1061 @@
+/**
+ * @file egraph.c
+ * @brief Equality saturation of expressions for the SEG language compiler (-O3).
+ *        Every integer or boolean expression is loaded into an e-graph: e-nodes are
+ *        hash-consed operators over e-classes, and an e-class holds all the forms of a
+ *        value found so far. The rewrite rules below are matched against every e-class in
+ *        each iteration and their right-hand sides are merged into the matched class, so
+ *        no rewrite ever loses a form the way greedy rewriting does. Saturation stops when
+ *        no rule adds anything new or at the node, iteration or time limit. The cheapest
+ *        form under an x86 cost model is then extracted and replaces the expression when
+ *        it costs less than the original.
+ * @author Dario Romandini
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+#include "token.h"
+
+#define EGRAPH_NODE_LIMIT 4000
+#define EGRAPH_ITERATION_LIMIT 24
+#define EGRAPH_TIME_LIMIT 0.05 /* seconds per expression */
+#define EGRAPH_MAX_MATCHES 64  /* per rule and e-class */
+#define EGRAPH_MAX_PATTERN_NODES 512
+#define EGRAPH_INFINITE_COST (1LL << 60)
+
+/*
+ * Cost model: latency plus micro-ops of the code the later passes make of each operator
+ * on a recent Intel core. Operands are loaded from globals, literals are immediates except
+ * booleans, which are loaded from .rodata. Multiplies and divides by constants are costed
+ * as the sequences strength reduction turns them into.
+ */
+#define COST_IMMEDIATE 1
+#define COST_LOAD 6
+#define COST_ALU 2
+#define COST_MULTIPLY 4
+#define COST_SETCC 5
+#define COST_DIVIDE_SHIFT 8
+#define COST_DIVIDE_MAGIC 13
+#define COST_DIVIDE 99
+
+/**
+ * @brief Kinds of e-nodes.
+ */
+typedef enum
+{
+    EN_CONST,  ///< Integer or boolean constant
+    EN_VAR,    ///< Global variable
+    EN_UNARY,  ///< Unary operator on child[0]
+    EN_BINARY  ///< Binary operator on child[0] and child[1]
+} ENodeKind;
+
+typedef struct
+{
+    ENodeKind kind;
+    TokenType op;
+    int child[2];     ///< Operand e-classes
+    long long value;  ///< Constant value
+    VarType type;     ///< Constant or variable type
+    const char *name; ///< Variable name, owned by the source expression
+    int cls;          ///< E-class the node was added to
+    int next;         ///< Next e-node of the same e-class, -1 at the end
+    int dead;         ///< Set for duplicates of a congruent e-node
+} ENode;
+
+typedef struct
+{
+    int parent;      ///< Union-find parent; the class is canonical when parent is itself
+    int head, tail;  ///< E-node list
+    VarType type;    ///< Type of the expression the class was created for
+    int constant;    ///< Set when the value is a known constant
+    long long value; ///< The constant
+    int pure;        ///< Some form of the value evaluates without faulting
+    int boolean;     ///< The value is 0 or 1
+} EClass;
+
+typedef struct
+{
+    ENode *nodes;
+    EClass *classes;
+    int count;       ///< Number of e-nodes and of e-classes (each new node opens a class)
+    int capacity;
+    int *table;      ///< Hash-cons table of e-node indices, -1 when empty
+    int table_size;
+    int changed;     ///< Set by every new e-node and every merge
+} EGraph;
+
+/* Rewrite rules */
+
+#define GUARD_PURE_A 1 /* ?a evaluates without faulting, so it may be dropped */
+#define GUARD_PURE_B 2
+#define GUARD_BOOL_A 4 /* ?a is 0 or 1 */
+#define GUARD_BOOL_B 8
+#define GUARD_CONST_A 16 /* ?a is a constant */
+
+typedef struct
+{
+    const char *name;
+    const char *pattern;
+    const char *replacement;
+    int guards;
+} EGraphRule;
+
+/*
+ * Patterns are prefix S-expressions over the SEG operators; ?a, ?b and ?c match any
+ * e-class (the same class where a name repeats) and integers match classes with that
+ * constant value. All rules hold under 64-bit wrap-around; one direction of associativity
+ * is enough since commutativity reaches every operand order.
+ */
+static const EGraphRule egraph_rules[] = {
+    /* Commutativity and associativity */
+    {"AddCommute", "(+ ?a ?b)", "(+ ?b ?a)", 0},
+    {"MulCommute", "(* ?a ?b)", "(* ?b ?a)", 0},
+    {"AndCommute", "(& ?a ?b)", "(& ?b ?a)", 0},
+    {"OrCommute", "(| ?a ?b)", "(| ?b ?a)", 0},
+    {"XorCommute", "(^ ?a ?b)", "(^ ?b ?a)", 0},
+    {"EqCommute", "(== ?a ?b)", "(== ?b ?a)", 0},
+    {"NeCommute", "(!= ?a ?b)", "(!= ?b ?a)", 0},
+    {"LtSwap", "(< ?a ?b)", "(> ?b ?a)", 0},
+    {"LeSwap", "(<= ?a ?b)", "(>= ?b ?a)", 0},
+    {"GtSwap", "(> ?a ?b)", "(< ?b ?a)", 0},
+    {"GeSwap", "(>= ?a ?b)", "(<= ?b ?a)", 0},
+    {"AddAssociate", "(+ (+ ?a ?b) ?c)", "(+ ?a (+ ?b ?c))", 0},
+    {"MulAssociate", "(* (* ?a ?b) ?c)", "(* ?a (* ?b ?c))", 0},
+    {"AndAssociate", "(& (& ?a ?b) ?c)", "(& ?a (& ?b ?c))", 0},
+    {"OrAssociate", "(| (| ?a ?b) ?c)", "(| ?a (| ?b ?c))", 0},
+    {"XorAssociate", "(^ (^ ?a ?b) ?c)", "(^ ?a (^ ?b ?c))", 0},
+
+    /* Subtraction */
+    {"SubSub", "(- (- ?a ?b) ?c)", "(- ?a (+ ?b ?c))", 0},
+    {"SubAddCancel", "(- (+ ?a ?b) ?b)", "?a", GUARD_PURE_B},
+    {"AddSubCancel", "(+ (- ?a ?b) ?b)", "?a", GUARD_PURE_B},
+    {"SubSelf", "(- ?a ?a)", "0", GUARD_PURE_A},
+
+    /* Distributivity */
+    /* Distributing variables would undo factoring and grow the graph without bound. */
+    {"MulDistribute", "(* ?a (+ ?b ?c))", "(+ (* ?a ?b) (* ?a ?c))", GUARD_CONST_A},
+    {"MulFactor", "(+ (* ?a ?b) (* ?a ?c))", "(* ?a (+ ?b ?c))", 0},
+    {"MulFactorSub", "(- (* ?a ?b) (* ?a ?c))", "(* ?a (- ?b ?c))", 0},
+    {"MulFactorOne", "(+ (* ?a ?b) ?a)", "(* ?a (+ ?b 1))", 0},
+    {"AddSelf", "(+ ?a ?a)", "(* ?a 2)", 0},
+    {"AndFactor", "(| (& ?a ?b) (& ?a ?c))", "(& ?a (| ?b ?c))", 0},
+    {"OrFactor", "(& (| ?a ?b) (| ?a ?c))", "(| ?a (& ?b ?c))", 0},
+
+    /* Identities */
+    {"AddZero", "(+ ?a 0)", "?a", 0},
+    {"SubZero", "(- ?a 0)", "?a", 0},
+    {"MulOne", "(* ?a 1)", "?a", 0},
+    {"MulZero", "(* ?a 0)", "0", GUARD_PURE_A},
+    {"DivOne", "(/ ?a 1)", "?a", 0},
+    {"RemOne", "(% ?a 1)", "0", GUARD_PURE_A},
+    {"AndZero", "(& ?a 0)", "0", GUARD_PURE_A},
+    {"OrZero", "(| ?a 0)", "?a", 0},
+    {"XorZero", "(^ ?a 0)", "?a", 0},
+    {"AndSelf", "(& ?a ?a)", "?a", 0},
+    {"OrSelf", "(| ?a ?a)", "?a", 0},
+    {"XorSelf", "(^ ?a ?a)", "0", GUARD_PURE_A},
+    {"AndOne", "(& ?a 1)", "?a", GUARD_BOOL_A},
+    {"OrOne", "(| ?a 1)", "1", GUARD_BOOL_A | GUARD_PURE_A},
+    {"AndAbsorb", "(& ?a (| ?a ?b))", "?a", GUARD_PURE_B},
+    {"OrAbsorb", "(| ?a (& ?a ?b))", "?a", GUARD_PURE_B},
+
+    /* Boolean normalization */
+    {"NotNot", "(! (! ?a))", "?a", GUARD_BOOL_A},
+    {"NotEq", "(! (== ?a ?b))", "(!= ?a ?b)", 0},
+    {"NotNe", "(! (!= ?a ?b))", "(== ?a ?b)", 0},
+    {"NotLt", "(! (< ?a ?b))", "(>= ?a ?b)", 0},
+    {"NotLe", "(! (<= ?a ?b))", "(> ?a ?b)", 0},
+    {"NotGt", "(! (> ?a ?b))", "(<= ?a ?b)", 0},
+    {"NotGe", "(! (>= ?a ?b))", "(< ?a ?b)", 0},
+    {"NotAsXor", "(! ?a)", "(^ ?a 1)", GUARD_BOOL_A},
+    {"EqZero", "(== ?a 0)", "(! ?a)", 0},
+    {"EqOne", "(== ?a 1)", "?a", GUARD_BOOL_A},
+    {"NeZero", "(!= ?a 0)", "?a", GUARD_BOOL_A},
+    {"NeAsXor", "(!= ?a ?b)", "(^ ?a ?b)", GUARD_BOOL_A | GUARD_BOOL_B},
+    {"DeMorganAnd", "(& (! ?a) (! ?b))", "(! (| ?a ?b))", 0},
+    {"DeMorganOr", "(| (! ?a) (! ?b))", "(! (& ?a ?b))", GUARD_BOOL_A | GUARD_BOOL_B},
+
+    /* Comparisons */
+    {"EqSelf", "(== ?a ?a)", "1", GUARD_PURE_A},
+    {"NeSelf", "(!= ?a ?a)", "0", GUARD_PURE_A},
+    {"LtSelf", "(< ?a ?a)", "0", GUARD_PURE_A},
+    {"LeSelf", "(<= ?a ?a)", "1", GUARD_PURE_A},
+    {"EqSub", "(== (- ?a ?b) 0)", "(== ?a ?b)", 0},
+    {"NeSub", "(!= (- ?a ?b) 0)", "(!= ?a ?b)", 0},
+    {"EqAddCancel", "(== (+ ?a ?c) (+ ?b ?c))", "(== ?a ?b)", GUARD_PURE_B},
+    {"NeAddCancel", "(!= (+ ?a ?c) (+ ?b ?c))", "(!= ?a ?b)", GUARD_PURE_B},
+};
+
+#define RULE_COUNT (int)(sizeof(egraph_rules) / sizeof(egraph_rules[0]))
+
+/* Compiled patterns */
+
+typedef enum
+{
+    PAT_VAR,
+    PAT_CONST,
+    PAT_OP
+} PatternKind;
+
+typedef struct
+{
+    PatternKind kind;
+    TokenType op;
+    int arity;
+    int child[2];
+    int var;         ///< Index of ?a, ?b, ?c
+    long long value; ///< Constant to match
+} PatternNode;
+
+static PatternNode patterns[EGRAPH_MAX_PATTERN_NODES];
+static int pattern_count = 0;
+static int rule_lhs[RULE_COUNT];
+static int rule_rhs[RULE_COUNT];
+
+static const struct
+{
+    const char *text;
+    TokenType op;
+    int arity;
+} pattern_operators[] = {
+    {"+", TOKEN_PLUS, 2}, {"-", TOKEN_MINUS, 2}, {"*", TOKEN_STAR, 2}, {"/", TOKEN_SLASH, 2},
+    {"%", TOKEN_PERCENT, 2}, {"==", TOKEN_EQ, 2}, {"!=", TOKEN_NEQ, 2}, {"<", TOKEN_LT, 2},
+    {"<=", TOKEN_LEQ, 2}, {">", TOKEN_GT, 2}, {">=", TOKEN_GEQ, 2}, {"&", TOKEN_AND, 2},
+    {"|", TOKEN_OR, 2}, {"^", TOKEN_XOR, 2}, {"!", TOKEN_NOT, 1},
+};
+
+static void pattern_error(const char *rule, const char *message)
+{
+    fprintf(stderr, "[EGraph Error] Rule %s: %s\n", rule, message);
+    exit(1);
+}
+
+static void skip_spaces(const char **text)
+{
+    while (**text == ' ')
+        (*text)++;
+}
+
+static int parse_pattern(const char **text, const char *rule)
+{
+    if (pattern_count == EGRAPH_MAX_PATTERN_NODES)
+        pattern_error(rule, "too many pattern nodes");
+    skip_spaces(text);
+
+    int index = pattern_count++;
+    PatternNode *node = &patterns[index];
+    const char *s = *text;
+
+    if (*s == '?')
+    {
+        if (s[1] < 'a' || s[1] > 'c')
+            pattern_error(rule, "pattern variables are ?a, ?b and ?c");
+        node->kind = PAT_VAR;
+        node->var = s[1] - 'a';
+        *text = s + 2;
+    }
+    else if (*s == '(')
+    {
+        s++;
+        size_t length = strcspn(s, " ");
+        int found = 0;
+        for (size_t i = 0; i < sizeof(pattern_operators) / sizeof(pattern_operators[0]); i++)
+        {
+            if (strlen(pattern_operators[i].text) == length && strncmp(s, pattern_operators[i].text, length) == 0)
+            {
+                node->kind = PAT_OP;
+                node->op = pattern_operators[i].op;
+                node->arity = pattern_operators[i].arity;
+                found = 1;
+            }
+        }
+        if (!found)
+            pattern_error(rule, "unknown operator");
+        *text = s + length;
+        for (int i = 0; i < node->arity; i++)
+        {
+            int child = parse_pattern(text, rule);
+            patterns[index].child[i] = child;
+        }
+        skip_spaces(text);
+        if (**text != ')')
+            pattern_error(rule, "expected ')'");
+        (*text)++;
+    }
+    else
+    {
+        char *end;
+        node->kind = PAT_CONST;
+        node->value = strtoll(s, &end, 10);
+        if (end == s)
+            pattern_error(rule, "expected a variable, a constant or '('");
+        *text = end;
+    }
+    return index;
+}
+
+static void compile_rules(void)
+{
+    if (pattern_count > 0)
+        return;
+    for (int i = 0; i < RULE_COUNT; i++)
+    {
+        const char *text = egraph_rules[i].pattern;
+        rule_lhs[i] = parse_pattern(&text, egraph_rules[i].name);
+        text = egraph_rules[i].replacement;
+        rule_rhs[i] = parse_pattern(&text, egraph_rules[i].name);
+    }
+}
+
+/* E-graph */
+
+static int find(EGraph *g, int cls)
+{
+    while (g->classes[cls].parent != cls)
+    {
+        g->classes[cls].parent = g->classes[g->classes[cls].parent].parent;
+        cls = g->classes[cls].parent;
+    }
+    return cls;
+}
+
+static unsigned hash_node(EGraph *g, const ENode *node)
+{
+    unsigned h = (unsigned)node->kind * 31u + (unsigned)node->op;
+    switch (node->kind)
+    {
+    case EN_CONST:
+        h = h * 31u + (unsigned)(node->value ^ (node->value >> 32)) * 17u + (unsigned)node->type;
+        break;
+    case EN_VAR:
+        for (const char *p = node->name; *p; p++)
+            h = h * 31u + (unsigned char)*p;
+        break;
+    case EN_BINARY:
+        h = h * 31u + (unsigned)find(g, node->child[1]);
+        /* fall through */
+    case EN_UNARY:
+        h = h * 31u + (unsigned)find(g, node->child[0]);
+        break;
+    }
+    return h * 2654435761u;
+}
+
+static int same_node(EGraph *g, const ENode *a, const ENode *b)
+{
+    if (a->kind != b->kind || a->op != b->op)
+        return 0;
+    switch (a->kind)
+    {
+    case EN_CONST:
+        return a->value == b->value && a->type == b->type;
+    case EN_VAR:
+        return strcmp(a->name, b->name) == 0;
+    case EN_UNARY:
+        return find(g, a->child[0]) == find(g, b->child[0]);
+    default:
+        return find(g, a->child[0]) == find(g, b->child[0]) && find(g, a->child[1]) == find(g, b->child[1]);
+    }
+}
+
+/* Returns the index of a live e-node equal to node, or -1; *slot receives the free slot. */
+static int lookup(EGraph *g, const ENode *node, int *slot)
+{
+    unsigned mask = (unsigned)g->table_size - 1;
+    for (unsigned i = hash_node(g, node) & mask;; i = (i + 1) & mask)
+    {
+        if (g->table[i] < 0)
+        {
+            *slot = (int)i;
+            return -1;
+        }
+        if (same_node(g, &g->nodes[g->table[i]], node))
+            return g->table[i];
+    }
+}
+
+static int merge(EGraph *g, int a, int b)
+{
+    a = find(g, a);
+    b = find(g, b);
+    if (a == b)
+        return 0;
+    if (b < a)
+    {
+        int t = a;
+        a = b;
+        b = t;
+    }
+
+    /* The older class stays canonical, so classes of the source expression keep their type. */
+    EClass *keep = &g->classes[a], *gone = &g->classes[b];
+    gone->parent = a;
+    g->nodes[keep->tail].next = gone->head;
+    keep->tail = gone->tail;
+    if (gone->constant && !keep->constant)
+    {
+        keep->constant = 1;
+        keep->value = gone->value;
+    }
+    keep->pure |= gone->pure;
+    keep->boolean |= gone->boolean;
+    g->changed = 1;
+    return 1;
+}
+
+/*
+ * Re-canonicalizes the operands of every e-node and rebuilds the hash-cons table. E-nodes
+ * that became equal are congruent: their classes are merged and the duplicate is dropped.
+ * Returns the number of merges.
+ */
+static int rehash(EGraph *g)
+{
+    int merges = 0;
+
+    if (g->table_size < 2 * g->capacity)
+    {
+        free(g->table);
+        g->table_size = 64;
+        while (g->table_size < 2 * g->capacity)
+            g->table_size *= 2;
+        g->table = malloc(sizeof(int) * g->table_size);
+    }
+    memset(g->table, -1, sizeof(int) * g->table_size);
+
+    for (int i = 0; i < g->count; i++)
+    {
+        ENode *node = &g->nodes[i];
+        if (node->dead)
+            continue;
+        if (node->kind == EN_UNARY || node->kind == EN_BINARY)
+            node->child[0] = find(g, node->child[0]);
+        if (node->kind == EN_BINARY)
+            node->child[1] = find(g, node->child[1]);
+
+        int slot;
+        int existing = lookup(g, node, &slot);
+        if (existing < 0)
+        {
+            g->table[slot] = i;
+            continue;
+        }
+        merges += merge(g, existing, i);
+        node->dead = 1;
+    }
+    return merges;
+}
+
+/* Adds an e-node unless an equal one exists; returns its canonical e-class. */
+static int add_node(EGraph *g, ENode node, VarType type)
+{
+    if (g->count == g->capacity)
+    {
+        g->capacity = g->capacity ? g->capacity * 2 : 64;
+        g->nodes = realloc(g->nodes, sizeof(ENode) * g->capacity);
+        g->classes = realloc(g->classes, sizeof(EClass) * g->capacity);
+        if (!g->nodes || !g->classes)
+        {
+            fprintf(stderr, "[EGraph Error] Out of memory\n");
+            exit(1);
+        }
+        rehash(g);
+    }
+
+    int slot;
+    int existing = lookup(g, &node, &slot);
+    if (existing >= 0)
+        return find(g, g->nodes[existing].cls);
+
+    int index = g->count++;
+    node.cls = index;
+    node.next = -1;
+    node.dead = 0;
+    g->nodes[index] = node;
+    g->table[slot] = index;
+
+    EClass *cls = &g->classes[index];
+    memset(cls, 0, sizeof(*cls));
+    cls->parent = index;
+    cls->head = cls->tail = index;
+    cls->type = type;
+    cls->pure = node.kind == EN_CONST || node.kind == EN_VAR;
+    if (node.kind == EN_CONST)
+    {
+        cls->constant = 1;
+        cls->value = node.value;
+        cls->boolean = node.value == 0 || node.value == 1;
+    }
+    else if (node.kind == EN_VAR)
+    {
+        cls->boolean = node.type == TYPE_BOOL;
+    }
+    g->changed = 1;
+    return index;
+}
+
+static int add_constant(EGraph *g, long long value, VarType type)
+{
+    ENode node = {EN_CONST, TOKEN_EOF, {0, 0}, value, type, NULL, 0, 0, 0};
+    if (type != TYPE_BOOL || (value != 0 && value != 1))
+        node.type = TYPE_INT;
+    return add_node(g, node, node.type);
+}
+
+static int add_operator(EGraph *g, TokenType op, int left, int right, VarType type)
+{
+    ENode node = {right < 0 ? EN_UNARY : EN_BINARY, op, {find(g, left), right < 0 ? 0 : find(g, right)},
+                  0, TYPE_UNKNOWN, NULL, 0, 0, 0};
+    return add_node(g, node, type);
+}
+
+static int is_comparison(TokenType op)
+{
+    return op == TOKEN_EQ || op == TOKEN_NEQ || op == TOKEN_LT || op == TOKEN_LEQ || op == TOKEN_GT ||
+           op == TOKEN_GEQ;
+}
+
+static int is_logical(TokenType op)
+{
+    return op == TOKEN_AND || op == TOKEN_OR || op == TOKEN_XOR;
+}
+
+/* A divide or remainder by this class cannot fault. */
+static int safe_divisor(EClass *cls)
+{
+    return cls->constant && cls->value != 0 && cls->value != -1;
+}
+
+/*
+ * Propagates the e-class facts (purity, 0/1 values, constants) through the operators until
+ * nothing changes. A class that turns out to be constant gets a constant e-node, which is
+ * what extraction picks for it. Returns 1 if classes were merged.
+ */
+static int analyse(EGraph *g)
+{
+    int merged = 0, progress = 1;
+
+    while (progress)
+    {
+        progress = 0;
+        for (int i = 0; i < g->count; i++)
+        {
+            ENode node = g->nodes[i];
+            if (node.dead || (node.kind != EN_UNARY && node.kind != EN_BINARY))
+                continue;
+
+            int cls = find(g, node.cls);
+            EClass *left = &g->classes[find(g, node.child[0])];
+            EClass *right = node.kind == EN_BINARY ? &g->classes[find(g, node.child[1])] : left;
+
+            int pure = left->pure && right->pure &&
+                       ((node.op != TOKEN_SLASH && node.op != TOKEN_PERCENT) || safe_divisor(right));
+            int boolean = node.op == TOKEN_NOT || is_comparison(node.op) ||
+                          (is_logical(node.op) && left->boolean && right->boolean);
+            if ((pure && !g->classes[cls].pure) || (boolean && !g->classes[cls].boolean))
+            {
+                g->classes[cls].pure |= pure;
+                g->classes[cls].boolean |= boolean;
+                progress = 1;
+            }
+
+            long long value;
+            int folded = 0;
+            if (node.kind == EN_UNARY && left->constant)
+            {
+                value = left->value == 0;
+                folded = 1;
+            }
+            else if (node.kind == EN_BINARY && left->constant && right->constant)
+            {
+                folded = fold_binary_operator(node.op, left->value, right->value, &value);
+            }
+            if (folded && !g->classes[cls].constant)
+            {
+                int constant = add_constant(g, value, g->classes[cls].type);
+                merge(g, cls, constant);
+                merged = progress = 1;
+            }
+        }
+    }
+    return merged;
+}
+
+/*
+ * Restores the e-graph invariants after a round of rewrites. Operators in constant classes
+ * and operators with their own class as an operand, such as x + 0 in the class of x, are
+ * dropped: extraction never picks them, and rules that keep rewriting them would only fill
+ * the graph with other spellings of the same value.
+ */
+static void rebuild(EGraph *g)
+{
+    int merges = 1;
+    while (merges)
+    {
+        merges = rehash(g);
+        merges += analyse(g);
+    }
+
+    for (int i = 0; i < g->count; i++)
+    {
+        ENode *node = &g->nodes[i];
+        if (node->kind == EN_CONST || node->kind == EN_VAR)
+            continue;
+        int cls = find(g, node->cls);
+        if (g->classes[cls].constant || find(g, node->child[0]) == cls ||
+            (node->kind == EN_BINARY && find(g, node->child[1]) == cls))
+            node->dead = 1;
+    }
+}
+
+/* Matching */
+
+typedef struct
+{
+    int var[3];
+} Substitution;
+
+typedef struct
+{
+    int rule;
+    int cls;
+    Substitution subst;
+} Match;
+
+/* Appends to out the extensions of subst under which pattern p matches e-class cls. */
+static int ematch(EGraph *g, int p, int cls, const Substitution *subst, Substitution *out, int count)
+{
+    const PatternNode *pattern = &patterns[p];
+    cls = find(g, cls);
+
+    switch (pattern->kind)
+    {
+    case PAT_VAR:
+    {
+        int bound = subst->var[pattern->var];
+        if ((bound >= 0 && find(g, bound) != cls) || count == EGRAPH_MAX_MATCHES)
+            return count;
+        out[count] = *subst;
+        out[count].var[pattern->var] = cls;
+        return count + 1;
+    }
+    case PAT_CONST:
+        if (g->classes[cls].constant && g->classes[cls].value == pattern->value && count < EGRAPH_MAX_MATCHES)
+            out[count++] = *subst;
+        return count;
+    default:
+        for (int n = g->classes[cls].head; n >= 0; n = g->nodes[n].next)
+        {
+            const ENode *node = &g->nodes[n];
+            if (node->dead || node->kind != (pattern->arity == 1 ? EN_UNARY : EN_BINARY) || node->op != pattern->op)
+                continue;
+
+            Substitution left[EGRAPH_MAX_MATCHES];
+            int left_count = ematch(g, pattern->child[0], node->child[0], subst, left, 0);
+            for (int i = 0; i < left_count; i++)
+            {
+                if (pattern->arity == 2)
+                    count = ematch(g, pattern->child[1], node->child[1], &left[i], out, count);
+                else if (count < EGRAPH_MAX_MATCHES)
+                    out[count++] = left[i];
+            }
+        }
+        return count;
+    }
+}
+
+static int guards_hold(EGraph *g, int guards, const Substitution *subst)
+{
+    EClass *a = subst->var[0] >= 0 ? &g->classes[find(g, subst->var[0])] : NULL;
+    EClass *b = subst->var[1] >= 0 ? &g->classes[find(g, subst->var[1])] : NULL;
+
+    if ((guards & GUARD_PURE_A) && !a->pure)
+        return 0;
+    if ((guards & GUARD_PURE_B) && !b->pure)
+        return 0;
+    if ((guards & GUARD_BOOL_A) && !a->boolean)
+        return 0;
+    if ((guards & GUARD_BOOL_B) && !b->boolean)
+        return 0;
+    if ((guards & GUARD_CONST_A) && !a->constant)
+        return 0;
+    return 1;
+}
+
+/* Adds the e-nodes of a right-hand side; a constant at its root takes the type of the class. */
+static int instantiate(EGraph *g, int p, const Substitution *subst, VarType type)
+{
+    const PatternNode *pattern = &patterns[p];
+    switch (pattern->kind)
+    {
+    case PAT_VAR:
+        return find(g, subst->var[pattern->var]);
+    case PAT_CONST:
+        return add_constant(g, pattern->value, type);
+    default:
+    {
+        int left = instantiate(g, pattern->child[0], subst, TYPE_INT);
+        int right = pattern->arity == 2 ? instantiate(g, pattern->child[1], subst, TYPE_INT) : -1;
+        VarType result = TYPE_INT;
+        if (pattern->op == TOKEN_NOT || is_comparison(pattern->op) ||
+            (is_logical(pattern->op) && g->classes[find(g, left)].type == TYPE_BOOL &&
+             g->classes[find(g, right)].type == TYPE_BOOL))
+            result = TYPE_BOOL;
+        return add_operator(g, pattern->op, left, right, result);
+    }
+    }
+}
+
+/* Runs rewrite rounds until saturation or a limit; returns the number of rounds. */
+static int saturate(EGraph *g, const char **stop)
+{
+    double start = pass_now_seconds();
+    Match *matches = NULL;
+    int capacity = 0;
+
+    for (int round = 0;; round++)
+    {
+        if (round == EGRAPH_ITERATION_LIMIT)
+        {
+            *stop = "iteration limit";
+            free(matches);
+            return round;
+        }
+
+        int count = 0;
+        for (int cls = 0; cls < g->count; cls++)
+        {
+            if (g->classes[cls].parent != cls)
+                continue;
+            for (int rule = 0; rule < RULE_COUNT; rule++)
+            {
+                Substitution empty = {{-1, -1, -1}};
+                Substitution found[EGRAPH_MAX_MATCHES];
+                int found_count = ematch(g, rule_lhs[rule], cls, &empty, found, 0);
+                for (int i = 0; i < found_count; i++)
+                {
+                    if (!guards_hold(g, egraph_rules[rule].guards, &found[i]))
+                        continue;
+                    if (count == capacity)
+                    {
+                        capacity = capacity ? capacity * 2 : 256;
+                        matches = realloc(matches, sizeof(Match) * capacity);
+                    }
+                    matches[count].rule = rule;
+                    matches[count].cls = cls;
+                    matches[count].subst = found[i];
+                    count++;
+                }
+            }
+        }
+
+        g->changed = 0;
+        for (int i = 0; i < count && g->count < EGRAPH_NODE_LIMIT; i++)
+        {
+            int cls = find(g, matches[i].cls);
+            int result = instantiate(g, rule_rhs[matches[i].rule], &matches[i].subst, g->classes[cls].type);
+            merge(g, cls, result);
+        }
+        rebuild(g);
+
+        if (!g->changed)
+            *stop = "saturated";
+        else if (g->count >= EGRAPH_NODE_LIMIT)
+            *stop = "node limit";
+        else if (pass_now_seconds() - start > EGRAPH_TIME_LIMIT)
+            *stop = "time limit";
+        else
+            continue;
+        free(matches);
+        return round + 1;
+    }
+}
+
+/* Extraction */
+
+static long long node_cost(EGraph *g, const ENode *node)
+{
+    EClass *right;
+    switch (node->kind)
+    {
+    case EN_CONST:
+        return g->classes[find(g, node->cls)].type == TYPE_BOOL ? COST_LOAD : COST_IMMEDIATE;
+    case EN_VAR:
+        return COST_LOAD;
+    case EN_UNARY:
+        return COST_SETCC;
+    default:
+        break;
+    }
+
+    right = &g->classes[find(g, node->child[1])];
+    switch (node->op)
+    {
+    case TOKEN_STAR:
+    {
+        EClass *left = &g->classes[find(g, node->child[0])];
+        EClass *factor = right->constant ? right : left->constant ? left : NULL;
+        if (factor && factor->value > 0 && (factor->value & (factor->value - 1)) == 0)
+            return COST_ALU;
+        return COST_MULTIPLY;
+    }
+    case TOKEN_SLASH:
+    case TOKEN_PERCENT:
+    {
+        long long cost = COST_DIVIDE;
+        if (safe_divisor(right))
+        {
+            unsigned long long magnitude = right->value < 0 ? 0 - (unsigned long long)right->value : (unsigned long long)right->value;
+            cost = (magnitude & (magnitude - 1)) == 0 ? COST_DIVIDE_SHIFT : COST_DIVIDE_MAGIC;
+        }
+        /* The remainder is recovered with a multiply and subtract, or a move after idiv. */
+        if (node->op == TOKEN_PERCENT)
+            cost += safe_divisor(right) ? COST_MULTIPLY + COST_ALU : COST_IMMEDIATE;
+        return cost;
+    }
+    default:
+        return is_comparison(node->op) ? COST_SETCC : COST_ALU;
+    }
+}
+
+/* Computes the cheapest e-node of every class; returns the cost of the cheapest form of root. */
+static long long extract_costs(EGraph *g, long long *cost, int *best, int root)
+{
+    for (int i = 0; i < g->count; i++)
+    {
+        cost[i] = EGRAPH_INFINITE_COST;
+        best[i] = -1;
+    }
+
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+        for (int i = 0; i < g->count; i++)
+        {
+            const ENode *node = &g->nodes[i];
+            if (node->dead)
+                continue;
+
+            long long total = node_cost(g, node);
+            if (node->kind == EN_UNARY || node->kind == EN_BINARY)
+                total += cost[find(g, node->child[0])];
+            if (node->kind == EN_BINARY)
+                total += cost[find(g, node->child[1])];
+            if (total > EGRAPH_INFINITE_COST)
+                total = EGRAPH_INFINITE_COST;
+
+            int cls = find(g, node->cls);
+            if (total < cost[cls])
+            {
+                cost[cls] = total;
+                best[cls] = i;
+                changed = 1;
+            }
+        }
+    }
+    return cost[find(g, root)];
+}
+
+static ASTNode *build_expression(EGraph *g, const int *best, int cls, ASTNode *origin)
+{
+    cls = find(g, cls);
+    const ENode *node = &g->nodes[best[cls]];
+    ASTNode *result;
+    char buffer[32];
+
+    switch (node->kind)
+    {
+    case EN_CONST:
+        if (g->classes[cls].type == TYPE_BOOL && (node->value == 0 || node->value == 1))
+        {
+            result = create_literal_node(node->value ? "true" : "false", TYPE_BOOL);
+        }
+        else
+        {
+            snprintf(buffer, sizeof(buffer), "%lld", node->value);
+            result = create_literal_node(buffer, TYPE_INT);
+        }
+        break;
+    case EN_VAR:
+        result = create_identifier_node(node->name);
+        result->result_type = node->type;
+        break;
+    case EN_UNARY:
+        result = create_unary_expr_node(node->op, build_expression(g, best, node->child[0], origin));
+        result->result_type = g->classes[cls].type;
+        break;
+    default:
+    {
+        ASTNode *left = build_expression(g, best, node->child[0], origin);
+        ASTNode *right = build_expression(g, best, node->child[1], origin);
+        result = create_binary_expr_node(node->op, left, right);
+        result->result_type = g->classes[cls].type;
+        break;
+    }
+    }
+    return set_node_location(result, origin->line, origin->column);
+}
+
+/* Loading */
+
+static int supported_type(VarType type)
+{
+    return type == TYPE_INT || type == TYPE_BOOL;
+}
+
+/* Expressions made only of integer and boolean literals, variables and operators. */
+static int supported_expression(ASTNode *node)
+{
+    switch (node->type)
+    {
+    case AST_LITERAL:
+        if (node->result_type == TYPE_BOOL)
+            return strcmp(node->literal.value, "true") == 0 || strcmp(node->literal.value, "false") == 0;
+        return node->result_type == TYPE_INT;
+    case AST_IDENTIFIER:
+        return supported_type(node->result_type);
+    case AST_UNARY_EXPR:
+        /* The parser leaves '!' untyped; its value is always 0 or 1. */
+        return node->unary_expr.op == TOKEN_NOT && supported_expression(node->unary_expr.operand);
+    case AST_BINARY_EXPR:
+        for (size_t i = 0; i < sizeof(pattern_operators) / sizeof(pattern_operators[0]); i++)
+        {
+            if (pattern_operators[i].op == node->binary_expr.op && pattern_operators[i].arity == 2)
+                return supported_type(node->result_type) && supported_expression(node->binary_expr.left) &&
+                       supported_expression(node->binary_expr.right);
+        }
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+static int load_expression(EGraph *g, ASTNode *node)
+{
+    switch (node->type)
+    {
+    case AST_LITERAL:
+    {
+        long long value = node->result_type == TYPE_BOOL ? strcmp(node->literal.value, "true") == 0
+                                                         : strtoll(node->literal.value, NULL, 10);
+        return add_constant(g, value, node->result_type);
+    }
+    case AST_IDENTIFIER:
+    {
+        ENode var = {EN_VAR, TOKEN_EOF, {0, 0}, 0, node->result_type, node->identifier.name, 0, 0, 0};
+        return add_node(g, var, node->result_type);
+    }
+    case AST_UNARY_EXPR:
+        return add_operator(g, node->unary_expr.op, load_expression(g, node->unary_expr.operand), -1, TYPE_BOOL);
+    default:
+    {
+        int left = load_expression(g, node->binary_expr.left);
+        int right = load_expression(g, node->binary_expr.right);
+        return add_operator(g, node->binary_expr.op, left, right, node->result_type);
+    }
+    }
+}
+
+static int optimize_expression(ASTNode **link)
+{
+    ASTNode *expression = *link;
+    if (!expression || (expression->type != AST_BINARY_EXPR && expression->type != AST_UNARY_EXPR) ||
+        !supported_expression(expression))
+        return 0;
+
+    EGraph g;
+    memset(&g, 0, sizeof(g));
+    int root = load_expression(&g, expression);
+    rebuild(&g);
+
+    long long *cost = malloc(sizeof(long long) * g.capacity);
+    int *best = malloc(sizeof(int) * g.capacity);
+    long long original = extract_costs(&g, cost, best, root);
+
+    const char *stop = NULL;
+    int rounds = saturate(&g, &stop);
+    if (g.capacity > 0)
+    {
+        cost = realloc(cost, sizeof(long long) * g.capacity);
+        best = realloc(best, sizeof(int) * g.capacity);
+    }
+    long long cheapest = extract_costs(&g, cost, best, root);
+
+    int classes = 0;
+    for (int i = 0; i < g.count; i++)
+        classes += g.classes[i].parent == i;
+    if (strcmp(stop, "saturated") != 0)
+    {
+        remark(REMARK_MISSED, "egraph", "SaturationStopped", expression->line,
+               "stopped at the %s after %d rounds with %d e-nodes in %d e-classes", stop, rounds, g.count,
+               classes);
+    }
+
+    int replaced = cheapest < original;
+    if (replaced)
+    {
+        remark(REMARK_PASSED, "egraph", "ExpressionExtracted", expression->line,
+               "cost %lld -> %lld (%d e-nodes in %d e-classes after %d rounds)", original, cheapest, g.count,
+               classes, rounds);
+        *link = build_expression(&g, best, root, expression);
+        free_ast(expression);
+    }
+    else
+    {
+        remark(REMARK_ANALYSIS, "egraph", "NoCheaperForm", expression->line,
+               "no form cheaper than cost %lld among %d e-nodes in %d e-classes", original, g.count, classes);
+    }
+
+    free(cost);
+    free(best);
+    free(g.nodes);
+    free(g.classes);
+    free(g.table);
+    return replaced;
+}
+
+static int optimize_statements(ASTNode *node)
+{
+    int changes = 0;
+    for (; node; node = node->next)
+    {
+        if (node->type == AST_VAR_DECL)
+        {
+            changes += optimize_expression(&node->var_decl.value);
+        }
+        else if (node->type == AST_IF_STATEMENT)
+        {
+            changes += optimize_expression(&node->if_statement.condition);
+            changes += optimize_statements(node->if_statement.then_branch);
+            changes += optimize_statements(node->if_statement.else_branch);
+        }
+        else if (node->type == AST_LOOP)
+        {
+            changes += optimize_statements(node->loop.init);
+            changes += optimize_expression(&node->loop.condition);
+            changes += optimize_statements(node->loop.update);
+            changes += optimize_statements(node->loop.body);
+        }
+        else if (node->type == AST_ARRAY_DECL)
+        {
+            for (int i = 0; i < node->array_decl.value_count; i++)
+                changes += optimize_expression(&node->array_decl.values[i]);
+        }
+        else if (node->type == AST_ELEMENT_ASSIGN)
+        {
+            changes += optimize_expression(&node->element_assign.index);
+            changes += optimize_expression(&node->element_assign.value);
+        }
+    }
+    return changes;
+}
+
+int run_egraph(ASTNode **program, PassContext *ctx)
+{
+    (void)ctx;
+    compile_rules();
+    return optimize_statements(*program);
+}
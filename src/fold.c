@@ -0,0 +1,376 @@
+/**
+ * @file fold.c
+ * @brief AST-level folding passes for the SEG language compiler.
+ *        Constant folding evaluates operators on integer and boolean literals with the
+ *        same 64-bit wrap-around semantics as the generated code; branch folding removes
+ *        if-statements whose condition folded to a constant.
+ * @author Dario Romandini
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+#include "token.h"
+
+/* Reads an integer or boolean literal the way the code generator materializes it. */
+static int literal_value(ASTNode *node, long long *value)
+{
+    if (!node || node->type != AST_LITERAL)
+        return 0;
+    if (node->result_type == TYPE_BOOL)
+    {
+        *value = strcmp(node->literal.value, "true") == 0;
+        return 1;
+    }
+    if (node->result_type == TYPE_INT)
+    {
+        *value = strtoll(node->literal.value, NULL, 10);
+        return 1;
+    }
+    return 0;
+}
+
+/* Turns an expression node into a literal in place, keeping its position in the tree. */
+static void make_literal(ASTNode *node, long long value)
+{
+    char buffer[32];
+    VarType type = node->result_type == TYPE_BOOL && (value == 0 || value == 1) ? TYPE_BOOL : TYPE_INT;
+
+    if (type == TYPE_BOOL)
+        snprintf(buffer, sizeof(buffer), "%s", value ? "true" : "false");
+    else
+        snprintf(buffer, sizeof(buffer), "%lld", value);
+
+    if (node->type == AST_BINARY_EXPR)
+    {
+        free_ast(node->binary_expr.left);
+        free_ast(node->binary_expr.right);
+    }
+    else if (node->type == AST_UNARY_EXPR)
+    {
+        free_ast(node->unary_expr.operand);
+    }
+
+    node->type = AST_LITERAL;
+    node->result_type = type;
+    node->literal.value = strdup_safe(buffer);
+}
+
+int fold_binary_operator(TokenType op, long long left, long long right, long long *result)
+{
+    unsigned long long l = (unsigned long long)left, r = (unsigned long long)right;
+
+    switch (op)
+    {
+    case TOKEN_PLUS:
+        *result = (long long)(l + r);
+        return 1;
+    case TOKEN_MINUS:
+        *result = (long long)(l - r);
+        return 1;
+    case TOKEN_STAR:
+        *result = (long long)(l * r);
+        return 1;
+    case TOKEN_SLASH:
+        /* idiv traps on these; leave them for run time. */
+        if (right == 0 || (right == -1 && left == (long long)(1ULL << 63)))
+            return 0;
+        *result = left / right;
+        return 1;
+    case TOKEN_PERCENT:
+        if (right == 0 || (right == -1 && left == (long long)(1ULL << 63)))
+            return 0;
+        *result = left % right;
+        return 1;
+    case TOKEN_EQ:
+        *result = left == right;
+        return 1;
+    case TOKEN_NEQ:
+        *result = left != right;
+        return 1;
+    case TOKEN_LT:
+        *result = left < right;
+        return 1;
+    case TOKEN_LEQ:
+        *result = left <= right;
+        return 1;
+    case TOKEN_GT:
+        *result = left > right;
+        return 1;
+    case TOKEN_GEQ:
+        *result = left >= right;
+        return 1;
+    case TOKEN_AND:
+        *result = (long long)(l & r);
+        return 1;
+    case TOKEN_OR:
+        *result = (long long)(l | r);
+        return 1;
+    case TOKEN_XOR:
+        *result = (long long)(l ^ r);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * The condition holds on entry if it is a literal, or if it compares the variable the init
+ * statement sets to a constant with a literal ("for (int i = 0; i < 10; ...)").
+ */
+int loop_condition_holds_on_entry(ASTNode *loop)
+{
+    ASTNode *init = loop->loop.init, *condition = loop->loop.condition;
+    long long value, left, right, result;
+
+    if (literal_value(condition, &value))
+        return value != 0;
+    if (!init || init->type != AST_VAR_DECL || !literal_value(init->var_decl.value, &value) ||
+        condition->type != AST_BINARY_EXPR)
+        return 0;
+
+    ASTNode *a = condition->binary_expr.left, *b = condition->binary_expr.right;
+    if (a->type == AST_IDENTIFIER && strcmp(a->identifier.name, init->var_decl.name) == 0 && literal_value(b, &right))
+        left = value;
+    else if (b->type == AST_IDENTIFIER && strcmp(b->identifier.name, init->var_decl.name) == 0 &&
+             literal_value(a, &left))
+        right = value;
+    else
+        return 0;
+
+    switch (condition->binary_expr.op)
+    {
+    case TOKEN_EQ:
+    case TOKEN_NEQ:
+    case TOKEN_LT:
+    case TOKEN_LEQ:
+    case TOKEN_GT:
+    case TOKEN_GEQ:
+        return fold_binary_operator(condition->binary_expr.op, left, right, &result) && result;
+    default:
+        return 0;
+    }
+}
+
+static int fold_expression(ASTNode *node)
+{
+    if (!node)
+        return 0;
+
+    int changes = 0;
+    long long left, right, result;
+
+    switch (node->type)
+    {
+    case AST_BINARY_EXPR:
+        changes += fold_expression(node->binary_expr.left);
+        changes += fold_expression(node->binary_expr.right);
+    {
+        int left_constant = literal_value(node->binary_expr.left, &left);
+        int right_constant = literal_value(node->binary_expr.right, &right);
+        if (left_constant && right_constant && fold_binary_operator(node->binary_expr.op, left, right, &result))
+        {
+            remark(REMARK_PASSED, "constfold", "ConstantFolded", node->line,
+                   "folded %s of constants to %lld", token_type_to_string(node->binary_expr.op), result);
+            make_literal(node, result);
+            changes++;
+        }
+        else if (left_constant && right_constant)
+        {
+            remark(REMARK_MISSED, "constfold", "NotFolded", node->line,
+                   "%s not folded: the operation traps and is left to run time",
+                   token_type_to_string(node->binary_expr.op));
+        }
+        else if (left_constant || right_constant)
+        {
+            ASTNode *other = left_constant ? node->binary_expr.right : node->binary_expr.left;
+            remark(REMARK_MISSED, "constfold", "NotFolded", node->line,
+                   "%s not folded: %s operand %s%s%s is not a constant",
+                   token_type_to_string(node->binary_expr.op), left_constant ? "right" : "left",
+                   other->type == AST_IDENTIFIER ? "'" : "",
+                   other->type == AST_IDENTIFIER ? other->identifier.name : "expression",
+                   other->type == AST_IDENTIFIER ? "'" : "");
+        }
+        break;
+    }
+    case AST_UNARY_EXPR:
+        changes += fold_expression(node->unary_expr.operand);
+        if (node->unary_expr.op == TOKEN_NOT && literal_value(node->unary_expr.operand, &left))
+        {
+            remark(REMARK_PASSED, "constfold", "ConstantFolded", node->line,
+                   "folded NOT of a constant to %d", left == 0);
+            node->result_type = TYPE_BOOL;
+            make_literal(node, left == 0);
+            changes++;
+        }
+        break;
+    case AST_INDEX:
+        changes += fold_expression(node->index.index);
+        break;
+    default:
+        break;
+    }
+    return changes;
+}
+
+static int fold_statements(ASTNode *node)
+{
+    int changes = 0;
+    for (; node; node = node->next)
+    {
+        if (node->type == AST_VAR_DECL)
+        {
+            changes += fold_expression(node->var_decl.value);
+        }
+        else if (node->type == AST_IF_STATEMENT)
+        {
+            changes += fold_expression(node->if_statement.condition);
+            changes += fold_statements(node->if_statement.then_branch);
+            changes += fold_statements(node->if_statement.else_branch);
+        }
+        else if (node->type == AST_LOOP)
+        {
+            changes += fold_statements(node->loop.init);
+            changes += fold_expression(node->loop.condition);
+            changes += fold_statements(node->loop.update);
+            changes += fold_statements(node->loop.body);
+        }
+        else if (node->type == AST_ARRAY_DECL)
+        {
+            for (int i = 0; i < node->array_decl.value_count; i++)
+                changes += fold_expression(node->array_decl.values[i]);
+        }
+        else if (node->type == AST_ELEMENT_ASSIGN)
+        {
+            changes += fold_expression(node->element_assign.index);
+            changes += fold_expression(node->element_assign.value);
+        }
+    }
+    return changes;
+}
+
+int run_constant_folding(ASTNode **program, PassContext *ctx)
+{
+    (void)ctx;
+    return fold_statements(*program);
+}
+
+static int declares_variable(ASTNode *node)
+{
+    for (; node; node = node->next)
+    {
+        if (node->type == AST_VAR_DECL)
+            return 1;
+    }
+    return 0;
+}
+
+/* A loop whose condition is false from the start only runs its init statement. */
+static int remove_false_loop(ASTNode **link, int top_level)
+{
+    ASTNode *node = *link;
+    long long condition;
+
+    if (!literal_value(node->loop.condition, &condition) || condition)
+        return 0;
+    if (top_level && declares_variable(node->loop.init) && !declares_variable(node->next))
+    {
+        remark(REMARK_MISSED, "branchfold", "BranchNotFolded", node->line,
+               "loop with false condition kept: its init statement would become the exit value");
+        return 0;
+    }
+    remark(REMARK_PASSED, "branchfold", "LoopRemoved", node->line, "loop with false condition removed");
+
+    ASTNode *replacement = node->loop.init;
+    node->loop.init = NULL;
+    ASTNode *rest = node->next;
+    node->next = NULL;
+    free_ast(node);
+    if (replacement)
+    {
+        replacement->next = rest;
+        *link = replacement;
+    }
+    else
+        *link = rest;
+    return 1;
+}
+
+static int fold_branches(ASTNode **link, int top_level)
+{
+    int changes = 0;
+    while (*link)
+    {
+        ASTNode *node = *link;
+        long long condition;
+
+        if (node->type == AST_LOOP)
+        {
+            changes += fold_branches(&node->loop.body, 0);
+            if (remove_false_loop(link, top_level))
+                changes++;
+            else
+                link = &node->next;
+            continue;
+        }
+        if (node->type != AST_IF_STATEMENT)
+        {
+            link = &node->next;
+            continue;
+        }
+
+        changes += fold_branches(&node->if_statement.then_branch, 0);
+        changes += fold_branches(&node->if_statement.else_branch, 0);
+
+        if (!literal_value(node->if_statement.condition, &condition))
+        {
+            link = &node->next;
+            continue;
+        }
+
+        /* Splice the taken branch in place of the if-statement. */
+        ASTNode **taken = condition ? &node->if_statement.then_branch : &node->if_statement.else_branch;
+
+        /* The last top-level declaration is the exit code; splicing must not change which one it is. */
+        if (top_level && declares_variable(*taken) && !declares_variable(node->next))
+        {
+            remark(REMARK_MISSED, "branchfold", "BranchNotFolded", node->line,
+                   "if-statement with constant condition kept: the taken branch declares the exit value");
+            link = &node->next;
+            continue;
+        }
+
+        remark(REMARK_PASSED, "branchfold", "BranchFolded", node->line,
+               "if-statement with constant condition replaced by its %s branch", condition ? "then" : "else");
+
+        ASTNode *replacement = *taken;
+        *taken = NULL;
+
+        ASTNode *rest = node->next;
+        node->next = NULL;
+        free_ast(node);
+
+        if (replacement)
+        {
+            ASTNode *tail = replacement;
+            while (tail->next)
+                tail = tail->next;
+            tail->next = rest;
+            *link = replacement;
+        }
+        else
+        {
+            *link = rest;
+        }
+        changes++;
+    }
+    return changes;
+}
+
+int run_branch_folding(ASTNode **program, PassContext *ctx)
+{
+    (void)ctx;
+    return fold_branches(program, 1);
+}
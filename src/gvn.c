@@ -0,0 +1,713 @@
+/**
+ * @file gvn.c
+ * @brief Global value numbering on the machine IR of the SEG compiler.
+ *        Every value held in a register, a global or a stack slot gets a value number.
+ *        Numbers of computations are hash-consed on (opcode, operand numbers), and loads
+ *        on (symbol, offset, memory generation), so the same expression evaluated twice
+ *        gets the same number as long as nothing in between has stored to its inputs.
+ *        A computation whose number is already available in a register, a global or as
+ *        a constant is replaced by a copy, a load or an immediate, and the instructions
+ *        that only fed it are removed by a dead-code sweep. Numbering runs over extended
+ *        basic blocks: state flows through fall-through edges and is dropped at labels
+ *        that are jumped to, after calls and after unconditional control transfers.
+ * @author Dario Romandini
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+
+#define GVN_HASH_BUCKETS 256
+#define GVN_MAX_MEMORY 64
+#define GVN_MAX_STACK 64
+
+/**
+ * @brief Kinds of hash-consed value keys.
+ */
+typedef enum
+{
+    KEY_CONST,  ///< Integer constant (imm)
+    KEY_LOAD,   ///< Load of [rip + sym + imm] of a given size in a memory generation
+    KEY_ADDR,   ///< Address of [rip + sym + imm]
+    KEY_SUBREG, ///< Low bytes of value a
+    KEY_OP      ///< Operation op/cond on values a, b, c with immediate imm
+} KeyKind;
+
+typedef struct ValueKey
+{
+    KeyKind kind;
+    MOpcode op;
+    MCond cond;
+    int size;
+    int a, b, c;
+    long long imm;
+    char *symbol;
+    int value;             ///< Value number assigned to the key
+    struct ValueKey *next; ///< Next key in the hash bucket
+} ValueKey;
+
+/**
+ * @brief A global known to hold a value number.
+ */
+typedef struct
+{
+    char *symbol;
+    long long disp;
+    int size;
+    int value;
+} MemoryEntry;
+
+typedef struct
+{
+    ValueKey *buckets[GVN_HASH_BUCKETS];
+    int next_value;                  ///< Next unused value number (0 means unknown)
+    int *is_const;                   ///< Per value number: 1 if it is a constant
+    long long *constant;             ///< Per value number: the constant
+    int capacity;                    ///< Size of is_const/constant
+    int generation;                  ///< Bumped on every store, so later loads get new keys
+    int reg_value[MREG_COUNT];       ///< Value number held by each 64-bit register
+    int flags_value;                 ///< Value number of the flags
+    MemoryEntry memory[GVN_MAX_MEMORY];
+    int memory_count;
+    int stack[GVN_MAX_STACK];        ///< Value numbers of pushed slots, bottom first
+    int stack_depth;
+} GvnState;
+
+static void ensure_capacity(GvnState *state, int value)
+{
+    if (value < state->capacity)
+        return;
+    int capacity = state->capacity ? state->capacity * 2 : 256;
+    while (capacity <= value)
+        capacity *= 2;
+    state->is_const = realloc(state->is_const, capacity * sizeof(int));
+    state->constant = realloc(state->constant, capacity * sizeof(long long));
+    memset(state->is_const + state->capacity, 0, (capacity - state->capacity) * sizeof(int));
+    state->capacity = capacity;
+}
+
+static int fresh_value(GvnState *state)
+{
+    int value = state->next_value++;
+    ensure_capacity(state, value);
+    state->is_const[value] = 0;
+    return value;
+}
+
+static unsigned hash_key(const ValueKey *key)
+{
+    unsigned hash = 2166136261u;
+    long long fields[8] = {key->kind, key->op, key->cond, key->size, key->a, key->b, key->c, key->imm};
+    for (int i = 0; i < 8; i++)
+        hash = (hash ^ (unsigned)(fields[i] ^ (fields[i] >> 32))) * 16777619u;
+    for (const char *s = key->symbol; s && *s; s++)
+        hash = (hash ^ (unsigned char)*s) * 16777619u;
+    return hash % GVN_HASH_BUCKETS;
+}
+
+static int keys_equal(const ValueKey *a, const ValueKey *b)
+{
+    if (a->kind != b->kind || a->op != b->op || a->cond != b->cond || a->size != b->size ||
+        a->a != b->a || a->b != b->b || a->c != b->c || a->imm != b->imm)
+        return 0;
+    if ((a->symbol == NULL) != (b->symbol == NULL))
+        return 0;
+    return !a->symbol || strcmp(a->symbol, b->symbol) == 0;
+}
+
+/* Returns the value number of a key, creating it on first use. */
+static int lookup_value(GvnState *state, const ValueKey *key)
+{
+    unsigned bucket = hash_key(key);
+    for (ValueKey *entry = state->buckets[bucket]; entry; entry = entry->next)
+    {
+        if (keys_equal(entry, key))
+            return entry->value;
+    }
+
+    ValueKey *entry = malloc(sizeof(ValueKey));
+    *entry = *key;
+    entry->symbol = key->symbol ? strdup(key->symbol) : NULL;
+    entry->value = fresh_value(state);
+    entry->next = state->buckets[bucket];
+    state->buckets[bucket] = entry;
+
+    if (key->kind == KEY_CONST)
+    {
+        state->is_const[entry->value] = 1;
+        state->constant[entry->value] = key->imm;
+    }
+    return entry->value;
+}
+
+static int const_value(GvnState *state, long long value)
+{
+    ValueKey key = {.kind = KEY_CONST};
+    key.imm = value;
+    return lookup_value(state, &key);
+}
+
+static int is_gpr(MReg reg)
+{
+    return reg >= MREG_RAX && reg <= MREG_R15;
+}
+
+static void forget_memory(GvnState *state, const char *symbol)
+{
+    for (int i = 0; i < state->memory_count; i++)
+    {
+        if (symbol && strcmp(state->memory[i].symbol, symbol) != 0)
+            continue;
+        free(state->memory[i].symbol);
+        state->memory[i--] = state->memory[--state->memory_count];
+    }
+    state->generation++;
+}
+
+static MemoryEntry *find_memory(GvnState *state, const MOperand *op)
+{
+    for (int i = 0; i < state->memory_count; i++)
+    {
+        MemoryEntry *entry = &state->memory[i];
+        if (entry->disp == op->imm && entry->size == op->size && strcmp(entry->symbol, op->symbol) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+static void record_memory(GvnState *state, const MOperand *op, int value)
+{
+    if (state->memory_count == GVN_MAX_MEMORY)
+        return;
+    MemoryEntry *entry = &state->memory[state->memory_count++];
+    entry->symbol = strdup(op->symbol);
+    entry->disp = op->imm;
+    entry->size = op->size;
+    entry->value = value;
+}
+
+static void reset_state(GvnState *state)
+{
+    for (int reg = 0; reg < MREG_COUNT; reg++)
+        state->reg_value[reg] = fresh_value(state);
+    state->flags_value = fresh_value(state);
+    state->stack_depth = 0;
+    forget_memory(state, NULL);
+}
+
+static int is_stack_slot(const MOperand *op)
+{
+    return op->kind == MOPND_MEM && op->reg == MREG_RSP && op->index == MREG_NONE &&
+           op->imm >= 0 && op->imm % 8 == 0 && op->size == 8;
+}
+
+/* Value number of a source operand. */
+static int operand_value(GvnState *state, const MOperand *op)
+{
+    switch (op->kind)
+    {
+    case MOPND_IMM:
+        return const_value(state, op->imm);
+    case MOPND_REG:
+    {
+        int value = state->reg_value[op->reg];
+        if (op->size == 8 || !is_gpr(op->reg))
+            return value;
+        ValueKey key = {.kind = KEY_SUBREG};
+        key.size = op->size;
+        key.a = value;
+        return lookup_value(state, &key);
+    }
+    case MOPND_MEM:
+    {
+        if (op->symbol && op->index == MREG_NONE)
+        {
+            MemoryEntry *entry = find_memory(state, op);
+            if (entry)
+                return entry->value;
+            ValueKey key = {.kind = KEY_LOAD};
+            key.size = op->size;
+            key.imm = op->imm;
+            key.symbol = op->symbol;
+            key.c = state->generation;
+            int value = lookup_value(state, &key);
+            record_memory(state, op, value);
+            return value;
+        }
+        if (is_stack_slot(op))
+        {
+            int slot = state->stack_depth - 1 - (int)(op->imm / 8);
+            if (slot >= 0)
+                return state->stack[slot];
+        }
+        return fresh_value(state);
+    }
+    default:
+        return fresh_value(state);
+    }
+}
+
+static int is_commutative(MOpcode op)
+{
+    return op == MI_ADD || op == MI_IMUL || op == MI_AND || op == MI_OR || op == MI_XOR;
+}
+
+/* Evaluates an operation on constants; returns 0 if it cannot be folded. */
+static int fold_constants(MOpcode op, long long a, long long b, long long *result)
+{
+    unsigned long long ua = (unsigned long long)a, ub = (unsigned long long)b;
+    switch (op)
+    {
+    case MI_ADD:
+        *result = (long long)(ua + ub);
+        return 1;
+    case MI_SUB:
+        *result = (long long)(ua - ub);
+        return 1;
+    case MI_IMUL:
+        *result = (long long)(ua * ub);
+        return 1;
+    case MI_AND:
+        *result = a & b;
+        return 1;
+    case MI_OR:
+        *result = a | b;
+        return 1;
+    case MI_XOR:
+        *result = a ^ b;
+        return 1;
+    case MI_SHL:
+        *result = (long long)(ua << (b & 63));
+        return 1;
+    case MI_SAR:
+        *result = a >> (b & 63);
+        return 1;
+    case MI_SHR:
+        *result = (long long)(ua >> (b & 63));
+        return 1;
+    case MI_NEG:
+        *result = (long long)(0 - ua);
+        return 1;
+    case MI_NOT:
+        *result = ~a;
+        return 1;
+    case MI_INC:
+        *result = (long long)(ua + 1);
+        return 1;
+    case MI_DEC:
+        *result = (long long)(ua - 1);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int op_value(GvnState *state, MOpcode op, int a, int b)
+{
+    long long folded;
+    if (state->is_const[a] && state->is_const[b] &&
+        fold_constants(op, state->constant[a], state->constant[b], &folded))
+        return const_value(state, folded);
+
+    ValueKey key = {.kind = KEY_OP};
+    key.op = op;
+    key.a = is_commutative(op) && b < a ? b : a;
+    key.b = is_commutative(op) && b < a ? a : b;
+    return lookup_value(state, &key);
+}
+
+/*
+ * Computes the value number an instruction leaves in its 64-bit general-purpose
+ * destination register, for instructions whose only other effect is on the flags.
+ * Returns 0 for anything else.
+ */
+static int pure_def_value(GvnState *state, const MInstr *instr)
+{
+    if (instr->nops < 1 || instr->ops[0].kind != MOPND_REG || instr->ops[0].size != 8)
+        return 0;
+    if (!is_gpr(instr->ops[0].reg) || instr->ops[0].reg == MREG_RSP)
+        return 0;
+
+    const MOperand *dst = &instr->ops[0];
+    const MOperand *src = instr->nops > 1 ? &instr->ops[1] : NULL;
+    if (src && src->kind == MOPND_REG && !is_gpr(src->reg))
+        return 0;
+
+    switch (instr->op)
+    {
+    case MI_MOV:
+        return operand_value(state, src);
+    case MI_MOVZX:
+    {
+        ValueKey key = {.kind = KEY_OP};
+        key.op = MI_MOVZX;
+        key.size = src->size;
+        key.a = operand_value(state, src);
+        return lookup_value(state, &key);
+    }
+    case MI_LEA:
+    {
+        ValueKey key = {.kind = KEY_ADDR};
+        if (src->symbol)
+        {
+            key.symbol = src->symbol;
+            key.imm = src->imm;
+            return lookup_value(state, &key);
+        }
+        key.kind = KEY_OP;
+        key.op = MI_LEA;
+        key.a = src->reg == MREG_NONE ? 0 : state->reg_value[src->reg];
+        key.b = src->index == MREG_NONE ? 0 : state->reg_value[src->index];
+        if ((!key.a || state->is_const[key.a]) && (!key.b || state->is_const[key.b]))
+        {
+            unsigned long long base = key.a ? (unsigned long long)state->constant[key.a] : 0;
+            unsigned long long index = key.b ? (unsigned long long)state->constant[key.b] : 0;
+            return const_value(state, (long long)(base + index * (unsigned long long)(src->scale ? src->scale : 1) +
+                                                  (unsigned long long)src->imm));
+        }
+        key.size = src->scale;
+        key.imm = src->imm;
+        return lookup_value(state, &key);
+    }
+    case MI_XOR:
+        if (mir_operand_equal(dst, src))
+            return const_value(state, 0);
+        return op_value(state, instr->op, state->reg_value[dst->reg], operand_value(state, src));
+    case MI_IMUL:
+        if (instr->nops == 1)
+            return 0;
+        if (instr->nops == 3)
+            return op_value(state, MI_IMUL, operand_value(state, src), operand_value(state, &instr->ops[2]));
+        return op_value(state, MI_IMUL, state->reg_value[dst->reg], operand_value(state, src));
+    case MI_ADD:
+    case MI_SUB:
+    case MI_AND:
+    case MI_OR:
+    case MI_SHL:
+    case MI_SAR:
+    case MI_SHR:
+        if (src->kind == MOPND_REG && src->size != 8 && instr->op != MI_SHL && instr->op != MI_SAR &&
+            instr->op != MI_SHR)
+            return 0;
+        return op_value(state, instr->op, state->reg_value[dst->reg], operand_value(state, src));
+    case MI_NEG:
+    case MI_NOT:
+    case MI_INC:
+    case MI_DEC:
+        return op_value(state, instr->op, state->reg_value[dst->reg], const_value(state, 0));
+    case MI_CMOVCC:
+    {
+        ValueKey key = {.kind = KEY_OP};
+        key.op = MI_CMOVCC;
+        key.cond = instr->cond;
+        key.a = state->flags_value;
+        key.b = state->reg_value[dst->reg];
+        key.c = operand_value(state, src);
+        return lookup_value(state, &key);
+    }
+    default:
+        return 0;
+    }
+}
+
+/* Finds a general-purpose register other than exclude holding a value number. */
+static MReg register_holding(GvnState *state, int value, MReg exclude)
+{
+    for (MReg reg = MREG_RAX; reg <= MREG_R15; reg++)
+    {
+        if (reg != exclude && reg != MREG_RSP && state->reg_value[reg] == value)
+            return reg;
+    }
+    return MREG_NONE;
+}
+
+static MemoryEntry *memory_holding(GvnState *state, int value)
+{
+    for (int i = 0; i < state->memory_count; i++)
+    {
+        if (state->memory[i].value == value && state->memory[i].size == 8)
+            return &state->memory[i];
+    }
+    return NULL;
+}
+
+static void replace_source(MInstr *instr, MOperand source)
+{
+    for (int i = 0; i < instr->nops; i++)
+        free(instr->ops[i].symbol);
+    MReg dest = instr->ops[0].reg;
+    instr->op = MI_MOV;
+    instr->cond = MCOND_NONE;
+    instr->nops = 2;
+    instr->ops[0] = mop_reg(dest);
+    instr->ops[1] = source;
+    instr->ops[2] = (MOperand){0};
+}
+
+/*
+ * A global read as an operand of an ALU instruction, a compare or a divide whose value
+ * is already in a register, or is a constant that fits an imm32, is read from there
+ * instead. Returns 1 if the operand was replaced.
+ */
+static int forward_memory_operand(GvnState *state, MInstr *instr)
+{
+    int slot;
+    switch (instr->op)
+    {
+    case MI_ADD:
+    case MI_SUB:
+    case MI_AND:
+    case MI_OR:
+    case MI_XOR:
+    case MI_CMP:
+        slot = instr->ops[0].kind == MOPND_MEM ? 0 : 1;
+        break;
+    case MI_IMUL:
+        if (instr->nops != 2)
+            return 0;
+        slot = 1;
+        break;
+    case MI_IDIV:
+        slot = 0;
+        break;
+    default:
+        return 0;
+    }
+
+    MOperand *op = &instr->ops[slot];
+    if (op->kind != MOPND_MEM || !op->symbol || op->index != MREG_NONE || op->size != 8)
+        return 0;
+    int value = operand_value(state, op);
+    MReg holder = register_holding(state, value, MREG_NONE);
+    /* Only a register can stand in for the destination of a compare with an immediate or a divisor. */
+    int register_only = instr->op == MI_IDIV || (slot == 0 && instr->ops[1].kind == MOPND_IMM);
+    if (holder != MREG_NONE)
+    {
+        remark(REMARK_PASSED, "gvn", "LoadForwarded", instr->line, "operand %s read from %s", op->symbol,
+               mreg_name(holder, 8));
+        free(op->symbol);
+        *op = mop_reg(holder);
+        return 1;
+    }
+    if (!register_only && slot == 1 && state->is_const[value] && state->constant[value] >= -2147483648LL &&
+        state->constant[value] <= 2147483647LL)
+    {
+        remark(REMARK_PASSED, "gvn", "ConstantPropagated", instr->line, "operand %s replaced by the constant %lld",
+               op->symbol, state->constant[value]);
+        free(op->symbol);
+        *op = mop_imm(state->constant[value]);
+        return 1;
+    }
+    return 0;
+}
+
+static int is_load(const MInstr *instr)
+{
+    return instr->op == MI_MOV && instr->ops[1].kind == MOPND_MEM;
+}
+
+/*
+ * Replaces a pure definition by the cheapest equivalent available: nothing when the
+ * destination already holds the value, a register copy, an immediate, or a load of a
+ * global the value was stored to. Returns 1 if the instruction was changed; a removed
+ * instruction's successor is stored in next.
+ */
+static int try_reuse(MFunction *fn, GvnState *state, MInstr *instr, int value, MInstr **next)
+{
+    MReg dest = instr->ops[0].reg;
+    int plain_copy = instr->op == MI_MOV && instr->ops[1].kind != MOPND_MEM;
+
+    if (mir_writes_flags(instr) && !mir_reg_dead_after(fn, instr, MREG_NONE))
+        return 0;
+
+    if (state->reg_value[dest] == value)
+    {
+        remark(REMARK_PASSED, "gvn", "RedundantRemoved", instr->line,
+               "%s already holds the value", mreg_name(dest, 8));
+        *next = mir_remove(fn, instr);
+        return 1;
+    }
+    if (plain_copy)
+        return 0;
+
+    MReg holder = register_holding(state, value, dest);
+    if (holder != MREG_NONE)
+    {
+        remark(REMARK_PASSED, "gvn", "ValueReused", instr->line,
+               "%s reused from %s", is_load(instr) ? "load" : "expression", mreg_name(holder, 8));
+        replace_source(instr, mop_reg(holder));
+        return 1;
+    }
+    if (state->is_const[value])
+    {
+        remark(REMARK_PASSED, "gvn", "ConstantPropagated", instr->line,
+               "%s replaced by the constant %lld", is_load(instr) ? "load" : "expression",
+               state->constant[value]);
+        replace_source(instr, mop_imm(state->constant[value]));
+        return 1;
+    }
+    MemoryEntry *entry = is_load(instr) ? NULL : memory_holding(state, value);
+    if (entry)
+    {
+        remark(REMARK_PASSED, "gvn", "ExpressionReloaded", instr->line,
+               "expression reloaded from %s", entry->symbol);
+        MOperand source = mop_sym(strdup(entry->symbol), 8);
+        source.imm = entry->disp;
+        replace_source(instr, source);
+        return 1;
+    }
+    return 0;
+}
+
+/* Applies the effects of an instruction that is not a pure register definition. */
+static void apply_effects(GvnState *state, MInstr *instr)
+{
+    switch (instr->op)
+    {
+    case MI_PUSH:
+    {
+        int value = operand_value(state, &instr->ops[0]);
+        if (state->stack_depth < GVN_MAX_STACK)
+            state->stack[state->stack_depth++] = value;
+        else
+            state->stack_depth = 0;
+        return;
+    }
+    case MI_POP:
+    {
+        int value = state->stack_depth > 0 ? state->stack[--state->stack_depth] : fresh_value(state);
+        if (instr->ops[0].kind == MOPND_REG && instr->ops[0].size == 8)
+            state->reg_value[instr->ops[0].reg] = value;
+        else
+            reset_state(state);
+        return;
+    }
+    case MI_CALL:
+    case MI_JMP:
+    case MI_RET:
+        reset_state(state);
+        return;
+    case MI_CMP:
+    case MI_TEST:
+    {
+        ValueKey key = {.kind = KEY_OP};
+        key.op = instr->op;
+        key.size = instr->ops[0].size;
+        key.a = operand_value(state, &instr->ops[0]);
+        key.b = operand_value(state, &instr->ops[1]);
+        state->flags_value = lookup_value(state, &key);
+        return;
+    }
+    case MI_SETCC:
+        if (instr->ops[0].kind == MOPND_REG && is_gpr(instr->ops[0].reg))
+        {
+            ValueKey key = {.kind = KEY_OP};
+            key.op = MI_SETCC;
+            key.cond = instr->cond;
+            key.a = state->flags_value;
+            key.b = state->reg_value[instr->ops[0].reg];
+            state->reg_value[instr->ops[0].reg] = lookup_value(state, &key);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    int writes = 0;
+    if (mir_accesses_memory(instr, &writes) && writes)
+    {
+        const MOperand *dst = &instr->ops[0];
+        if (dst->kind == MOPND_MEM && dst->symbol && dst->index == MREG_NONE)
+        {
+            int stored = instr->op == MI_MOV && dst->size == 8 ? operand_value(state, &instr->ops[1]) : 0;
+            forget_memory(state, dst->symbol);
+            if (stored)
+                record_memory(state, dst, stored);
+        }
+        else if (dst->kind == MOPND_MEM && dst->reg == MREG_RSP)
+            state->stack_depth = 0;
+        else
+            forget_memory(state, mir_addressed_symbol(instr, dst));
+    }
+
+    for (MReg reg = MREG_RAX; reg < MREG_RIP; reg++)
+    {
+        if (mir_writes_reg(instr, reg))
+            state->reg_value[reg] = fresh_value(state);
+    }
+    if (mir_writes_reg(instr, MREG_RSP))
+        state->stack_depth = 0;
+    if (mir_writes_flags(instr))
+        state->flags_value = fresh_value(state);
+}
+
+static int number_values(MFunction *fn, GvnState *state)
+{
+    int changes = 0;
+    reset_state(state);
+
+    for (MInstr *instr = fn->head; instr;)
+    {
+        MInstr *next = instr->next;
+
+        if (instr->op == MI_LABEL)
+        {
+            if (mir_label_is_referenced(fn, instr))
+                reset_state(state);
+        }
+        else if (instr->op != MI_DIRECTIVE)
+        {
+            changes += forward_memory_operand(state, instr);
+            int value = pure_def_value(state, instr);
+            if (value)
+            {
+                /* Whether removed or rewritten, the destination ends up holding the value. */
+                MReg dest = instr->ops[0].reg;
+                changes += try_reuse(fn, state, instr, value, &next);
+                state->reg_value[dest] = value;
+            }
+            else
+                apply_effects(state, instr);
+        }
+        instr = next;
+    }
+    return changes;
+}
+
+int run_gvn(MFunction *fn, PassContext *ctx)
+{
+    (void)ctx;
+    GvnState state;
+    memset(&state, 0, sizeof(state));
+    state.next_value = 1;
+
+    int changes = number_values(fn, &state);
+    int values = state.next_value - 1;
+    if (changes > 0)
+    {
+        int removed = mir_remove_dead_code(fn);
+        if (removed > 0)
+            remark(REMARK_PASSED, "gvn", "DeadCodeRemoved", 0, "%d instructions left unused were removed", removed);
+        changes += removed;
+    }
+
+    remark(REMARK_ANALYSIS, "gvn", "ValueNumbers", 0, "%d value numbers, %d instructions rewritten or removed",
+           values, changes);
+
+    for (int i = 0; i < GVN_HASH_BUCKETS; i++)
+    {
+        for (ValueKey *key = state.buckets[i]; key;)
+        {
+            ValueKey *next = key->next;
+            free(key->symbol);
+            free(key);
+            key = next;
+        }
+    }
+    forget_memory(&state, NULL);
+    free(state.is_const);
+    free(state.constant);
+    return changes;
+}
@@ -0,0 +1,655 @@
+/**
+ * @file isel.c
+ * @brief Tree-pattern instruction selection for the SEG language compiler.
+ *        The labeler walks an expression bottom-up and records, for each node and
+ *        each nonterminal (a value in rax, an immediate, a memory operand, a scaled
+ *        index), the cheapest rule producing it, with costs taken from the rule and
+ *        operator tables below. The reducer then emits the chosen tiles top-down.
+ *        Tiles fold literals into imm32 operands and variables into [rip + name]
+ *        operands (cmp qword ptr [rip + a], 10 needs no load at all), use lea for
+ *        add-and-scale, and, when enabled, the superoptimized kernels of superopt.h.
+ *        Array elements with a constant index are [rip + name + 8k] operands like
+ *        variables; other elements are loaded from [rcx + rax*8 + 8k], with the array
+ *        address in rcx and the variable part of the index in rax, or from [rcx + 8k]
+ *        when ivopt keeps the address in a pointer variable.
+ *        Shorter encodings of the selected instructions are picked later by the
+ *        shrink pass.
+ * @author Dario Romandini
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "isel.h"
+#include "superopt.h"
+#include "token.h"
+
+#define ISEL_INFINITE (INT_MAX / 4)
+
+typedef enum
+{
+    NT_REG,    ///< Value in rax
+    NT_IMM,    ///< Literal that fits a sign-extended imm32
+    NT_MEM,    ///< Integer variable or constant-index element, addressed as [rip + name + disp]
+    NT_SCALED, ///< Value times 2, 4 or 8, usable as a scaled index
+    NT_COUNT
+} Nonterminal;
+
+typedef enum
+{
+    RULE_NONE,
+    RULE_LOAD_IMM,    ///< reg <- imm                  mov rax, imm
+    RULE_LOAD_MEM,    ///< reg <- mem                  mov rax, [rip + name]
+    RULE_LEAF,        ///< reg <- float/string value   code generator
+    RULE_LOAD_ELEMENT, ///< reg <- a[reg + k]           lea rcx, [rip + a] / mov rax, [rcx + rax*8 + 8k]
+    RULE_OPERAND,     ///< imm, mem                    folded into the user
+    RULE_OP_IMM,      ///< reg <- op(reg, imm)         op rax, imm
+    RULE_OP_MEM,      ///< reg <- op(reg, mem)         op rax, [rip + name]
+    RULE_OP_SWAPPED,  ///< reg <- op(imm|mem, reg)     op rax, left (commutative or mirrored compare)
+    RULE_SUB_SWAPPED, ///< reg <- -(imm|mem, reg)      neg rax / add rax, left
+    RULE_OP_REG,      ///< reg <- op(reg, reg)         push / pop rbx / op rax, rbx
+    RULE_CMP_MEM_IMM, ///< reg <- cmp(mem, imm)        cmp qword ptr [rip + name], imm / setcc
+    RULE_NOT,         ///< reg <- !(reg)               cmp rax, 0 / sete
+    RULE_NOT_MEM,     ///< reg <- !(mem)               cmp qword ptr [rip + name], 0 / sete
+    RULE_PASS,        ///< reg <- unary(reg)           operand only
+    RULE_SCALE,       ///< scaled <- *(reg, 2|4|8)     folded into an address
+    RULE_LEA_INDEX,   ///< reg <- +(reg, scaled)       push / pop rbx / lea rax, [rax + rbx*s]
+    RULE_LEA_DISP,    ///< reg <- +(scaled, imm)       lea rax, [rax*s + imm]
+    RULE_KERNEL,      ///< reg <- superopt kernel      table sequence
+    RULE_COUNT
+} Rule;
+
+/* Instructions a rule adds besides its operands and the operator itself. */
+static const int rule_overhead[RULE_COUNT] = {
+    [RULE_LOAD_IMM] = 1, [RULE_LOAD_MEM] = 1,   [RULE_LEAF] = 1,      [RULE_SUB_SWAPPED] = 1,
+    [RULE_OP_REG] = 2,   [RULE_LEA_INDEX] = 3,  [RULE_LEA_DISP] = 1,  [RULE_LOAD_ELEMENT] = 2,
+};
+
+typedef enum
+{
+    OPERAND_REG,
+    OPERAND_IMM,
+    OPERAND_MEM
+} OperandKind;
+
+typedef struct Label
+{
+    int cost[NT_COUNT];
+    Rule rule[NT_COUNT];
+    int swapped;                    ///< RULE_OP_SWAPPED, RULE_SUB_SWAPPED, RULE_LEA_*: the operands trade places
+    int scale_swapped;              ///< RULE_SCALE: the scale is the left operand
+    long long value;                ///< Literal value (NT_IMM), scale (NT_SCALED) or element offset (AST_INDEX)
+    struct Label *left;
+    struct Label *right;
+    const SuperoptKernel *kernel;   ///< RULE_KERNEL
+    ASTNode *x;
+    ASTNode *y;
+} Label;
+
+typedef struct
+{
+    MFunction *fn;
+    Symbol *symbols;
+    int kernels;
+    IselLeafGenerator leaf;
+} Isel;
+
+static int is_compare(TokenType op)
+{
+    return op == TOKEN_EQ || op == TOKEN_NEQ || op == TOKEN_LT || op == TOKEN_LEQ || op == TOKEN_GT ||
+           op == TOKEN_GEQ;
+}
+
+static int is_commutative(TokenType op)
+{
+    return op == TOKEN_PLUS || op == TOKEN_STAR || op == TOKEN_AND || op == TOKEN_OR || op == TOKEN_XOR ||
+           op == TOKEN_EQ || op == TOKEN_NEQ;
+}
+
+/* Instructions an operator takes once its left operand is in rax and its right one is ready. */
+static int operator_cost(TokenType op, OperandKind right)
+{
+    switch (op)
+    {
+    case TOKEN_SLASH:
+        return 2 + (right == OPERAND_IMM);
+    case TOKEN_PERCENT:
+        return 3 + (right == OPERAND_IMM);
+    case TOKEN_EQ:
+    case TOKEN_NEQ:
+    case TOKEN_LT:
+    case TOKEN_LEQ:
+    case TOKEN_GT:
+    case TOKEN_GEQ:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+static MCond compare_condition(TokenType op)
+{
+    switch (op)
+    {
+    case TOKEN_EQ:
+        return MCOND_E;
+    case TOKEN_NEQ:
+        return MCOND_NE;
+    case TOKEN_LT:
+        return MCOND_L;
+    case TOKEN_LEQ:
+        return MCOND_LE;
+    case TOKEN_GT:
+        return MCOND_G;
+    default:
+        return MCOND_GE;
+    }
+}
+
+static int integer_literal(ASTNode *node, long long *value)
+{
+    if (node->type != AST_LITERAL)
+        return 0;
+    switch (node->result_type)
+    {
+    case TYPE_INT:
+        *value = strtoll(node->literal.value, NULL, 10);
+        return 1;
+    case TYPE_BOOL:
+        *value = strcmp(node->literal.value, "true") == 0;
+        return 1;
+    case TYPE_CHAR:
+        *value = (unsigned char)node->literal.value[0];
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int integer_variable(Isel *isel, ASTNode *node)
+{
+    if (node->type != AST_IDENTIFIER)
+        return 0;
+    Symbol *sym = lookup_symbol(isel->symbols, node->identifier.name);
+    if (!sym)
+    {
+        fprintf(stderr, "[Codegen Error] Undefined variable: %s\n", node->identifier.name);
+        exit(1);
+    }
+    return sym->type != TYPE_FLOAT && sym->type != TYPE_STRING;
+}
+
+/* Displacements of element operands are 32-bit. */
+#define MAX_ELEMENT_OFFSET (1LL << 27)
+
+ASTNode *isel_split_index(ASTNode *index, const Symbol *array, int line, long long *offset)
+{
+    long long value;
+    if (integer_literal(index, &value))
+    {
+        if (value < 0 || value >= array->length)
+        {
+            fprintf(stderr, "[Codegen Error] Index %lld is out of bounds for array '%.*s' of %d elements (line %d)\n",
+                    value, (int)strcspn(array->name, "."), array->name, array->length, line);
+            exit(1);
+        }
+        *offset = value;
+        return NULL;
+    }
+    if (index->type == AST_BINARY_EXPR &&
+        (index->binary_expr.op == TOKEN_PLUS || index->binary_expr.op == TOKEN_MINUS) &&
+        integer_literal(index->binary_expr.right, &value) && value > -MAX_ELEMENT_OFFSET && value < MAX_ELEMENT_OFFSET)
+    {
+        *offset = index->binary_expr.op == TOKEN_PLUS ? value : -value;
+        return index->binary_expr.left;
+    }
+    *offset = 0;
+    return index;
+}
+
+/* Labeling */
+
+static void consider(Label *label, Nonterminal nt, Rule rule, int cost, int swapped)
+{
+    if (cost < label->cost[nt])
+    {
+        label->cost[nt] = cost;
+        label->rule[nt] = rule;
+        if (nt == NT_REG)
+            label->swapped = swapped;
+    }
+}
+
+static Label *find_label(ASTNode *node, Label *label, ASTNode *target)
+{
+    if (node == target)
+        return label;
+    Label *found = NULL;
+    if (node->type == AST_BINARY_EXPR)
+    {
+        found = find_label(node->binary_expr.left, label->left, target);
+        if (!found)
+            found = find_label(node->binary_expr.right, label->right, target);
+    }
+    else if (node->type == AST_UNARY_EXPR)
+        found = find_label(node->unary_expr.operand, label->left, target);
+    return found;
+}
+
+static void label_binary(Label *label, TokenType op, Label *left, Label *right)
+{
+    int commutative = is_commutative(op);
+    int compare = is_compare(op);
+
+    /* Right operand folded into the instruction. */
+    consider(label, NT_REG, RULE_OP_IMM, left->cost[NT_REG] + right->cost[NT_IMM] + operator_cost(op, OPERAND_IMM), 0);
+    consider(label, NT_REG, RULE_OP_MEM, left->cost[NT_REG] + right->cost[NT_MEM] + operator_cost(op, OPERAND_MEM), 0);
+
+    /* Left operand folded, by commuting or mirroring the operator. */
+    if (commutative || compare)
+    {
+        TokenType mirrored = mirror_comparison(op);
+        consider(label, NT_REG, RULE_OP_SWAPPED,
+                 right->cost[NT_REG] + left->cost[NT_IMM] + operator_cost(mirrored, OPERAND_IMM), 1);
+        consider(label, NT_REG, RULE_OP_SWAPPED,
+                 right->cost[NT_REG] + left->cost[NT_MEM] + operator_cost(mirrored, OPERAND_MEM), 1);
+    }
+    if (op == TOKEN_MINUS)
+    {
+        int folded = left->cost[NT_IMM] < left->cost[NT_MEM] ? left->cost[NT_IMM] : left->cost[NT_MEM];
+        consider(label, NT_REG, RULE_SUB_SWAPPED, right->cost[NT_REG] + folded + rule_overhead[RULE_SUB_SWAPPED] + 1, 1);
+    }
+    if (compare)
+        consider(label, NT_REG, RULE_CMP_MEM_IMM, left->cost[NT_MEM] + right->cost[NT_IMM] + operator_cost(op, OPERAND_MEM), 0);
+
+    consider(label, NT_REG, RULE_OP_REG,
+             left->cost[NT_REG] + right->cost[NT_REG] + rule_overhead[RULE_OP_REG] + operator_cost(op, OPERAND_REG), 0);
+
+    if (op == TOKEN_STAR)
+    {
+        for (int swapped = 0; swapped <= 1; swapped++)
+        {
+            Label *index = swapped ? right : left;
+            Label *scale = swapped ? left : right;
+            if (scale->rule[NT_IMM] == RULE_OPERAND && (scale->value == 2 || scale->value == 4 || scale->value == 8) &&
+                index->cost[NT_REG] < label->cost[NT_SCALED])
+            {
+                label->cost[NT_SCALED] = index->cost[NT_REG];
+                label->rule[NT_SCALED] = RULE_SCALE;
+                label->value = scale->value;
+                label->scale_swapped = swapped;
+            }
+        }
+    }
+    if (op == TOKEN_PLUS)
+    {
+        for (int swapped = 0; swapped <= 1; swapped++)
+        {
+            Label *base = swapped ? right : left;
+            Label *scaled = swapped ? left : right;
+            consider(label, NT_REG, RULE_LEA_INDEX,
+                     base->cost[NT_REG] + scaled->cost[NT_SCALED] + rule_overhead[RULE_LEA_INDEX], swapped);
+            consider(label, NT_REG, RULE_LEA_DISP,
+                     scaled->cost[NT_SCALED] + base->cost[NT_IMM] + rule_overhead[RULE_LEA_DISP], swapped);
+        }
+    }
+}
+
+static Label *label_tree(Isel *isel, ASTNode *node)
+{
+    Label *label = calloc(1, sizeof(Label));
+    for (int nt = 0; nt < NT_COUNT; nt++)
+        label->cost[nt] = ISEL_INFINITE;
+
+    long long value;
+    switch (node->type)
+    {
+    case AST_LITERAL:
+        if (integer_literal(node, &value))
+        {
+            if (value >= INT_MIN && value <= INT_MAX)
+            {
+                consider(label, NT_IMM, RULE_OPERAND, 0, 0);
+                label->value = value;
+            }
+            consider(label, NT_REG, RULE_LOAD_IMM, rule_overhead[RULE_LOAD_IMM], 0);
+        }
+        else
+            consider(label, NT_REG, RULE_LEAF, rule_overhead[RULE_LEAF], 0);
+        break;
+    case AST_IDENTIFIER:
+        if (integer_variable(isel, node))
+        {
+            consider(label, NT_MEM, RULE_OPERAND, 0, 0);
+            consider(label, NT_REG, RULE_LOAD_MEM, rule_overhead[RULE_LOAD_MEM], 0);
+        }
+        else
+            consider(label, NT_REG, RULE_LEAF, rule_overhead[RULE_LEAF], 0);
+        break;
+    case AST_INDEX:
+    {
+        Symbol *sym = lookup_symbol(isel->symbols, node->index.name);
+        if (node->index.pointer)
+        {
+            integer_literal(node->index.index, &label->value);
+            consider(label, NT_REG, RULE_LOAD_ELEMENT, rule_overhead[RULE_LOAD_ELEMENT], 0);
+            break;
+        }
+        ASTNode *variable = isel_split_index(node->index.index, sym, node->line, &label->value);
+        if (variable)
+        {
+            label->left = label_tree(isel, variable);
+            consider(label, NT_REG, RULE_LOAD_ELEMENT, label->left->cost[NT_REG] + rule_overhead[RULE_LOAD_ELEMENT], 0);
+        }
+        else if (sym->type == TYPE_INT)
+        {
+            consider(label, NT_MEM, RULE_OPERAND, 0, 0);
+            consider(label, NT_REG, RULE_LOAD_MEM, rule_overhead[RULE_LOAD_MEM], 0);
+        }
+        else
+            consider(label, NT_REG, RULE_LOAD_ELEMENT, 1, 0);
+        break;
+    }
+    case AST_BINARY_EXPR:
+    {
+        Label *left = label_tree(isel, node->binary_expr.left);
+        Label *right = label_tree(isel, node->binary_expr.right);
+        if (node->result_type == TYPE_FLOAT)
+            consider(label, NT_REG, RULE_OP_REG, left->cost[NT_REG] + right->cost[NT_REG] + rule_overhead[RULE_OP_REG] + 1, 0);
+        else
+            label_binary(label, node->binary_expr.op, left, right);
+        label->left = left;
+        label->right = right;
+        break;
+    }
+    case AST_UNARY_EXPR:
+        label->left = label_tree(isel, node->unary_expr.operand);
+        if (node->unary_expr.op == TOKEN_NOT)
+        {
+            consider(label, NT_REG, RULE_NOT, label->left->cost[NT_REG] + 3, 0);
+            consider(label, NT_REG, RULE_NOT_MEM, label->left->cost[NT_MEM] + 3, 0);
+        }
+        else
+            consider(label, NT_REG, RULE_PASS, label->left->cost[NT_REG], 0);
+        break;
+    default:
+        fprintf(stderr, "[Codegen Error] Unsupported expression node: %d\n", node->type);
+        exit(1);
+    }
+
+    if (isel->kernels)
+    {
+        ASTNode *x, *y;
+        const SuperoptKernel *kernel = superopt_match(node, isel->symbols, &x, &y);
+        if (kernel)
+        {
+            int cost = superopt_length(kernel) + find_label(node, label, x)->cost[NT_REG];
+            if (y)
+                cost += find_label(node, label, y)->cost[NT_REG] + 2;
+            if (cost < label->cost[NT_REG])
+            {
+                consider(label, NT_REG, RULE_KERNEL, cost, 0);
+                label->kernel = kernel;
+                label->x = x;
+                label->y = y;
+            }
+        }
+    }
+    return label;
+}
+
+static void free_label(Label *label)
+{
+    if (!label)
+        return;
+    free_label(label->left);
+    free_label(label->right);
+    free(label);
+}
+
+/* Reduction */
+
+static void reduce(Isel *isel, ASTNode *node, Label *label);
+
+/* [rip + name] for a variable, [rip + name + 8k] for an element with a constant index. */
+static MOperand variable_operand(ASTNode *node, Label *label)
+{
+    if (node->type != AST_INDEX)
+        return mop_sym(node->identifier.name, 8);
+    MOperand element = mop_sym(node->index.name, 8);
+    element.imm = 8 * label->value;
+    return element;
+}
+
+static MOperand operand(ASTNode *node, Label *label, Nonterminal nt)
+{
+    if (nt == NT_IMM)
+        return mop_imm(label->value);
+    return variable_operand(node, label);
+}
+
+/*
+ * The address of an element; a computed index is evaluated into rax and the array address put in
+ * rcx. An element read through a pointer variable is at [rcx + 8k] once the pointer is in rcx.
+ */
+static MOperand element_operand(Isel *isel, ASTNode *node, Label *label)
+{
+    if (node->index.pointer)
+    {
+        mir_emit(isel->fn, MI_MOV, 2, mop_reg(MREG_RCX), mop_sym(node->index.pointer, 8));
+        return mop_mem(MREG_RCX, 8 * label->value, 8);
+    }
+    if (!label->left)
+        return variable_operand(node, label);
+
+    long long offset;
+    ASTNode *variable = isel_split_index(node->index.index, lookup_symbol(isel->symbols, node->index.name),
+                                         node->line, &offset);
+    reduce(isel, variable, label->left);
+    mir_emit(isel->fn, MI_LEA, 2, mop_reg(MREG_RCX), mop_sym(node->index.name, 8));
+    MOperand element = mop_mem(MREG_RCX, 8 * offset, 8);
+    element.index = MREG_RAX;
+    element.scale = 8;
+    return element;
+}
+
+/* The cheaper of the folded operand forms of a node. */
+static Nonterminal folded_form(Label *label)
+{
+    return label->cost[NT_IMM] <= label->cost[NT_MEM] ? NT_IMM : NT_MEM;
+}
+
+/* rax = rax op source, for a source that is rbx, an immediate or a memory operand. */
+static void apply_operator(Isel *isel, TokenType op, MOperand source)
+{
+    MFunction *fn = isel->fn;
+    switch (op)
+    {
+    case TOKEN_PLUS:
+        mir_emit(fn, MI_ADD, 2, mop_reg(MREG_RAX), source);
+        break;
+    case TOKEN_MINUS:
+        mir_emit(fn, MI_SUB, 2, mop_reg(MREG_RAX), source);
+        break;
+    case TOKEN_STAR:
+        if (source.kind == MOPND_IMM)
+            mir_emit(fn, MI_IMUL, 3, mop_reg(MREG_RAX), mop_reg(MREG_RAX), source);
+        else
+            mir_emit(fn, MI_IMUL, 2, mop_reg(MREG_RAX), source);
+        break;
+    case TOKEN_SLASH:
+    case TOKEN_PERCENT:
+        /* idiv has no immediate form; the divisor goes to rbx, where strength reduction finds it. */
+        if (source.kind == MOPND_IMM)
+        {
+            mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RBX), source);
+            source = mop_reg(MREG_RBX);
+        }
+        mir_emit(fn, MI_CQO, 0);
+        mir_emit(fn, MI_IDIV, 1, source);
+        if (op == TOKEN_PERCENT)
+            mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_reg(MREG_RDX));
+        break;
+    case TOKEN_AND:
+        mir_emit(fn, MI_AND, 2, mop_reg(MREG_RAX), source);
+        break;
+    case TOKEN_OR:
+        mir_emit(fn, MI_OR, 2, mop_reg(MREG_RAX), source);
+        break;
+    case TOKEN_XOR:
+        mir_emit(fn, MI_XOR, 2, mop_reg(MREG_RAX), source);
+        break;
+    case TOKEN_EQ:
+    case TOKEN_NEQ:
+    case TOKEN_LT:
+    case TOKEN_LEQ:
+    case TOKEN_GT:
+    case TOKEN_GEQ:
+        mir_emit(fn, MI_CMP, 2, mop_reg(MREG_RAX), source);
+        mir_emit_cond(fn, MI_SETCC, compare_condition(op), 1, mop_reg_sized(MREG_RAX, 1));
+        mir_emit(fn, MI_MOVZX, 2, mop_reg(MREG_RAX), mop_reg_sized(MREG_RAX, 1));
+        break;
+    default:
+        fprintf(stderr, "[Codegen Error] Unsupported binary operator: %s\n", token_type_to_string(op));
+        exit(1);
+    }
+}
+
+/* Evaluates the right operand, then the left, leaving them in rbx and rax. */
+static void reduce_pair(Isel *isel, ASTNode *left, Label *left_label, ASTNode *right, Label *right_label)
+{
+    reduce(isel, right, right_label);
+    mir_emit(isel->fn, MI_PUSH, 1, mop_reg(MREG_RAX));
+    reduce(isel, left, left_label);
+    mir_emit(isel->fn, MI_POP, 1, mop_reg(MREG_RBX));
+}
+
+static MOperand scaled_address(MReg base, long long scale, long long displacement)
+{
+    MOperand address = mop_mem(base, displacement, 8);
+    address.index = MREG_RAX;
+    address.scale = (int)scale;
+    return address;
+}
+
+static void reduce_lea(Isel *isel, ASTNode *node, Label *label)
+{
+    ASTNode *base = label->swapped ? node->binary_expr.right : node->binary_expr.left;
+    ASTNode *scaled = label->swapped ? node->binary_expr.left : node->binary_expr.right;
+    Label *base_label = label->swapped ? label->right : label->left;
+    Label *scaled_label = label->swapped ? label->left : label->right;
+    ASTNode *index = scaled_label->scale_swapped ? scaled->binary_expr.right : scaled->binary_expr.left;
+    Label *index_label = scaled_label->scale_swapped ? scaled_label->right : scaled_label->left;
+
+    if (label->rule[NT_REG] == RULE_LEA_DISP)
+    {
+        reduce(isel, index, index_label);
+        mir_emit(isel->fn, MI_LEA, 2, mop_reg(MREG_RAX), scaled_address(MREG_NONE, scaled_label->value, base_label->value));
+        return;
+    }
+
+    /* lea rax, [rbx + rax*s]: the index is evaluated last, into rax. */
+    reduce(isel, base, base_label);
+    mir_emit(isel->fn, MI_PUSH, 1, mop_reg(MREG_RAX));
+    reduce(isel, index, index_label);
+    mir_emit(isel->fn, MI_POP, 1, mop_reg(MREG_RBX));
+    mir_emit(isel->fn, MI_LEA, 2, mop_reg(MREG_RAX), scaled_address(MREG_RBX, scaled_label->value, 0));
+}
+
+static void reduce(Isel *isel, ASTNode *node, Label *label)
+{
+    MFunction *fn = isel->fn;
+
+    switch (label->rule[NT_REG])
+    {
+    case RULE_LOAD_IMM:
+    {
+        long long value = 0;
+        integer_literal(node, &value);
+        mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_imm(value));
+        break;
+    }
+    case RULE_LOAD_MEM:
+        mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), variable_operand(node, label));
+        break;
+    case RULE_LOAD_ELEMENT:
+    {
+        MOperand element = element_operand(isel, node, label);
+        if (lookup_symbol(isel->symbols, node->index.name)->type == TYPE_FLOAT)
+            mir_emit(fn, MI_MOVSD, 2, mop_reg(MREG_XMM0), element);
+        else
+            mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), element);
+        break;
+    }
+    case RULE_LEAF:
+        isel->leaf(node, fn, isel->symbols);
+        break;
+    case RULE_OP_IMM:
+    case RULE_OP_MEM:
+        reduce(isel, node->binary_expr.left, label->left);
+        apply_operator(isel, node->binary_expr.op,
+                       operand(node->binary_expr.right, label->right,
+                               label->rule[NT_REG] == RULE_OP_IMM ? NT_IMM : NT_MEM));
+        break;
+    case RULE_OP_SWAPPED:
+        reduce(isel, node->binary_expr.right, label->right);
+        apply_operator(isel, mirror_comparison(node->binary_expr.op),
+                       operand(node->binary_expr.left, label->left, folded_form(label->left)));
+        break;
+    case RULE_SUB_SWAPPED:
+        reduce(isel, node->binary_expr.right, label->right);
+        mir_emit(fn, MI_NEG, 1, mop_reg(MREG_RAX));
+        apply_operator(isel, TOKEN_PLUS, operand(node->binary_expr.left, label->left, folded_form(label->left)));
+        break;
+    case RULE_OP_REG:
+        reduce_pair(isel, node->binary_expr.left, label->left, node->binary_expr.right, label->right);
+        apply_operator(isel, node->binary_expr.op, mop_reg(MREG_RBX));
+        break;
+    case RULE_CMP_MEM_IMM:
+        mir_emit(fn, MI_CMP, 2, variable_operand(node->binary_expr.left, label->left), mop_imm(label->right->value));
+        mir_emit_cond(fn, MI_SETCC, compare_condition(node->binary_expr.op), 1, mop_reg_sized(MREG_RAX, 1));
+        mir_emit(fn, MI_MOVZX, 2, mop_reg(MREG_RAX), mop_reg_sized(MREG_RAX, 1));
+        break;
+    case RULE_NOT:
+        reduce(isel, node->unary_expr.operand, label->left);
+        mir_emit(fn, MI_CMP, 2, mop_reg(MREG_RAX), mop_imm(0));
+        mir_emit_cond(fn, MI_SETCC, MCOND_E, 1, mop_reg_sized(MREG_RAX, 1));
+        mir_emit(fn, MI_MOVZX, 2, mop_reg(MREG_RAX), mop_reg_sized(MREG_RAX, 1));
+        break;
+    case RULE_NOT_MEM:
+        mir_emit(fn, MI_CMP, 2, variable_operand(node->unary_expr.operand, label->left), mop_imm(0));
+        mir_emit_cond(fn, MI_SETCC, MCOND_E, 1, mop_reg_sized(MREG_RAX, 1));
+        mir_emit(fn, MI_MOVZX, 2, mop_reg(MREG_RAX), mop_reg_sized(MREG_RAX, 1));
+        break;
+    case RULE_PASS:
+        reduce(isel, node->unary_expr.operand, label->left);
+        break;
+    case RULE_LEA_INDEX:
+    case RULE_LEA_DISP:
+        reduce_lea(isel, node, label);
+        break;
+    case RULE_KERNEL:
+        if (label->y)
+        {
+            reduce(isel, label->y, find_label(node, label, label->y));
+            mir_emit(fn, MI_PUSH, 1, mop_reg(MREG_RAX));
+        }
+        reduce(isel, label->x, find_label(node, label, label->x));
+        if (label->y)
+            mir_emit(fn, MI_POP, 1, mop_reg(MREG_RBX));
+        superopt_emit(label->kernel, fn, node->line);
+        break;
+    default:
+        fprintf(stderr, "[Codegen Error] No instruction pattern covers expression node: %d\n", node->type);
+        exit(1);
+    }
+}
+
+void isel_expression(ASTNode *node, MFunction *fn, Symbol *symbols, int kernels, IselLeafGenerator leaf)
+{
+    Isel isel = {fn, symbols, kernels, leaf};
+    Label *label = label_tree(&isel, node);
+    reduce(&isel, node, label);
+    free_label(label);
+}
@@ -0,0 +1,589 @@
+/**
+ * @file ivopt.c
+ * @brief Induction-variable optimization for the SEG language compiler.
+ *        Works on counted loops: the loop variable steps by a constant and the condition
+ *        compares it with a bound the loop does not change. An array index that is an affine
+ *        function k*i + base + c of the variable is a derived induction variable; the accesses
+ *        of one array with the same k and base share a pointer that the preheader sets to the
+ *        address of a[k*i + base] and the update advances by 8*k*step bytes, so each access is
+ *        [pointer + 8c] with no index computation. A loop variable that is then only used to
+ *        count the iterations is redundant: the exit test becomes a countdown of the trip
+ *        count, computed in the preheader, to zero, and the variable is no longer updated.
+ *        Pointers are only installed when they remove the variable and save more index
+ *        arithmetic than advancing them costs.
+ * @author Dario Romandini
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+#include "token.h"
+
+/* Scales whose products with each other, with the step of a counted loop and with 8 stay far from overflow. */
+#define MAX_SCALE (1LL << 20)
+
+/* Element offsets of pointer accesses become 32-bit displacements, as in isel. */
+#define MAX_ELEMENT_OFFSET (1LL << 27)
+
+/* An array index scale*i + base + offset, with base invariant in the loop. */
+typedef struct
+{
+    long long scale;
+    long long offset;
+    const ASTNode *base; ///< Invariant part, or NULL
+} Affine;
+
+/* The pointer shared by the accesses of one array with the same scale and base. */
+typedef struct
+{
+    const char *array;
+    long long scale;
+    ASTNode *base; ///< Copy of the invariant part of the index, or NULL
+    char *name;    ///< Variable holding the address of array[scale*i + base], once selected
+    int accesses;  ///< Element reads and writes it would address
+    int reads;     ///< Reads of the loop variable in their indices
+    int line;
+    int column;
+} Pointer;
+
+/*
+ * The pointers of one loop. A first walk only groups the accesses, so that the pointers that
+ * pay for themselves can be selected; a second walk rewrites the accesses of those.
+ */
+typedef struct
+{
+    const CountedLoop *loop;
+    Pointer *items;
+    int count;
+    int capacity;
+    int rewrite; ///< Set for the second walk
+} PointerSet;
+
+static int temp_counter = 0;
+
+static int within_limit(long long value, long long limit)
+{
+    return value < limit && value > -limit;
+}
+
+/*
+ * Splits an index into scale*i + base + offset. Literal factors and addends are folded into
+ * the scale and the offset; one invariant addend that cannot fault becomes the base.
+ */
+static int decompose(const ASTNode *node, const CountedLoop *loop, Affine *affine)
+{
+    Affine left, right;
+    long long value;
+    affine->scale = 0;
+    affine->offset = 0;
+    affine->base = NULL;
+
+    if (integer_literal_value(node, &value))
+    {
+        affine->offset = value;
+        return within_limit(value, MAX_ELEMENT_OFFSET);
+    }
+    if (is_counter(node, loop->counter))
+    {
+        affine->scale = 1;
+        return 1;
+    }
+    if (node->type == AST_BINARY_EXPR)
+    {
+        const ASTNode *a = node->binary_expr.left, *b = node->binary_expr.right;
+        switch (node->binary_expr.op)
+        {
+        case TOKEN_PLUS:
+            if (!decompose(a, loop, &left) || !decompose(b, loop, &right) || (left.base && right.base))
+                return 0;
+            affine->scale = left.scale + right.scale;
+            affine->offset = left.offset + right.offset;
+            affine->base = left.base ? left.base : right.base;
+            return within_limit(affine->scale, MAX_SCALE) && within_limit(affine->offset, MAX_ELEMENT_OFFSET);
+        case TOKEN_MINUS:
+            if (!decompose(a, loop, &left) || !decompose(b, loop, &right) || right.base)
+                return 0;
+            affine->scale = left.scale - right.scale;
+            affine->offset = left.offset - right.offset;
+            affine->base = left.base;
+            return within_limit(affine->scale, MAX_SCALE) && within_limit(affine->offset, MAX_ELEMENT_OFFSET);
+        case TOKEN_STAR:
+            if (integer_literal_value(a, &value))
+                a = b;
+            else if (!integer_literal_value(b, &value))
+                break;
+            if (!within_limit(value, MAX_SCALE) || !decompose(a, loop, &left) || left.base)
+                return 0;
+            affine->scale = left.scale * value;
+            affine->offset = left.offset * value;
+            return within_limit(affine->scale, MAX_SCALE) && within_limit(affine->offset, MAX_ELEMENT_OFFSET);
+        default:
+            break;
+        }
+    }
+    if (node->result_type != TYPE_INT || !is_loop_invariant(node, loop->node) || may_trap(node))
+        return 0;
+    affine->base = node;
+    return 1;
+}
+
+/* Copies an invariant expression; only the node kinds is_invariant accepts occur. */
+static ASTNode *clone_expression(const ASTNode *node)
+{
+    ASTNode *copy;
+    switch (node->type)
+    {
+    case AST_LITERAL:
+        copy = create_literal_node(node->literal.value, node->result_type);
+        break;
+    case AST_IDENTIFIER:
+        copy = create_identifier_node(node->identifier.name);
+        break;
+    case AST_BINARY_EXPR:
+        copy = create_binary_expr_node(node->binary_expr.op, clone_expression(node->binary_expr.left),
+                                       clone_expression(node->binary_expr.right));
+        break;
+    case AST_UNARY_EXPR:
+        copy = create_unary_expr_node(node->unary_expr.op, clone_expression(node->unary_expr.operand));
+        break;
+    default:
+        copy = create_index_node(node->index.name, clone_expression(node->index.index));
+        break;
+    }
+    copy->result_type = node->result_type;
+    return set_node_location(copy, node->line, node->column);
+}
+
+/* "ivoptN.array", which tells the IR passes which array the accesses through it reach. */
+static char *new_pointer(const char *array)
+{
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer), "ivopt%d.%s", ++temp_counter, array);
+    return strdup_safe(buffer);
+}
+
+static ASTNode *integer_literal(long long value, const ASTNode *origin)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%lld", value);
+    ASTNode *node = create_literal_node(buffer, TYPE_INT);
+    return set_node_location(node, origin->line, origin->column);
+}
+
+static ASTNode *variable_reference(const char *name, const ASTNode *origin)
+{
+    ASTNode *node = create_identifier_node(name);
+    node->result_type = TYPE_INT;
+    return set_node_location(node, origin->line, origin->column);
+}
+
+static ASTNode *arithmetic(TokenType op, ASTNode *left, ASTNode *right, const ASTNode *origin)
+{
+    ASTNode *node = create_binary_expr_node(op, left, right);
+    node->result_type = TYPE_INT;
+    return set_node_location(node, origin->line, origin->column);
+}
+
+static ASTNode *assignment(const char *name, ASTNode *value, const ASTNode *origin)
+{
+    ASTNode *node = create_var_decl_node(TYPE_INT, name, value);
+    return set_node_location(node, origin->line, origin->column);
+}
+
+static Pointer *find_pointer(PointerSet *set, const char *array, const Affine *affine, const ASTNode *origin)
+{
+    for (int i = 0; i < set->count; i++)
+    {
+        Pointer *pointer = &set->items[i];
+        if (strcmp(pointer->array, array) == 0 && pointer->scale == affine->scale &&
+            same_expression(pointer->base, affine->base))
+            return pointer;
+    }
+    if (set->count == set->capacity)
+    {
+        set->capacity = set->capacity ? 2 * set->capacity : 4;
+        set->items = realloc(set->items, set->capacity * sizeof(Pointer));
+    }
+    Pointer *pointer = &set->items[set->count++];
+    pointer->array = array;
+    pointer->scale = affine->scale;
+    pointer->base = affine->base ? clone_expression(affine->base) : NULL;
+    pointer->name = NULL;
+    pointer->accesses = 0;
+    pointer->reads = 0;
+    pointer->line = origin->line;
+    pointer->column = origin->column;
+    return pointer;
+}
+
+/* Turns an access at a derived index into one at a constant offset from its pointer. */
+static void rewrite_access(PointerSet *set, const char *array, ASTNode **index, char **pointer_name,
+                           const ASTNode *origin)
+{
+    Affine affine;
+    if (*pointer_name || !decompose(*index, set->loop, &affine) || affine.scale == 0)
+        return;
+    Pointer *pointer = find_pointer(set, array, &affine, origin);
+    if (!set->rewrite)
+    {
+        pointer->accesses++;
+        pointer->reads += count_reads(*index, NULL, set->loop->counter);
+        return;
+    }
+    if (!pointer->name)
+        return;
+    free_ast(*index);
+    *index = integer_literal(affine.offset, origin);
+    *pointer_name = strdup_safe(pointer->name);
+}
+
+static void rewrite_expression(PointerSet *set, ASTNode *node)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case AST_BINARY_EXPR:
+        rewrite_expression(set, node->binary_expr.left);
+        rewrite_expression(set, node->binary_expr.right);
+        break;
+    case AST_UNARY_EXPR:
+        rewrite_expression(set, node->unary_expr.operand);
+        break;
+    case AST_INDEX:
+        rewrite_expression(set, node->index.index);
+        rewrite_access(set, node->index.name, &node->index.index, &node->index.pointer, node);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Every statement of the body runs with the variable at its value of the current iteration,
+ * which is what the pointers hold until the update advances both.
+ */
+static void rewrite_statements(PointerSet *set, ASTNode *node)
+{
+    for (; node; node = node->next)
+    {
+        switch (node->type)
+        {
+        case AST_VAR_DECL:
+            rewrite_expression(set, node->var_decl.value);
+            break;
+        case AST_IF_STATEMENT:
+            rewrite_expression(set, node->if_statement.condition);
+            rewrite_statements(set, node->if_statement.then_branch);
+            rewrite_statements(set, node->if_statement.else_branch);
+            break;
+        case AST_LOOP:
+            rewrite_statements(set, node->loop.init);
+            rewrite_statements(set, node->loop.preheader);
+            rewrite_expression(set, node->loop.condition);
+            rewrite_expression(set, node->loop.latch);
+            rewrite_statements(set, node->loop.update);
+            rewrite_statements(set, node->loop.body);
+            rewrite_statements(set, node->loop.exit);
+            break;
+        case AST_ARRAY_DECL:
+            for (int i = 0; i < node->array_decl.value_count; i++)
+                rewrite_expression(set, node->array_decl.values[i]);
+            break;
+        case AST_ELEMENT_ASSIGN:
+            rewrite_expression(set, node->element_assign.index);
+            rewrite_expression(set, node->element_assign.value);
+            rewrite_access(set, node->element_assign.name, &node->element_assign.index, &node->element_assign.pointer,
+                           node);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/* scale*i + base, with i at its start value when that is known. */
+static ASTNode *start_index(const Pointer *pointer, const CountedLoop *loop, const ASTNode *origin)
+{
+    ASTNode *index;
+    if (loop->known_start && within_limit(loop->start, MAX_ELEMENT_OFFSET))
+    {
+        if (loop->start == 0 && pointer->base)
+            return clone_expression(pointer->base);
+        index = integer_literal(pointer->scale * loop->start, origin);
+    }
+    else if (pointer->scale == 1)
+        index = variable_reference(loop->counter, origin);
+    else
+        index = arithmetic(TOKEN_STAR, variable_reference(loop->counter, origin), integer_literal(pointer->scale, origin),
+                           origin);
+    if (pointer->base)
+        index = arithmetic(TOKEN_PLUS, index, clone_expression(pointer->base), origin);
+    return index;
+}
+
+/* Sets each selected pointer in the preheader and advances it right after the loop variable. */
+static void install_pointers(PointerSet *set, const CountedLoop *loop)
+{
+    ASTNode *update = *loop->update_link;
+    for (int i = 0; i < set->count; i++)
+    {
+        const Pointer *pointer = &set->items[i];
+        if (!pointer->name)
+            continue;
+        ASTNode origin = {0};
+        origin.line = pointer->line;
+        origin.column = pointer->column;
+
+        ASTNode *address = create_address_node(pointer->array, start_index(pointer, loop, &origin));
+        set_node_location(address, origin.line, origin.column);
+        append_statement(&loop->node->loop.preheader, assignment(pointer->name, address, &origin));
+
+        ASTNode *advance = arithmetic(TOKEN_PLUS, variable_reference(pointer->name, update),
+                                      integer_literal(8 * pointer->scale * loop->step, update), update);
+        ASTNode *statement = assignment(pointer->name, advance, update);
+        statement->next = update->next;
+        update->next = statement;
+        update = statement;
+
+        remark(REMARK_PASSED, "ivopt", "PointerInduction", pointer->line,
+               "'%.*s[]' addressed through a pointer advanced by %lld bytes per iteration of the loop at line %d",
+               source_length(pointer->array), pointer->array, 8 * pointer->scale * loop->step, loop->node->line);
+    }
+}
+
+/*
+ * Trip count of a loop with a constant start and bound, worked out with the variable moving
+ * up; 0 when the loop does not run, or when the variable wraps around or moves away from the
+ * bound, which the countdown could not reproduce.
+ */
+static long long constant_trips(const CountedLoop *loop)
+{
+    long long start = loop->start, bound, step = loop->step;
+    TokenType op = loop->op;
+    if (!loop->known_start || !integer_literal_value(loop->bound, &bound))
+        return 0;
+    if (step < 0)
+    {
+        if (start == LLONG_MIN || bound == LLONG_MIN)
+            return 0;
+        start = -start;
+        bound = -bound;
+        step = -step;
+        op = mirror_comparison(op);
+    }
+
+    unsigned long long distance, trips;
+    if (op == TOKEN_LEQ)
+    {
+        if (bound == LLONG_MAX)
+            return 0;
+        bound++;
+        op = TOKEN_LT;
+    }
+    if (start >= bound)
+        return 0;
+    distance = (unsigned long long)bound - (unsigned long long)start;
+    if (op == TOKEN_LT)
+        trips = distance / step + (distance % step != 0);
+    else if (op == TOKEN_NEQ && distance % step == 0)
+        trips = distance / step;
+    else
+        return 0;
+    /* The variable reaches start + trips*step, which must not pass LLONG_MAX. */
+    if (trips > (unsigned long long)LLONG_MAX || trips * step > (unsigned long long)LLONG_MAX - (unsigned long long)start)
+        return 0;
+    return (long long)trips;
+}
+
+/*
+ * The trip count as computed in the preheader, for a loop that has passed its entry test. A
+ * unit step reaches the bound exactly, so "i < n" runs n - i times, and the count wraps the
+ * same way the countdown does; "i <= n" needs a literal n below the largest value, which would
+ * make the loop endless. Other steps need a constant trip count. NULL if there is none.
+ */
+static ASTNode *trip_count(const CountedLoop *loop, const char **reason)
+{
+    const ASTNode *origin = loop->node;
+    long long trips = constant_trips(loop), bound;
+    if (trips > 0)
+        return integer_literal(trips, origin);
+
+    ASTNode *counter = variable_reference(loop->counter, origin);
+    if (loop->step == 1 && (loop->op == TOKEN_LT || loop->op == TOKEN_NEQ))
+        return arithmetic(TOKEN_MINUS, clone_expression(loop->bound), counter, origin);
+    if (loop->step == -1 && (loop->op == TOKEN_GT || loop->op == TOKEN_NEQ))
+        return arithmetic(TOKEN_MINUS, counter, clone_expression(loop->bound), origin);
+    if (loop->step == 1 && loop->op == TOKEN_LEQ && integer_literal_value(loop->bound, &bound) && bound < LLONG_MAX)
+        return arithmetic(TOKEN_MINUS, integer_literal(bound + 1, origin), counter, origin);
+    if (loop->step == -1 && loop->op == TOKEN_GEQ && integer_literal_value(loop->bound, &bound) && bound > LLONG_MIN)
+        return arithmetic(TOKEN_MINUS, counter, integer_literal(bound - 1, origin), origin);
+    free_ast(counter);
+
+    if ((loop->step > 0 && (loop->op == TOKEN_GT || loop->op == TOKEN_GEQ)) ||
+        (loop->step < 0 && (loop->op == TOKEN_LT || loop->op == TOKEN_LEQ)))
+        *reason = "the variable moves away from its bound";
+    else if (loop->step != 1 && loop->step != -1)
+        *reason = "its trip count is not constant and the step is not 1 or -1";
+    else
+        *reason = "the bound may be the largest value, where the loop never ends";
+    return NULL;
+}
+
+/*
+ * Whether the loop variable only counts iterations once the pointers took over its index_reads
+ * reads in array indices. It must not be read after the loop, so it has to be declared by the
+ * init statement and nothing else may use it.
+ */
+static int only_counts(const CountedLoop *loop, const ASTNode *program, int index_reads)
+{
+    const ASTNode *node = loop->node, *update = *loop->update_link;
+    const ASTNode *stop = node->loop.update ? NULL : update;
+    if (!symbol_is_block_scoped(loop->counter) || occurs_outside(program, node, loop->counter))
+        return 0;
+    return count_reads(node->loop.body, stop, loop->counter) == index_reads &&
+           !count_reads(update->next, NULL, loop->counter) && !count_reads(node->loop.preheader, NULL, loop->counter) &&
+           !count_reads(node->loop.exit, NULL, loop->counter);
+}
+
+/*
+ * Replaces the variable by a temporary that the preheader sets to the trip count and the
+ * update counts down; the loop branches back while it is not zero. The original condition
+ * remains the entry test.
+ */
+static void count_down(const CountedLoop *loop, ASTNode *count)
+{
+    ASTNode *node = loop->node, *update = *loop->update_link;
+    char *temp = new_temp("ivopt");
+    append_statement(&node->loop.preheader, assignment(temp, count, node));
+
+    /* The decrement goes after the pointer updates, so that the branch reads the flags it sets. */
+    ASTNode *decrement = assignment(temp, arithmetic(TOKEN_MINUS, variable_reference(temp, node),
+                                                     integer_literal(1, node), node), node);
+    ASTNode *latch = create_binary_expr_node(TOKEN_NEQ, variable_reference(temp, node), integer_literal(0, node));
+    latch->result_type = TYPE_BOOL;
+    node->loop.latch = set_node_location(latch, node->line, node->column);
+    free(temp);
+
+    remark(REMARK_PASSED, "ivopt", "Countdown", node->line,
+           "loop variable '%.*s' removed: the exit test counts the trip count down to zero",
+           source_length(loop->counter), loop->counter);
+
+    /* The update names the variable, so it is freed last. */
+    *loop->update_link = update->next;
+    update->next = NULL;
+    free_ast(update);
+    append_statement(loop->update_link, decrement);
+}
+
+/*
+ * Instructions per iteration, as codegen routes values through rax: stepping a variable takes
+ * three and the exit test two, while a countdown's decrement sets the flags its branch reads.
+ * An access at a computed index loads the variable and the array address, plus an instruction
+ * each for a scale and a base; an access through a pointer only loads the pointer.
+ */
+static int pointers_pay(const PointerSet *set)
+{
+    int before = 5, after = 4;
+    for (int i = 0; i < set->count; i++)
+    {
+        const Pointer *pointer = &set->items[i];
+        before += pointer->accesses * (2 + (pointer->scale != 1) + (pointer->base != NULL));
+        after += 3 + pointer->accesses;
+    }
+    return after < before;
+}
+
+/*
+ * A pointer is one more variable to advance, which only pays when the loop variable goes in
+ * exchange and the index arithmetic it saves outweighs the advances. The variable goes when
+ * the pointers took over all its reads in the body and the trip count can be computed; a loop
+ * without array accesses only has its exit test counted down.
+ */
+static int optimize_loop(ASTNode *node, const ASTNode *previous, const ASTNode *program)
+{
+    CountedLoop loop;
+    if (node->loop.latch || recognize_counted_loop(node, previous, &loop))
+        return 0;
+
+    PointerSet pointers = {0};
+    pointers.loop = &loop;
+    rewrite_statements(&pointers, node->loop.body);
+
+    int index_reads = 0, computed = 0;
+    for (int i = 0; i < pointers.count; i++)
+    {
+        index_reads += pointers.items[i].reads;
+        computed |= pointers.items[i].scale != 1 || pointers.items[i].base;
+    }
+
+    ASTNode *count = NULL;
+    if (!pointers_pay(&pointers))
+    {
+        if (computed)
+            remark(REMARK_MISSED, "ivopt", "NoPointerInduction", node->line,
+                   "arrays in the loop on '%.*s' kept indexed: advancing pointers costs more than the index arithmetic",
+                   source_length(loop.counter), loop.counter);
+    }
+    else if (only_counts(&loop, program, index_reads))
+    {
+        const char *reason = NULL;
+        count = trip_count(&loop, &reason);
+        if (!count)
+            remark(REMARK_MISSED, "ivopt", "NoCountdown", node->line,
+                   "exit test on '%.*s' not counted down to zero: %s", source_length(loop.counter), loop.counter,
+                   reason);
+    }
+
+    int changes = 0;
+    if (count)
+    {
+        /* Accesses in the condition that need a pointer of their own stay indexed. */
+        changes = pointers.count + 1;
+        for (int i = 0; i < pointers.count; i++)
+            pointers.items[i].name = new_pointer(pointers.items[i].array);
+        pointers.rewrite = 1;
+        rewrite_expression(&pointers, node->loop.condition);
+        rewrite_statements(&pointers, node->loop.body);
+        install_pointers(&pointers, &loop);
+        count_down(&loop, count);
+    }
+
+    for (int i = 0; i < pointers.count; i++)
+    {
+        free_ast(pointers.items[i].base);
+        free(pointers.items[i].name);
+    }
+    free(pointers.items);
+    return changes;
+}
+
+/* Inner loops go first, so an access gets the pointer of the innermost loop its index moves in. */
+static int optimize_statements(ASTNode *node, const ASTNode *program)
+{
+    int changes = 0;
+    const ASTNode *previous = NULL;
+    for (; node; previous = node, node = node->next)
+    {
+        if (node->type == AST_IF_STATEMENT)
+        {
+            changes += optimize_statements(node->if_statement.then_branch, program);
+            changes += optimize_statements(node->if_statement.else_branch, program);
+        }
+        else if (node->type == AST_LOOP)
+        {
+            changes += optimize_statements(node->loop.body, program);
+            changes += optimize_loop(node, previous, program);
+        }
+    }
+    return changes;
+}
+
+int run_ivopt(ASTNode **program, PassContext *ctx)
+{
+    (void)ctx;
+    return optimize_statements(*program, *program);
+}
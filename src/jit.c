@@ -0,0 +1,567 @@
+/**
+ * @file jit.c
+ * @brief In-process execution of compiled SEG programs.
+ *        The generated assembly is turned into an ELF relocatable object by the system
+ *        assembler; this loader copies its allocatable sections into anonymous memory,
+ *        applies the x86-64 relocations, resolves external symbols with dlsym, and calls
+ *        main. Profilers are told about the anonymous code through /tmp/perf-<pid>.map
+ *        and the jitdump format documented in the Linux tree
+ *        (tools/perf/Documentation/jitdump-specification.txt).
+ * @author Dario Romandini
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "jit.h"
+
+#define JIT_STUB_SIZE 16
+
+#define JITDUMP_MAGIC 0x4A695444
+#define JITDUMP_VERSION 1
+#define JIT_CODE_LOAD 0
+#define JIT_CODE_CLOSE 3
+#define JIT_CODE_DEBUG_INFO 2
+
+/**
+ * @brief A relocatable object loaded into executable memory.
+ */
+typedef struct
+{
+    unsigned char *file;     ///< Object file contents
+    size_t file_size;        ///< Size of the object file
+    Elf64_Ehdr *ehdr;        ///< ELF header
+    Elf64_Shdr *shdrs;       ///< Section headers
+    const char *shstrtab;    ///< Section name string table
+    Elf64_Sym *symtab;       ///< Symbol table
+    size_t symbol_count;     ///< Number of symbols
+    const char *strtab;      ///< Symbol name string table
+    unsigned char *base;     ///< Start of the mapping
+    size_t size;             ///< Size of the mapping
+    size_t code_size;        ///< Page-aligned size of the executable part (code and stubs)
+    uintptr_t *section_addr; ///< Load address per section (0 if not loaded)
+    unsigned char *stubs;    ///< One jump stub per symbol, also used as its GOT slot
+} JitImage;
+
+/**
+ * @brief One entry of the line table emitted by the code generator.
+ */
+typedef struct
+{
+    uint64_t address;
+    uint32_t line;
+    uint32_t column;
+} JitLine;
+
+static uintptr_t align_up(uintptr_t value, uintptr_t alignment)
+{
+    if (alignment < 2)
+        return value;
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static int assemble(const char *asm_path, const char *object_path)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+        return 0;
+    if (pid == 0)
+    {
+        execlp("as", "as", "--64", "-o", object_path, asm_path, (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+        return 0;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int read_object(const char *path, JitImage *image)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    image->file = malloc(size > 0 ? (size_t)size : 1);
+    image->file_size = size > 0 ? (size_t)size : 0;
+    int ok = size > 0 && fread(image->file, 1, image->file_size, file) == image->file_size;
+    fclose(file);
+    if (!ok || image->file_size < sizeof(Elf64_Ehdr))
+        return 0;
+
+    image->ehdr = (Elf64_Ehdr *)image->file;
+    Elf64_Ehdr *ehdr = image->ehdr;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr->e_type != ET_REL || ehdr->e_machine != EM_X86_64 ||
+        ehdr->e_shoff + (size_t)ehdr->e_shnum * sizeof(Elf64_Shdr) > image->file_size)
+    {
+        fprintf(stderr, "[JIT Error] Not an x86-64 relocatable object\n");
+        return 0;
+    }
+
+    image->shdrs = (Elf64_Shdr *)(image->file + ehdr->e_shoff);
+    image->shstrtab = (const char *)image->file + image->shdrs[ehdr->e_shstrndx].sh_offset;
+    for (int i = 0; i < ehdr->e_shnum; i++)
+    {
+        if (image->shdrs[i].sh_type == SHT_SYMTAB)
+        {
+            image->symtab = (Elf64_Sym *)(image->file + image->shdrs[i].sh_offset);
+            image->symbol_count = image->shdrs[i].sh_size / sizeof(Elf64_Sym);
+            image->strtab = (const char *)image->file + image->shdrs[image->shdrs[i].sh_link].sh_offset;
+        }
+    }
+    if (!image->symtab)
+    {
+        fprintf(stderr, "[JIT Error] Object has no symbol table\n");
+        return 0;
+    }
+    return 1;
+}
+
+/* Executable sections and the stubs come first so that they can be sealed read+execute. */
+static int map_sections(JitImage *image)
+{
+    int count = image->ehdr->e_shnum;
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t offset = 0, stubs = 0;
+
+    image->section_addr = calloc(count, sizeof(uintptr_t));
+    uintptr_t *offsets = calloc(count, sizeof(uintptr_t));
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            Elf64_Shdr *shdr = &image->shdrs[i];
+            if (!(shdr->sh_flags & SHF_ALLOC) || !!(shdr->sh_flags & SHF_EXECINSTR) != (pass == 0))
+                continue;
+            offset = align_up(offset, shdr->sh_addralign);
+            offsets[i] = offset;
+            offset += shdr->sh_size;
+        }
+        if (pass == 0)
+        {
+            stubs = align_up(offset, JIT_STUB_SIZE);
+            image->code_size = align_up(stubs + image->symbol_count * JIT_STUB_SIZE, page);
+            offset = image->code_size;
+        }
+    }
+
+    image->size = align_up(offset, page);
+    image->base = mmap(NULL, image->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image->base == MAP_FAILED)
+    {
+        image->base = NULL;
+        free(offsets);
+        perror("[JIT Error] mmap");
+        return 0;
+    }
+
+    image->stubs = image->base + stubs;
+    for (int i = 0; i < count; i++)
+    {
+        Elf64_Shdr *shdr = &image->shdrs[i];
+        if (!(shdr->sh_flags & SHF_ALLOC))
+            continue;
+        image->section_addr[i] = (uintptr_t)image->base + offsets[i];
+        if (shdr->sh_type != SHT_NOBITS)
+            memcpy((void *)image->section_addr[i], image->file + shdr->sh_offset, shdr->sh_size);
+    }
+    free(offsets);
+    return 1;
+}
+
+static int symbol_address(JitImage *image, size_t index, uintptr_t *address)
+{
+    Elf64_Sym *sym = &image->symtab[index];
+    const char *name = image->strtab + sym->st_name;
+
+    if (sym->st_shndx == SHN_UNDEF)
+    {
+        void *resolved = dlsym(RTLD_DEFAULT, name);
+        if (!resolved)
+        {
+            fprintf(stderr, "[JIT Error] Unresolved symbol: %s\n", name);
+            return 0;
+        }
+        *address = (uintptr_t)resolved;
+    }
+    else if (sym->st_shndx == SHN_ABS)
+    {
+        *address = sym->st_value;
+    }
+    else if (sym->st_shndx < image->ehdr->e_shnum && image->section_addr[sym->st_shndx])
+    {
+        *address = image->section_addr[sym->st_shndx] + sym->st_value;
+    }
+    else
+    {
+        fprintf(stderr, "[JIT Error] Symbol '%s' is in an unloaded section\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+/* "jmp [rip + 0]" followed by the target: reachable by rel32 and usable as a GOT entry. */
+static uintptr_t symbol_stub(JitImage *image, size_t index, uintptr_t target)
+{
+    unsigned char *stub = image->stubs + index * JIT_STUB_SIZE;
+    static const unsigned char jump[6] = {0xff, 0x25, 0, 0, 0, 0};
+    memcpy(stub, jump, sizeof(jump));
+    memcpy(stub + 6, &target, sizeof(target));
+    return (uintptr_t)stub;
+}
+
+static int write_pc32(unsigned char *place, int64_t value)
+{
+    if (value < INT32_MIN || value > INT32_MAX)
+    {
+        fprintf(stderr, "[JIT Error] Relocation target out of 32-bit range\n");
+        return 0;
+    }
+    int32_t narrow = (int32_t)value;
+    memcpy(place, &narrow, sizeof(narrow));
+    return 1;
+}
+
+static int apply_relocations(JitImage *image)
+{
+    for (int i = 0; i < image->ehdr->e_shnum; i++)
+    {
+        Elf64_Shdr *shdr = &image->shdrs[i];
+        if (shdr->sh_type == SHT_REL)
+        {
+            fprintf(stderr, "[JIT Error] SHT_REL relocations are not supported\n");
+            return 0;
+        }
+        if (shdr->sh_type != SHT_RELA || !image->section_addr[shdr->sh_info])
+            continue;
+
+        Elf64_Rela *relocs = (Elf64_Rela *)(image->file + shdr->sh_offset);
+        size_t count = shdr->sh_size / sizeof(Elf64_Rela);
+        for (size_t r = 0; r < count; r++)
+        {
+            size_t sym_index = ELF64_R_SYM(relocs[r].r_info);
+            unsigned type = ELF64_R_TYPE(relocs[r].r_info);
+            uintptr_t place = image->section_addr[shdr->sh_info] + relocs[r].r_offset;
+            int64_t addend = relocs[r].r_addend;
+            uintptr_t target;
+
+            if (!symbol_address(image, sym_index, &target))
+                return 0;
+
+            switch (type)
+            {
+            case R_X86_64_64:
+            {
+                uint64_t value = target + addend;
+                memcpy((void *)place, &value, sizeof(value));
+                break;
+            }
+            case R_X86_64_PC32:
+            case R_X86_64_PLT32:
+                if (image->symtab[sym_index].st_shndx == SHN_UNDEF)
+                    target = symbol_stub(image, sym_index, target);
+                if (!write_pc32((unsigned char *)place, (int64_t)(target + addend - place)))
+                    return 0;
+                break;
+            case R_X86_64_GOTPCREL:
+            case R_X86_64_GOTPCRELX:
+            case R_X86_64_REX_GOTPCRELX:
+            {
+                uintptr_t slot = symbol_stub(image, sym_index, target) + 6;
+                if (!write_pc32((unsigned char *)place, (int64_t)(slot + addend - place)))
+                    return 0;
+                break;
+            }
+            default:
+                fprintf(stderr, "[JIT Error] Unsupported relocation type %u\n", type);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static const Elf64_Sym *find_symbol(const JitImage *image, const char *name)
+{
+    for (size_t i = 1; i < image->symbol_count; i++)
+    {
+        const Elf64_Sym *sym = &image->symtab[i];
+        if (ELF64_ST_TYPE(sym->st_info) == STT_FUNC && strcmp(image->strtab + sym->st_name, name) == 0)
+            return sym;
+    }
+    return NULL;
+}
+
+static const JitLine *find_line_table(const JitImage *image, size_t *count)
+{
+    for (int i = 0; i < image->ehdr->e_shnum; i++)
+    {
+        if (image->section_addr[i] &&
+            strcmp(image->shstrtab + image->shdrs[i].sh_name, JIT_LINE_TABLE_SECTION) == 0)
+        {
+            *count = image->shdrs[i].sh_size / sizeof(JitLine);
+            return (const JitLine *)image->section_addr[i];
+        }
+    }
+    *count = 0;
+    return NULL;
+}
+
+/* Runs the constructors or destructors of a loaded object, as the C runtime would. */
+static void run_array(const JitImage *image, Elf64_Word type)
+{
+    for (int i = 0; i < image->ehdr->e_shnum; i++)
+    {
+        if (image->shdrs[i].sh_type != type || !image->section_addr[i])
+            continue;
+        void (**functions)(void) = (void (**)(void))image->section_addr[i];
+        size_t count = image->shdrs[i].sh_size / sizeof(functions[0]);
+        for (size_t f = 0; f < count; f++)
+            functions[type == SHT_FINI_ARRAY ? count - 1 - f : f]();
+    }
+}
+
+static int compare_lines(const void *a, const void *b)
+{
+    const JitLine *x = a, *y = b;
+    return x->address < y->address ? -1 : x->address > y->address;
+}
+
+static void free_image(JitImage *image)
+{
+    if (image->base)
+        munmap(image->base, image->size);
+    free(image->section_addr);
+    free(image->file);
+}
+
+/*
+ * One perf map entry per source line range, so that perf report attributes samples to
+ * "main:<file>:<line>" rather than to a single opaque function. Code before the first line
+ * entry (or without a line table, the whole function) is reported under the function name.
+ */
+static void write_perf_map(const char *name, uintptr_t start, size_t size, const JitLine *lines,
+                           size_t line_count, const char *source_path)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+    FILE *map = fopen(path, "a");
+    if (!map)
+    {
+        perror("[JIT Error] Failed to open perf map");
+        return;
+    }
+
+    uintptr_t end = start + size;
+    uintptr_t first = end;
+    for (size_t i = 0; i < line_count; i++)
+    {
+        if (lines[i].address >= start && lines[i].address < first)
+            first = lines[i].address;
+    }
+    if (first > start)
+        fprintf(map, "%lx %lx %s\n", (unsigned long)start, (unsigned long)(first - start), name);
+    for (size_t i = 0; i < line_count; i++)
+    {
+        uintptr_t from = lines[i].address;
+        uintptr_t to = i + 1 < line_count && lines[i + 1].address < end ? lines[i + 1].address : end;
+        if (from < start || from >= end || to <= from)
+            continue;
+        fprintf(map, "%lx %lx %s:%s:%u\n", (unsigned long)from, (unsigned long)(to - from), name, source_path,
+                lines[i].line);
+    }
+    fclose(map);
+}
+
+static uint64_t timestamp(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void write_record_header(FILE *dump, uint32_t id, uint32_t total_size)
+{
+    uint64_t time = timestamp();
+    fwrite(&id, sizeof(id), 1, dump);
+    fwrite(&total_size, sizeof(total_size), 1, dump);
+    fwrite(&time, sizeof(time), 1, dump);
+}
+
+/*
+ * perf record only notices the dump through an executable mapping of the file, so the
+ * first page stays mapped until the dump is closed; perf inject -j then merges the
+ * records into the profile. Timestamps use CLOCK_MONOTONIC (record with -k mono).
+ */
+static FILE *open_jitdump(void **marker, long *marker_size)
+{
+    const char *dir = getenv("JITDUMPDIR");
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/jit-%d.dump", dir && *dir ? dir : ".", (int)getpid());
+
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd < 0)
+    {
+        perror("[JIT Error] Failed to open jitdump file");
+        return NULL;
+    }
+    *marker_size = sysconf(_SC_PAGESIZE);
+    *marker = mmap(NULL, *marker_size, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+    if (*marker == MAP_FAILED)
+    {
+        perror("[JIT Error] Failed to map jitdump file");
+        close(fd);
+        return NULL;
+    }
+
+    FILE *dump = fdopen(fd, "wb");
+    struct
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t total_size;
+        uint32_t elf_mach;
+        uint32_t pad1;
+        uint32_t pid;
+        uint64_t timestamp;
+        uint64_t flags;
+    } header = {JITDUMP_MAGIC, JITDUMP_VERSION, sizeof(header), EM_X86_64, 0, (uint32_t)getpid(), timestamp(), 0};
+    fwrite(&header, sizeof(header), 1, dump);
+    return dump;
+}
+
+/* Debug information must precede the code load record it describes. */
+static void write_jitdump_code(FILE *dump, const char *name, uint64_t code_index, uintptr_t start, size_t size,
+                               const JitLine *lines, size_t line_count, const char *source_path)
+{
+    size_t name_size = strlen(source_path) + 1;
+    size_t in_range = 0;
+    for (size_t i = 0; i < line_count; i++)
+        in_range += lines[i].address >= start && lines[i].address < start + size;
+
+    if (in_range)
+    {
+        uint32_t total = 16 + 16 + (uint32_t)(in_range * (16 + name_size));
+        uint64_t address = start, count = in_range;
+        write_record_header(dump, JIT_CODE_DEBUG_INFO, total);
+        fwrite(&address, sizeof(address), 1, dump);
+        fwrite(&count, sizeof(count), 1, dump);
+        for (size_t i = 0; i < line_count; i++)
+        {
+            if (lines[i].address < start || lines[i].address >= start + size)
+                continue;
+            uint64_t entry_address = lines[i].address;
+            uint32_t line = lines[i].line, discriminator = 0;
+            fwrite(&entry_address, sizeof(entry_address), 1, dump);
+            fwrite(&line, sizeof(line), 1, dump);
+            fwrite(&discriminator, sizeof(discriminator), 1, dump);
+            fwrite(source_path, 1, name_size, dump);
+        }
+    }
+
+    size_t symbol_size = strlen(name) + 1;
+    uint32_t pid = (uint32_t)getpid(), tid = (uint32_t)syscall(SYS_gettid);
+    uint64_t vma = start, code_addr = start, code_size = size;
+    write_record_header(dump, JIT_CODE_LOAD, (uint32_t)(16 + 40 + symbol_size + size));
+    fwrite(&pid, sizeof(pid), 1, dump);
+    fwrite(&tid, sizeof(tid), 1, dump);
+    fwrite(&vma, sizeof(vma), 1, dump);
+    fwrite(&code_addr, sizeof(code_addr), 1, dump);
+    fwrite(&code_size, sizeof(code_size), 1, dump);
+    fwrite(&code_index, sizeof(code_index), 1, dump);
+    fwrite(name, 1, symbol_size, dump);
+    fwrite((const void *)start, 1, size, dump);
+    fflush(dump);
+}
+
+int jit_run(const char *asm_path, const JitOptions *options, int *exit_code)
+{
+    char object_path[] = "/tmp/seg-jit-XXXXXX";
+    int fd = mkstemp(object_path);
+    if (fd < 0)
+    {
+        perror("[JIT Error] Failed to create object file");
+        return 0;
+    }
+    close(fd);
+
+    JitImage image = {0};
+    int ok = assemble(asm_path, object_path);
+    if (!ok)
+        fprintf(stderr, "[JIT Error] Failed to assemble %s\n", asm_path);
+    ok = ok && read_object(object_path, &image) && map_sections(&image) && apply_relocations(&image);
+    unlink(object_path);
+
+    const Elf64_Sym *entry = ok ? find_symbol(&image, "main") : NULL;
+    if (ok && (!entry || !image.section_addr[entry->st_shndx]))
+    {
+        fprintf(stderr, "[JIT Error] Program has no main function\n");
+        ok = 0;
+    }
+    if (!ok || mprotect(image.base, image.code_size, PROT_READ | PROT_EXEC) != 0)
+    {
+        free_image(&image);
+        return 0;
+    }
+
+    uintptr_t start = image.section_addr[entry->st_shndx] + entry->st_value;
+    size_t line_count;
+    const JitLine *table = find_line_table(&image, &line_count);
+    JitLine *lines = malloc((line_count ? line_count : 1) * sizeof(JitLine));
+    if (line_count)
+        memcpy(lines, table, line_count * sizeof(JitLine));
+    qsort(lines, line_count, sizeof(JitLine), compare_lines);
+
+    const char *source_path = options && options->source_path ? options->source_path : "<unknown>";
+    FILE *dump = NULL;
+    void *marker = NULL;
+    long marker_size = 0;
+    if (options && options->jitdump)
+        dump = open_jitdump(&marker, &marker_size);
+
+    /* Every loaded function is described: main, its out-of-line cold part, runtime helpers. */
+    uint64_t code_index = 0;
+    for (size_t i = 1; options && (options->perf_map || dump) && i < image.symbol_count; i++)
+    {
+        const Elf64_Sym *sym = &image.symtab[i];
+        if (ELF64_ST_TYPE(sym->st_info) != STT_FUNC || sym->st_shndx >= image.ehdr->e_shnum ||
+            !image.section_addr[sym->st_shndx] || sym->st_size == 0)
+            continue;
+        const char *name = image.strtab + sym->st_name;
+        uintptr_t address = image.section_addr[sym->st_shndx] + sym->st_value;
+        if (options->perf_map)
+            write_perf_map(name, address, sym->st_size, lines, line_count, source_path);
+        if (dump)
+            write_jitdump_code(dump, name, code_index++, address, sym->st_size, lines, line_count, source_path);
+    }
+    free(lines);
+
+    int (*program)(void) = (int (*)(void))start;
+    run_array(&image, SHT_INIT_ARRAY);
+    *exit_code = program();
+    run_array(&image, SHT_FINI_ARRAY);
+
+    if (dump)
+    {
+        write_record_header(dump, JIT_CODE_CLOSE, 16);
+        fclose(dump);
+        munmap(marker, marker_size);
+    }
+    free_image(&image);
+    return 1;
+}
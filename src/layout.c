@@ -0,0 +1,379 @@
+/**
+ * @file layout.c
+ * @brief Basic-block layout and code alignment on the machine IR of the SEG compiler.
+ *        Splits main into basic blocks, estimates block frequencies with static
+ *        heuristics (forward branches are even, loop back edges are taken), chains the
+ *        heaviest edges into fall-through sequences, then rewrites the branches to match:
+ *        jumps to the next block disappear and branches over a jump are inverted.
+ *        Hot join points and loop heads are aligned with .p2align within a padding budget.
+ *        Code after a .pushsection (the out-of-line cold part) is left where it is.
+ * @author Dario Romandini
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+
+#define LOOP_TAKEN_PROBABILITY 0.9
+#define LOOP_TRIP_ESTIMATE 10.0
+#define HOT_FREQUENCY 2.0
+#define ALIGN_LOG2 4
+#define LOOP_HEAD_MAX_PADDING 15
+#define JOIN_MAX_PADDING 7
+
+/* Per-function worst-case padding budgets in bytes; -Os never pads. */
+#define PADDING_BUDGET_O1 32
+#define PADDING_BUDGET_O2 64
+
+typedef struct Block
+{
+    MInstr *first;             ///< First instruction (the label, if any)
+    MInstr *last;              ///< Last instruction
+    MInstr *branch;            ///< Terminating jcc/jmp, or NULL
+    int index;                 ///< Position in the original order
+    struct Block *taken;       ///< Target of the terminating branch (NULL if none or outside the region)
+    struct Block *fall;        ///< Fall-through successor (NULL after jmp/ret)
+    double freq;               ///< Estimated executions per function entry
+    int preds;                 ///< Number of incoming edges
+    int loop_head;             ///< Target of a back edge
+    struct Block *chain_next;  ///< Block placed right after this one
+    struct Block *chain_head;  ///< First block of this block's chain
+    int placed;                ///< Already emitted in the new order
+} Block;
+
+typedef struct
+{
+    Block *from;
+    Block *to;
+    double weight;
+    int fallthrough; ///< The edge was a fall-through in the original order
+} Edge;
+
+static int block_label_counter = 0;
+
+static const char *block_label(const Block *block)
+{
+    return block->first && block->first->op == MI_LABEL ? block->first->text : NULL;
+}
+
+static Block *find_block(Block *blocks, int count, const char *label)
+{
+    for (int i = 0; i < count; i++)
+    {
+        for (MInstr *instr = blocks[i].first; instr && instr->op == MI_LABEL; instr = instr->next)
+        {
+            if (strcmp(instr->text, label) == 0)
+                return &blocks[i];
+            if (instr == blocks[i].last)
+                break;
+        }
+    }
+    return NULL;
+}
+
+/* Splits the region before `end` into blocks. Returns -1 if the region holds directives. */
+static int split_blocks(MFunction *fn, MInstr *end, Block **out)
+{
+    int count = 0, capacity = 16;
+    Block *blocks = calloc(capacity, sizeof(Block));
+    Block *current = NULL;
+
+    for (MInstr *instr = fn->head; instr != end; instr = instr->next)
+    {
+        if (instr->op == MI_DIRECTIVE)
+        {
+            free(blocks);
+            return -1;
+        }
+        if (!current || (instr->op == MI_LABEL && current->last->op != MI_LABEL))
+        {
+            if (count == capacity)
+            {
+                capacity *= 2;
+                blocks = realloc(blocks, capacity * sizeof(Block));
+            }
+            current = &blocks[count];
+            memset(current, 0, sizeof(Block));
+            current->index = count++;
+            current->first = instr;
+        }
+        current->last = instr;
+        if (mir_is_terminator(instr) || instr->op == MI_JCC)
+        {
+            current->branch = instr->op == MI_RET ? NULL : instr;
+            current = NULL;
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        Block *block = &blocks[i];
+        MInstr *last = block->last;
+        if (block->branch)
+            block->taken = find_block(blocks, count, block->branch->ops[0].symbol);
+        if (last->op != MI_JMP && last->op != MI_RET && i + 1 < count)
+            block->fall = &blocks[i + 1];
+        if (block->taken)
+            block->taken->preds++;
+        if (block->fall)
+            block->fall->preds++;
+        if (block->taken && block->taken->index <= block->index)
+            block->taken->loop_head = 1;
+    }
+    *out = blocks;
+    return count;
+}
+
+/* Probability that control leaves `block` through its branch. */
+static double taken_probability(const Block *block)
+{
+    if (!block->branch)
+        return 0.0;
+    if (block->branch->op == MI_JMP)
+        return 1.0;
+    if (!block->taken)
+        return 0.0; /* Branch to out-of-line (cold) code */
+    if (block->taken->index <= block->index)
+        return LOOP_TAKEN_PROBABILITY;
+    if (block->fall && block->fall->index <= block->index)
+        return 1.0 - LOOP_TAKEN_PROBABILITY;
+    return 0.5;
+}
+
+/* Forward edges are propagated in program order; each loop head runs LOOP_TRIP_ESTIMATE times. */
+static void estimate_frequencies(Block *blocks, int count)
+{
+    blocks[0].freq = 1.0;
+    for (int i = 0; i < count; i++)
+    {
+        Block *block = &blocks[i];
+        if (block->loop_head)
+            block->freq *= LOOP_TRIP_ESTIMATE;
+        double p = taken_probability(block);
+        if (block->taken && block->taken->index > i)
+            block->taken->freq += block->freq * p;
+        if (block->fall && block->fall->index > i)
+            block->fall->freq += block->freq * (1.0 - p);
+    }
+}
+
+static int compare_edges(const void *a, const void *b)
+{
+    const Edge *x = a, *y = b;
+    if (x->weight != y->weight)
+        return x->weight > y->weight ? -1 : 1;
+    if (x->fallthrough != y->fallthrough)
+        return y->fallthrough - x->fallthrough;
+    return x->from->index - y->from->index;
+}
+
+/* Greedy chaining: the heaviest edges become fall-throughs, ties keep the original order. */
+static void build_chains(Block *blocks, int count)
+{
+    Edge *edges = malloc(2 * count * sizeof(Edge));
+    int edge_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        blocks[i].chain_head = &blocks[i];
+        double p = taken_probability(&blocks[i]);
+        if (blocks[i].taken)
+            edges[edge_count++] = (Edge){&blocks[i], blocks[i].taken, blocks[i].freq * p,
+                                         blocks[i].taken->index == i + 1};
+        if (blocks[i].fall)
+            edges[edge_count++] = (Edge){&blocks[i], blocks[i].fall, blocks[i].freq * (1.0 - p), 1};
+    }
+    qsort(edges, edge_count, sizeof(Edge), compare_edges);
+
+    for (int i = 0; i < edge_count; i++)
+    {
+        Block *from = edges[i].from, *to = edges[i].to;
+        if (from->chain_next || to == &blocks[0] || to->chain_head != to || from->chain_head == to)
+            continue;
+        /* Only a chain tail can fall into a chain head. */
+        from->chain_next = to;
+        for (Block *b = to; b; b = b->chain_next)
+            b->chain_head = from->chain_head;
+    }
+    free(edges);
+}
+
+static MInstr *ensure_label(MFunction *fn, Block *block)
+{
+    if (block_label(block))
+        return block->first;
+    char name[32];
+    sprintf(name, "L_block_%d", block_label_counter++);
+    MInstr *label = mir_emit_label(fn, name);
+    mir_unlink(fn, label);
+    label->line = block->first->line;
+    label->column = block->first->column;
+    mir_insert_before(fn, block->first, label);
+    block->first = label;
+    return label;
+}
+
+static MInstr *insert_jump_after(MFunction *fn, Block *block, const char *target)
+{
+    MInstr *jump = mir_emit(fn, MI_JMP, 1, mop_label(target));
+    mir_unlink(fn, jump);
+    jump->line = block->last->line;
+    jump->column = block->last->column;
+    mir_insert_before(fn, block->last->next, jump);
+    block->last = jump;
+    return jump;
+}
+
+/* Makes the branches of a block agree with the block that now follows it. */
+static void fix_branches(MFunction *fn, Block *block, Block *next, int *removed, int *inverted)
+{
+    MInstr *branch = block->branch;
+
+    if (branch && branch->op == MI_JMP && block->taken && block->taken == next)
+    {
+        block->last = branch->prev;
+        mir_remove(fn, branch);
+        block->branch = NULL;
+        (*removed)++;
+        return;
+    }
+    if (branch && branch->op == MI_JCC && block->taken == next && block->fall && block->fall != next)
+    {
+        char *target = strdup(ensure_label(fn, block->fall)->text);
+        branch->cond = mcond_invert(branch->cond);
+        free(branch->ops[0].symbol);
+        branch->ops[0].symbol = target;
+        Block *old_taken = block->taken;
+        block->taken = block->fall;
+        block->fall = old_taken;
+        (*inverted)++;
+        return;
+    }
+    if (block->fall && block->fall != next)
+        insert_jump_after(fn, block, ensure_label(fn, block->fall)->text);
+}
+
+static int compare_candidates(const void *a, const void *b)
+{
+    const Block *x = *(const Block *const *)a, *y = *(const Block *const *)b;
+    if (x->loop_head != y->loop_head)
+        return y->loop_head - x->loop_head;
+    if (x->freq != y->freq)
+        return x->freq > y->freq ? -1 : 1;
+    return x->index - y->index;
+}
+
+/* Worst-case padding is charged against the budget, hottest loop heads first. */
+static int align_blocks(MFunction *fn, Block *blocks, int count, int budget)
+{
+    Block **candidates = malloc(count * sizeof(Block *));
+    int candidate_count = 0, aligned = 0;
+    for (int i = 1; i < count; i++)
+    {
+        if (blocks[i].freq >= HOT_FREQUENCY && (blocks[i].loop_head || blocks[i].preds >= 2))
+            candidates[candidate_count++] = &blocks[i];
+    }
+    qsort(candidates, candidate_count, sizeof(Block *), compare_candidates);
+
+    for (int i = 0; i < candidate_count; i++)
+    {
+        Block *block = candidates[i];
+        int padding = block->loop_head ? LOOP_HEAD_MAX_PADDING : JOIN_MAX_PADDING;
+        MInstr *label = ensure_label(fn, block);
+        if (padding > budget)
+        {
+            remark(REMARK_MISSED, "blocklayout", "AlignmentBudget", label->line,
+                   "%s not aligned: padding budget exhausted", label->text);
+            continue;
+        }
+        budget -= padding;
+        MInstr *align = mir_emit_directive(fn, ".p2align %d,,%d", ALIGN_LOG2, padding);
+        mir_unlink(fn, align);
+        mir_insert_before(fn, label, align);
+        aligned++;
+        remark(REMARK_PASSED, "blocklayout", "BlockAligned", label->line,
+               "%s %s aligned to %d bytes (estimated %.1f executions per call)", block->loop_head ? "loop head" : "join point",
+               label->text, 1 << ALIGN_LOG2, block->freq);
+    }
+    free(candidates);
+    return aligned;
+}
+
+int run_block_layout(MFunction *fn, PassContext *ctx)
+{
+    MInstr *end = fn->head;
+    while (end && !(end->op == MI_DIRECTIVE && strncmp(end->text, ".pushsection", 12) == 0))
+        end = end->next;
+
+    Block *blocks = NULL;
+    int count = split_blocks(fn, end, &blocks);
+    if (count <= 0)
+    {
+        if (count < 0)
+            remark(REMARK_MISSED, "blocklayout", "UnknownDirective", 0, "blocks not reordered: directive in code");
+        return 0;
+    }
+
+    estimate_frequencies(blocks, count);
+    build_chains(blocks, count);
+
+    /* Entry chain first, then the remaining chains in their original order. */
+    Block **order = malloc(count * sizeof(Block *));
+    int placed = 0, moved = 0;
+    for (int i = 0; i < count; i++)
+    {
+        Block *head = i == 0 ? &blocks[0] : blocks[i].chain_head == &blocks[i] ? &blocks[i] : NULL;
+        for (Block *b = head; b && !b->placed; b = b->chain_next)
+        {
+            b->placed = 1;
+            moved += b->index != placed;
+            order[placed++] = b;
+        }
+    }
+
+    /* Snapshot the region per block, detach it, and relink it in the new order. */
+    int total = 0;
+    for (MInstr *instr = fn->head; instr != end; instr = instr->next)
+        total++;
+    MInstr **instrs = malloc(total * sizeof(MInstr *));
+    int *offsets = malloc((count + 1) * sizeof(int));
+    int n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        offsets[i] = n;
+        for (MInstr *instr = blocks[i].first; n < total; instr = instr->next)
+        {
+            instrs[n++] = instr;
+            if (instr == blocks[i].last)
+                break;
+        }
+    }
+    offsets[count] = n;
+    for (int i = 0; i < n; i++)
+        mir_unlink(fn, instrs[i]);
+    for (int i = 0; i < count; i++)
+    {
+        int b = order[i]->index;
+        for (int k = offsets[b]; k < offsets[b + 1]; k++)
+            mir_insert_before(fn, end, instrs[k]);
+    }
+    free(instrs);
+    free(offsets);
+
+    int removed = 0, inverted = 0;
+    for (int i = 0; i < count; i++)
+        fix_branches(fn, order[i], i + 1 < count ? order[i + 1] : NULL, &removed, &inverted);
+
+    int budget = ctx->level == OPT_OS ? 0 : ctx->level == OPT_O1 ? PADDING_BUDGET_O1 : PADDING_BUDGET_O2;
+    int aligned = align_blocks(fn, blocks, count, budget);
+
+    if (moved || removed || inverted || aligned)
+        remark(REMARK_ANALYSIS, "blocklayout", "Layout", 0,
+               "%d blocks: %d moved, %d jumps removed, %d branches inverted, %d aligned", count, moved, removed,
+               inverted, aligned);
+
+    free(order);
+    free(blocks);
+    return moved + removed + inverted + aligned;
+}
@@ -2,6 +2,7 @@
  * @file lexer.c
  * @brief Lexer implementation for the SEG language compiler.
  *        Converts source code into tokens including keywords, literals, operators, and symbols.
+ *        A '#' directive becomes a single pragma token holding the rest of its line.
  * @author Dario Romandini
  */
 
@@ -28,6 +29,10 @@ static TokenType check_keyword(const char *str)
         return TOKEN_IF;
     if (strcmp(str, "else") == 0)
         return TOKEN_ELSE;
+    if (strcmp(str, "while") == 0)
+        return TOKEN_WHILE;
+    if (strcmp(str, "for") == 0)
+        return TOKEN_FOR;
     if (strcmp(str, "true") == 0 || strcmp(str, "false") == 0)
         return TOKEN_BOOL_LITERAL;
     return TOKEN_IDENTIFIER;
@@ -37,26 +42,46 @@ void lexer_init(Lexer *lexer, FILE *source)
 {
     lexer->source = source;
     lexer->line = 1;
+    lexer->column = 1;
+}
+
+static int next_char(Lexer *lexer)
+{
+    int c = fgetc(lexer->source);
+    if (c != EOF)
+        lexer->column++;
+    return c;
+}
+
+static void put_back(Lexer *lexer, int c)
+{
+    if (c == EOF)
+        return;
+    ungetc(c, lexer->source);
+    lexer->column--;
 }
 
 Token lexer_next_token(Lexer *lexer)
 {
     int c;
     Token token = {0};
-    token.line = lexer->line;
 
-    while ((c = fgetc(lexer->source)) != EOF)
+    while ((c = next_char(lexer)) != EOF)
     {
         if (c == ' ' || c == '\t' || c == '\r')
             continue;
         if (c == '\n')
         {
             lexer->line++;
+            lexer->column = 1;
             continue;
         }
         break;
     }
 
+    token.line = lexer->line;
+    token.column = lexer->column - 1;
+
     if (c == EOF)
     {
         token.type = TOKEN_EOF;
@@ -68,9 +93,9 @@ Token lexer_next_token(Lexer *lexer)
         char buffer[64] = {0};
         int i = 0;
         buffer[i++] = c;
-        while ((c = fgetc(lexer->source)) != EOF && (isalnum(c) || c == '_'))
+        while ((c = next_char(lexer)) != EOF && (isalnum(c) || c == '_'))
             buffer[i++] = c;
-        ungetc(c, lexer->source);
+        put_back(lexer, c);
         token.type = check_keyword(buffer);
         token.lexeme = strdup(buffer);
         return token;
@@ -81,9 +106,9 @@ Token lexer_next_token(Lexer *lexer)
         char buffer[64] = {0};
         int i = 0;
         buffer[i++] = c;
-        while ((c = fgetc(lexer->source)) != EOF && (isdigit(c) || c == '.'))
+        while ((c = next_char(lexer)) != EOF && (isdigit(c) || c == '.'))
             buffer[i++] = c;
-        ungetc(c, lexer->source);
+        put_back(lexer, c);
         token.type = TOKEN_NUMBER;
         token.lexeme = strdup(buffer);
         return token;
@@ -92,8 +117,8 @@ Token lexer_next_token(Lexer *lexer)
     if (c == '\'')
     {
         char buffer[4] = {0};
-        buffer[0] = fgetc(lexer->source);
-        if (fgetc(lexer->source) != '\'')
+        buffer[0] = next_char(lexer);
+        if (next_char(lexer) != '\'')
         {
             token.type = TOKEN_ERROR;
             token.lexeme = strdup("Unterminated char");
@@ -108,7 +133,7 @@ Token lexer_next_token(Lexer *lexer)
     {
         char buffer[256] = {0};
         int i = 0;
-        while ((c = fgetc(lexer->source)) != EOF && c != '"')
+        while ((c = next_char(lexer)) != EOF && c != '"')
         {
             if (c == '\n')
             {
@@ -123,6 +148,25 @@ Token lexer_next_token(Lexer *lexer)
         return token;
     }
 
+    if (c == '#')
+    {
+        char buffer[256] = {0};
+        int i = 0;
+        while ((c = next_char(lexer)) != EOF && c != '\n')
+        {
+            if (i == 0 && (c == ' ' || c == '\t'))
+                continue;
+            if (i < (int)sizeof(buffer) - 1)
+                buffer[i++] = c;
+        }
+        put_back(lexer, c);
+        while (i > 0 && (buffer[i - 1] == ' ' || buffer[i - 1] == '\t' || buffer[i - 1] == '\r'))
+            buffer[--i] = '\0';
+        token.type = TOKEN_PRAGMA;
+        token.lexeme = strdup(buffer);
+        return token;
+    }
+
     token.lexeme = malloc(3);
     token.lexeme[0] = c;
     token.lexeme[1] = '\0';
@@ -130,7 +174,7 @@ Token lexer_next_token(Lexer *lexer)
     switch (c)
     {
     case '=':
-        if ((c = fgetc(lexer->source)) == '=')
+        if ((c = next_char(lexer)) == '=')
         {
             token.type = TOKEN_EQ;
             token.lexeme[1] = '=';
@@ -138,12 +182,12 @@ Token lexer_next_token(Lexer *lexer)
         }
         else
         {
-            ungetc(c, lexer->source);
+            put_back(lexer, c);
             token.type = TOKEN_ASSIGN;
         }
         break;
     case '!':
-        if ((c = fgetc(lexer->source)) == '=')
+        if ((c = next_char(lexer)) == '=')
         {
             token.type = TOKEN_NEQ;
             token.lexeme[1] = '=';
@@ -151,12 +195,12 @@ Token lexer_next_token(Lexer *lexer)
         }
         else
         {
-            ungetc(c, lexer->source);
+            put_back(lexer, c);
             token.type = TOKEN_NOT;
         }
         break;
     case '<':
-        if ((c = fgetc(lexer->source)) == '=')
+        if ((c = next_char(lexer)) == '=')
         {
             token.type = TOKEN_LEQ;
             token.lexeme[1] = '=';
@@ -164,12 +208,12 @@ Token lexer_next_token(Lexer *lexer)
         }
         else
         {
-            ungetc(c, lexer->source);
+            put_back(lexer, c);
             token.type = TOKEN_LT;
         }
         break;
     case '>':
-        if ((c = fgetc(lexer->source)) == '=')
+        if ((c = next_char(lexer)) == '=')
         {
             token.type = TOKEN_GEQ;
             token.lexeme[1] = '=';
@@ -177,7 +221,7 @@ Token lexer_next_token(Lexer *lexer)
         }
         else
         {
-            ungetc(c, lexer->source);
+            put_back(lexer, c);
             token.type = TOKEN_GT;
         }
         break;
@@ -193,9 +237,15 @@ Token lexer_next_token(Lexer *lexer)
     case '/':
         token.type = TOKEN_SLASH;
         break;
+    case '%':
+        token.type = TOKEN_PERCENT;
+        break;
     case ';':
         token.type = TOKEN_SEMICOLON;
         break;
+    case ',':
+        token.type = TOKEN_COMMA;
+        break;
     case '(':
         token.type = TOKEN_LPAREN;
         break;
@@ -208,8 +258,14 @@ Token lexer_next_token(Lexer *lexer)
     case '}':
         token.type = TOKEN_RBRACE;
         break;
+    case '[':
+        token.type = TOKEN_LBRACKET;
+        break;
+    case ']':
+        token.type = TOKEN_RBRACKET;
+        break;
     case '&':
-        if ((c = fgetc(lexer->source)) == '&')
+        if ((c = next_char(lexer)) == '&')
         {
             token.type = TOKEN_AND;
             token.lexeme[1] = '&';
@@ -217,12 +273,12 @@ Token lexer_next_token(Lexer *lexer)
         }
         else
         {
-            ungetc(c, lexer->source);
+            put_back(lexer, c);
             token.type = TOKEN_ERROR;
         }
         break;
     case '|':
-        if ((c = fgetc(lexer->source)) == '|')
+        if ((c = next_char(lexer)) == '|')
         {
             token.type = TOKEN_OR;
             token.lexeme[1] = '|';
@@ -230,7 +286,7 @@ Token lexer_next_token(Lexer *lexer)
         }
         else
         {
-            ungetc(c, lexer->source);
+            put_back(lexer, c);
             token.type = TOKEN_ERROR;
         }
         break;
@@ -0,0 +1,698 @@
+/**
+ * @file licm.c
+ * @brief Loop-invariant code motion for the SEG language compiler.
+ *        Works on the AST, where a hoisted value can get a variable of its own: the
+ *        instruction list computes every expression in rax, so an invariant value there
+ *        has no register to live in across the loop. Invariant expressions and array
+ *        element loads move into temporaries set in the loop preheader, which promote
+ *        then keeps in registers; array elements stored at a constant index are kept in a
+ *        temporary that is stored back once at the loop exit.
+ * @author Dario Romandini
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+#include "token.h"
+
+/*
+ * A variable or array the loop writes. Variables and arrays written at a computed index or
+ * declared in the loop are written as a whole; elements stored at a constant index are
+ * recorded one by one, so that loads of other elements stay invariant. Each name is a
+ * separate global or block variable, so two different names never alias.
+ */
+typedef struct
+{
+    char *name;      ///< Variable or array
+    long long index; ///< Element stored to, unless whole
+    int whole;       ///< Set when any element, or the variable itself, may change
+} Write;
+
+typedef struct
+{
+    const ASTNode *expression; ///< Expression computed in the preheader
+    char *temp;                ///< Temporary holding its value
+} Hoisted;
+
+typedef struct
+{
+    ASTNode *node;         ///< The AST_LOOP
+    Write *writes;         ///< Everything the condition, body and update write
+    int write_count;
+    int write_capacity;
+    Hoisted *hoisted;      ///< Expressions already moved to the preheader
+    int hoisted_count;
+    int hoisted_capacity;
+    int nested;            ///< The loop contains another loop
+    int runs_body;         ///< The body runs at least once whenever the preheader runs
+} Loop;
+
+/* Length and element type of an array declaration anywhere in the program. */
+typedef struct
+{
+    const char *name;
+    VarType type;
+    int length;
+} ArrayInfo;
+
+typedef struct
+{
+    ArrayInfo *items;
+    int count;
+    int capacity;
+} ArrayTable;
+
+static int literal_index(const ASTNode *node, long long *value)
+{
+    if (!node || node->type != AST_LITERAL)
+        return 0;
+    if (node->result_type == TYPE_BOOL)
+    {
+        *value = strcmp(node->literal.value, "true") == 0;
+        return 1;
+    }
+    if (node->result_type == TYPE_INT)
+    {
+        *value = strtoll(node->literal.value, NULL, 10);
+        return 1;
+    }
+    return 0;
+}
+
+static void add_write(Loop *loop, const char *name, long long index, int whole)
+{
+    if (loop->write_count == loop->write_capacity)
+    {
+        loop->write_capacity = loop->write_capacity ? 2 * loop->write_capacity : 16;
+        loop->writes = realloc(loop->writes, loop->write_capacity * sizeof(Write));
+    }
+    loop->writes[loop->write_count++] = (Write){strdup_safe(name), index, whole};
+}
+
+static void collect_writes(Loop *loop, ASTNode *node)
+{
+    long long index;
+    for (; node; node = node->next)
+    {
+        switch (node->type)
+        {
+        case AST_VAR_DECL:
+            add_write(loop, node->var_decl.name, 0, 1);
+            break;
+        case AST_IF_STATEMENT:
+            collect_writes(loop, node->if_statement.then_branch);
+            collect_writes(loop, node->if_statement.else_branch);
+            break;
+        case AST_LOOP:
+            loop->nested = 1;
+            collect_writes(loop, node->loop.init);
+            collect_writes(loop, node->loop.preheader);
+            collect_writes(loop, node->loop.update);
+            collect_writes(loop, node->loop.body);
+            collect_writes(loop, node->loop.exit);
+            break;
+        case AST_ARRAY_DECL:
+            add_write(loop, node->array_decl.name, 0, 1);
+            break;
+        case AST_ELEMENT_ASSIGN:
+            if (literal_index(node->element_assign.index, &index))
+                add_write(loop, node->element_assign.name, index, 0);
+            else
+                add_write(loop, node->element_assign.name, 0, 1);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void clear_writes(Loop *loop)
+{
+    for (int i = 0; i < loop->write_count; i++)
+        free(loop->writes[i].name);
+    loop->write_count = 0;
+}
+
+static void analyze_loop(Loop *loop)
+{
+    clear_writes(loop);
+    loop->nested = 0;
+    collect_writes(loop, loop->node->loop.update);
+    collect_writes(loop, loop->node->loop.body);
+}
+
+/* Whether the loop may change a variable (index NULL) or the element name[index]. */
+static int is_written(const Loop *loop, const char *name, const ASTNode *index)
+{
+    long long value = 0;
+    int constant = literal_index(index, &value);
+    for (int i = 0; i < loop->write_count; i++)
+    {
+        const Write *write = &loop->writes[i];
+        if (strcmp(write->name, name) != 0)
+            continue;
+        if (write->whole || !index || !constant || write->index == value)
+            return 1;
+    }
+    return 0;
+}
+
+static int is_written_whole(const Loop *loop, const char *name)
+{
+    for (int i = 0; i < loop->write_count; i++)
+    {
+        if (loop->writes[i].whole && strcmp(loop->writes[i].name, name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static int is_integer_type(VarType type)
+{
+    return type == TYPE_INT || type == TYPE_BOOL;
+}
+
+/* An integer or boolean expression whose operands the loop never writes. */
+static int is_invariant(const Loop *loop, const ASTNode *node)
+{
+    if (!is_integer_type(node->result_type))
+        return 0;
+    switch (node->type)
+    {
+    case AST_LITERAL:
+        return 1;
+    case AST_IDENTIFIER:
+        return !is_written(loop, node->identifier.name, NULL);
+    case AST_BINARY_EXPR:
+        return is_invariant(loop, node->binary_expr.left) && is_invariant(loop, node->binary_expr.right);
+    case AST_UNARY_EXPR:
+        return is_invariant(loop, node->unary_expr.operand);
+    case AST_INDEX:
+        return node->result_type == TYPE_INT && is_invariant(loop, node->index.index) &&
+               !is_written(loop, node->index.name, node->index.index);
+    default:
+        return 0;
+    }
+}
+
+/* A boolean expression that is already 0 or 1; "&" of two integers is typed bool but is not. */
+static int is_truth_value(const ASTNode *node)
+{
+    switch (node->type)
+    {
+    case AST_LITERAL:
+    case AST_IDENTIFIER:
+        return node->result_type == TYPE_BOOL;
+    case AST_UNARY_EXPR:
+        return node->unary_expr.op == TOKEN_NOT;
+    case AST_BINARY_EXPR:
+        switch (node->binary_expr.op)
+        {
+        case TOKEN_EQ:
+        case TOKEN_NEQ:
+        case TOKEN_LT:
+        case TOKEN_LEQ:
+        case TOKEN_GT:
+        case TOKEN_GEQ:
+            return 1;
+        case TOKEN_AND:
+        case TOKEN_OR:
+        case TOKEN_XOR:
+            return is_truth_value(node->binary_expr.left) && is_truth_value(node->binary_expr.right);
+        default:
+            return 0;
+        }
+    default:
+        return 0;
+    }
+}
+
+static int is_leaf(const ASTNode *node)
+{
+    return node->type == AST_LITERAL || node->type == AST_IDENTIFIER;
+}
+
+static int reads_variable(const ASTNode *node)
+{
+    switch (node->type)
+    {
+    case AST_IDENTIFIER:
+    case AST_INDEX:
+        return 1;
+    case AST_BINARY_EXPR:
+        return reads_variable(node->binary_expr.left) || reads_variable(node->binary_expr.right);
+    case AST_UNARY_EXPR:
+        return reads_variable(node->unary_expr.operand);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Whether moving an invariant expression to a temporary saves work in the loop. A leaf is
+ * already a single load or immediate, and a comparison of two leaves that decides a branch
+ * already compiles to a compare and a jump, as a test of the temporary would.
+ */
+static int worth_hoisting(const ASTNode *node, int branch_condition)
+{
+    if (is_leaf(node) || !reads_variable(node))
+        return 0;
+    if (node->result_type == TYPE_BOOL && !is_truth_value(node))
+        return 0;
+    if (branch_condition && node->type == AST_BINARY_EXPR && is_truth_value(node) &&
+        is_leaf(node->binary_expr.left) && is_leaf(node->binary_expr.right))
+        return 0;
+    return 1;
+}
+
+static ASTNode *temp_reference(const char *temp, const ASTNode *origin)
+{
+    ASTNode *node = create_identifier_node(temp);
+    node->result_type = origin->result_type;
+    return set_node_location(node, origin->line, origin->column);
+}
+
+static void describe(const ASTNode *node, char *buffer, size_t size)
+{
+    long long element;
+    if (node->type == AST_INDEX && literal_index(node->index.index, &element))
+        snprintf(buffer, size, "load of '%.*s[%lld]'", source_length(node->index.name), node->index.name, element);
+    else if (node->type == AST_INDEX)
+        snprintf(buffer, size, "load of '%.*s[]'", source_length(node->index.name), node->index.name);
+    else if (node->type == AST_BINARY_EXPR)
+        snprintf(buffer, size, "%s", token_type_to_string(node->binary_expr.op));
+    else
+        snprintf(buffer, size, "%s", token_type_to_string(node->unary_expr.op));
+}
+
+/* Replaces an invariant expression with a temporary, shared by equal expressions of the loop. */
+static void hoist(Loop *loop, ASTNode **link)
+{
+    ASTNode *node = *link;
+    char what[96];
+    describe(node, what, sizeof(what));
+
+    for (int i = 0; i < loop->hoisted_count; i++)
+    {
+        if (same_expression(loop->hoisted[i].expression, node))
+        {
+            remark(REMARK_PASSED, "licm", "Hoisted", node->line,
+                   "loop-invariant %s reuses the value hoisted out of the loop at line %d", what,
+                   loop->node->line);
+            *link = temp_reference(loop->hoisted[i].temp, node);
+            free_ast(node);
+            return;
+        }
+    }
+
+    remark(REMARK_PASSED, "licm", "Hoisted", node->line, "loop-invariant %s hoisted out of the loop at line %d",
+           what, loop->node->line);
+    char *temp = new_temp("licm");
+    *link = temp_reference(temp, node);
+    ASTNode *declaration = create_var_decl_node(node->result_type, temp, node);
+    append_statement(&loop->node->loop.preheader, set_node_location(declaration, node->line, node->column));
+
+    if (loop->hoisted_count == loop->hoisted_capacity)
+    {
+        loop->hoisted_capacity = loop->hoisted_capacity ? 2 * loop->hoisted_capacity : 8;
+        loop->hoisted = realloc(loop->hoisted, loop->hoisted_capacity * sizeof(Hoisted));
+    }
+    loop->hoisted[loop->hoisted_count++] = (Hoisted){node, temp};
+}
+
+/*
+ * Hoists the largest invariant subexpressions. Expressions that may trap only move when
+ * they run on the first iteration anyway (executed), so the preheader never faults where
+ * the original program did not.
+ */
+static int hoist_expression(Loop *loop, ASTNode **link, int executed, int branch_condition)
+{
+    ASTNode *node = *link;
+    if (!node)
+        return 0;
+    if ((node->type == AST_BINARY_EXPR || node->type == AST_UNARY_EXPR || node->type == AST_INDEX) &&
+        is_invariant(loop, node) && worth_hoisting(node, branch_condition))
+    {
+        if (!may_trap(node) || executed)
+        {
+            hoist(loop, link);
+            return 1;
+        }
+        char what[96];
+        describe(node, what, sizeof(what));
+        remark(REMARK_MISSED, "licm", "NotHoisted", node->line,
+               "loop-invariant %s not hoisted: it may trap and might not run on every path through the loop", what);
+    }
+
+    switch (node->type)
+    {
+    case AST_BINARY_EXPR:
+        return hoist_expression(loop, &node->binary_expr.left, executed, 0) +
+               hoist_expression(loop, &node->binary_expr.right, executed, 0);
+    case AST_UNARY_EXPR:
+        return hoist_expression(loop, &node->unary_expr.operand, executed, 0);
+    case AST_INDEX:
+        return hoist_expression(loop, &node->index.index, executed, 0);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Statements directly in the body run on the first iteration when the body runs at least
+ * once, up to the first nested loop, which might not terminate.
+ */
+static int hoist_statements(Loop *loop, ASTNode *node, int executed)
+{
+    int changes = 0;
+    for (; node; node = node->next)
+    {
+        switch (node->type)
+        {
+        case AST_VAR_DECL:
+            changes += hoist_expression(loop, &node->var_decl.value, executed, 0);
+            break;
+        case AST_IF_STATEMENT:
+            changes += hoist_expression(loop, &node->if_statement.condition, executed, 1);
+            changes += hoist_statements(loop, node->if_statement.then_branch, 0);
+            changes += hoist_statements(loop, node->if_statement.else_branch, 0);
+            break;
+        case AST_LOOP:
+            changes += hoist_statements(loop, node->loop.init, executed);
+            changes += hoist_expression(loop, &node->loop.condition, executed, 1);
+            changes += hoist_statements(loop, node->loop.update, 0);
+            changes += hoist_statements(loop, node->loop.body, 0);
+            executed = 0;
+            break;
+        case AST_ARRAY_DECL:
+            for (int i = 0; i < node->array_decl.value_count; i++)
+                changes += hoist_expression(loop, &node->array_decl.values[i], executed, 0);
+            break;
+        case AST_ELEMENT_ASSIGN:
+            changes += hoist_expression(loop, &node->element_assign.index, executed, 0);
+            changes += hoist_expression(loop, &node->element_assign.value, executed, 0);
+            break;
+        default:
+            break;
+        }
+    }
+    return changes;
+}
+
+static void collect_arrays(ArrayTable *table, ASTNode *node)
+{
+    for (; node; node = node->next)
+    {
+        switch (node->type)
+        {
+        case AST_ARRAY_DECL:
+            if (table->count == table->capacity)
+            {
+                table->capacity = table->capacity ? 2 * table->capacity : 8;
+                table->items = realloc(table->items, table->capacity * sizeof(ArrayInfo));
+            }
+            table->items[table->count++] =
+                (ArrayInfo){node->array_decl.name, node->array_decl.var_type, node->array_decl.length};
+            break;
+        case AST_IF_STATEMENT:
+            collect_arrays(table, node->if_statement.then_branch);
+            collect_arrays(table, node->if_statement.else_branch);
+            break;
+        case AST_LOOP:
+            collect_arrays(table, node->loop.init);
+            collect_arrays(table, node->loop.body);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static const ArrayInfo *find_array(const ArrayTable *table, const char *name)
+{
+    for (int i = 0; i < table->count; i++)
+    {
+        if (strcmp(table->items[i].name, name) == 0)
+            return &table->items[i];
+    }
+    return NULL;
+}
+
+/* Whether an expression reads an element of the array at an index that is not a literal. */
+static int reads_computed_element(const ASTNode *node, const char *name)
+{
+    if (!node)
+        return 0;
+    switch (node->type)
+    {
+    case AST_BINARY_EXPR:
+        return reads_computed_element(node->binary_expr.left, name) ||
+               reads_computed_element(node->binary_expr.right, name);
+    case AST_UNARY_EXPR:
+        return reads_computed_element(node->unary_expr.operand, name);
+    case AST_INDEX:
+        return (strcmp(node->index.name, name) == 0 && node->index.index->type != AST_LITERAL) ||
+               reads_computed_element(node->index.index, name);
+    default:
+        return 0;
+    }
+}
+
+static int statements_read_computed_element(const ASTNode *node, const char *name)
+{
+    for (; node; node = node->next)
+    {
+        int found = 0;
+        switch (node->type)
+        {
+        case AST_VAR_DECL:
+            found = reads_computed_element(node->var_decl.value, name);
+            break;
+        case AST_IF_STATEMENT:
+            found = reads_computed_element(node->if_statement.condition, name) ||
+                    statements_read_computed_element(node->if_statement.then_branch, name) ||
+                    statements_read_computed_element(node->if_statement.else_branch, name);
+            break;
+        case AST_LOOP:
+            found = statements_read_computed_element(node->loop.init, name) ||
+                    statements_read_computed_element(node->loop.preheader, name) ||
+                    reads_computed_element(node->loop.condition, name) ||
+                    statements_read_computed_element(node->loop.update, name) ||
+                    statements_read_computed_element(node->loop.body, name) ||
+                    statements_read_computed_element(node->loop.exit, name);
+            break;
+        case AST_ARRAY_DECL:
+            for (int i = 0; i < node->array_decl.value_count && !found; i++)
+                found = reads_computed_element(node->array_decl.values[i], name);
+            break;
+        case AST_ELEMENT_ASSIGN:
+            found = reads_computed_element(node->element_assign.index, name) ||
+                    reads_computed_element(node->element_assign.value, name);
+            break;
+        default:
+            break;
+        }
+        if (found)
+            return 1;
+    }
+    return 0;
+}
+
+static int is_element(const ASTNode *index, long long element)
+{
+    long long value;
+    return literal_index(index, &value) && value == element;
+}
+
+static void replace_element_reads(ASTNode **link, const char *name, long long element, const char *temp)
+{
+    ASTNode *node = *link;
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case AST_BINARY_EXPR:
+        replace_element_reads(&node->binary_expr.left, name, element, temp);
+        replace_element_reads(&node->binary_expr.right, name, element, temp);
+        break;
+    case AST_UNARY_EXPR:
+        replace_element_reads(&node->unary_expr.operand, name, element, temp);
+        break;
+    case AST_INDEX:
+        if (strcmp(node->index.name, name) == 0 && is_element(node->index.index, element))
+        {
+            *link = temp_reference(temp, node);
+            free_ast(node);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* Turns name[element] = value into temp = value, keeping the node's place in its list. */
+static void replace_element(ASTNode *node, const char *name, long long element, const char *temp)
+{
+    for (; node; node = node->next)
+    {
+        switch (node->type)
+        {
+        case AST_VAR_DECL:
+            replace_element_reads(&node->var_decl.value, name, element, temp);
+            break;
+        case AST_IF_STATEMENT:
+            replace_element_reads(&node->if_statement.condition, name, element, temp);
+            replace_element(node->if_statement.then_branch, name, element, temp);
+            replace_element(node->if_statement.else_branch, name, element, temp);
+            break;
+        case AST_LOOP:
+            replace_element(node->loop.init, name, element, temp);
+            replace_element(node->loop.preheader, name, element, temp);
+            replace_element_reads(&node->loop.condition, name, element, temp);
+            replace_element(node->loop.update, name, element, temp);
+            replace_element(node->loop.body, name, element, temp);
+            replace_element(node->loop.exit, name, element, temp);
+            break;
+        case AST_ARRAY_DECL:
+            for (int i = 0; i < node->array_decl.value_count; i++)
+                replace_element_reads(&node->array_decl.values[i], name, element, temp);
+            break;
+        case AST_ELEMENT_ASSIGN:
+            replace_element_reads(&node->element_assign.index, name, element, temp);
+            replace_element_reads(&node->element_assign.value, name, element, temp);
+            if (strcmp(node->element_assign.name, name) == 0 && is_element(node->element_assign.index, element))
+            {
+                ASTNode *value = node->element_assign.value;
+                free(node->element_assign.name);
+                free_ast(node->element_assign.index);
+                node->type = AST_VAR_DECL;
+                node->result_type = TYPE_INT;
+                node->var_decl.var_type = TYPE_INT;
+                node->var_decl.name = strdup_safe(temp);
+                node->var_decl.value = value;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static ASTNode *index_literal(long long element, int line, int column)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%lld", element);
+    return set_node_location(create_literal_node(buffer, TYPE_INT), line, column);
+}
+
+/*
+ * Scalar replacement of the int elements the loop stores at a constant index: the preheader
+ * loads the element into a temporary, the loop reads and writes the temporary, and the exit
+ * stores it back. This is only legal when every access to the array in the loop is at a
+ * literal index, since an access at a computed index may reach the same element.
+ */
+static int sink_stores(Loop *loop, const ArrayTable *arrays)
+{
+    ASTNode *node = loop->node;
+    int changes = 0;
+
+    for (int i = 0; i < loop->write_count; i++)
+    {
+        const Write *write = &loop->writes[i];
+        int repeated = 0;
+        for (int j = 0; j < i && !repeated; j++)
+            repeated = !loop->writes[j].whole && loop->writes[j].index == write->index &&
+                       strcmp(loop->writes[j].name, write->name) == 0;
+        if (write->whole || repeated)
+            continue;
+
+        const ArrayInfo *array = find_array(arrays, write->name);
+        if (!array || array->type != TYPE_INT || write->index < 0 || write->index >= array->length ||
+            is_written_whole(loop, write->name))
+            continue;
+        if (reads_computed_element(node->loop.condition, write->name) ||
+            statements_read_computed_element(node->loop.update, write->name) ||
+            statements_read_computed_element(node->loop.body, write->name))
+        {
+            remark(REMARK_MISSED, "licm", "StoreNotSunk", node->line,
+                   "stores to '%.*s[%lld]' not sunk: the loop also reads '%.*s' at a computed index",
+                   source_length(array->name), array->name, write->index, source_length(array->name), array->name);
+            continue;
+        }
+
+        remark(REMARK_PASSED, "licm", "StoreSunk", node->line,
+               "'%.*s[%lld]' kept in a temporary across the loop; its stores sunk to the loop exit",
+               source_length(array->name), array->name, write->index);
+        char *temp = new_temp("licm");
+        replace_element_reads(&node->loop.condition, write->name, write->index, temp);
+        replace_element(node->loop.update, write->name, write->index, temp);
+        replace_element(node->loop.body, write->name, write->index, temp);
+
+        ASTNode *load = create_index_node(write->name, index_literal(write->index, node->line, node->column));
+        load->result_type = TYPE_INT;
+        set_node_location(load, node->line, node->column);
+        ASTNode *declaration = create_var_decl_node(TYPE_INT, temp, load);
+        append_statement(&node->loop.preheader, set_node_location(declaration, node->line, node->column));
+        ASTNode *store = create_element_assign_node(write->name, index_literal(write->index, node->line, node->column),
+                                                    temp_reference(temp, load));
+        append_statement(&node->loop.exit, set_node_location(store, node->line, node->column));
+        free(temp);
+        changes++;
+    }
+    return changes;
+}
+
+static int optimize_statements(ASTNode *node, const ArrayTable *arrays);
+
+/* Outer loops go first, so a value invariant in both loops is computed once, before both. */
+static int optimize_loop(ASTNode *node, const ArrayTable *arrays)
+{
+    Loop loop = {0};
+    loop.node = node;
+    analyze_loop(&loop);
+
+    int changes = sink_stores(&loop, arrays);
+    if (changes)
+        analyze_loop(&loop);
+
+    loop.runs_body = loop_condition_holds_on_entry(node);
+    changes += hoist_expression(&loop, &node->loop.condition, !loop.nested, 1);
+    changes += hoist_statements(&loop, node->loop.body, loop.runs_body);
+    changes += hoist_statements(&loop, node->loop.update, loop.runs_body && !loop.nested);
+
+    for (int i = 0; i < loop.hoisted_count; i++)
+        free(loop.hoisted[i].temp);
+    free(loop.hoisted);
+    clear_writes(&loop);
+    free(loop.writes);
+
+    return changes + optimize_statements(node->loop.body, arrays);
+}
+
+static int optimize_statements(ASTNode *node, const ArrayTable *arrays)
+{
+    int changes = 0;
+    for (; node; node = node->next)
+    {
+        if (node->type == AST_LOOP)
+            changes += optimize_loop(node, arrays);
+        else if (node->type == AST_IF_STATEMENT)
+        {
+            changes += optimize_statements(node->if_statement.then_branch, arrays);
+            changes += optimize_statements(node->if_statement.else_branch, arrays);
+        }
+    }
+    return changes;
+}
+
+int run_licm(ASTNode **program, PassContext *ctx)
+{
+    (void)ctx;
+    ArrayTable arrays = {0};
+    collect_arrays(&arrays, *program);
+    int changes = optimize_statements(*program, &arrays);
+    free(arrays.items);
+    return changes;
+}
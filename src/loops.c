@@ -0,0 +1,273 @@
+/**
+ * @file loops.c
+ * @brief Counted-loop analysis for the SEG language compiler, shared by unroll and ivopt.
+ *        A counted loop steps its variable by a constant, nothing else in the body writes
+ *        the variable, and the condition compares it with a bound the loop does not change.
+ * @author Dario Romandini
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+
+/* Steps whose multiples by any unroll count or index scale stay far from overflow. */
+#define MAX_STEP (1LL << 20)
+
+int integer_literal_value(const ASTNode *node, long long *value)
+{
+    if (!node || node->type != AST_LITERAL || node->result_type != TYPE_INT)
+        return 0;
+    *value = strtoll(node->literal.value, NULL, 10);
+    return 1;
+}
+
+int is_counter(const ASTNode *node, const char *counter)
+{
+    return node->type == AST_IDENTIFIER && strcmp(node->identifier.name, counter) == 0;
+}
+
+int writes_variable(const ASTNode *node, const ASTNode *stop, const char *name)
+{
+    for (; node && node != stop; node = node->next)
+    {
+        switch (node->type)
+        {
+        case AST_VAR_DECL:
+            if (strcmp(node->var_decl.name, name) == 0)
+                return 1;
+            break;
+        case AST_ELEMENT_ASSIGN:
+            if (strcmp(node->element_assign.name, name) == 0)
+                return 1;
+            break;
+        case AST_IF_STATEMENT:
+            if (writes_variable(node->if_statement.then_branch, NULL, name) ||
+                writes_variable(node->if_statement.else_branch, NULL, name))
+                return 1;
+            break;
+        case AST_LOOP:
+            if (writes_variable(node->loop.init, NULL, name) || writes_variable(node->loop.preheader, NULL, name) ||
+                writes_variable(node->loop.update, NULL, name) || writes_variable(node->loop.body, NULL, name) ||
+                writes_variable(node->loop.exit, NULL, name))
+                return 1;
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+int is_loop_invariant(const ASTNode *node, const ASTNode *loop)
+{
+    const ASTNode *body = loop->loop.body, *update = loop->loop.update;
+    switch (node->type)
+    {
+    case AST_LITERAL:
+        return 1;
+    case AST_IDENTIFIER:
+        return !writes_variable(body, NULL, node->identifier.name) &&
+               !writes_variable(update, NULL, node->identifier.name);
+    case AST_INDEX:
+        return !node->index.pointer && !writes_variable(body, NULL, node->index.name) &&
+               !writes_variable(update, NULL, node->index.name) && is_loop_invariant(node->index.index, loop);
+    case AST_BINARY_EXPR:
+        return is_loop_invariant(node->binary_expr.left, loop) && is_loop_invariant(node->binary_expr.right, loop);
+    case AST_UNARY_EXPR:
+        return is_loop_invariant(node->unary_expr.operand, loop);
+    default:
+        return 0;
+    }
+}
+
+int count_reads(const ASTNode *node, const ASTNode *stop, const char *name)
+{
+    int count = 0;
+    for (; node && node != stop; node = node->next)
+    {
+        switch (node->type)
+        {
+        case AST_VAR_DECL:
+            count += count_reads(node->var_decl.value, NULL, name);
+            break;
+        case AST_IDENTIFIER:
+            count += strcmp(node->identifier.name, name) == 0;
+            break;
+        case AST_BINARY_EXPR:
+            count += count_reads(node->binary_expr.left, NULL, name) + count_reads(node->binary_expr.right, NULL, name);
+            break;
+        case AST_UNARY_EXPR:
+            count += count_reads(node->unary_expr.operand, NULL, name);
+            break;
+        case AST_IF_STATEMENT:
+            count += count_reads(node->if_statement.condition, NULL, name) +
+                     count_reads(node->if_statement.then_branch, NULL, name) +
+                     count_reads(node->if_statement.else_branch, NULL, name);
+            break;
+        case AST_LOOP:
+            count += count_reads(node->loop.init, NULL, name) + count_reads(node->loop.preheader, NULL, name) +
+                     count_reads(node->loop.condition, NULL, name) + count_reads(node->loop.latch, NULL, name) +
+                     count_reads(node->loop.update, NULL, name) + count_reads(node->loop.body, NULL, name) +
+                     count_reads(node->loop.exit, NULL, name);
+            break;
+        case AST_ARRAY_DECL:
+            for (int i = 0; i < node->array_decl.value_count; i++)
+                count += count_reads(node->array_decl.values[i], NULL, name);
+            break;
+        case AST_INDEX:
+        case AST_ADDRESS:
+            count += count_reads(node->index.index, NULL, name);
+            break;
+        case AST_ELEMENT_ASSIGN:
+            count += count_reads(node->element_assign.index, NULL, name) +
+                     count_reads(node->element_assign.value, NULL, name);
+            break;
+        default:
+            break;
+        }
+    }
+    return count;
+}
+
+int occurs_outside(const ASTNode *node, const ASTNode *skip, const char *name)
+{
+    for (; node; node = node->next)
+    {
+        if (node == skip)
+            continue;
+        switch (node->type)
+        {
+        case AST_VAR_DECL:
+            if (strcmp(node->var_decl.name, name) == 0 || occurs_outside(node->var_decl.value, skip, name))
+                return 1;
+            break;
+        case AST_IDENTIFIER:
+            if (strcmp(node->identifier.name, name) == 0)
+                return 1;
+            break;
+        case AST_BINARY_EXPR:
+            if (occurs_outside(node->binary_expr.left, skip, name) || occurs_outside(node->binary_expr.right, skip, name))
+                return 1;
+            break;
+        case AST_UNARY_EXPR:
+            if (occurs_outside(node->unary_expr.operand, skip, name))
+                return 1;
+            break;
+        case AST_IF_STATEMENT:
+            if (occurs_outside(node->if_statement.condition, skip, name) ||
+                occurs_outside(node->if_statement.then_branch, skip, name) ||
+                occurs_outside(node->if_statement.else_branch, skip, name))
+                return 1;
+            break;
+        case AST_LOOP:
+            if (occurs_outside(node->loop.init, skip, name) || occurs_outside(node->loop.preheader, skip, name) ||
+                occurs_outside(node->loop.condition, skip, name) || occurs_outside(node->loop.latch, skip, name) ||
+                occurs_outside(node->loop.update, skip, name) || occurs_outside(node->loop.body, skip, name) ||
+                occurs_outside(node->loop.exit, skip, name))
+                return 1;
+            break;
+        case AST_ARRAY_DECL:
+            for (int i = 0; i < node->array_decl.value_count; i++)
+            {
+                if (occurs_outside(node->array_decl.values[i], skip, name))
+                    return 1;
+            }
+            break;
+        case AST_INDEX:
+        case AST_ADDRESS:
+            if (occurs_outside(node->index.index, skip, name))
+                return 1;
+            break;
+        case AST_ELEMENT_ASSIGN:
+            if (occurs_outside(node->element_assign.index, skip, name) ||
+                occurs_outside(node->element_assign.value, skip, name))
+                return 1;
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Reads "counter = counter + c", "counter = c + counter" or "counter = counter - c". */
+static int read_step(const ASTNode *update, const char *counter, long long *step)
+{
+    const ASTNode *value = update->var_decl.value;
+    long long c;
+    if (!value || value->type != AST_BINARY_EXPR)
+        return 0;
+    const ASTNode *left = value->binary_expr.left, *right = value->binary_expr.right;
+    if (value->binary_expr.op == TOKEN_PLUS && is_counter(left, counter) && integer_literal_value(right, &c))
+        *step = c;
+    else if (value->binary_expr.op == TOKEN_PLUS && is_counter(right, counter) && integer_literal_value(left, &c))
+        *step = c;
+    else if (value->binary_expr.op == TOKEN_MINUS && is_counter(left, counter) && integer_literal_value(right, &c) &&
+             c != LLONG_MIN)
+        *step = -c;
+    else
+        return 0;
+    return *step != 0 && *step <= MAX_STEP && *step >= -MAX_STEP;
+}
+
+const char *recognize_counted_loop(ASTNode *node, const ASTNode *previous, CountedLoop *loop)
+{
+    memset(loop, 0, sizeof(*loop));
+    loop->node = node;
+
+    ASTNode **link = &node->loop.update;
+    if (!*link)
+    {
+        for (link = &node->loop.body; *link && (*link)->next; link = &(*link)->next)
+            ;
+    }
+    ASTNode *update = *link;
+    if (!update || update->type != AST_VAR_DECL || update->next || update->var_decl.var_type != TYPE_INT ||
+        !read_step(update, update->var_decl.name, &loop->step))
+        return "the loop variable does not step by a constant";
+    loop->counter = update->var_decl.name;
+    loop->update = update;
+    loop->update_link = link;
+
+    ASTNode *condition = node->loop.condition;
+    if (condition->type != AST_BINARY_EXPR)
+        return "the condition does not compare the loop variable with a bound";
+    switch (condition->binary_expr.op)
+    {
+    case TOKEN_LT:
+    case TOKEN_LEQ:
+    case TOKEN_GT:
+    case TOKEN_GEQ:
+    case TOKEN_NEQ:
+        break;
+    default:
+        return "the condition does not compare the loop variable with a bound";
+    }
+    if (is_counter(condition->binary_expr.left, loop->counter))
+    {
+        loop->op = condition->binary_expr.op;
+        loop->bound = condition->binary_expr.right;
+    }
+    else if (is_counter(condition->binary_expr.right, loop->counter))
+    {
+        loop->op = mirror_comparison(condition->binary_expr.op);
+        loop->bound = condition->binary_expr.left;
+    }
+    else
+        return "the condition does not compare the loop variable with a bound";
+
+    const ASTNode *stop = node->loop.update ? NULL : update;
+    if (writes_variable(node->loop.body, stop, loop->counter))
+        return "the body writes the loop variable";
+    if (loop->bound->result_type != TYPE_INT)
+        return "the bound is not an integer";
+    if (!is_loop_invariant(loop->bound, node))
+        return "the bound changes in the loop";
+
+    const ASTNode *init = node->loop.init ? node->loop.init : previous;
+    if (init && init->type == AST_VAR_DECL && strcmp(init->var_decl.name, loop->counter) == 0 &&
+        integer_literal_value(init->var_decl.value, &loop->start))
+        loop->known_start = 1;
+    return NULL;
+}
@@ -8,86 +8,225 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "lexer.h"
 #include "parser.h"
 #include "codegen.h"
+#include "jit.h"
+#include "profile.h"
+#include "passes.h"
+#include "remarks.h"
 #include "ast.h"
 #include "token.h"
 
-static void print_expression(ASTNode *node)
+static void print_usage(const char *program)
 {
-    if (!node)
-        return;
-
-    switch (node->type)
-    {
-    case AST_LITERAL:
-        printf("%s", node->literal.value);
-        break;
-    case AST_IDENTIFIER:
-        printf("%s", node->identifier.name);
-        break;
-    case AST_BINARY_EXPR:
-        printf("(");
-        print_expression(node->binary_expr.left);
-        printf(" %s ", token_type_to_string(node->binary_expr.op));
-        print_expression(node->binary_expr.right);
-        printf(")");
-        break;
-    case AST_UNARY_EXPR:
-        printf("(%s ", token_type_to_string(node->unary_expr.op));
-        print_expression(node->unary_expr.operand);
-        printf(")");
-        break;
-    default:
-        printf("[Unknown Expression]");
-    }
+    printf("Usage: %s [options] <file.seg>\n", program);
+    printf("Options:\n");
+    printf("  -o <file.s>            Write assembly to <file.s> (default: output.s)\n");
+    printf("  -O0 | -O1 | -O2 | -O3 | -Os  Optimization level (default: -O0)\n");
+    printf("  -mtune=<cpu>           Schedule instructions for generic (default), skylake or znver3\n");
+    printf("  -g                     Emit DWARF line tables (.file/.loc) for debuggers and profilers\n");
+    printf("  -finstrument-statements[=<file>]        Count statement and if-arm executions; dump at exit\n");
+    printf("  -fprofile-generate[=<file>]             Same as -finstrument-statements, for -fprofile-use\n");
+    printf("  -fprofile-use[=<file>]  Lay out, outline and if-convert branches using a recorded profile\n");
+    printf("  --jit                  Run the program in-process after compiling; exits with its result\n");
+    printf("  --perf-map             With --jit, write /tmp/perf-<pid>.map symbols for perf\n");
+    printf("  --jitdump              With --jit, write jit-<pid>.dump (code and line info) for perf inject\n");
+    printf("  --disable-pass=<name>  Skip a pass of the pipeline\n");
+    printf("  --print-after=<name>   Dump the IR after a pass (or 'all') to stderr\n");
+    printf("  --time-passes          Report time and change counts per pass\n");
+    printf("  --list-passes          List the registered passes\n");
+    printf("  -Rpass=<regex>         Print remarks of passes that applied an optimization\n");
+    printf("  -Rpass-missed=<regex>  Print remarks of passes that missed an optimization\n");
+    printf("  -Rpass-analysis=<regex> Print analysis remarks\n");
+    printf("  -fsave-optimization-record[=yaml|json]  Save all remarks next to the output\n");
+    printf("  -foptimization-record-file=<file>       Save all remarks to <file>\n");
 }
 
-static void print_ast(ASTNode *node)
+int main(int argc, char *argv[])
 {
-    while (node)
+    const char *input_path = NULL;
+    const char *output_path = "output.s";
+    OptLevel level = OPT_O0;
+    TuneTarget tune = TUNE_GENERIC;
+    CodegenOptions codegen_options = {0};
+    JitOptions jit_options = {0};
+    int jit = 0;
+    int time_passes = 0;
+    int save_record = 0;
+    RecordFormat record_format = RECORD_YAML;
+    const char *record_path = NULL;
+
+    /* Pipeline options are applied once the level is known. */
+    const char *disabled[MAX_PIPELINE_PASSES];
+    const char *print_after[MAX_PIPELINE_PASSES];
+    int disabled_count = 0, print_after_count = 0;
+
+    for (int i = 1; i < argc; i++)
     {
-        switch (node->type)
-        {
-        case AST_VAR_DECL:
-            printf("VarDecl: type=%d name=%s value=", node->var_decl.var_type, node->var_decl.name);
-            print_expression(node->var_decl.value);
-            printf("\n");
-            break;
-        case AST_IF_STATEMENT:
-            printf("IfStatement: condition=");
-            print_expression(node->if_statement.condition);
-            printf("\nThen:\n");
-            print_ast(node->if_statement.then_branch);
-            if (node->if_statement.else_branch)
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if (parse_opt_level(argv[i], &level))
+        {
+            continue;
+        }
+        else if (strncmp(argv[i], "-mtune=", 7) == 0)
+        {
+            if (!parse_tune(argv[i] + 7, &tune))
+            {
+                fprintf(stderr, "Unknown tuning target: %s\n", argv[i] + 7);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-g") == 0)
+        {
+            codegen_options.debug_info = 1;
+        }
+        else if (strncmp(argv[i], "-finstrument-statements", 23) == 0 && (argv[i][23] == '\0' || argv[i][23] == '='))
+        {
+            codegen_options.profile_path = argv[i][23] == '=' ? argv[i] + 24 : PROFILE_DEFAULT_PATH;
+        }
+        else if (strncmp(argv[i], "-fprofile-generate", 18) == 0 && (argv[i][18] == '\0' || argv[i][18] == '='))
+        {
+            codegen_options.profile_path = argv[i][18] == '=' ? argv[i] + 19 : PROFILE_DEFAULT_PATH;
+        }
+        else if (strncmp(argv[i], "-fprofile-use", 13) == 0 && (argv[i][13] == '\0' || argv[i][13] == '='))
+        {
+            const char *path = argv[i][13] == '=' ? argv[i] + 14 : PROFILE_DEFAULT_PATH;
+            if (!profile_load(path))
+                fprintf(stderr, "Warning: cannot read profile %s; compiling without it\n", path);
+        }
+        else if (strcmp(argv[i], "--jit") == 0)
+        {
+            jit = 1;
+        }
+        else if (strcmp(argv[i], "--perf-map") == 0)
+        {
+            jit_options.perf_map = 1;
+        }
+        else if (strcmp(argv[i], "--jitdump") == 0)
+        {
+            jit_options.jitdump = 1;
+        }
+        else if (strncmp(argv[i], "--disable-pass=", 15) == 0 && disabled_count < MAX_PIPELINE_PASSES)
+        {
+            disabled[disabled_count++] = argv[i] + 15;
+        }
+        else if (strncmp(argv[i], "--print-after=", 14) == 0 && print_after_count < MAX_PIPELINE_PASSES)
+        {
+            print_after[print_after_count++] = argv[i] + 14;
+        }
+        else if (strcmp(argv[i], "--time-passes") == 0)
+        {
+            time_passes = 1;
+        }
+        else if (strncmp(argv[i], "-Rpass=", 7) == 0 || strncmp(argv[i], "-Rpass-missed=", 14) == 0 ||
+                 strncmp(argv[i], "-Rpass-analysis=", 16) == 0)
+        {
+            const char *pattern = strchr(argv[i], '=') + 1;
+            RemarkKind kind = argv[i][6] == '=' ? REMARK_PASSED : argv[i][7] == 'm' ? REMARK_MISSED : REMARK_ANALYSIS;
+            if (!remarks_enable(kind, pattern))
             {
-                printf("Else:\n");
-                print_ast(node->if_statement.else_branch);
+                fprintf(stderr, "Invalid remark pattern: %s\n", pattern);
+                return 1;
             }
-            break;
-        default:
-            printf("[Unknown Node]\n");
         }
-        node = node->next;
+        else if (strncmp(argv[i], "-fsave-optimization-record", 26) == 0)
+        {
+            const char *format = argv[i][26] == '=' ? argv[i] + 27 : "yaml";
+            save_record = 1;
+            if (strcmp(format, "json") == 0)
+                record_format = RECORD_JSON;
+            else if (strcmp(format, "yaml") != 0)
+            {
+                fprintf(stderr, "Unknown optimization record format: %s\n", format);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "-foptimization-record-file=", 27) == 0)
+        {
+            save_record = 1;
+            record_path = argv[i] + 27;
+        }
+        else if (strcmp(argv[i], "--list-passes") == 0)
+        {
+            list_passes(stdout);
+            return 0;
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            input_path = argv[i];
+        }
     }
-}
 
-int main(int argc, char *argv[])
-{
-    if (argc < 2)
+    PassManager passes;
+    pass_manager_init(&passes, level);
+    passes.context.tune = tune;
+    codegen_options.superopt = level != OPT_O0;
+    codegen_options.optimize_size = level == OPT_OS;
+    for (int i = 0; i < disabled_count; i++)
+    {
+        if (!pass_manager_disable(&passes, disabled[i]))
+        {
+            fprintf(stderr, "Unknown pass: %s\n", disabled[i]);
+            return 1;
+        }
+    }
+    for (int i = 0; i < print_after_count; i++)
     {
-        printf("Usage: %s <file.seg>\n", argv[0]);
+        if (!pass_manager_print_after(&passes, print_after[i]))
+        {
+            fprintf(stderr, "Unknown pass: %s\n", print_after[i]);
+            return 1;
+        }
+    }
+
+    if (!input_path)
+    {
+        print_usage(argv[0]);
         return 1;
     }
 
-    FILE *source = fopen(argv[1], "r");
+    FILE *source = fopen(input_path, "r");
     if (!source)
     {
         perror("Failed to open source file");
         return 1;
     }
 
+    remarks_set_source(input_path);
+    codegen_options.source_path = input_path;
+    codegen_options.line_table = jit && (jit_options.perf_map || jit_options.jitdump);
+    jit_options.source_path = input_path;
+    if (save_record)
+    {
+        char default_path[1024];
+        if (!record_path)
+        {
+            size_t len = strlen(output_path);
+            if (len > 2 && strcmp(output_path + len - 2, ".s") == 0)
+                len -= 2;
+            snprintf(default_path, sizeof(default_path), "%.*s.opt.%s", (int)len, output_path,
+                     record_format == RECORD_JSON ? "json" : "yaml");
+            record_path = default_path;
+        }
+        if (!remarks_open_record(record_path, record_format))
+        {
+            perror("Failed to open optimization record file");
+            fclose(source);
+            return 1;
+        }
+    }
+
     Lexer lexer;
     lexer_init(&lexer, source);
 
@@ -97,9 +236,11 @@ int main(int argc, char *argv[])
     ASTNode *program = parse_program(&parser);
 
     printf("=== Parsed AST ===\n");
-    print_ast(program);
+    print_ast(program, stdout);
+
+    pass_manager_run_ast(&passes, &program);
 
-    FILE *asm_file = fopen("output.s", "w");
+    FILE *asm_file = fopen(output_path, "w");
     if (!asm_file)
     {
         perror("Failed to open output file");
@@ -108,11 +249,24 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    generate_program(program, asm_file);
+    generate_program(program, asm_file, &passes, &codegen_options);
     fclose(asm_file);
+
+    remarks_finish();
+    profile_free();
+
+    if (time_passes)
+        pass_manager_report(&passes, stderr);
     free_ast(program);
     fclose(source);
 
-    printf("Compilation successful. Assembly code generated in output.s\n");
-    return 0;
+    printf("Compilation successful. Assembly code generated in %s\n", output_path);
+    if (!jit)
+        return 0;
+
+    fflush(stdout);
+    int exit_code;
+    if (!jit_run(output_path, &jit_options, &exit_code))
+        return 1;
+    return exit_code;
 }
@@ -0,0 +1,636 @@
+/**
+ * @file memopt.c
+ * @brief Redundant load and dead store elimination for globals on the machine IR of
+ *        the SEG compiler. Globals are accessed only as [rip + name], so two distinct
+ *        names never alias; an array element indexed from lea reg, [rip + name] reaches
+ *        only that array, other accesses through a register may reach any global, and
+ *        calls may read and write all of them. Two data-flow problems are solved over the
+ *        control-flow graph of main:
+ *        - forward, which register or constant is known to hold each global (the value
+ *          last stored or loaded), met by intersection at joins; loads and memory
+ *          operands of such globals are read from there instead;
+ *        - backward, which globals may still be read; a store that is overwritten or
+ *          reaches the return before any read is removed, since nothing observes the
+ *          globals of a SEG program once main has returned.
+ *        A global whose address is taken, or that is accessed with another size or offset,
+ *        is left alone.
+ * @author Dario Romandini
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+
+#define MEMOPT_MAX_ROUNDS 4
+
+typedef enum
+{
+    HELD_UNKNOWN, ///< Nothing is known about the global
+    HELD_REG,     ///< A register holds the global's value
+    HELD_CONST,   ///< The global holds a known constant
+    HELD_TOP      ///< Not computed yet (block not reached)
+} HeldKind;
+
+typedef struct
+{
+    HeldKind kind;
+    MReg reg;
+    long long value;
+} Held;
+
+typedef struct
+{
+    MInstr *first;
+    MInstr *last;
+    int succ[2];             ///< Successor blocks, -1 if none
+    int leaves;              ///< Jumps out of main (all globals may be read there)
+    int reached;             ///< The forward analysis has reached the block
+    Held *in;                ///< Forward state at entry
+    unsigned char *live_out; ///< Globals that may be read after the block
+} MemBlock;
+
+typedef struct
+{
+    char **names;
+    int *eligible;
+    int count;
+    int capacity;
+    MemBlock *blocks;
+    int block_count;
+} MemState;
+
+static int find_global(MemState *state, const char *name)
+{
+    for (int i = 0; i < state->count; i++)
+    {
+        if (strcmp(state->names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int add_global(MemState *state, const char *name)
+{
+    int index = find_global(state, name);
+    if (index >= 0)
+        return index;
+    if (state->count == state->capacity)
+    {
+        state->capacity = state->capacity ? state->capacity * 2 : 16;
+        state->names = realloc(state->names, state->capacity * sizeof(char *));
+        state->eligible = realloc(state->eligible, state->capacity * sizeof(int));
+    }
+    state->names[state->count] = strdup(name);
+    state->eligible[state->count] = 1;
+    return state->count++;
+}
+
+/* Memory operand of an instruction, or NULL. */
+static MOperand *memory_operand(MInstr *instr)
+{
+    for (int i = 0; i < instr->nops; i++)
+    {
+        if (instr->ops[i].kind == MOPND_MEM)
+            return &instr->ops[i];
+    }
+    return NULL;
+}
+
+static int is_stack_access(const MOperand *op)
+{
+    return op->kind == MOPND_MEM && !op->symbol && (op->reg == MREG_RSP || op->reg == MREG_RBP);
+}
+
+/* mov [rip + name], src; a movsd store stays an opaque write, as no xmm value is forwarded. */
+static int is_integer_store(const MInstr *instr)
+{
+    return instr->op == MI_MOV && mir_is_plain_store(instr);
+}
+
+static void collect_globals(MFunction *fn, MemState *state)
+{
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        MOperand *op = memory_operand(instr);
+        if (!op || !op->symbol)
+            continue;
+        int index = add_global(state, op->symbol);
+        if (!mir_is_plain_global(op) || instr->op == MI_LEA)
+            state->eligible[index] = 0;
+    }
+}
+
+/* Forward states hold one entry per global, then one per register (constants only). */
+static int held_slots(const MemState *state)
+{
+    return state->count + MREG_COUNT;
+}
+
+/* Control-flow graph */
+
+static int block_of_label(MemState *state, const char *name)
+{
+    for (int i = 0; i < state->block_count; i++)
+    {
+        for (MInstr *instr = state->blocks[i].first; instr->op == MI_LABEL || instr->op == MI_DIRECTIVE;
+             instr = instr->next)
+        {
+            if (instr->op == MI_LABEL && strcmp(instr->text, name) == 0)
+                return i;
+            if (instr == state->blocks[i].last)
+                break;
+        }
+    }
+    return -1;
+}
+
+static void build_blocks(MFunction *fn, MemState *state)
+{
+    int capacity = 16;
+    MemBlock *current = NULL;
+    state->blocks = calloc(capacity, sizeof(MemBlock));
+
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        if (!current || (instr->op == MI_LABEL && current->last->op != MI_LABEL && current->last->op != MI_DIRECTIVE))
+        {
+            if (state->block_count == capacity)
+            {
+                capacity *= 2;
+                state->blocks = realloc(state->blocks, capacity * sizeof(MemBlock));
+            }
+            current = &state->blocks[state->block_count++];
+            memset(current, 0, sizeof(MemBlock));
+            current->first = instr;
+        }
+        current->last = instr;
+        if (mir_is_terminator(instr) || instr->op == MI_JCC)
+            current = NULL;
+    }
+
+    for (int i = 0; i < state->block_count; i++)
+    {
+        MemBlock *block = &state->blocks[i];
+        MInstr *last = block->last;
+        block->succ[0] = block->succ[1] = -1;
+        if (last->op == MI_JMP || last->op == MI_JCC)
+        {
+            block->succ[0] = block_of_label(state, last->ops[0].symbol);
+            block->leaves = block->succ[0] < 0;
+        }
+        if (last->op != MI_JMP && last->op != MI_RET && i + 1 < state->block_count)
+            block->succ[1] = i + 1;
+        block->in = malloc(held_slots(state) * sizeof(Held));
+        block->live_out = calloc(state->count ? state->count : 1, 1);
+        for (int g = 0; g < held_slots(state); g++)
+            block->in[g].kind = HELD_TOP;
+    }
+}
+
+/* Forward analysis: where each global's value is held */
+
+static void forget_all(MemState *state, Held *held)
+{
+    for (int g = 0; g < held_slots(state); g++)
+        held[g].kind = HELD_UNKNOWN;
+}
+
+/* Constant a register holds after instr writes it, from the state before instr. */
+static Held written_value(MemState *state, const Held *held, const MInstr *instr, MReg reg)
+{
+    const Held *regs = held + state->count;
+    Held unknown = {HELD_UNKNOWN, MREG_NONE, 0};
+    if (instr->nops != 2 || !mir_is_gpr64(&instr->ops[0]) || instr->ops[0].reg != reg)
+        return unknown;
+
+    const MOperand *src = &instr->ops[1];
+    if (instr->op == MI_XOR && mir_operand_equal(&instr->ops[0], src))
+        return (Held){HELD_CONST, MREG_NONE, 0};
+    if (instr->op != MI_MOV)
+        return unknown;
+    if (src->kind == MOPND_IMM)
+        return (Held){HELD_CONST, MREG_NONE, src->imm};
+    if (mir_is_gpr64(src) && regs[src->reg].kind == HELD_CONST)
+        return regs[src->reg];
+    if (mir_is_plain_global(src) && held[find_global(state, src->symbol)].kind == HELD_CONST)
+        return held[find_global(state, src->symbol)];
+    return unknown;
+}
+
+static void transfer_held(MemState *state, Held *held, MInstr *instr)
+{
+    Held *regs = held + state->count;
+
+    if (instr->op == MI_LABEL || instr->op == MI_DIRECTIVE)
+        return;
+    if (instr->op == MI_CALL)
+    {
+        forget_all(state, held);
+        return;
+    }
+
+    int writes = 0;
+    MOperand *op = memory_operand(instr);
+    int loaded = -1;
+    if (op && mir_accesses_memory(instr, &writes) && writes && instr->op != MI_PUSH)
+    {
+        const char *array = mir_addressed_symbol(instr, op);
+        if (array)
+            held[find_global(state, array)].kind = HELD_UNKNOWN;
+        else if (!op->symbol && !is_stack_access(op))
+        {
+            for (int g = 0; g < state->count; g++)
+                held[g].kind = HELD_UNKNOWN;
+        }
+        else if (op->symbol)
+            held[find_global(state, op->symbol)].kind = HELD_UNKNOWN;
+    }
+    if (instr->op == MI_MOV && mir_is_gpr64(&instr->ops[0]) && mir_is_plain_global(&instr->ops[1]))
+        loaded = find_global(state, instr->ops[1].symbol);
+
+    Held written[MREG_COUNT];
+    for (MReg reg = MREG_RAX; reg <= MREG_R15; reg++)
+    {
+        if (mir_writes_reg(instr, reg))
+            written[reg] = written_value(state, held, instr, reg);
+    }
+
+    /* A global held by an overwritten register keeps the register's constant, if any. */
+    for (int g = 0; g < state->count; g++)
+    {
+        if (held[g].kind == HELD_REG && mir_writes_reg(instr, held[g].reg))
+        {
+            if (regs[held[g].reg].kind == HELD_CONST)
+                held[g] = regs[held[g].reg];
+            else
+                held[g].kind = HELD_UNKNOWN;
+        }
+    }
+    for (MReg reg = MREG_RAX; reg <= MREG_R15; reg++)
+    {
+        if (mir_writes_reg(instr, reg))
+            regs[reg] = written[reg];
+    }
+
+    if (is_integer_store(instr))
+    {
+        int g = find_global(state, instr->ops[0].symbol);
+        const MOperand *src = &instr->ops[1];
+        if (mir_is_gpr64(src))
+            held[g] = (Held){HELD_REG, src->reg, 0};
+        else if (src->kind == MOPND_IMM)
+            held[g] = (Held){HELD_CONST, MREG_NONE, src->imm};
+    }
+    else if (loaded >= 0 && held[loaded].kind == HELD_UNKNOWN)
+        held[loaded] = (Held){HELD_REG, instr->ops[0].reg, 0};
+}
+
+/* The constant behind an entry: its own, or that of the register holding the global. */
+static int held_constant(MemState *state, const Held *held, const Held *entry, long long *value)
+{
+    if (entry->kind == HELD_REG)
+        entry = &held[state->count + entry->reg];
+    *value = entry->value;
+    return entry->kind == HELD_CONST;
+}
+
+static int meet_held(MemState *state, Held *into, const Held *from)
+{
+    int changed = 0;
+    /* Globals first: they look at the registers of both states before those are met. */
+    for (int g = 0; g < held_slots(state); g++)
+    {
+        Held *a = &into[g];
+        const Held *b = &from[g];
+        long long va, vb;
+        if (b->kind == HELD_TOP || a->kind == HELD_UNKNOWN)
+            continue;
+        if (a->kind == HELD_TOP)
+            *a = *b;
+        else if (a->kind == b->kind && ((a->kind == HELD_REG && a->reg == b->reg) ||
+                                        (a->kind == HELD_CONST && a->value == b->value)))
+            continue;
+        else if (held_constant(state, into, a, &va) && held_constant(state, from, b, &vb) && va == vb)
+        {
+            if (a->kind == HELD_CONST)
+                continue;
+            *a = (Held){HELD_CONST, MREG_NONE, va};
+        }
+        else
+            a->kind = HELD_UNKNOWN;
+        changed = 1;
+    }
+    return changed;
+}
+
+static void solve_held(MemState *state)
+{
+    Held *held = malloc(held_slots(state) * sizeof(Held));
+    forget_all(state, state->blocks[0].in);
+    state->blocks[0].reached = 1;
+
+    for (int changed = 1; changed;)
+    {
+        changed = 0;
+        for (int i = 0; i < state->block_count; i++)
+        {
+            MemBlock *block = &state->blocks[i];
+            if (!block->reached)
+                continue;
+            memcpy(held, block->in, held_slots(state) * sizeof(Held));
+            for (MInstr *instr = block->first;; instr = instr->next)
+            {
+                transfer_held(state, held, instr);
+                if (instr == block->last)
+                    break;
+            }
+            for (int s = 0; s < 2; s++)
+            {
+                if (block->succ[s] < 0)
+                    continue;
+                MemBlock *succ = &state->blocks[block->succ[s]];
+                changed |= meet_held(state, succ->in, held) || !succ->reached;
+                succ->reached = 1;
+            }
+        }
+    }
+    free(held);
+}
+
+/* Reads the global operand op from where its value is held; returns 1 if rewritten. */
+static int forward_operand(MFunction *fn, MemState *state, Held *held, MInstr *instr, MOperand *op, int register_only,
+                           MInstr **next)
+{
+    int g = find_global(state, op->symbol);
+    if (!state->eligible[g])
+        return 0;
+    if (held[g].kind == HELD_REG)
+    {
+        if (instr->op == MI_MOV && instr->ops[0].reg == held[g].reg)
+        {
+            remark(REMARK_PASSED, "memopt", "LoadRemoved", instr->line, "%s already holds %s",
+                   mreg_name(held[g].reg, 8), op->symbol);
+            *next = mir_remove(fn, instr);
+            return 1;
+        }
+        remark(REMARK_PASSED, "memopt", "LoadForwarded", instr->line, "%s read from %s", op->symbol,
+               mreg_name(held[g].reg, 8));
+        free(op->symbol);
+        *op = mop_reg(held[g].reg);
+        return 1;
+    }
+    if (held[g].kind == HELD_CONST && !register_only &&
+        (instr->op == MI_MOV || (held[g].value >= -2147483648LL && held[g].value <= 2147483647LL)))
+    {
+        remark(REMARK_PASSED, "memopt", "LoadForwarded", instr->line, "%s replaced by the constant %lld",
+               op->symbol, held[g].value);
+        free(op->symbol);
+        *op = mop_imm(held[g].value);
+        return 1;
+    }
+    return 0;
+}
+
+/* mov [rip + name], src storing the value the global already holds. */
+static int stores_held_value(MemState *state, const Held *held, const MInstr *instr)
+{
+    int g = find_global(state, instr->ops[0].symbol);
+    const MOperand *src = &instr->ops[1];
+    long long current, stored;
+    if (!state->eligible[g])
+        return 0;
+    if (held[g].kind == HELD_REG && mir_is_gpr64(src) && src->reg == held[g].reg)
+        return 1;
+    if (!held_constant(state, held, &held[g], &current))
+        return 0;
+    if (src->kind == MOPND_IMM)
+        stored = src->imm;
+    else if (!mir_is_gpr64(src) || !held_constant(state, held, &held[state->count + src->reg], &stored))
+        return 0;
+    return current == stored;
+}
+
+static int forward_loads(MFunction *fn, MemState *state)
+{
+    Held *held = malloc(held_slots(state) * sizeof(Held));
+    int changes = 0;
+
+    for (int i = 0; i < state->block_count; i++)
+    {
+        MemBlock *block = &state->blocks[i];
+        memcpy(held, block->in, held_slots(state) * sizeof(Held));
+        for (int g = 0; g < held_slots(state); g++)
+        {
+            if (held[g].kind == HELD_TOP)
+                held[g].kind = HELD_UNKNOWN;
+        }
+
+        MInstr *end = block->last->next;
+        for (MInstr *instr = block->first; instr != end;)
+        {
+            MInstr *next = instr->next;
+            int slot = -1, register_only = 0;
+            switch (instr->op)
+            {
+            case MI_MOV:
+                slot = mir_is_gpr64(&instr->ops[0]) ? 1 : -1;
+                break;
+            case MI_ADD:
+            case MI_SUB:
+            case MI_AND:
+            case MI_OR:
+            case MI_XOR:
+            case MI_CMP:
+                slot = instr->ops[0].kind == MOPND_MEM ? 0 : 1;
+                register_only = slot == 0;
+                if (slot == 0 && instr->op != MI_CMP)
+                    slot = -1;
+                break;
+            case MI_IMUL:
+                slot = instr->nops == 2 ? 1 : -1;
+                break;
+            case MI_IDIV:
+                slot = 0;
+                register_only = 1;
+                break;
+            default:
+                break;
+            }
+            if (is_integer_store(instr) && stores_held_value(state, held, instr))
+            {
+                remark(REMARK_PASSED, "memopt", "RedundantStoreRemoved", instr->line,
+                       "%s already holds the stored value", instr->ops[0].symbol);
+                next = mir_remove(fn, instr);
+                changes++;
+                instr = next;
+                continue;
+            }
+            if (slot >= 0 && mir_is_plain_global(&instr->ops[slot]) &&
+                forward_operand(fn, state, held, instr, &instr->ops[slot], register_only, &next))
+            {
+                changes++;
+                if (next != instr->next)
+                {
+                    /* The load was removed: the destination still holds the value. */
+                    instr = next;
+                    continue;
+                }
+            }
+            transfer_held(state, held, instr);
+            instr = next;
+        }
+    }
+    free(held);
+    return changes;
+}
+
+/* Backward analysis: globals that may still be read */
+
+static void transfer_live(MemState *state, unsigned char *live, MInstr *instr)
+{
+    if (instr->op == MI_CALL)
+    {
+        memset(live, 1, state->count);
+        return;
+    }
+    if (is_integer_store(instr))
+    {
+        live[find_global(state, instr->ops[0].symbol)] = 0;
+        return;
+    }
+    MOperand *op = memory_operand(instr);
+    if (!op || instr->op == MI_LEA || is_stack_access(op))
+        return;
+    const char *array = mir_addressed_symbol(instr, op);
+    if (array)
+        live[find_global(state, array)] = 1;
+    else if (!op->symbol)
+        memset(live, 1, state->count);
+    else
+        live[find_global(state, op->symbol)] = 1;
+}
+
+static void block_live_in(MemState *state, MemBlock *block, unsigned char *live)
+{
+    memcpy(live, block->live_out, state->count);
+    for (MInstr *instr = block->last;; instr = instr->prev)
+    {
+        transfer_live(state, live, instr);
+        if (instr == block->first)
+            break;
+    }
+}
+
+static void solve_live(MemState *state)
+{
+    unsigned char *live = malloc(state->count ? state->count : 1);
+
+    for (int i = 0; i < state->block_count; i++)
+    {
+        /* Globals that are not plain variables are always observable. */
+        for (int g = 0; g < state->count; g++)
+            state->blocks[i].live_out[g] = !state->eligible[g] || state->blocks[i].leaves;
+    }
+
+    for (int changed = 1; changed;)
+    {
+        changed = 0;
+        for (int i = state->block_count - 1; i >= 0; i--)
+        {
+            MemBlock *block = &state->blocks[i];
+            for (int s = 0; s < 2; s++)
+            {
+                if (block->succ[s] < 0)
+                    continue;
+                block_live_in(state, &state->blocks[block->succ[s]], live);
+                for (int g = 0; g < state->count; g++)
+                {
+                    if (live[g] && !block->live_out[g])
+                    {
+                        block->live_out[g] = 1;
+                        changed = 1;
+                    }
+                }
+            }
+        }
+    }
+    free(live);
+}
+
+static int remove_dead_stores(MFunction *fn, MemState *state)
+{
+    unsigned char *live = malloc(state->count ? state->count : 1);
+    int changes = 0;
+
+    for (int i = 0; i < state->block_count; i++)
+    {
+        MemBlock *block = &state->blocks[i];
+        memcpy(live, block->live_out, state->count);
+        for (MInstr *instr = block->last;;)
+        {
+            MInstr *prev = instr == block->first ? NULL : instr->prev;
+            if (is_integer_store(instr) && !live[find_global(state, instr->ops[0].symbol)])
+            {
+                remark(REMARK_PASSED, "memopt", "DeadStoreRemoved", instr->line,
+                       "store to %s is never read", instr->ops[0].symbol);
+                if (instr == block->first)
+                    block->first = instr->next;
+                mir_remove(fn, instr);
+                changes++;
+            }
+            else
+                transfer_live(state, live, instr);
+            if (!prev)
+                break;
+            instr = prev;
+        }
+    }
+    free(live);
+    return changes;
+}
+
+static void free_state(MemState *state)
+{
+    for (int i = 0; i < state->block_count; i++)
+    {
+        free(state->blocks[i].in);
+        free(state->blocks[i].live_out);
+    }
+    free(state->blocks);
+    for (int g = 0; g < state->count; g++)
+        free(state->names[g]);
+    free(state->names);
+    free(state->eligible);
+}
+
+int run_memopt(MFunction *fn, PassContext *ctx)
+{
+    (void)ctx;
+    int total = 0;
+
+    /* Removed stores and dead register copies can make further loads redundant. */
+    for (int round = 0; round < MEMOPT_MAX_ROUNDS && fn->head; round++)
+    {
+        MemState state = {0};
+        collect_globals(fn, &state);
+        build_blocks(fn, &state);
+        solve_held(&state);
+        int changes = forward_loads(fn, &state);
+        free_state(&state);
+
+        /* Forwarding removed reads; recompute the blocks and liveness on the new code. */
+        memset(&state, 0, sizeof(state));
+        collect_globals(fn, &state);
+        build_blocks(fn, &state);
+        solve_live(&state);
+        changes += remove_dead_stores(fn, &state);
+        free_state(&state);
+
+        if (changes == 0)
+            break;
+        mir_remove_dead_code(fn);
+        total += changes;
+    }
+    return total;
+}
@@ -0,0 +1,901 @@
+/**
+ * @file mir.c
+ * @brief Implementation of the machine-level IR used by the SEG code generator.
+ *        Provides instruction list construction, operand queries used by the
+ *        IR-level optimization passes, and Intel-syntax printing.
+ * @author Dario Romandini
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+#include "mir.h"
+#include "symbol.h"
+
+/* How an opcode treats its first operand. */
+typedef enum
+{
+    DEST_NONE,      ///< All operands are read (cmp, test, push, ...)
+    DEST_WRITE,     ///< First operand is overwritten (mov, lea, setcc, ...)
+    DEST_READ_WRITE ///< First operand is read and written (add, sub, ...)
+} DestMode;
+
+typedef struct
+{
+    const char *mnemonic;
+    DestMode dest;
+    int writes_flags;
+} OpcodeInfo;
+
+static const OpcodeInfo opcode_info[MI_OPCODE_COUNT] = {
+    [MI_LABEL] = {"", DEST_NONE, 0},
+    [MI_DIRECTIVE] = {"", DEST_NONE, 0},
+    [MI_MOV] = {"mov", DEST_WRITE, 0},
+    [MI_MOVZX] = {"movzx", DEST_WRITE, 0},
+    [MI_MOVSD] = {"movsd", DEST_WRITE, 0},
+    [MI_MOVQ] = {"movq", DEST_WRITE, 0},
+    [MI_LEA] = {"lea", DEST_WRITE, 0},
+    [MI_ADD] = {"add", DEST_READ_WRITE, 1},
+    [MI_SUB] = {"sub", DEST_READ_WRITE, 1},
+    [MI_ADC] = {"adc", DEST_READ_WRITE, 1},
+    [MI_SBB] = {"sbb", DEST_READ_WRITE, 1},
+    [MI_IMUL] = {"imul", DEST_READ_WRITE, 1},
+    [MI_CQO] = {"cqo", DEST_NONE, 0},
+    [MI_IDIV] = {"idiv", DEST_NONE, 1},
+    [MI_NEG] = {"neg", DEST_READ_WRITE, 1},
+    [MI_NOT] = {"not", DEST_READ_WRITE, 0},
+    [MI_AND] = {"and", DEST_READ_WRITE, 1},
+    [MI_OR] = {"or", DEST_READ_WRITE, 1},
+    [MI_XOR] = {"xor", DEST_READ_WRITE, 1},
+    [MI_SHL] = {"shl", DEST_READ_WRITE, 1},
+    [MI_SAR] = {"sar", DEST_READ_WRITE, 1},
+    [MI_SHR] = {"shr", DEST_READ_WRITE, 1},
+    [MI_INC] = {"inc", DEST_READ_WRITE, 1},
+    [MI_DEC] = {"dec", DEST_READ_WRITE, 1},
+    [MI_CMP] = {"cmp", DEST_NONE, 1},
+    [MI_TEST] = {"test", DEST_NONE, 1},
+    [MI_SETCC] = {"set", DEST_WRITE, 0},
+    [MI_CMOVCC] = {"cmov", DEST_READ_WRITE, 0},
+    [MI_JCC] = {"j", DEST_NONE, 0},
+    [MI_JMP] = {"jmp", DEST_NONE, 0},
+    [MI_PUSH] = {"push", DEST_NONE, 0},
+    [MI_POP] = {"pop", DEST_WRITE, 0},
+    [MI_CALL] = {"call", DEST_NONE, 1},
+    [MI_RET] = {"ret", DEST_NONE, 0},
+    [MI_CVTTSD2SI] = {"cvttsd2si", DEST_WRITE, 0},
+    [MI_CVTSI2SD] = {"cvtsi2sd", DEST_WRITE, 0},
+    [MI_ADDSD] = {"addsd", DEST_READ_WRITE, 0},
+    [MI_SUBSD] = {"subsd", DEST_READ_WRITE, 0},
+    [MI_MULSD] = {"mulsd", DEST_READ_WRITE, 0},
+    [MI_DIVSD] = {"divsd", DEST_READ_WRITE, 0},
+    [MI_UCOMISD] = {"ucomisd", DEST_NONE, 1},
+};
+
+static const char *reg_names[MREG_COUNT][4] = {
+    [MREG_RAX] = {"rax", "eax", "ax", "al"},
+    [MREG_RBX] = {"rbx", "ebx", "bx", "bl"},
+    [MREG_RCX] = {"rcx", "ecx", "cx", "cl"},
+    [MREG_RDX] = {"rdx", "edx", "dx", "dl"},
+    [MREG_RSI] = {"rsi", "esi", "si", "sil"},
+    [MREG_RDI] = {"rdi", "edi", "di", "dil"},
+    [MREG_RBP] = {"rbp", "ebp", "bp", "bpl"},
+    [MREG_RSP] = {"rsp", "esp", "sp", "spl"},
+    [MREG_R8] = {"r8", "r8d", "r8w", "r8b"},
+    [MREG_R9] = {"r9", "r9d", "r9w", "r9b"},
+    [MREG_R10] = {"r10", "r10d", "r10w", "r10b"},
+    [MREG_R11] = {"r11", "r11d", "r11w", "r11b"},
+    [MREG_R12] = {"r12", "r12d", "r12w", "r12b"},
+    [MREG_R13] = {"r13", "r13d", "r13w", "r13b"},
+    [MREG_R14] = {"r14", "r14d", "r14w", "r14b"},
+    [MREG_R15] = {"r15", "r15d", "r15w", "r15b"},
+    [MREG_RIP] = {"rip", "rip", "rip", "rip"},
+};
+
+static const char *xmm_names[16] = {
+    "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+    "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"};
+
+MOperand mop_reg(MReg reg)
+{
+    return mop_reg_sized(reg, 8);
+}
+
+MOperand mop_reg_sized(MReg reg, int size)
+{
+    MOperand op = {0};
+    op.kind = MOPND_REG;
+    op.reg = reg;
+    op.size = size;
+    return op;
+}
+
+MOperand mop_imm(long long value)
+{
+    MOperand op = {0};
+    op.kind = MOPND_IMM;
+    op.imm = value;
+    op.size = 8;
+    return op;
+}
+
+MOperand mop_sym(const char *symbol, int size)
+{
+    MOperand op = {0};
+    op.kind = MOPND_MEM;
+    op.reg = MREG_RIP;
+    op.symbol = (char *)symbol;
+    op.size = size;
+    return op;
+}
+
+MOperand mop_mem(MReg base, long long disp, int size)
+{
+    MOperand op = {0};
+    op.kind = MOPND_MEM;
+    op.reg = base;
+    op.imm = disp;
+    op.size = size;
+    return op;
+}
+
+MOperand mop_label(const char *label)
+{
+    MOperand op = {0};
+    op.kind = MOPND_LABEL;
+    op.symbol = (char *)label;
+    return op;
+}
+
+MFunction *mir_function_create(const char *name)
+{
+    MFunction *fn = calloc(1, sizeof(MFunction));
+    fn->name = strdup_safe(name);
+    return fn;
+}
+
+void mir_instr_free(MInstr *instr)
+{
+    if (!instr)
+        return;
+    for (int i = 0; i < instr->nops; i++)
+        free(instr->ops[i].symbol);
+    free(instr->text);
+    free(instr);
+}
+
+void mir_function_free(MFunction *fn)
+{
+    if (!fn)
+        return;
+    MInstr *instr = fn->head;
+    while (instr)
+    {
+        MInstr *next = instr->next;
+        mir_instr_free(instr);
+        instr = next;
+    }
+    free(fn->name);
+    free(fn);
+}
+
+void mir_insert_before(MFunction *fn, MInstr *before, MInstr *instr)
+{
+    if (!before)
+    {
+        instr->prev = fn->tail;
+        instr->next = NULL;
+        if (fn->tail)
+            fn->tail->next = instr;
+        else
+            fn->head = instr;
+        fn->tail = instr;
+        return;
+    }
+    instr->next = before;
+    instr->prev = before->prev;
+    if (before->prev)
+        before->prev->next = instr;
+    else
+        fn->head = instr;
+    before->prev = instr;
+}
+
+void mir_unlink(MFunction *fn, MInstr *instr)
+{
+    if (instr->prev)
+        instr->prev->next = instr->next;
+    else
+        fn->head = instr->next;
+    if (instr->next)
+        instr->next->prev = instr->prev;
+    else
+        fn->tail = instr->prev;
+    instr->prev = instr->next = NULL;
+}
+
+MInstr *mir_remove(MFunction *fn, MInstr *instr)
+{
+    MInstr *next = instr->next;
+    mir_unlink(fn, instr);
+    mir_instr_free(instr);
+    return next;
+}
+
+static MInstr *new_instr(MFunction *fn, MOpcode op, MCond cond, int nops, va_list args)
+{
+    MInstr *instr = calloc(1, sizeof(MInstr));
+    instr->op = op;
+    instr->cond = cond;
+    instr->nops = nops;
+    instr->line = fn->current_line;
+    instr->column = fn->current_column;
+    for (int i = 0; i < nops && i < 3; i++)
+    {
+        instr->ops[i] = va_arg(args, MOperand);
+        instr->ops[i].symbol = strdup_safe(instr->ops[i].symbol);
+    }
+    mir_insert_before(fn, NULL, instr);
+    return instr;
+}
+
+MInstr *mir_emit(MFunction *fn, MOpcode op, int nops, ...)
+{
+    va_list args;
+    va_start(args, nops);
+    MInstr *instr = new_instr(fn, op, MCOND_NONE, nops, args);
+    va_end(args);
+    return instr;
+}
+
+MInstr *mir_emit_cond(MFunction *fn, MOpcode op, MCond cond, int nops, ...)
+{
+    va_list args;
+    va_start(args, nops);
+    MInstr *instr = new_instr(fn, op, cond, nops, args);
+    va_end(args);
+    return instr;
+}
+
+MInstr *mir_emit_label(MFunction *fn, const char *name)
+{
+    MInstr *instr = mir_emit(fn, MI_LABEL, 0);
+    instr->text = strdup_safe(name);
+    return instr;
+}
+
+MInstr *mir_emit_directive(MFunction *fn, const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    MInstr *instr = mir_emit(fn, MI_DIRECTIVE, 0);
+    instr->text = strdup_safe(buffer);
+    return instr;
+}
+
+MInstr *mir_clone(const MInstr *instr)
+{
+    MInstr *copy = malloc(sizeof(MInstr));
+    *copy = *instr;
+    copy->prev = copy->next = NULL;
+    copy->text = strdup_safe(instr->text);
+    for (int i = 0; i < copy->nops; i++)
+        copy->ops[i].symbol = strdup_safe(instr->ops[i].symbol);
+    return copy;
+}
+
+int mir_is_gpr64(const MOperand *op)
+{
+    return op->kind == MOPND_REG && op->size == 8 && op->reg >= MREG_RAX && op->reg <= MREG_R15 &&
+           op->reg != MREG_RSP;
+}
+
+int mir_is_plain_global(const MOperand *op)
+{
+    return op->kind == MOPND_MEM && op->symbol && op->index == MREG_NONE && op->imm == 0 && op->size == 8;
+}
+
+int mir_is_plain_store(const MInstr *instr)
+{
+    return (instr->op == MI_MOV || instr->op == MI_MOVSD) && mir_is_plain_global(&instr->ops[0]);
+}
+
+int mir_operand_equal(const MOperand *a, const MOperand *b)
+{
+    if (a->kind != b->kind)
+        return 0;
+    switch (a->kind)
+    {
+    case MOPND_REG:
+        return a->reg == b->reg && a->size == b->size;
+    case MOPND_IMM:
+        return a->imm == b->imm;
+    case MOPND_MEM:
+        if ((a->symbol == NULL) != (b->symbol == NULL))
+            return 0;
+        if (a->symbol && strcmp(a->symbol, b->symbol) != 0)
+            return 0;
+        return a->reg == b->reg && a->index == b->index && a->scale == b->scale &&
+               a->imm == b->imm && a->size == b->size;
+    case MOPND_LABEL:
+        return strcmp(a->symbol, b->symbol) == 0;
+    default:
+        return 1;
+    }
+}
+
+static int is_caller_saved(MReg reg)
+{
+    return reg == MREG_RAX || reg == MREG_RCX || reg == MREG_RDX || reg == MREG_RSI ||
+           reg == MREG_RDI || (reg >= MREG_R8 && reg <= MREG_R11) ||
+           (reg >= MREG_XMM0 && reg <= MREG_XMM15);
+}
+
+int mir_reads_reg(const MInstr *instr, MReg reg)
+{
+    if (instr->op == MI_LABEL || instr->op == MI_DIRECTIVE)
+        return 0;
+
+    for (int i = 0; i < instr->nops; i++)
+    {
+        const MOperand *op = &instr->ops[i];
+        if (op->kind == MOPND_MEM)
+        {
+            if (op->reg == reg || op->index == reg)
+                return 1;
+            continue;
+        }
+        if (op->kind != MOPND_REG || op->reg != reg)
+            continue;
+        if (i > 0 || opcode_info[instr->op].dest != DEST_WRITE)
+        {
+            /* Three-operand imul only writes its destination. */
+            if (i == 0 && instr->op == MI_IMUL && instr->nops == 3)
+                continue;
+            /* xor r, r is the zero idiom and does not depend on r. */
+            if (instr->op == MI_XOR && instr->nops == 2 && mir_operand_equal(&instr->ops[0], &instr->ops[1]))
+                return 0;
+            return 1;
+        }
+        /* A partial write keeps the upper bits, so they are read. */
+        if (op->size < 4)
+            return 1;
+    }
+
+    switch (instr->op)
+    {
+    case MI_IMUL:
+        return instr->nops == 1 && reg == MREG_RAX;
+    case MI_CQO:
+        return reg == MREG_RAX;
+    case MI_IDIV:
+        return reg == MREG_RAX || reg == MREG_RDX;
+    case MI_PUSH:
+    case MI_POP:
+        return reg == MREG_RSP;
+    case MI_RET:
+        /* Callee-saved registers are saved around the body after optimization. */
+        return reg == MREG_RAX || reg == MREG_RSP;
+    case MI_CALL:
+        return reg == MREG_RDI || reg == MREG_RSI || reg == MREG_RDX || reg == MREG_RCX ||
+               reg == MREG_R8 || reg == MREG_R9 || reg == MREG_RAX || reg == MREG_RSP;
+    default:
+        return 0;
+    }
+}
+
+int mir_writes_reg(const MInstr *instr, MReg reg)
+{
+    if (instr->op == MI_LABEL || instr->op == MI_DIRECTIVE)
+        return 0;
+    /* One-operand imul writes the full product to rdx:rax. */
+    if (instr->op == MI_IMUL && instr->nops == 1)
+        return reg == MREG_RAX || reg == MREG_RDX;
+    if (instr->nops > 0 && opcode_info[instr->op].dest != DEST_NONE &&
+        instr->ops[0].kind == MOPND_REG && instr->ops[0].reg == reg)
+        return 1;
+
+    switch (instr->op)
+    {
+    case MI_CQO:
+        return reg == MREG_RDX;
+    case MI_IDIV:
+        return reg == MREG_RAX || reg == MREG_RDX;
+    case MI_PUSH:
+    case MI_POP:
+        return reg == MREG_RSP;
+    case MI_CALL:
+        return is_caller_saved(reg);
+    default:
+        return 0;
+    }
+}
+
+/* A write that replaces the whole register, so its previous value is dead. */
+static int kills_reg(const MInstr *instr, MReg reg)
+{
+    if (!mir_writes_reg(instr, reg) || mir_reads_reg(instr, reg))
+        return 0;
+    if (instr->nops > 0 && instr->ops[0].kind == MOPND_REG && instr->ops[0].reg == reg)
+        return instr->ops[0].size >= 4 || reg >= MREG_XMM0;
+    return 1;
+}
+
+int mir_writes_flags(const MInstr *instr)
+{
+    return opcode_info[instr->op].writes_flags;
+}
+
+int mir_reads_flags(const MInstr *instr)
+{
+    return instr->op == MI_JCC || instr->op == MI_SETCC || instr->op == MI_CMOVCC || instr->op == MI_ADC ||
+           instr->op == MI_SBB;
+}
+
+int mir_accesses_memory(const MInstr *instr, int *writes)
+{
+    int loads = 0, stores = 0;
+
+    switch (instr->op)
+    {
+    case MI_PUSH:
+    case MI_CALL:
+        stores = 1;
+        break;
+    case MI_POP:
+    case MI_RET:
+        loads = 1;
+        break;
+    default:
+        break;
+    }
+
+    if (instr->op != MI_LEA)
+    {
+        for (int i = 0; i < instr->nops; i++)
+        {
+            if (instr->ops[i].kind != MOPND_MEM)
+                continue;
+            if (i == 0 && opcode_info[instr->op].dest == DEST_WRITE)
+                stores = 1;
+            else if (i == 0 && opcode_info[instr->op].dest == DEST_READ_WRITE)
+                loads = stores = 1;
+            else
+                loads = 1;
+        }
+    }
+
+    if (writes)
+        *writes = stores;
+    return loads || stores;
+}
+
+/*
+ * The code generator addresses an array element as [reg + index*8 + 8k] right after
+ * lea reg, [rip + name]; SEG indexing never leaves the array, so such an access reaches
+ * only that global.
+ */
+const char *mir_addressed_symbol(const MInstr *instr, const MOperand *op)
+{
+    if (op->kind != MOPND_MEM || op->symbol || op->reg == MREG_NONE || op->reg == MREG_RIP ||
+        op->reg == MREG_RSP || op->reg == MREG_RBP)
+        return NULL;
+    for (const MInstr *prev = instr->prev; prev; prev = prev->prev)
+    {
+        if (prev->op == MI_LABEL || prev->op == MI_CALL || mir_is_terminator(prev))
+            return NULL;
+        if (!mir_writes_reg(prev, op->reg))
+            continue;
+        if (prev->op == MI_LEA && prev->ops[1].symbol && prev->ops[1].index == MREG_NONE)
+            return prev->ops[1].symbol;
+        if (prev->op == MI_MOV && prev->ops[1].kind == MOPND_MEM && prev->ops[1].symbol)
+            return symbol_pointer_target(prev->ops[1].symbol);
+        return NULL;
+    }
+    return NULL;
+}
+
+int mir_is_terminator(const MInstr *instr)
+{
+    return instr->op == MI_JMP || instr->op == MI_JCC || instr->op == MI_RET;
+}
+
+MInstr *mir_find_label(MFunction *fn, const char *name)
+{
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        if (instr->op == MI_LABEL && strcmp(instr->text, name) == 0)
+            return instr;
+    }
+    return NULL;
+}
+
+#define DEAD_SCAN_LIMIT 256
+#define DEAD_SCAN_DEPTH 8
+#define DEAD_CODE_MAX_ITERATIONS 8
+
+static int dead_from(MFunction *fn, MInstr *instr, MReg reg, int depth, int *budget)
+{
+    if (depth > DEAD_SCAN_DEPTH)
+        return 0;
+
+    for (; instr; instr = instr->next)
+    {
+        if (--*budget <= 0)
+            return 0;
+
+        if (reg == MREG_NONE)
+        {
+            if (mir_reads_flags(instr))
+                return 0;
+            if (mir_writes_flags(instr))
+                return 1;
+        }
+        else
+        {
+            if (mir_reads_reg(instr, reg))
+                return 0;
+            if (kills_reg(instr, reg))
+                return 1;
+        }
+
+        switch (instr->op)
+        {
+        case MI_RET:
+            return 1;
+        case MI_CALL:
+            return reg == MREG_NONE || is_caller_saved(reg);
+        case MI_JMP:
+        case MI_JCC:
+        {
+            if (instr->ops[0].kind != MOPND_LABEL)
+                return 0;
+            MInstr *target = mir_find_label(fn, instr->ops[0].symbol);
+            if (!target || !dead_from(fn, target->next, reg, depth + 1, budget))
+                return 0;
+            if (instr->op == MI_JMP)
+                return 1;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+int mir_reg_dead_after(MFunction *fn, MInstr *after, MReg reg)
+{
+    int budget = DEAD_SCAN_LIMIT;
+    return dead_from(fn, after->next, reg, 0, &budget);
+}
+
+int mir_label_is_referenced(MFunction *fn, const MInstr *label)
+{
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        if ((instr->op == MI_JMP || instr->op == MI_JCC) && instr->ops[0].kind == MOPND_LABEL &&
+            strcmp(instr->ops[0].symbol, label->text) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+int *mir_loop_depths(MFunction *fn)
+{
+    int count = 0;
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+        count++;
+    int *depth = calloc(count + 1, sizeof(int));
+
+    int position = 0;
+    for (MInstr *instr = fn->head; instr; instr = instr->next, position++)
+    {
+        if (instr->op == MI_DIRECTIVE && strncmp(instr->text, ".pushsection", 12) == 0)
+            break;
+        if ((instr->op != MI_JMP && instr->op != MI_JCC) || instr->ops[0].kind != MOPND_LABEL)
+            continue;
+        int head = 0;
+        MInstr *label = fn->head;
+        while (label != instr && !(label->op == MI_LABEL && strcmp(label->text, instr->ops[0].symbol) == 0))
+        {
+            label = label->next;
+            head++;
+        }
+        if (label == instr)
+            continue;
+        /* Difference array: the range [head, position] is one loop deeper. */
+        depth[head]++;
+        depth[position + 1]--;
+    }
+    for (int i = 1; i <= count; i++)
+        depth[i] += depth[i - 1];
+    return depth;
+}
+
+/* Instructions whose only effects are on their destination register and the flags. */
+static int is_removable(const MInstr *instr)
+{
+    switch (instr->op)
+    {
+    case MI_IMUL:
+        if (instr->nops == 1)
+            return 0;
+        break;
+    case MI_MOV:
+    case MI_MOVZX:
+    case MI_LEA:
+    case MI_ADD:
+    case MI_SUB:
+    case MI_ADC:
+    case MI_SBB:
+    case MI_AND:
+    case MI_OR:
+    case MI_XOR:
+    case MI_SHL:
+    case MI_SAR:
+    case MI_SHR:
+    case MI_NEG:
+    case MI_NOT:
+    case MI_INC:
+    case MI_DEC:
+    case MI_SETCC:
+    case MI_CMOVCC:
+        break;
+    default:
+        return 0;
+    }
+    const MOperand *dst = &instr->ops[0];
+    return dst->kind == MOPND_REG && dst->reg >= MREG_RAX && dst->reg <= MREG_R15 && dst->reg != MREG_RSP;
+}
+
+/*
+ * push src / pop dst  ->  mov dst, src   (or nothing when dst is never read)
+ * Rewrites often leave an operand spilled around an instruction that no longer exists.
+ */
+static int fold_stack_pair(MFunction *fn, MInstr *push, MInstr **next)
+{
+    MInstr *pop = push->next;
+
+    if (push->op != MI_PUSH || !pop || pop->op != MI_POP)
+        return 0;
+    if (pop->ops[0].kind != MOPND_REG || pop->ops[0].size != 8 || pop->ops[0].reg > MREG_R15)
+        return 0;
+    if (push->ops[0].kind != MOPND_REG && push->ops[0].kind != MOPND_IMM)
+        return 0;
+
+    if (mir_reg_dead_after(fn, pop, pop->ops[0].reg))
+    {
+        mir_remove(fn, push);
+        *next = mir_remove(fn, pop);
+        return 2;
+    }
+    MOperand source = push->ops[0];
+    mir_remove(fn, push);
+    pop->op = MI_MOV;
+    pop->nops = 2;
+    pop->ops[1] = source;
+    *next = pop->next;
+    return 1;
+}
+
+int mir_remove_dead_code(MFunction *fn)
+{
+    int total = 0;
+
+    for (int iteration = 0; iteration < DEAD_CODE_MAX_ITERATIONS; iteration++)
+    {
+        int changes = 0;
+        for (MInstr *instr = fn->head; instr;)
+        {
+            MInstr *next = NULL;
+            int folded = fold_stack_pair(fn, instr, &next);
+            if (folded)
+            {
+                changes += folded;
+                instr = next;
+                continue;
+            }
+            if (!is_removable(instr) || !mir_reg_dead_after(fn, instr, instr->ops[0].reg) ||
+                (mir_writes_flags(instr) && !mir_reg_dead_after(fn, instr, MREG_NONE)))
+            {
+                instr = instr->next;
+                continue;
+            }
+            instr = mir_remove(fn, instr);
+            changes++;
+        }
+        total += changes;
+        if (changes == 0)
+            break;
+    }
+    return total;
+}
+
+MCond mcond_invert(MCond cond)
+{
+    switch (cond)
+    {
+    case MCOND_E:
+        return MCOND_NE;
+    case MCOND_NE:
+        return MCOND_E;
+    case MCOND_L:
+        return MCOND_GE;
+    case MCOND_GE:
+        return MCOND_L;
+    case MCOND_LE:
+        return MCOND_G;
+    case MCOND_G:
+        return MCOND_LE;
+    case MCOND_B:
+        return MCOND_AE;
+    case MCOND_AE:
+        return MCOND_B;
+    case MCOND_BE:
+        return MCOND_A;
+    case MCOND_A:
+        return MCOND_BE;
+    case MCOND_S:
+        return MCOND_NS;
+    case MCOND_NS:
+        return MCOND_S;
+    default:
+        return MCOND_NONE;
+    }
+}
+
+const char *mcond_suffix(MCond cond)
+{
+    switch (cond)
+    {
+    case MCOND_E:
+        return "e";
+    case MCOND_NE:
+        return "ne";
+    case MCOND_L:
+        return "l";
+    case MCOND_LE:
+        return "le";
+    case MCOND_G:
+        return "g";
+    case MCOND_GE:
+        return "ge";
+    case MCOND_B:
+        return "b";
+    case MCOND_BE:
+        return "be";
+    case MCOND_A:
+        return "a";
+    case MCOND_AE:
+        return "ae";
+    case MCOND_S:
+        return "s";
+    case MCOND_NS:
+        return "ns";
+    default:
+        return "";
+    }
+}
+
+const char *mreg_name(MReg reg, int size)
+{
+    if (reg >= MREG_XMM0 && reg <= MREG_XMM15)
+        return xmm_names[reg - MREG_XMM0];
+    if (reg <= MREG_NONE || reg >= MREG_COUNT)
+        return "?";
+    switch (size)
+    {
+    case 4:
+        return reg_names[reg][1];
+    case 2:
+        return reg_names[reg][2];
+    case 1:
+        return reg_names[reg][3];
+    default:
+        return reg_names[reg][0];
+    }
+}
+
+static const char *size_keyword(int size)
+{
+    switch (size)
+    {
+    case 1:
+        return "byte ptr ";
+    case 2:
+        return "word ptr ";
+    case 4:
+        return "dword ptr ";
+    default:
+        return "qword ptr ";
+    }
+}
+
+/* Memory widths are implied by a register operand, except for extensions and conversions. */
+static int needs_size_keyword(const MInstr *instr)
+{
+    if (instr->op == MI_MOVZX || instr->op == MI_CVTSI2SD)
+        return 1;
+    for (int i = 0; i < instr->nops; i++)
+    {
+        if (instr->ops[i].kind == MOPND_REG)
+            return 0;
+    }
+    return 1;
+}
+
+static void print_operand(const MInstr *instr, const MOperand *op, FILE *output)
+{
+    switch (op->kind)
+    {
+    case MOPND_REG:
+        fputs(mreg_name(op->reg, op->size), output);
+        break;
+    case MOPND_IMM:
+        fprintf(output, "%lld", op->imm);
+        break;
+    case MOPND_LABEL:
+        fputs(op->symbol, output);
+        break;
+    case MOPND_MEM:
+    {
+        if (needs_size_keyword(instr))
+            fputs(size_keyword(op->size), output);
+        fputc('[', output);
+        if (op->symbol)
+        {
+            fprintf(output, "rip + %s", op->symbol);
+        }
+        else
+        {
+            if (op->reg != MREG_NONE)
+                fputs(mreg_name(op->reg, 8), output);
+            if (op->index != MREG_NONE)
+                fprintf(output, "%s%s*%d", op->reg != MREG_NONE ? " + " : "", mreg_name(op->index, 8),
+                        op->scale ? op->scale : 1);
+        }
+        if (op->imm > 0)
+            fprintf(output, " + %lld", op->imm);
+        else if (op->imm < 0)
+            fprintf(output, " - %lld", -op->imm);
+        fputc(']', output);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void mir_print_instr(const MInstr *instr, FILE *output)
+{
+    if (instr->op == MI_LABEL)
+    {
+        fprintf(output, "%s:\n", instr->text);
+        return;
+    }
+    if (instr->op == MI_DIRECTIVE)
+    {
+        fprintf(output, "    %s\n", instr->text);
+        return;
+    }
+
+    fprintf(output, "    %s%s", opcode_info[instr->op].mnemonic, mcond_suffix(instr->cond));
+    for (int i = 0; i < instr->nops; i++)
+    {
+        fputs(i == 0 ? " " : ", ", output);
+        print_operand(instr, &instr->ops[i], output);
+    }
+    fputc('\n', output);
+}
+
+void mir_print_function(const MFunction *fn, FILE *output)
+{
+    fprintf(output, "%s:\n", fn->name);
+    for (const MInstr *instr = fn->head; instr; instr = instr->next)
+        mir_print_instr(instr, output);
+}
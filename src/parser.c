@@ -1,7 +1,8 @@
 /**
  * @file parser.c
  * @brief Parser implementation for the SEG language compiler.
- *        Handles variable declarations, expressions, control flow (if/else if/else),
+ *        Handles variable and array declarations, assignments, expressions, control flow
+ *        (if/else if/else, while and for loops, "#pragma unroll" hints on loops),
  *        type checking, and basic error reporting. Promotes type consistency and modular AST generation.
  * @author Dario Romandini
  */
@@ -14,6 +15,31 @@
 #include "symbol.h"
 #include "token.h"
 
+/* Element offsets of an array must fit the 32-bit displacement of an addressing mode. */
+#define ARRAY_MAX_LENGTH (1 << 24)
+
+/* Largest count "#pragma unroll(N)" accepts. */
+#define UNROLL_MAX_COUNT 1024
+
+static const char *type_name(VarType type)
+{
+    switch (type)
+    {
+    case TYPE_INT:
+        return "int";
+    case TYPE_FLOAT:
+        return "float";
+    case TYPE_BOOL:
+        return "bool";
+    case TYPE_CHAR:
+        return "char";
+    case TYPE_STRING:
+        return "string";
+    default:
+        return "unknown";
+    }
+}
+
 static void advance(Parser *parser)
 {
     token_free(&parser->current_token);
@@ -36,6 +62,24 @@ void parser_init(Parser *parser, Lexer *lexer)
 {
     parser->lexer = lexer;
     parser->current_token = lexer_next_token(lexer);
+    parser->symbols = NULL;
+    parser->block_depth = 0;
+    parser->block_variables = 0;
+}
+
+/*
+ * Block-scoped variables are renamed "name.N", so the variable a source name refers to is
+ * the innermost one in scope named either "name" or "name.N".
+ */
+static Symbol *find_variable(Parser *parser, const char *name)
+{
+    size_t length = strlen(name);
+    for (Symbol *sym = parser->symbols; sym; sym = sym->next)
+    {
+        if (strncmp(sym->name, name, length) == 0 && (sym->name[length] == '\0' || sym->name[length] == '.'))
+            return sym;
+    }
+    return NULL;
 }
 
 ASTNode *parse_program(Parser *parser)
@@ -50,6 +94,8 @@ ASTNode *parse_program(Parser *parser)
             current->next = node;
         current = node;
     }
+    free_symbol_table(parser->symbols);
+    parser->symbols = NULL;
     return head;
 }
 
@@ -59,6 +105,22 @@ ASTNode *parse_statement(Parser *parser)
     {
         return parse_if_statement(parser);
     }
+    else if (parser->current_token.type == TOKEN_WHILE)
+    {
+        return parse_while_statement(parser);
+    }
+    else if (parser->current_token.type == TOKEN_FOR)
+    {
+        return parse_for_statement(parser);
+    }
+    else if (parser->current_token.type == TOKEN_PRAGMA)
+    {
+        return parse_pragma_statement(parser);
+    }
+    else if (parser->current_token.type == TOKEN_IDENTIFIER)
+    {
+        return parse_assignment(parser);
+    }
     else if (parser->current_token.type == TOKEN_INT || parser->current_token.type == TOKEN_FLOAT ||
              parser->current_token.type == TOKEN_BOOL || parser->current_token.type == TOKEN_CHAR ||
              parser->current_token.type == TOKEN_STRING)
@@ -74,8 +136,133 @@ ASTNode *parse_statement(Parser *parser)
     }
 }
 
+/* Parses the value assigned to a variable of the given type and checks its type. */
+static ASTNode *parse_value(Parser *parser, const char *name, VarType var_type)
+{
+    ASTNode *value = parse_expression(parser);
+
+    if (var_type == TYPE_BOOL)
+        value->result_type = TYPE_BOOL;
+    else if (var_type == TYPE_INT || var_type == TYPE_FLOAT)
+    {
+        if (value->result_type == TYPE_BOOL)
+        {
+            value->result_type = TYPE_INT;
+        }
+    }
+
+    if (value->result_type != var_type)
+    {
+        printf("[Parser Warning] Type mismatch in assignment to '%s': declared %s, assigned %s (line %d).\n",
+               name, type_name(var_type), type_name(value->result_type),
+               parser->current_token.line);
+    }
+    return value;
+}
+
+/* Renames a variable declared inside a block (see parse_var_decl) and adds it to the scope. */
+static Symbol *declare_symbol(Parser *parser, char *name, VarType var_type)
+{
+    if (parser->block_depth > 0)
+    {
+        char *unique = malloc(strlen(name) + 16);
+        sprintf(unique, "%s.%d", name, ++parser->block_variables);
+        free(name);
+        name = unique;
+    }
+    parser->symbols = add_symbol(parser->symbols, name, var_type);
+    free(name);
+    return parser->symbols;
+}
+
+/* Parses "[index]" after the name of an array. */
+static ASTNode *parse_index(Parser *parser, Symbol *sym)
+{
+    if (!sym->length)
+    {
+        printf("[Parser Error] '%.*s' is not an array (line %d)\n", (int)strcspn(sym->name, "."), sym->name,
+               parser->current_token.line);
+        exit(1);
+    }
+    expect(parser, TOKEN_LBRACKET);
+    advance(parser);
+    ASTNode *index = parse_expression(parser);
+    if (index->result_type != TYPE_INT && index->result_type != TYPE_CHAR && index->result_type != TYPE_BOOL)
+    {
+        printf("[Parser Error] Index of array '%.*s' must be an integer, got %s (line %d)\n",
+               (int)strcspn(sym->name, "."), sym->name, type_name(index->result_type),
+               parser->current_token.line);
+        exit(1);
+    }
+    expect(parser, TOKEN_RBRACKET);
+    advance(parser);
+    return index;
+}
+
+/* Parses the rest of "type name[length] = { values };" after the name. */
+static ASTNode *parse_array_decl(Parser *parser, VarType var_type, char *name, int line, int column)
+{
+    if (var_type != TYPE_INT && var_type != TYPE_FLOAT)
+    {
+        printf("[Parser Error] Arrays of %s are not supported (line %d)\n", type_name(var_type), line);
+        exit(1);
+    }
+    if (find_variable(parser, name))
+    {
+        printf("[Parser Error] Array '%s' redeclares a variable in scope (line %d)\n", name, line);
+        exit(1);
+    }
+
+    advance(parser);
+    long long length = parser->current_token.type == TOKEN_NUMBER && !strchr(parser->current_token.lexeme, '.')
+                           ? strtoll(parser->current_token.lexeme, NULL, 10)
+                           : 0;
+    if (length <= 0 || length > ARRAY_MAX_LENGTH)
+    {
+        printf("[Parser Error] Size of array '%s' must be an integer literal from 1 to %d (line %d)\n", name,
+               ARRAY_MAX_LENGTH, line);
+        exit(1);
+    }
+    advance(parser);
+    expect(parser, TOKEN_RBRACKET);
+    advance(parser);
+
+    ASTNode **values = NULL;
+    int value_count = 0;
+    if (parser->current_token.type == TOKEN_ASSIGN)
+    {
+        advance(parser);
+        expect(parser, TOKEN_LBRACE);
+        advance(parser);
+        while (parser->current_token.type != TOKEN_RBRACE)
+        {
+            if (value_count == length)
+            {
+                printf("[Parser Error] Too many initializers for array '%s' of %lld elements (line %d)\n", name,
+                       length, parser->current_token.line);
+                exit(1);
+            }
+            values = realloc(values, (value_count + 1) * sizeof(ASTNode *));
+            values[value_count++] = parse_value(parser, name, var_type);
+            if (parser->current_token.type != TOKEN_COMMA)
+                break;
+            advance(parser);
+        }
+        expect(parser, TOKEN_RBRACE);
+        advance(parser);
+    }
+    expect(parser, TOKEN_SEMICOLON);
+    advance(parser);
+
+    Symbol *sym = declare_symbol(parser, name, var_type);
+    sym->length = (int)length;
+    ASTNode *node = create_array_decl_node(var_type, sym->name, sym->length, values, value_count);
+    return set_node_location(node, line, column);
+}
+
 ASTNode *parse_var_decl(Parser *parser)
 {
+    int line = parser->current_token.line, column = parser->current_token.column;
     VarType var_type;
     switch (parser->current_token.type)
     {
@@ -105,36 +292,235 @@ ASTNode *parse_var_decl(Parser *parser)
     char *name = strdup(parser->current_token.lexeme);
     advance(parser);
 
+    if (parser->current_token.type == TOKEN_LBRACKET)
+        return parse_array_decl(parser, var_type, name, line, column);
     expect(parser, TOKEN_ASSIGN);
     advance(parser);
 
-    ASTNode *value = parse_expression(parser);
+    ASTNode *value = parse_value(parser, name, var_type);
 
-    if (var_type == TYPE_BOOL)
-        value->result_type = TYPE_BOOL;
-    else if (var_type == TYPE_INT || var_type == TYPE_FLOAT)
+    expect(parser, TOKEN_SEMICOLON);
+    advance(parser);
+
+    /*
+     * Declaring a variable that is already in scope assigns it. A new variable declared
+     * inside a block lives until the end of the block and gets a unique name, so that
+     * later passes and the code generator never confuse it with another of the same name.
+     */
+    Symbol *sym = find_variable(parser, name);
+    if (sym && sym->length)
     {
-        if (value->result_type == TYPE_BOOL)
-        {
-            value->result_type = TYPE_INT;
-        }
+        printf("[Parser Error] '%s' is an array; only its elements can be assigned (line %d)\n", name, line);
+        exit(1);
     }
+    if (sym)
+        free(name);
+    else
+        sym = declare_symbol(parser, name, var_type);
 
-    if (value->result_type != var_type)
+    ASTNode *node = create_var_decl_node(var_type, sym->name, value);
+    set_node_location(node, line, column);
+    return node;
+}
+
+/* Parses "name = expression" or "name[index] = expression" without the semicolon. */
+static ASTNode *parse_assignment_expression(Parser *parser)
+{
+    int line = parser->current_token.line, column = parser->current_token.column;
+    expect(parser, TOKEN_IDENTIFIER);
+    Symbol *sym = find_variable(parser, parser->current_token.lexeme);
+    if (!sym)
     {
-        printf("[Parser Warning] Type mismatch in assignment to '%s': declared %s, assigned %s (line %d).\n",
-               name, token_type_to_string(var_type), token_type_to_string(value->result_type),
-               parser->current_token.line);
+        printf("[Parser Error] Assignment to undeclared variable '%s' (line %d)\n", parser->current_token.lexeme,
+               line);
+        exit(1);
+    }
+    advance(parser);
+
+    ASTNode *index = NULL;
+    if (parser->current_token.type == TOKEN_LBRACKET || sym->length)
+        index = parse_index(parser, sym);
+
+    expect(parser, TOKEN_ASSIGN);
+    advance(parser);
+
+    ASTNode *value = parse_value(parser, sym->name, sym->type);
+    ASTNode *node = index ? create_element_assign_node(sym->name, index, value)
+                          : create_var_decl_node(sym->type, sym->name, value);
+    set_node_location(node, line, column);
+    return node;
+}
+
+ASTNode *parse_assignment(Parser *parser)
+{
+    ASTNode *node = parse_assignment_expression(parser);
+    expect(parser, TOKEN_SEMICOLON);
+    advance(parser);
+    return node;
+}
+
+/* Takes the variables declared since enclosing out of scope. */
+static void leave_scope(Parser *parser, Symbol *enclosing)
+{
+    while (parser->symbols != enclosing)
+    {
+        Symbol *sym = parser->symbols;
+        parser->symbols = sym->next;
+        sym->next = NULL;
+        free_symbol_table(sym);
     }
+    parser->block_depth--;
+}
+
+ASTNode *parse_while_statement(Parser *parser)
+{
+    int line = parser->current_token.line, column = parser->current_token.column;
+    expect(parser, TOKEN_WHILE);
+    advance(parser);
+
+    expect(parser, TOKEN_LPAREN);
+    advance(parser);
+    ASTNode *condition = parse_expression(parser);
+    expect(parser, TOKEN_RPAREN);
+    advance(parser);
+
+    expect(parser, TOKEN_LBRACE);
+    advance(parser);
+    ASTNode *body = parse_block(parser);
+
+    ASTNode *node = create_loop_node(NULL, condition, NULL, body);
+    set_node_location(node, line, column);
+    return node;
+}
+
+ASTNode *parse_for_statement(Parser *parser)
+{
+    int line = parser->current_token.line, column = parser->current_token.column;
+    expect(parser, TOKEN_FOR);
+    advance(parser);
+
+    expect(parser, TOKEN_LPAREN);
+    advance(parser);
+
+    /* The loop is a block of its own, so that the variable it declares is local to it. */
+    Symbol *enclosing = parser->symbols;
+    parser->block_depth++;
 
+    ASTNode *init = NULL;
+    if (parser->current_token.type == TOKEN_SEMICOLON)
+        advance(parser);
+    else if (parser->current_token.type == TOKEN_IDENTIFIER)
+        init = parse_assignment(parser);
+    else
+        init = parse_var_decl(parser);
+
+    ASTNode *condition = parse_expression(parser);
     expect(parser, TOKEN_SEMICOLON);
     advance(parser);
 
-    return create_var_decl_node(var_type, name, value);
+    ASTNode *update = NULL;
+    if (parser->current_token.type != TOKEN_RPAREN)
+        update = parse_assignment_expression(parser);
+    expect(parser, TOKEN_RPAREN);
+    advance(parser);
+
+    expect(parser, TOKEN_LBRACE);
+    advance(parser);
+    ASTNode *body = parse_block(parser);
+
+    leave_scope(parser, enclosing);
+
+    ASTNode *node = create_loop_node(init, condition, update, body);
+    set_node_location(node, line, column);
+    return node;
+}
+
+/*
+ * Reads the unroll hint of "pragma unroll", "pragma unroll(N)", "pragma unroll N" or
+ * "pragma nounroll". Returns 0 if the text is some other pragma, -1 if the count is malformed.
+ */
+static int parse_unroll_hint(const char *text, int *hint)
+{
+    const char *p = text + strlen("pragma");
+    while (*p == ' ' || *p == '\t')
+        p++;
+
+    if (strcmp(p, "nounroll") == 0)
+    {
+        *hint = 1;
+        return 1;
+    }
+    if (strncmp(p, "unroll", 6) != 0 || (p[6] != '\0' && p[6] != ' ' && p[6] != '\t' && p[6] != '('))
+        return 0;
+    p += 6;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p == '\0')
+    {
+        *hint = LOOP_UNROLL_FULL;
+        return 1;
+    }
+
+    int parenthesized = *p == '(';
+    if (parenthesized)
+        p++;
+    char *end;
+    long count = strtol(p, &end, 10);
+    if (end == p || count < 1 || count > UNROLL_MAX_COUNT)
+        return -1;
+    p = end;
+    if (parenthesized)
+    {
+        if (*p != ')')
+            return -1;
+        p++;
+    }
+    if (*p != '\0')
+        return -1;
+    *hint = (int)count;
+    return 1;
+}
+
+ASTNode *parse_pragma_statement(Parser *parser)
+{
+    int line = parser->current_token.line;
+    const char *text = parser->current_token.lexeme;
+    int hint = 0;
+
+    if (strncmp(text, "pragma", 6) != 0 || (text[6] != '\0' && text[6] != ' ' && text[6] != '\t'))
+    {
+        printf("[Parser Error] Unknown directive '#%s' (line %d)\n", text, line);
+        exit(1);
+    }
+
+    int result = parse_unroll_hint(text, &hint);
+    if (result < 0)
+    {
+        printf("[Parser Error] Unroll count must be an integer from 1 to %d (line %d)\n", UNROLL_MAX_COUNT, line);
+        exit(1);
+    }
+    if (result == 0)
+    {
+        printf("[Parser Warning] Ignoring unknown '#%s' (line %d).\n", text, line);
+        advance(parser);
+        return parse_statement(parser);
+    }
+
+    advance(parser);
+    if (parser->current_token.type != TOKEN_WHILE && parser->current_token.type != TOKEN_FOR)
+    {
+        printf("[Parser Error] #pragma unroll must be followed by a loop, got %s (line %d)\n",
+               token_type_to_string(parser->current_token.type), parser->current_token.line);
+        exit(1);
+    }
+    ASTNode *node = parse_statement(parser);
+    node->loop.unroll = hint;
+    return node;
 }
 
 ASTNode *parse_if_statement(Parser *parser)
 {
+    int line = parser->current_token.line, column = parser->current_token.column;
     expect(parser, TOKEN_IF);
     advance(parser);
 
@@ -164,12 +550,16 @@ ASTNode *parse_if_statement(Parser *parser)
         }
     }
 
-    return create_if_statement_node(condition, then_branch, else_branch);
+    ASTNode *node = create_if_statement_node(condition, then_branch, else_branch);
+    set_node_location(node, line, column);
+    return node;
 }
 
 ASTNode *parse_block(Parser *parser)
 {
     ASTNode *head = NULL, *current = NULL;
+    Symbol *enclosing = parser->symbols;
+    parser->block_depth++;
     while (parser->current_token.type != TOKEN_RBRACE && parser->current_token.type != TOKEN_EOF)
     {
         ASTNode *node = parse_statement(parser);
@@ -183,6 +573,9 @@ ASTNode *parse_block(Parser *parser)
     expect(parser, TOKEN_RBRACE);
     advance(parser);
 
+    /* The variables declared in the block go out of scope. */
+    leave_scope(parser, enclosing);
+
     return head;
 }
 
@@ -209,9 +602,11 @@ ASTNode *parse_logical_or(Parser *parser)
     while (parser->current_token.type == TOKEN_OR)
     {
         TokenType op = parser->current_token.type;
+        int line = parser->current_token.line, column = parser->current_token.column;
         advance(parser);
         ASTNode *right = parse_logical_xor(parser);
         node = create_binary_expr_node(op, node, right);
+        set_node_location(node, line, column);
         node->result_type = TYPE_BOOL;
     }
     return node;
@@ -223,9 +618,11 @@ ASTNode *parse_logical_xor(Parser *parser)
     while (parser->current_token.type == TOKEN_XOR)
     {
         TokenType op = parser->current_token.type;
+        int line = parser->current_token.line, column = parser->current_token.column;
         advance(parser);
         ASTNode *right = parse_logical_and(parser);
         node = create_binary_expr_node(op, node, right);
+        set_node_location(node, line, column);
         node->result_type = TYPE_BOOL;
     }
     return node;
@@ -237,9 +634,11 @@ ASTNode *parse_logical_and(Parser *parser)
     while (parser->current_token.type == TOKEN_AND)
     {
         TokenType op = parser->current_token.type;
+        int line = parser->current_token.line, column = parser->current_token.column;
         advance(parser);
         ASTNode *right = parse_equality(parser);
         node = create_binary_expr_node(op, node, right);
+        set_node_location(node, line, column);
         node->result_type = TYPE_BOOL;
     }
     return node;
@@ -251,9 +650,11 @@ ASTNode *parse_equality(Parser *parser)
     while (parser->current_token.type == TOKEN_EQ || parser->current_token.type == TOKEN_NEQ)
     {
         TokenType op = parser->current_token.type;
+        int line = parser->current_token.line, column = parser->current_token.column;
         advance(parser);
         ASTNode *right = parse_comparison(parser);
         node = create_binary_expr_node(op, node, right);
+        set_node_location(node, line, column);
         node->result_type = TYPE_BOOL;
     }
     return node;
@@ -266,9 +667,11 @@ ASTNode *parse_comparison(Parser *parser)
            parser->current_token.type == TOKEN_LEQ || parser->current_token.type == TOKEN_GEQ)
     {
         TokenType op = parser->current_token.type;
+        int line = parser->current_token.line, column = parser->current_token.column;
         advance(parser);
         ASTNode *right = parse_term(parser);
         node = create_binary_expr_node(op, node, right);
+        set_node_location(node, line, column);
         node->result_type = TYPE_BOOL;
     }
     return node;
@@ -278,21 +681,24 @@ ASTNode *parse_term(Parser *parser)
 {
     ASTNode *node = parse_unary(parser);
     while (parser->current_token.type == TOKEN_PLUS || parser->current_token.type == TOKEN_MINUS ||
-           parser->current_token.type == TOKEN_STAR || parser->current_token.type == TOKEN_SLASH)
+           parser->current_token.type == TOKEN_STAR || parser->current_token.type == TOKEN_SLASH ||
+           parser->current_token.type == TOKEN_PERCENT)
     {
         TokenType op = parser->current_token.type;
+        int line = parser->current_token.line, column = parser->current_token.column;
         advance(parser);
         ASTNode *right = parse_unary(parser);
         if (node->result_type != right->result_type)
         {
             printf("[Parser Warning] Type mismatch in arithmetic operation: %s vs %s (line %d).\n",
-                   token_type_to_string(node->result_type),
-                   token_type_to_string(right->result_type),
+                   type_name(node->result_type),
+                   type_name(right->result_type),
                    parser->current_token.line);
             node->result_type = TYPE_FLOAT;
             right->result_type = TYPE_FLOAT;
         }
         node = create_binary_expr_node(op, node, right);
+        set_node_location(node, line, column);
         node->result_type = right->result_type;
     }
     return node;
@@ -303,9 +709,12 @@ ASTNode *parse_unary(Parser *parser)
     if (parser->current_token.type == TOKEN_NOT)
     {
         TokenType op = parser->current_token.type;
+        int line = parser->current_token.line, column = parser->current_token.column;
         advance(parser);
         ASTNode *operand = parse_unary(parser);
-        return create_unary_expr_node(op, operand);
+        ASTNode *node = create_unary_expr_node(op, operand);
+        set_node_location(node, line, column);
+        return node;
     }
     return parse_factor(parser);
 }
@@ -313,6 +722,7 @@ ASTNode *parse_unary(Parser *parser)
 ASTNode *parse_factor(Parser *parser)
 {
     ASTNode *node = NULL;
+    int line = parser->current_token.line, column = parser->current_token.column;
     switch (parser->current_token.type)
     {
     case TOKEN_NUMBER:
@@ -333,9 +743,21 @@ ASTNode *parse_factor(Parser *parser)
         advance(parser);
         break;
     case TOKEN_IDENTIFIER:
-        node = create_identifier_node(parser->current_token.lexeme);
+    {
+        Symbol *sym = find_variable(parser, parser->current_token.lexeme);
+        node = create_identifier_node(sym ? sym->name : parser->current_token.lexeme);
+        if (sym)
+            node->result_type = sym->type;
         advance(parser);
+        if (sym && (sym->length || parser->current_token.type == TOKEN_LBRACKET))
+        {
+            ASTNode *index = parse_index(parser, sym);
+            free_ast(node);
+            node = create_index_node(sym->name, index);
+            node->result_type = sym->type;
+        }
         break;
+    }
     case TOKEN_LPAREN:
         advance(parser);
         node = parse_expression(parser);
@@ -346,5 +768,7 @@ ASTNode *parse_factor(Parser *parser)
         printf("[Parser Error] Unexpected token: %s\n", token_type_to_string(parser->current_token.type));
         exit(1);
     }
+    if (node->line == 0)
+        set_node_location(node, line, column);
     return node;
 }
@@ -0,0 +1,228 @@
+/**
+ * @file passes.c
+ * @brief Pass manager implementation for the SEG language compiler.
+ *        Holds the registry of optimization passes and the pipelines run at each
+ *        optimization level, and instruments every pass with timing and change counts.
+ * @author Dario Romandini
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "passes.h"
+#include "optimize.h"
+
+static const Pass pass_registry[] = {
+    {"constfold", PASS_AST, "Fold operators on integer and boolean literals", run_constant_folding, NULL},
+    {"simplify", PASS_AST, "Apply the algebraic rewrite rules of simplify.rules", run_simplify, NULL},
+    {"egraph", PASS_AST, "Saturate an e-graph of each expression and extract its cheapest form", run_egraph, NULL},
+    {"branchfold", PASS_AST, "Replace if-statements with constant conditions by the taken branch", run_branch_folding, NULL},
+    {"unroll", PASS_AST, "Unroll counted loops, fully when the trip count is small and constant", run_unroll, NULL},
+    {"licm", PASS_AST, "Hoist loop-invariant expressions and loads, sink element stores to the loop exit", run_licm, NULL},
+    {"ivopt", PASS_AST, "Address arrays through pointer induction variables, count loop exits down to zero", run_ivopt, NULL},
+    {"peephole", PASS_MIR, "Fold push/pop pairs, forward copies, fuse compare-and-branch", NULL, run_peephole},
+    {"strength", PASS_MIR, "Reduce multiplies and divides by constants to shifts, lea and multiply-high", NULL, run_strength_reduction},
+    {"gvn", PASS_MIR, "Value-number expressions and loads, reuse available values, remove dead code", NULL, run_gvn},
+    {"memopt", PASS_MIR, "Forward stored globals to later loads across blocks, remove dead stores", NULL, run_memopt},
+    {"promote", PASS_MIR, "Keep non-escaping globals of main in free registers and stack slots", NULL, run_promote},
+    {"blocklayout", PASS_MIR, "Order blocks for fall-through, drop jumps to the next block, align hot blocks", NULL, run_block_layout},
+    {"shrink", PASS_MIR, "Pick shorter encodings: xor for zero, test for compares with zero, 32-bit forms", NULL, run_shrink},
+    {"schedule", PASS_MIR, "List-schedule straight-line code with the -mtune= latency and port model", NULL, run_schedule},
+};
+
+#define PASS_COUNT (int)(sizeof(pass_registry) / sizeof(pass_registry[0]))
+
+/* Pipelines, in execution order. AST passes always precede MIR passes. */
+static const char *pipeline_o0[] = {NULL};
+static const char *pipeline_o1[] = {"constfold", "simplify", "branchfold", "peephole", "strength", "promote", "blocklayout", "shrink", NULL};
+static const char *pipeline_o2[] = {"constfold", "simplify", "branchfold", "unroll", "constfold", "branchfold", "licm", "ivopt", "peephole", "gvn", "memopt", "strength", "promote", "gvn", "blocklayout", "shrink", "schedule", NULL};
+static const char *pipeline_o3[] = {"constfold", "simplify", "egraph", "branchfold", "unroll", "constfold", "branchfold", "licm", "ivopt", "peephole", "gvn", "memopt", "strength", "promote", "gvn", "blocklayout", "shrink", "schedule", NULL};
+static const char *pipeline_os[] = {"constfold", "simplify", "branchfold", "unroll", "constfold", "branchfold", "licm", "ivopt", "peephole", "gvn", "memopt", "strength", "promote", "gvn", "blocklayout", "shrink", NULL};
+
+const Pass *find_pass(const char *name)
+{
+    for (int i = 0; i < PASS_COUNT; i++)
+    {
+        if (strcmp(pass_registry[i].name, name) == 0)
+            return &pass_registry[i];
+    }
+    return NULL;
+}
+
+int parse_opt_level(const char *flag, OptLevel *level)
+{
+    if (strcmp(flag, "-O0") == 0)
+        *level = OPT_O0;
+    else if (strcmp(flag, "-O1") == 0)
+        *level = OPT_O1;
+    else if (strcmp(flag, "-O2") == 0)
+        *level = OPT_O2;
+    else if (strcmp(flag, "-O3") == 0)
+        *level = OPT_O3;
+    else if (strcmp(flag, "-Os") == 0)
+        *level = OPT_OS;
+    else
+        return 0;
+    return 1;
+}
+
+static const char *tune_names[TUNE_COUNT] = {
+    [TUNE_GENERIC] = "generic",
+    [TUNE_SKYLAKE] = "skylake",
+    [TUNE_ZNVER3] = "znver3",
+};
+
+int parse_tune(const char *name, TuneTarget *tune)
+{
+    for (int i = 0; i < TUNE_COUNT; i++)
+    {
+        if (strcmp(tune_names[i], name) == 0)
+        {
+            *tune = (TuneTarget)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void pass_manager_init(PassManager *pm, OptLevel level)
+{
+    memset(pm, 0, sizeof(*pm));
+    pm->context.level = level;
+    pm->dump = stderr;
+
+    const char **names = pipeline_o0;
+    switch (level)
+    {
+    case OPT_O1:
+        names = pipeline_o1;
+        break;
+    case OPT_O2:
+        names = pipeline_o2;
+        break;
+    case OPT_O3:
+        names = pipeline_o3;
+        break;
+    case OPT_OS:
+        names = pipeline_os;
+        break;
+    default:
+        break;
+    }
+
+    for (int i = 0; names[i] && pm->count < MAX_PIPELINE_PASSES; i++)
+    {
+        const Pass *pass = find_pass(names[i]);
+        if (!pass)
+        {
+            fprintf(stderr, "[Pass Manager Error] Unknown pass in pipeline: %s\n", names[i]);
+            exit(1);
+        }
+        pm->pipeline[pm->count++] = pass;
+    }
+}
+
+int pass_manager_disable(PassManager *pm, const char *name)
+{
+    if (!find_pass(name))
+        return 0;
+    for (int i = 0; i < pm->count; i++)
+    {
+        if (strcmp(pm->pipeline[i]->name, name) == 0)
+            pm->disabled[i] = 1;
+    }
+    return 1;
+}
+
+int pass_manager_print_after(PassManager *pm, const char *name)
+{
+    int all = strcmp(name, "all") == 0;
+    if (!all && !find_pass(name))
+        return 0;
+    for (int i = 0; i < pm->count; i++)
+    {
+        if (all || strcmp(pm->pipeline[i]->name, name) == 0)
+            pm->print_after[i] = 1;
+    }
+    return 1;
+}
+
+double pass_now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_pipeline(PassManager *pm, PassKind kind, ASTNode **program, MFunction *fn)
+{
+    for (int i = 0; i < pm->count; i++)
+    {
+        const Pass *pass = pm->pipeline[i];
+        if (pass->kind != kind || pm->disabled[i])
+            continue;
+
+        double start = pass_now_seconds();
+        int changes = kind == PASS_AST ? pass->run_ast(program, &pm->context)
+                                       : pass->run_mir(fn, &pm->context);
+        pm->stats[i].seconds += pass_now_seconds() - start;
+        pm->stats[i].changes += changes;
+        pm->stats[i].runs++;
+
+        if (pm->print_after[i])
+        {
+            fprintf(pm->dump, "*** IR Dump After %s (%d change%s) ***\n",
+                    pass->name, changes, changes == 1 ? "" : "s");
+            if (kind == PASS_AST)
+                print_ast(*program, pm->dump);
+            else
+                mir_print_function(fn, pm->dump);
+        }
+    }
+}
+
+void pass_manager_run_ast(PassManager *pm, ASTNode **program)
+{
+    run_pipeline(pm, PASS_AST, program, NULL);
+}
+
+void pass_manager_run_mir(PassManager *pm, MFunction *fn)
+{
+    if (pm)
+        run_pipeline(pm, PASS_MIR, NULL, fn);
+}
+
+void pass_manager_report(const PassManager *pm, FILE *output)
+{
+    double total = 0;
+    int total_changes = 0;
+    for (int i = 0; i < pm->count; i++)
+    {
+        total += pm->stats[i].seconds;
+        total_changes += pm->stats[i].changes;
+    }
+
+    fprintf(output, "=== Pass execution report ===\n");
+    fprintf(output, "  %10s  %6s  %8s  %s\n", "Time (ms)", "%", "Changes", "Pass");
+    for (int i = 0; i < pm->count; i++)
+    {
+        const PassStats *stats = &pm->stats[i];
+        fprintf(output, "  %10.3f  %5.1f%%  %8d  %s%s\n",
+                stats->seconds * 1e3,
+                total > 0 ? 100.0 * stats->seconds / total : 0.0,
+                stats->changes,
+                pm->pipeline[i]->name,
+                pm->disabled[i] ? " (disabled)" : "");
+    }
+    fprintf(output, "  %10.3f  %5.1f%%  %8d  Total\n", total * 1e3, 100.0, total_changes);
+}
+
+void list_passes(FILE *output)
+{
+    for (int i = 0; i < PASS_COUNT; i++)
+    {
+        fprintf(output, "  %-12s %-4s %s\n", pass_registry[i].name,
+                pass_registry[i].kind == PASS_AST ? "AST" : "MIR", pass_registry[i].description);
+    }
+}
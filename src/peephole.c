@@ -0,0 +1,135 @@
+/**
+ * @file peephole.c
+ * @brief Peephole optimizations on the machine IR of the SEG compiler.
+ *        Cleans up the stack-machine shape of the naive expression code: push/pop pairs
+ *        around a single load become register moves, copies are forwarded into their
+ *        users, and compare/setcc/test/branch chains are fused into one conditional jump.
+ * @author Dario Romandini
+ */
+
+#include <stdlib.h>
+#include "optimize.h"
+#include "remarks.h"
+
+#define PEEPHOLE_MAX_ITERATIONS 8
+
+static int is_reg(const MOperand *op, MReg reg)
+{
+    return op->kind == MOPND_REG && op->reg == reg && op->size == 8;
+}
+
+static int is_imm(const MOperand *op, long long value)
+{
+    return op->kind == MOPND_IMM && op->imm == value;
+}
+
+/* A single instruction that only writes rax from a source not involving rax, rbx or the stack. */
+static int is_simple_rax_load(const MInstr *instr)
+{
+    if (instr->nops != 2 || !is_reg(&instr->ops[0], MREG_RAX))
+        return 0;
+    if (instr->op != MI_MOV && instr->op != MI_MOVZX && instr->op != MI_LEA)
+        return 0;
+    return !mir_reads_reg(instr, MREG_RAX) && !mir_reads_reg(instr, MREG_RBX) &&
+           !mir_reads_reg(instr, MREG_RSP);
+}
+
+/*
+ * push rax / <load rax> / pop rbx  ->  mov rbx, rax / <load rax>
+ */
+static int fold_push_pop(MFunction *fn, MInstr *push)
+{
+    MInstr *load = push->next;
+    MInstr *pop = load ? load->next : NULL;
+
+    if (push->op != MI_PUSH || !is_reg(&push->ops[0], MREG_RAX) || !pop)
+        return 0;
+    if (!is_simple_rax_load(load) || pop->op != MI_POP || !is_reg(&pop->ops[0], MREG_RBX))
+        return 0;
+
+    remark(REMARK_PASSED, "peephole", "PushPopFolded", push->line,
+           "operand passed in rbx instead of through the stack");
+    push->op = MI_MOV;
+    push->nops = 2;
+    push->ops[0] = mop_reg(MREG_RBX);
+    push->ops[1] = mop_reg(MREG_RAX);
+    mir_remove(fn, pop);
+    return 1;
+}
+
+/*
+ * mov rax, src / mov rbx, rax  ->  mov rbx, src   (when rax is dead afterwards)
+ */
+static int forward_copy(MFunction *fn, MInstr *def)
+{
+    MInstr *copy = def->next;
+
+    if (!copy || !is_simple_rax_load(def))
+        return 0;
+    if (copy->op != MI_MOV || !is_reg(&copy->ops[0], MREG_RBX) || !is_reg(&copy->ops[1], MREG_RAX))
+        return 0;
+    if (!mir_reg_dead_after(fn, copy, MREG_RAX))
+        return 0;
+
+    remark(REMARK_PASSED, "peephole", "CopyForwarded", def->line, "load forwarded into rbx");
+    def->ops[0] = mop_reg(MREG_RBX);
+    mir_remove(fn, copy);
+    return 1;
+}
+
+/*
+ * cmp a, b / setcc al / movzx rax, al / cmp rax, 0 / je L  ->  cmp a, b / jncc L
+ */
+static int fuse_compare_branch(MFunction *fn, MInstr *cmp)
+{
+    MInstr *set = cmp->next;
+    MInstr *extend = set ? set->next : NULL;
+    MInstr *test = extend ? extend->next : NULL;
+    MInstr *branch = test ? test->next : NULL;
+
+    if (cmp->op != MI_CMP || !branch)
+        return 0;
+    if (set->op != MI_SETCC || set->ops[0].reg != MREG_RAX)
+        return 0;
+    if (extend->op != MI_MOVZX || !is_reg(&extend->ops[0], MREG_RAX) || extend->ops[1].reg != MREG_RAX)
+        return 0;
+    if (test->op != MI_CMP || !is_reg(&test->ops[0], MREG_RAX) || !is_imm(&test->ops[1], 0))
+        return 0;
+    if (branch->op != MI_JCC || (branch->cond != MCOND_E && branch->cond != MCOND_NE))
+        return 0;
+    if (!mir_reg_dead_after(fn, branch, MREG_RAX) || !mir_reg_dead_after(fn, branch, MREG_NONE))
+    {
+        remark(REMARK_MISSED, "peephole", "CompareBranchNotFused", branch->line,
+               "compare not fused into the branch: its boolean result is used afterwards");
+        return 0;
+    }
+
+    remark(REMARK_PASSED, "peephole", "CompareBranchFused", branch->line,
+           "compare and branch fused into j%s", mcond_suffix(branch->cond == MCOND_E ? mcond_invert(set->cond) : set->cond));
+    branch->cond = branch->cond == MCOND_E ? mcond_invert(set->cond) : set->cond;
+    mir_remove(fn, set);
+    mir_remove(fn, extend);
+    mir_remove(fn, test);
+    return 1;
+}
+
+int run_peephole(MFunction *fn, PassContext *ctx)
+{
+    (void)ctx;
+    int total = 0;
+
+    for (int iteration = 0; iteration < PEEPHOLE_MAX_ITERATIONS; iteration++)
+    {
+        int changes = 0;
+        for (MInstr *instr = fn->head; instr; instr = instr->next)
+        {
+            changes += fold_push_pop(fn, instr);
+            changes += forward_copy(fn, instr);
+            changes += fuse_compare_branch(fn, instr);
+        }
+        total += changes;
+        if (changes == 0)
+            break;
+    }
+    return total;
+}
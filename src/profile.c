@@ -0,0 +1,105 @@
+/**
+ * @file profile.c
+ * @brief Implementation of execution profile loading for the SEG language compiler.
+ *        Each record line is "id line kind count"; comment lines start with '#'.
+ * @author Dario Romandini
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+typedef struct ProfileSite
+{
+    char kind[8];
+    int line;
+    long long count;
+    int duplicates; ///< Other sites with the same kind and line (lookups are then ambiguous)
+    struct ProfileSite *next;
+} ProfileSite;
+
+static ProfileSite *sites = NULL;
+static int loaded = 0;
+
+static ProfileSite *find_site(const char *kind, int line)
+{
+    for (ProfileSite *site = sites; site; site = site->next)
+    {
+        if (site->line == line && strcmp(site->kind, kind) == 0)
+            return site;
+    }
+    return NULL;
+}
+
+int profile_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return 0;
+
+    char buffer[1024];
+    if (!fgets(buffer, sizeof(buffer), file) || strncmp(buffer, PROFILE_MAGIC, strlen(PROFILE_MAGIC)) != 0)
+    {
+        fclose(file);
+        return 0;
+    }
+
+    while (fgets(buffer, sizeof(buffer), file))
+    {
+        long id;
+        int line;
+        char kind[8];
+        long long count;
+        if (buffer[0] == '#' || sscanf(buffer, "%ld %d %7s %lld", &id, &line, kind, &count) != 4)
+            continue;
+
+        ProfileSite *site = find_site(kind, line);
+        if (site)
+        {
+            site->duplicates++;
+            continue;
+        }
+        site = calloc(1, sizeof(ProfileSite));
+        strcpy(site->kind, kind);
+        site->line = line;
+        site->count = count;
+        site->next = sites;
+        sites = site;
+    }
+
+    fclose(file);
+    loaded = 1;
+    return 1;
+}
+
+int profile_loaded(void)
+{
+    return loaded;
+}
+
+/* Must agree with the site lines chosen by the instrumentation in codegen.c. */
+int profile_branch_counts(const ASTNode *node, long long *then_count, long long *else_count)
+{
+    const ASTNode *then_branch = node->if_statement.then_branch;
+    const ASTNode *else_branch = node->if_statement.else_branch;
+    ProfileSite *then_site = find_site("then", then_branch ? then_branch->line : node->line);
+    ProfileSite *else_site = find_site("else", else_branch ? else_branch->line : node->line);
+
+    if (!then_site || !else_site || then_site->duplicates || else_site->duplicates)
+        return 0;
+    *then_count = then_site->count;
+    *else_count = else_site->count;
+    return 1;
+}
+
+void profile_free(void)
+{
+    while (sites)
+    {
+        ProfileSite *next = sites->next;
+        free(sites);
+        sites = next;
+    }
+    loaded = 0;
+}
@@ -0,0 +1,288 @@
+/**
+ * @file promote.c
+ * @brief Promotion of global variables to registers and stack slots for the SEG compiler.
+ *        A SEG variable is a global only because it is the simplest place to put
+ *        it: no SEG code can take its address, and nothing outside main reads it once
+ *        main has returned. The escape analysis below keeps a global only if its address
+ *        is taken or it is accessed at another size or offset (the statement counters, the
+ *        literal pool). Every other variable becomes a local of main: the most used integer
+ *        variables take the registers main never touches, the rest live in [rbp - n] slots
+ *        of a frame the code generator builds around the body. Accesses inside loops count
+ *        LOOP_WEIGHT times per level of nesting, so loop counters and accumulators get the
+ *        registers before variables only used once. Variables that can be read
+ *        before main's first store to them start out as zero, like the globals they replace.
+ * @author Dario Romandini
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+#include "symbol.h"
+
+/* Estimated iterations of a loop, and the deepest nesting the estimate compounds over. */
+#define LOOP_WEIGHT 8
+#define LOOP_WEIGHT_MAX_DEPTH 4
+
+typedef struct
+{
+    char *name;
+    int uses;       ///< Number of accesses, weighted by loop depth
+    int eligible;   ///< Only whole-variable 8-byte accesses
+    int stored;     ///< Written by a plain store somewhere
+    int floating;   ///< Accessed by SSE instructions, so it cannot live in a general register
+    int read_early; ///< May be read on some path from the entry before it is stored
+    MOperand home;  ///< Register or stack slot replacing [rip + name]
+} Variable;
+
+typedef struct
+{
+    Variable *vars;
+    int count;
+    int capacity;
+} Variables;
+
+/* Registers main may use as variables: caller-saved first (free in a leaf), then callee-saved. */
+static const MReg candidate_registers[] = {MREG_RSI, MREG_RDI, MREG_R8,  MREG_R9,  MREG_R10, MREG_R11,
+                                           MREG_RCX, MREG_R12, MREG_R13, MREG_R14, MREG_R15};
+
+static int is_sse(MOpcode op)
+{
+    return op == MI_MOVSD || op == MI_MOVQ || op == MI_CVTTSD2SI || op == MI_ADDSD || op == MI_SUBSD ||
+           op == MI_MULSD || op == MI_DIVSD || op == MI_UCOMISD;
+}
+
+static Variable *find_variable(Variables *vars, const char *name)
+{
+    for (int i = 0; i < vars->count; i++)
+    {
+        if (strcmp(vars->vars[i].name, name) == 0)
+            return &vars->vars[i];
+    }
+    if (vars->count == vars->capacity)
+    {
+        vars->capacity = vars->capacity ? vars->capacity * 2 : 16;
+        vars->vars = realloc(vars->vars, vars->capacity * sizeof(Variable));
+    }
+    Variable *var = &vars->vars[vars->count++];
+    memset(var, 0, sizeof(Variable));
+    var->name = strdup(name);
+    var->eligible = 1;
+    return var;
+}
+
+static void analyze(MFunction *fn, Variables *vars)
+{
+    int *depths = mir_loop_depths(fn);
+    int position = 0;
+    for (MInstr *instr = fn->head; instr; instr = instr->next, position++)
+    {
+        int weight = 1;
+        for (int level = 0; level < depths[position] && level < LOOP_WEIGHT_MAX_DEPTH; level++)
+            weight *= LOOP_WEIGHT;
+        for (int i = 0; i < instr->nops; i++)
+        {
+            MOperand *op = &instr->ops[i];
+            if (op->kind != MOPND_MEM || !op->symbol)
+                continue;
+            Variable *var = find_variable(vars, op->symbol);
+            var->uses += weight;
+            if (!mir_is_plain_global(op) || instr->op == MI_LEA)
+                var->eligible = 0;
+            if (is_sse(instr->op))
+                var->floating = 1;
+            var->stored |= i == 0 && mir_is_plain_store(instr);
+        }
+    }
+    free(depths);
+}
+
+static int label_index(MInstr **labels, int count, const char *name)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(labels[i]->text, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/* Adds the variables set in from to into; returns whether into grew. */
+static int merge_unstored(unsigned char *into, const unsigned char *from, int count)
+{
+    int grew = 0;
+    for (int i = 0; i < count; i++)
+    {
+        grew |= from[i] && !into[i];
+        into[i] |= from[i];
+    }
+    return grew;
+}
+
+/*
+ * Forward data flow over the instruction list: which variables may not have been stored
+ * yet. The set at a label is the union over the jumps to it and the fall-through into it;
+ * a variable read while in the set must start out as zero, like the global it replaces.
+ */
+static void find_early_reads(MFunction *fn, Variables *vars)
+{
+    int label_count = 0;
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+        label_count += instr->op == MI_LABEL;
+
+    MInstr **labels = malloc((label_count ? label_count : 1) * sizeof(MInstr *));
+    unsigned char *at_label = calloc((size_t)(label_count ? label_count : 1) * (vars->count ? vars->count : 1), 1);
+    unsigned char *unstored = malloc(vars->count ? vars->count : 1);
+    label_count = 0;
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        if (instr->op == MI_LABEL)
+            labels[label_count++] = instr;
+    }
+
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+        int label = 0;
+        memset(unstored, 1, vars->count);
+        for (MInstr *instr = fn->head; instr; instr = instr->next)
+        {
+            if (instr->op == MI_LABEL)
+            {
+                unsigned char *state = at_label + (size_t)label++ * vars->count;
+                changed |= merge_unstored(state, unstored, vars->count);
+                memcpy(unstored, state, vars->count);
+                continue;
+            }
+            for (int i = 0; i < instr->nops; i++)
+            {
+                MOperand *op = &instr->ops[i];
+                if (op->kind != MOPND_MEM || !op->symbol)
+                    continue;
+                int var = (int)(find_variable(vars, op->symbol) - vars->vars);
+                if (i == 0 && mir_is_plain_store(instr))
+                    unstored[var] = 0;
+                else
+                    vars->vars[var].read_early |= unstored[var];
+            }
+            if ((instr->op == MI_JCC || instr->op == MI_JMP) && instr->ops[0].kind == MOPND_LABEL)
+            {
+                int target = label_index(labels, label_count, instr->ops[0].symbol);
+                if (target >= 0)
+                    changed |= merge_unstored(at_label + (size_t)target * vars->count, unstored, vars->count);
+            }
+            if (instr->op == MI_JMP || instr->op == MI_RET)
+                memset(unstored, 0, vars->count);
+        }
+    }
+
+    free(labels);
+    free(at_label);
+    free(unstored);
+}
+
+static int register_is_free(MFunction *fn, MReg reg)
+{
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        if (instr->op == MI_CALL && reg < MREG_R12)
+            return 0;
+        if (mir_reads_reg(instr, reg) || mir_writes_reg(instr, reg))
+            return 0;
+    }
+    return 1;
+}
+
+static int by_uses(const void *a, const void *b)
+{
+    const Variable *x = *(Variable *const *)a, *y = *(Variable *const *)b;
+    return y->uses - x->uses;
+}
+
+static void assign_homes(MFunction *fn, Variables *vars)
+{
+    Variable **order = malloc((vars->count ? vars->count : 1) * sizeof(Variable *));
+    int count = 0;
+    for (int i = 0; i < vars->count; i++)
+    {
+        Variable *var = &vars->vars[i];
+        if (var->eligible && var->stored)
+            order[count++] = var;
+        else if (!var->eligible)
+            remark(REMARK_MISSED, "promote", "KeptGlobal", 0,
+                   "%s stays a global: its address is taken or it is accessed at another size or offset", var->name);
+    }
+    qsort(order, count, sizeof(Variable *), by_uses);
+
+    size_t next_register = 0;
+    for (int i = 0; i < count; i++)
+    {
+        Variable *var = order[i];
+        while (!var->floating && next_register < sizeof(candidate_registers) / sizeof(candidate_registers[0]) &&
+               !register_is_free(fn, candidate_registers[next_register]))
+            next_register++;
+        if (!var->floating && next_register < sizeof(candidate_registers) / sizeof(candidate_registers[0]))
+        {
+            var->home = mop_reg(candidate_registers[next_register++]);
+            remark(REMARK_PASSED, "promote", "Register", 0, "%s kept in %s", var->name, mreg_name(var->home.reg, 8));
+            continue;
+        }
+        /* Block-scoped variables already have slots, shared with those of disjoint blocks. */
+        if (symbol_is_block_scoped(var->name))
+            continue;
+        fn->frame_size += 8;
+        var->home = mop_mem(MREG_RBP, -fn->frame_size, 8);
+        remark(REMARK_PASSED, "promote", "StackSlot", 0, "%s kept in [rbp - %d]", var->name, fn->frame_size);
+    }
+    free(order);
+}
+
+static int rewrite_accesses(MFunction *fn, Variables *vars)
+{
+    int changes = 0;
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        for (int i = 0; i < instr->nops; i++)
+        {
+            MOperand *op = &instr->ops[i];
+            if (op->kind != MOPND_MEM || !op->symbol)
+                continue;
+            Variable *var = find_variable(vars, op->symbol);
+            if (var->home.kind == MOPND_NONE)
+                continue;
+            free(op->symbol);
+            *op = var->home;
+            changes++;
+        }
+    }
+
+    /* Globals start out as zero; so do locals that may be read before they are stored. */
+    for (int i = 0; i < vars->count; i++)
+    {
+        Variable *var = &vars->vars[i];
+        if (var->home.kind == MOPND_NONE || !var->read_early)
+            continue;
+        MInstr *zero = mir_emit(fn, MI_MOV, 2, var->home, mop_imm(0));
+        mir_unlink(fn, zero);
+        zero->line = zero->column = 0;
+        mir_insert_before(fn, fn->head, zero);
+    }
+    return changes;
+}
+
+int run_promote(MFunction *fn, PassContext *ctx)
+{
+    (void)ctx;
+    Variables vars = {0};
+
+    analyze(fn, &vars);
+    find_early_reads(fn, &vars);
+    assign_homes(fn, &vars);
+    int changes = rewrite_accesses(fn, &vars);
+
+    for (int i = 0; i < vars.count; i++)
+        free(vars.vars[i].name);
+    free(vars.vars);
+    return changes;
+}
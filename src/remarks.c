@@ -0,0 +1,166 @@
+/**
+ * @file remarks.c
+ * @brief Implementation of optimization remarks for the SEG language compiler.
+ *        Text remarks go to stderr in "file:line: remark: ..." form; the record file
+ *        uses the YAML document layout of LLVM's -fsave-optimization-record, or a JSON
+ *        array with the same fields.
+ * @author Dario Romandini
+ */
+
+#include <regex.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "remarks.h"
+
+static const char *flag_names[REMARK_KIND_COUNT] = {"-Rpass", "-Rpass-missed", "-Rpass-analysis"};
+static const char *yaml_tags[REMARK_KIND_COUNT] = {"Passed", "Missed", "Analysis"};
+
+static const char *source_path = "<unknown>";
+static regex_t filters[REMARK_KIND_COUNT];
+static int filter_enabled[REMARK_KIND_COUNT];
+
+static FILE *record = NULL;
+static RecordFormat record_format = RECORD_YAML;
+static int record_count = 0;
+
+void remarks_set_source(const char *path)
+{
+    source_path = path;
+}
+
+int remarks_enable(RemarkKind kind, const char *pattern)
+{
+    if (filter_enabled[kind])
+        regfree(&filters[kind]);
+    filter_enabled[kind] = regcomp(&filters[kind], pattern, REG_EXTENDED | REG_NOSUB) == 0;
+    return filter_enabled[kind];
+}
+
+int remarks_open_record(const char *path, RecordFormat format)
+{
+    record = fopen(path, "w");
+    if (!record)
+        return 0;
+    record_format = format;
+    record_count = 0;
+    if (format == RECORD_JSON)
+        fprintf(record, "[");
+    return 1;
+}
+
+static int printed(RemarkKind kind, const char *pass)
+{
+    return filter_enabled[kind] && regexec(&filters[kind], pass, 0, NULL, 0) == 0;
+}
+
+int remarks_wanted(RemarkKind kind, const char *pass)
+{
+    return record != NULL || printed(kind, pass);
+}
+
+static void write_yaml_string(const char *s)
+{
+    fputc('\'', record);
+    for (; *s; s++)
+    {
+        if (*s == '\'')
+            fputc('\'', record);
+        fputc(*s, record);
+    }
+    fputc('\'', record);
+}
+
+static void write_json_string(const char *s)
+{
+    fputc('"', record);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', record);
+        if (*s == '\n')
+            fputs("\\n", record);
+        else
+            fputc(*s, record);
+    }
+    fputc('"', record);
+}
+
+static void write_record(RemarkKind kind, const char *pass, const char *name, int line, const char *message)
+{
+    if (record_format == RECORD_YAML)
+    {
+        fprintf(record, "--- !%s\n", yaml_tags[kind]);
+        fprintf(record, "Pass:            %s\n", pass);
+        fprintf(record, "Name:            %s\n", name);
+        if (line > 0)
+        {
+            fprintf(record, "DebugLoc:        { File: ");
+            write_yaml_string(source_path);
+            fprintf(record, ", Line: %d, Column: 0 }\n", line);
+        }
+        fprintf(record, "Function:        main\n");
+        fprintf(record, "Args:\n  - String:          ");
+        write_yaml_string(message);
+        fprintf(record, "\n...\n");
+        return;
+    }
+
+    fprintf(record, "%s\n  {\"Kind\": \"%s\", \"Pass\": ", record_count ? "," : "", yaml_tags[kind]);
+    write_json_string(pass);
+    fprintf(record, ", \"Name\": ");
+    write_json_string(name);
+    if (line > 0)
+    {
+        fprintf(record, ", \"DebugLoc\": {\"File\": ");
+        write_json_string(source_path);
+        fprintf(record, ", \"Line\": %d, \"Column\": 0}", line);
+    }
+    fprintf(record, ", \"Function\": \"main\", \"Message\": ");
+    write_json_string(message);
+    fprintf(record, "}");
+}
+
+void remark(RemarkKind kind, const char *pass, const char *name, int line, const char *format, ...)
+{
+    if (!remarks_wanted(kind, pass))
+        return;
+
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if (printed(kind, pass))
+    {
+        if (line > 0)
+            fprintf(stderr, "%s:%d: remark: %s [%s=%s]\n", source_path, line, message, flag_names[kind], pass);
+        else
+            fprintf(stderr, "%s: remark: %s [%s=%s]\n", source_path, message, flag_names[kind], pass);
+    }
+
+    if (record)
+    {
+        write_record(kind, pass, name, line, message);
+        record_count++;
+    }
+}
+
+void remarks_finish(void)
+{
+    if (record)
+    {
+        if (record_format == RECORD_JSON)
+            fprintf(record, "\n]\n");
+        fclose(record);
+        record = NULL;
+    }
+    for (int i = 0; i < REMARK_KIND_COUNT; i++)
+    {
+        if (filter_enabled[i])
+            regfree(&filters[i]);
+        filter_enabled[i] = 0;
+    }
+}
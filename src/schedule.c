@@ -0,0 +1,641 @@
+/**
+ * @file schedule.c
+ * @brief Instruction scheduling on the machine IR of the SEG compiler.
+ *        Runs after register allocation (the code generator assigns registers directly)
+ *        on each straight-line run of instructions between labels, directives, branches
+ *        and calls. The code generator computes every value in rax (or xmm0), so short live
+ *        ranges that reuse a register are first renamed to caller-saved registers main never
+ *        touches, which removes the anti- and output dependences between otherwise
+ *        independent computations. A dependence graph over registers, the flags and memory
+ *        then orders the run; a list scheduler then picks, cycle by cycle, the ready instruction with the
+ *        longest latency path to the end of the run, within the issue width and the free
+ *        execution ports of the -mtune= machine model. The new order is kept only when an
+ *        in-order simulation of the model predicts fewer cycles than the original one;
+ *        otherwise the renaming is undone as well.
+ * @author Dario Romandini
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+
+#define MAX_RUN_LENGTH 64
+
+typedef enum
+{
+    UNIT_ALU,
+    UNIT_LOAD,
+    UNIT_STORE,
+    UNIT_MUL,
+    UNIT_DIV,
+    UNIT_FP,
+    UNIT_COUNT
+} Unit;
+
+/* Latency classes of the computation an instruction performs, apart from memory access. */
+typedef enum
+{
+    CLASS_ALU,      ///< Integer moves, arithmetic, logic, setcc, cmov
+    CLASS_MUL,      ///< imul
+    CLASS_DIV,      ///< idiv
+    CLASS_FADD,     ///< addsd, subsd, ucomisd
+    CLASS_FMUL,     ///< mulsd
+    CLASS_FDIV,     ///< divsd
+    CLASS_CVT,      ///< cvtsi2sd, cvttsd2si
+    CLASS_TRANSFER, ///< movq between general-purpose and xmm registers
+    CLASS_COUNT
+} LatencyClass;
+
+typedef struct
+{
+    int latency;   ///< Cycles until the result can be used
+    int occupancy; ///< Cycles the unit stays busy (1 when fully pipelined)
+} ClassCost;
+
+typedef struct
+{
+    const char *name;
+    int issue_width;             ///< Instructions issued per cycle
+    int load_latency;            ///< L1 hit latency added to instructions that load
+    int ports[UNIT_COUNT];       ///< Ports able to execute each unit's work
+    ClassCost cost[CLASS_COUNT]; ///< Indexed by LatencyClass
+} MachineModel;
+
+static const Unit class_unit[CLASS_COUNT] = {
+    [CLASS_ALU] = UNIT_ALU,
+    [CLASS_MUL] = UNIT_MUL,
+    [CLASS_DIV] = UNIT_DIV,
+    [CLASS_FADD] = UNIT_FP,
+    [CLASS_FMUL] = UNIT_FP,
+    [CLASS_FDIV] = UNIT_FP,
+    [CLASS_CVT] = UNIT_FP,
+    [CLASS_TRANSFER] = UNIT_FP,
+};
+
+/* Latencies and reciprocal throughputs of the 64-bit and scalar double forms. */
+static const MachineModel machine_models[TUNE_COUNT] = {
+    [TUNE_GENERIC] = {"generic", 4, 5, {3, 2, 1, 1, 1, 2},
+                      {{1, 1}, {3, 1}, {40, 20}, {4, 1}, {4, 1}, {14, 5}, {6, 1}, {3, 1}}},
+    [TUNE_SKYLAKE] = {"skylake", 4, 5, {4, 2, 1, 1, 1, 2},
+                      {{1, 1}, {3, 1}, {42, 24}, {4, 1}, {4, 1}, {14, 4}, {6, 1}, {2, 1}}},
+    [TUNE_ZNVER3] = {"znver3", 6, 4, {4, 3, 2, 1, 1, 2},
+                     {{1, 1}, {3, 1}, {17, 12}, {3, 1}, {3, 1}, {13, 5}, {5, 1}, {3, 1}}},
+};
+
+typedef struct
+{
+    MInstr *instr;
+    LatencyClass class;
+    int loads;    ///< Reads memory
+    int stores;   ///< Writes memory
+    int latency;  ///< Cycles until the results are available, load included
+    int priority; ///< Longest latency path from the instruction to the end of the run
+} Node;
+
+typedef struct
+{
+    const MachineModel *model;
+    Node nodes[MAX_RUN_LENGTH];
+    int count;
+    int edge[MAX_RUN_LENGTH][MAX_RUN_LENGTH]; ///< Latency from i to j (i before j), -1 if independent
+    int spare[MREG_COUNT];                    ///< Caller-saved registers main never uses
+} Run;
+
+/* A renamed register operand, for undoing the renaming. */
+typedef struct
+{
+    MOperand *op;
+    MReg reg;
+    MReg index;
+} RenameEntry;
+
+typedef struct
+{
+    RenameEntry *entries;
+    int count;
+    int capacity;
+    int ranges; ///< Number of renamed live ranges
+} RenameLog;
+
+/* Spare registers in order of preference: no REX prefix first. */
+static const MReg spare_order[] = {
+    MREG_RCX, MREG_RDX, MREG_RSI, MREG_RDI, MREG_R8, MREG_R9, MREG_R10, MREG_R11,
+    MREG_XMM0, MREG_XMM1, MREG_XMM2, MREG_XMM3, MREG_XMM4, MREG_XMM5, MREG_XMM6, MREG_XMM7,
+    MREG_XMM8, MREG_XMM9, MREG_XMM10, MREG_XMM11, MREG_XMM12, MREG_XMM13, MREG_XMM14, MREG_XMM15,
+};
+
+#define SPARE_COUNT (int)(sizeof(spare_order) / sizeof(spare_order[0]))
+
+static int is_barrier(const MInstr *instr)
+{
+    switch (instr->op)
+    {
+    case MI_LABEL:
+    case MI_DIRECTIVE:
+    case MI_JCC:
+    case MI_JMP:
+    case MI_CALL:
+    case MI_RET:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static LatencyClass classify(const MInstr *instr)
+{
+    switch (instr->op)
+    {
+    case MI_IMUL:
+        return CLASS_MUL;
+    case MI_IDIV:
+        return CLASS_DIV;
+    case MI_ADDSD:
+    case MI_SUBSD:
+    case MI_UCOMISD:
+        return CLASS_FADD;
+    case MI_MULSD:
+        return CLASS_FMUL;
+    case MI_DIVSD:
+        return CLASS_FDIV;
+    case MI_CVTSI2SD:
+    case MI_CVTTSD2SI:
+        return CLASS_CVT;
+    case MI_MOVQ:
+        return CLASS_TRANSFER;
+    default:
+        return CLASS_ALU;
+    }
+}
+
+/* Whether the instruction stores without loading: the destination is only written. */
+static int is_pure_store(const MInstr *instr)
+{
+    return instr->op == MI_MOV || instr->op == MI_MOVSD || instr->op == MI_MOVQ || instr->op == MI_SETCC ||
+           instr->op == MI_PUSH;
+}
+
+/* Moves to or from memory only occupy a load or store port. */
+static int is_memory_move(const Node *node)
+{
+    switch (node->instr->op)
+    {
+    case MI_MOV:
+    case MI_MOVZX:
+    case MI_MOVSD:
+    case MI_MOVQ:
+    case MI_PUSH:
+    case MI_POP:
+        return node->loads || node->stores;
+    default:
+        return 0;
+    }
+}
+
+static int ranges_overlap(const MOperand *a, const MOperand *b)
+{
+    return a->imm < b->imm + b->size && b->imm < a->imm + a->size;
+}
+
+/*
+ * Each variable is a separate object and stack slots are addressed from rbp, so accesses to
+ * different symbols, or to disjoint slots, are independent. Anything else may alias.
+ */
+static int operands_may_alias(const MOperand *a, const MOperand *b)
+{
+    int a_symbol = a->symbol != NULL, b_symbol = b->symbol != NULL;
+    int a_slot = !a_symbol && a->reg == MREG_RBP && a->index == MREG_NONE;
+    int b_slot = !b_symbol && b->reg == MREG_RBP && b->index == MREG_NONE;
+
+    if (a_symbol && b_symbol)
+        return strcmp(a->symbol, b->symbol) == 0 && ranges_overlap(a, b);
+    if (a_slot && b_slot)
+        return ranges_overlap(a, b);
+    if ((a_symbol && b_slot) || (a_slot && b_symbol))
+        return 0;
+    return 1;
+}
+
+static int may_alias(const MInstr *a, const MInstr *b)
+{
+    /* push and pop access the stack through rsp. */
+    if (a->op == MI_PUSH || a->op == MI_POP || b->op == MI_PUSH || b->op == MI_POP)
+        return 1;
+    for (int i = 0; i < a->nops; i++)
+    {
+        if (a->ops[i].kind != MOPND_MEM)
+            continue;
+        for (int j = 0; j < b->nops; j++)
+        {
+            if (b->ops[j].kind == MOPND_MEM && operands_may_alias(&a->ops[i], &b->ops[j]))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static int is_xmm(MReg reg)
+{
+    return reg >= MREG_XMM0 && reg <= MREG_XMM15;
+}
+
+/* Whether the instruction accesses registers only through operands that can be renamed. */
+static int renamable_access(const MInstr *instr)
+{
+    switch (instr->op)
+    {
+    case MI_CQO:
+    case MI_IDIV:
+    case MI_PUSH:
+    case MI_POP:
+        return 0;
+    case MI_IMUL:
+        return instr->nops > 1;
+    default:
+        return 1;
+    }
+}
+
+static int accesses_reg(const MInstr *instr, MReg reg)
+{
+    return mir_reads_reg(instr, reg) || mir_writes_reg(instr, reg);
+}
+
+static void rename_operands(MInstr *instr, MReg from, MReg to, RenameLog *log)
+{
+    for (int i = 0; i < instr->nops; i++)
+    {
+        MOperand *op = &instr->ops[i];
+        int base = (op->kind == MOPND_REG || op->kind == MOPND_MEM) && op->reg == from;
+        int index = op->kind == MOPND_MEM && op->index == from;
+        if (!base && !index)
+            continue;
+        if (log->count == log->capacity)
+        {
+            log->capacity = log->capacity ? log->capacity * 2 : 16;
+            log->entries = realloc(log->entries, log->capacity * sizeof(RenameEntry));
+        }
+        log->entries[log->count++] = (RenameEntry){op, op->reg, op->index};
+        if (base)
+            op->reg = to;
+        if (index)
+            op->index = to;
+    }
+}
+
+static void undo_renaming(RenameLog *log)
+{
+    while (log->count > 0)
+    {
+        RenameEntry *entry = &log->entries[--log->count];
+        entry->op->reg = entry->reg;
+        entry->op->index = entry->index;
+    }
+    log->ranges = 0;
+}
+
+/*
+ * The live range starting at nodes[start], which overwrites reg without reading it, ends
+ * before the next such write. It can move to another register if no instruction accesses
+ * reg implicitly and the value is dead at the end of the range. Returns the index one past
+ * the range, or -1.
+ */
+static int live_range_end(MFunction *fn, const Run *run, int start, MReg reg)
+{
+    int last = start;
+    for (int j = start + 1; j < run->count; j++)
+    {
+        const MInstr *instr = run->nodes[j].instr;
+        if (!accesses_reg(instr, reg))
+            continue;
+        if (!mir_reads_reg(instr, reg))
+            return j;
+        if (!renamable_access(instr))
+            return -1;
+        last = j;
+    }
+    return mir_reg_dead_after(fn, run->nodes[last].instr, reg) ? last + 1 : -1;
+}
+
+/* Gives a spare register to each live range of a register the run has already used. */
+static void break_anti_dependences(MFunction *fn, Run *run, RenameLog *log)
+{
+    int used[MREG_COUNT] = {0};
+    int taken[MREG_COUNT] = {0};
+
+    for (int i = 0; i < run->count; i++)
+    {
+        MInstr *instr = run->nodes[i].instr;
+        for (int reg = MREG_RAX; reg <= MREG_XMM15; reg++)
+        {
+            if (!accesses_reg(instr, reg))
+                continue;
+            int seen = used[reg];
+            used[reg] = 1;
+            if (!seen || reg == MREG_RSP || reg == MREG_RBP || mir_reads_reg(instr, reg) ||
+                !renamable_access(instr))
+                continue;
+            int end = live_range_end(fn, run, i, reg);
+            if (end < 0)
+                continue;
+
+            MReg to = MREG_NONE;
+            for (int k = 0; k < SPARE_COUNT && to == MREG_NONE; k++)
+            {
+                MReg candidate = spare_order[k];
+                if (run->spare[candidate] && !taken[candidate] && is_xmm(candidate) == is_xmm(reg))
+                    to = candidate;
+            }
+            if (to == MREG_NONE)
+                continue;
+            taken[to] = 1;
+            for (int j = i; j < end; j++)
+                rename_operands(run->nodes[j].instr, reg, to, log);
+            log->ranges++;
+        }
+    }
+}
+
+static void find_spare_registers(MFunction *fn, Run *run)
+{
+    for (int k = 0; k < SPARE_COUNT; k++)
+        run->spare[spare_order[k]] = 1;
+    for (MInstr *instr = fn->head; instr; instr = instr->next)
+    {
+        for (int k = 0; k < SPARE_COUNT; k++)
+        {
+            if (accesses_reg(instr, spare_order[k]))
+                run->spare[spare_order[k]] = 0;
+        }
+    }
+}
+
+static void add_edge(Run *run, int from, int to, int latency)
+{
+    if (run->edge[from][to] < latency)
+        run->edge[from][to] = latency;
+}
+
+/* Orders every pair that shares a register, the flags or possibly a memory location. */
+static void build_dependences(Run *run)
+{
+    for (int j = 0; j < run->count; j++)
+    {
+        const MInstr *later = run->nodes[j].instr;
+        for (int i = 0; i < j; i++)
+        {
+            const Node *node = &run->nodes[i];
+            const MInstr *earlier = node->instr;
+            run->edge[i][j] = -1;
+
+            for (int reg = MREG_RAX; reg <= MREG_XMM15; reg++)
+            {
+                if (mir_writes_reg(earlier, reg) && mir_reads_reg(later, reg))
+                    add_edge(run, i, j, node->latency);
+                else if (mir_writes_reg(later, reg) && (mir_writes_reg(earlier, reg) || mir_reads_reg(earlier, reg)))
+                    add_edge(run, i, j, 0);
+            }
+            if (mir_writes_flags(earlier) && mir_reads_flags(later))
+                add_edge(run, i, j, node->latency);
+            else if (mir_writes_flags(later) && (mir_writes_flags(earlier) || mir_reads_flags(earlier)))
+                add_edge(run, i, j, 0);
+
+            const Node *other = &run->nodes[j];
+            if ((node->stores || other->stores) && (node->loads || node->stores) && (other->loads || other->stores) &&
+                may_alias(earlier, later))
+            {
+                /* A load of a just-stored value is forwarded from the store buffer. */
+                add_edge(run, i, j, node->stores && other->loads ? 1 : 0);
+            }
+        }
+    }
+}
+
+static void compute_priorities(Run *run)
+{
+    for (int i = run->count - 1; i >= 0; i--)
+    {
+        Node *node = &run->nodes[i];
+        node->priority = node->latency;
+        for (int j = i + 1; j < run->count; j++)
+        {
+            if (run->edge[i][j] >= 0 && run->edge[i][j] + run->nodes[j].priority > node->priority)
+                node->priority = run->edge[i][j] + run->nodes[j].priority;
+        }
+    }
+}
+
+/* Tracks the ports in use per cycle. */
+typedef struct
+{
+    const MachineModel *model;
+    int cycles;
+    int (*busy)[UNIT_COUNT];
+    int *issued;
+} Reservations;
+
+static void reservations_init(Reservations *table, const Run *run)
+{
+    int cycles = 1;
+    for (int i = 0; i < run->count; i++)
+        cycles += run->nodes[i].latency + run->model->cost[run->nodes[i].class].occupancy + 1;
+    table->model = run->model;
+    table->cycles = cycles;
+    table->busy = calloc(cycles, sizeof(*table->busy));
+    table->issued = calloc(cycles, sizeof(int));
+}
+
+static void reservations_free(Reservations *table)
+{
+    free(table->busy);
+    free(table->issued);
+}
+
+static int node_uses_unit(const Node *node, Unit unit)
+{
+    if (unit == UNIT_LOAD)
+        return node->loads;
+    if (unit == UNIT_STORE)
+        return node->stores;
+    return !is_memory_move(node) && class_unit[node->class] == unit;
+}
+
+static int can_issue(const Reservations *table, const Node *node, int cycle)
+{
+    if (table->issued[cycle] >= table->model->issue_width)
+        return 0;
+    for (Unit unit = UNIT_ALU; unit < UNIT_COUNT; unit++)
+    {
+        if (!node_uses_unit(node, unit))
+            continue;
+        int occupancy = unit == class_unit[node->class] ? table->model->cost[node->class].occupancy : 1;
+        for (int c = cycle; c < cycle + occupancy; c++)
+        {
+            if (table->busy[c][unit] >= table->model->ports[unit])
+                return 0;
+        }
+    }
+    return 1;
+}
+
+static void issue(Reservations *table, const Node *node, int cycle)
+{
+    table->issued[cycle]++;
+    for (Unit unit = UNIT_ALU; unit < UNIT_COUNT; unit++)
+    {
+        if (!node_uses_unit(node, unit))
+            continue;
+        int occupancy = unit == class_unit[node->class] ? table->model->cost[node->class].occupancy : 1;
+        for (int c = cycle; c < cycle + occupancy; c++)
+            table->busy[c][unit]++;
+    }
+}
+
+/* Cycles until every result of the run is available when issued in order. */
+static int simulate(const Run *run, const int *order)
+{
+    Reservations table;
+    reservations_init(&table, run);
+    int start[MAX_RUN_LENGTH];
+    int cycle = 0, finish = 0;
+
+    for (int k = 0; k < run->count; k++)
+    {
+        int i = order[k];
+        int ready = cycle;
+        for (int p = 0; p < k; p++)
+        {
+            int pred = order[p];
+            int latency = pred < i ? run->edge[pred][i] : -1;
+            if (latency >= 0 && start[pred] + latency > ready)
+                ready = start[pred] + latency;
+        }
+        while (!can_issue(&table, &run->nodes[i], ready))
+            ready++;
+        issue(&table, &run->nodes[i], ready);
+        start[i] = cycle = ready;
+        if (ready + run->nodes[i].latency > finish)
+            finish = ready + run->nodes[i].latency;
+    }
+    reservations_free(&table);
+    return finish;
+}
+
+/* Fills order with a list schedule: ready instructions by priority, then original position. */
+static void list_schedule(const Run *run, int *order)
+{
+    Reservations table;
+    reservations_init(&table, run);
+    int pending[MAX_RUN_LENGTH], earliest[MAX_RUN_LENGTH], done[MAX_RUN_LENGTH] = {0};
+    int scheduled = 0, cycle = 0;
+
+    for (int j = 0; j < run->count; j++)
+    {
+        pending[j] = earliest[j] = 0;
+        for (int i = 0; i < j; i++)
+            pending[j] += run->edge[i][j] >= 0;
+    }
+
+    while (scheduled < run->count)
+    {
+        int best = -1;
+        for (int i = 0; i < run->count; i++)
+        {
+            if (done[i] || pending[i] || earliest[i] > cycle || !can_issue(&table, &run->nodes[i], cycle))
+                continue;
+            if (best < 0 || run->nodes[i].priority > run->nodes[best].priority)
+                best = i;
+        }
+        if (best < 0)
+        {
+            cycle++;
+            continue;
+        }
+        issue(&table, &run->nodes[best], cycle);
+        done[best] = 1;
+        order[scheduled++] = best;
+        for (int j = best + 1; j < run->count; j++)
+        {
+            if (run->edge[best][j] < 0)
+                continue;
+            pending[j]--;
+            if (cycle + run->edge[best][j] > earliest[j])
+                earliest[j] = cycle + run->edge[best][j];
+        }
+    }
+    reservations_free(&table);
+}
+
+/* Schedules the run and relinks it before next; returns 1 if the order changed. */
+static int schedule_run(MFunction *fn, Run *run, MInstr *next)
+{
+    if (run->count < 2)
+        return 0;
+
+    RenameLog log = {0};
+    break_anti_dependences(fn, run, &log);
+    build_dependences(run);
+    compute_priorities(run);
+
+    int original[MAX_RUN_LENGTH], order[MAX_RUN_LENGTH];
+    for (int i = 0; i < run->count; i++)
+        original[i] = i;
+    list_schedule(run, order);
+
+    int before = simulate(run, original);
+    int after = simulate(run, order);
+    if (after >= before)
+    {
+        undo_renaming(&log);
+        free(log.entries);
+        return 0;
+    }
+
+    remark(REMARK_PASSED, "schedule", "Scheduled", run->nodes[0].instr->line,
+           "%d instructions reordered for %s, %d live range%s renamed: %d cycles instead of %d", run->count,
+           run->model->name, log.ranges, log.ranges == 1 ? "" : "s", after, before);
+    free(log.entries);
+    for (int i = 0; i < run->count; i++)
+        mir_unlink(fn, run->nodes[i].instr);
+    for (int k = 0; k < run->count; k++)
+        mir_insert_before(fn, next, run->nodes[order[k]].instr);
+    return 1;
+}
+
+static void add_node(Run *run, MInstr *instr)
+{
+    Node *node = &run->nodes[run->count++];
+    int writes = 0;
+    int accesses = mir_accesses_memory(instr, &writes);
+
+    node->instr = instr;
+    node->class = classify(instr);
+    node->stores = writes;
+    node->loads = accesses && !(writes && is_pure_store(instr));
+    node->latency = run->model->cost[node->class].latency + (node->loads ? run->model->load_latency : 0);
+}
+
+int run_schedule(MFunction *fn, PassContext *ctx)
+{
+    Run *run = calloc(1, sizeof(Run));
+    run->model = &machine_models[ctx->tune];
+    int changes = 0;
+    find_spare_registers(fn, run);
+
+    MInstr *instr = fn->head;
+    while (instr)
+    {
+        MInstr *next = instr->next;
+        if (!is_barrier(instr))
+            add_node(run, instr);
+        if (is_barrier(instr) || run->count == MAX_RUN_LENGTH || !next)
+        {
+            changes += schedule_run(fn, run, is_barrier(instr) ? instr : next);
+            run->count = 0;
+        }
+        instr = next;
+    }
+    free(run);
+    return changes;
+}
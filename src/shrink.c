@@ -0,0 +1,247 @@
+/**
+ * @file shrink.c
+ * @brief Encoding-size reduction on the machine IR of the SEG compiler.
+ *        Runs after the rewriting passes, before the scheduler, and turns instructions into
+ *        shorter equivalent encodings: zeroing moves become xor (when the flags are dead), comparisons with zero become
+ *        test, and 64-bit moves, zero-extensions and logic operations drop their REX.W
+ *        prefix when the upper 32 bits of the result are known to be zero, since a write to
+ *        a 32-bit register clears them. The known bits come from a forward scan that starts
+ *        over at every label and call. A comparison with zero right after the arithmetic
+ *        that computed the register is dropped when only the zero and sign flags are read,
+ *        which the arithmetic sets the same way. The assembler already picks imm8 over
+ *        imm32 forms.
+ * @author Dario Romandini
+ */
+
+#include "optimize.h"
+#include "remarks.h"
+
+typedef struct
+{
+    int upper_zero[MREG_COUNT]; ///< Bits 32-63 of the register are known to be zero
+} ShrinkState;
+
+static int fits_uint32(long long value)
+{
+    return value >= 0 && value <= 0xFFFFFFFFLL;
+}
+
+/* Bits 32-63 of an operand, extended to 64 bits as the instruction would, are zero. */
+static int operand_upper_zero(const ShrinkState *state, const MOperand *op)
+{
+    if (op->kind == MOPND_IMM)
+        return op->imm >= 0 && op->imm <= 0x7FFFFFFFLL;
+    if (mir_is_gpr64(op))
+        return state->upper_zero[op->reg];
+    return 0;
+}
+
+/* Whether the upper bits of reg are zero after instr, given that instr writes reg. */
+static int upper_zero_after(const ShrinkState *state, const MInstr *instr, MReg reg)
+{
+    const MOperand *dest = &instr->ops[0];
+    if (instr->nops == 0 || dest->kind != MOPND_REG || dest->reg != reg)
+        return 0;
+    if (dest->size == 4)
+        return 1;
+    if (dest->size < 4)
+        return instr->op != MI_MOVZX && state->upper_zero[reg];
+
+    const MOperand *src = &instr->ops[1];
+    switch (instr->op)
+    {
+    case MI_MOV:
+        return src->kind == MOPND_IMM ? fits_uint32(src->imm) : operand_upper_zero(state, src);
+    case MI_MOVZX:
+        return 1;
+    case MI_AND:
+        return state->upper_zero[reg] || operand_upper_zero(state, src);
+    case MI_OR:
+        return state->upper_zero[reg] && operand_upper_zero(state, src);
+    case MI_XOR:
+        return mir_operand_equal(dest, src) || (state->upper_zero[reg] && operand_upper_zero(state, src));
+    case MI_SHR:
+        return src->kind == MOPND_IMM && src->imm >= 32;
+    default:
+        return 0;
+    }
+}
+
+static void track(ShrinkState *state, const MInstr *instr)
+{
+    if (instr->op == MI_LABEL || instr->op == MI_CALL)
+    {
+        for (int reg = 0; reg < MREG_COUNT; reg++)
+            state->upper_zero[reg] = 0;
+        return;
+    }
+
+    int after[MREG_COUNT];
+    for (int reg = MREG_RAX; reg <= MREG_R15; reg++)
+        after[reg] = mir_writes_reg(instr, reg) ? upper_zero_after(state, instr, reg) : state->upper_zero[reg];
+    for (int reg = MREG_RAX; reg <= MREG_R15; reg++)
+        state->upper_zero[reg] = after[reg];
+}
+
+static int shrink_instruction(MFunction *fn, ShrinkState *state, MInstr *instr)
+{
+    MOperand *dest = &instr->ops[0];
+    MOperand *src = &instr->ops[1];
+
+    if (instr->nops != 2 || !mir_is_gpr64(dest))
+        return 0;
+
+    switch (instr->op)
+    {
+    case MI_MOV:
+        if (src->kind != MOPND_IMM)
+            return 0;
+        if (src->imm == 0 && mir_reg_dead_after(fn, instr, MREG_NONE))
+        {
+            remark(REMARK_PASSED, "shrink", "ZeroIdiom", instr->line, "mov %s, 0 replaced by xor",
+                   mreg_name(dest->reg, 8));
+            instr->op = MI_XOR;
+            *dest = mop_reg_sized(dest->reg, 4);
+            *src = *dest;
+            return 1;
+        }
+        if (src->imm > 0 && fits_uint32(src->imm))
+        {
+            *dest = mop_reg_sized(dest->reg, 4);
+            return 1;
+        }
+        return 0;
+    case MI_MOVZX:
+        if (src->kind != MOPND_REG || src->size != 1)
+            return 0;
+        *dest = mop_reg_sized(dest->reg, 4);
+        return 1;
+    case MI_CMP:
+        if (src->kind != MOPND_IMM || src->imm != 0)
+            return 0;
+        instr->op = MI_TEST;
+        *src = *dest;
+        return 1;
+    case MI_AND:
+    case MI_OR:
+    case MI_XOR:
+        if (instr->op == MI_XOR && mir_operand_equal(dest, src))
+        {
+            /* The zero idiom sets the same flags at either width. */
+            *dest = mop_reg_sized(dest->reg, 4);
+            *src = *dest;
+            return 1;
+        }
+        if (src->kind == MOPND_MEM || !operand_upper_zero(state, src))
+            return 0;
+        if (instr->op != MI_AND && !state->upper_zero[dest->reg])
+            return 0;
+        if (!mir_reg_dead_after(fn, instr, MREG_NONE))
+            return 0;
+        *dest = mop_reg_sized(dest->reg, 4);
+        if (src->kind == MOPND_REG)
+            *src = mop_reg_sized(src->reg, 4);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int is_zero_sign_condition(MCond cond)
+{
+    return cond == MCOND_E || cond == MCOND_NE || cond == MCOND_S || cond == MCOND_NS;
+}
+
+/* test reg, reg or cmp reg, 0, which set the zero and sign flags from reg. */
+static int tests_register(const MInstr *instr)
+{
+    const MOperand *dest = &instr->ops[0], *src = &instr->ops[1];
+    if (instr->nops != 2 || !mir_is_gpr64(dest))
+        return 0;
+    if (instr->op == MI_TEST)
+        return mir_operand_equal(dest, src);
+    return instr->op == MI_CMP && src->kind == MOPND_IMM && src->imm == 0;
+}
+
+/* Arithmetic whose zero and sign flags describe the register it writes. */
+static int sets_result_flags(const MInstr *instr, MReg reg)
+{
+    switch (instr->op)
+    {
+    case MI_ADD:
+    case MI_SUB:
+    case MI_AND:
+    case MI_OR:
+    case MI_XOR:
+    case MI_INC:
+    case MI_DEC:
+    case MI_NEG:
+        return mir_is_gpr64(&instr->ops[0]) && instr->ops[0].reg == reg;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * The flags a comparison with zero sets are only read for the zero and sign flags: up to the
+ * next instruction that writes the flags, or through the first branch, past which they must
+ * be dead. Carry and overflow differ between the comparison and the arithmetic.
+ */
+static int reads_zero_sign_only(MFunction *fn, MInstr *test)
+{
+    for (MInstr *instr = test->next; instr; instr = instr->next)
+    {
+        if (mir_reads_flags(instr) && !is_zero_sign_condition(instr->cond))
+            return 0;
+        if (mir_writes_flags(instr) || instr->op == MI_RET || instr->op == MI_CALL)
+            return 1;
+        if (instr->op == MI_JCC)
+            return mir_reg_dead_after(fn, instr, MREG_NONE);
+        if (instr->op == MI_JMP)
+            return 0;
+    }
+    return 1;
+}
+
+/* Whether a comparison of a register with zero repeats the flags of the arithmetic that computed it. */
+static int is_redundant_test(MFunction *fn, MInstr *test)
+{
+    if (!tests_register(test))
+        return 0;
+    MReg reg = test->ops[0].reg;
+    for (MInstr *prev = test->prev; prev; prev = prev->prev)
+    {
+        if (prev->op == MI_LABEL || prev->op == MI_CALL || mir_is_terminator(prev))
+            return 0;
+        if (mir_writes_flags(prev))
+            return sets_result_flags(prev, reg) && reads_zero_sign_only(fn, test);
+        if (mir_writes_reg(prev, reg))
+            return 0;
+    }
+    return 0;
+}
+
+int run_shrink(MFunction *fn, PassContext *ctx)
+{
+    (void)ctx;
+    ShrinkState state = {{0}};
+    int changes = 0;
+    MInstr *next;
+
+    for (MInstr *instr = fn->head; instr; instr = next)
+    {
+        next = instr->next;
+        if (is_redundant_test(fn, instr))
+        {
+            remark(REMARK_PASSED, "shrink", "TestRemoved", instr->line,
+                   "comparison of %s with zero removed: the arithmetic before it set the flags",
+                   mreg_name(instr->ops[0].reg, 8));
+            mir_remove(fn, instr);
+            changes++;
+            continue;
+        }
+        changes += shrink_instruction(fn, &state, instr);
+        track(&state, instr);
+    }
+    return changes;
+}
@@ -0,0 +1,290 @@
+/**
+ * @file simplify.c
+ * @brief Algebraic simplification of expressions for the SEG language compiler.
+ *        The rewrite rules (identities, boolean normalization, comparison
+ *        canonicalization and reassociation of integer constants) live in the
+ *        declarative table src/simplify.rules; tools/rulegen.c turns the table into the
+ *        matchers and builders included below. This file provides the primitives the
+ *        generated code calls and applies the rules bottom-up until no rule matches.
+ * @author Dario Romandini
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+#include "token.h"
+
+#define SIMPLIFY_MAX_REWRITES 16
+
+/* Matching primitives */
+
+static int rule_root_operator(ASTNode *node)
+{
+    if (node->type == AST_BINARY_EXPR)
+        return node->binary_expr.op;
+    if (node->type == AST_UNARY_EXPR)
+        return node->unary_expr.op;
+    return -1;
+}
+
+static int rule_binary_op(ASTNode *node, TokenType op)
+{
+    return node->type == AST_BINARY_EXPR && node->binary_expr.op == op;
+}
+
+static int rule_unary_op(ASTNode *node, TokenType op)
+{
+    return node->type == AST_UNARY_EXPR && node->unary_expr.op == op;
+}
+
+static int rule_int_literal(ASTNode *node, long long *value)
+{
+    if (node->type != AST_LITERAL || node->result_type != TYPE_INT)
+        return 0;
+    *value = strtoll(node->literal.value, NULL, 10);
+    return 1;
+}
+
+static int rule_int_value(ASTNode *node, long long value)
+{
+    long long actual;
+    return rule_int_literal(node, &actual) && actual == value;
+}
+
+static int rule_bool_value(ASTNode *node, long long value)
+{
+    if (node->type != AST_LITERAL || node->result_type != TYPE_BOOL)
+        return 0;
+    return (strcmp(node->literal.value, "true") == 0) == value;
+}
+
+static int rule_same(ASTNode *a, ASTNode *b)
+{
+    if (a->type != b->type)
+        return 0;
+    switch (a->type)
+    {
+    case AST_LITERAL:
+        return a->result_type == b->result_type && strcmp(a->literal.value, b->literal.value) == 0;
+    case AST_IDENTIFIER:
+        return strcmp(a->identifier.name, b->identifier.name) == 0;
+    case AST_BINARY_EXPR:
+        return a->binary_expr.op == b->binary_expr.op && rule_same(a->binary_expr.left, b->binary_expr.left) &&
+               rule_same(a->binary_expr.right, b->binary_expr.right);
+    case AST_UNARY_EXPR:
+        return a->unary_expr.op == b->unary_expr.op && rule_same(a->unary_expr.operand, b->unary_expr.operand);
+    case AST_INDEX:
+        /* Expressions have no side effects, so an element reads the same value throughout one. */
+        return strcmp(a->index.name, b->index.name) == 0 && rule_same(a->index.index, b->index.index);
+    default:
+        return 0;
+    }
+}
+
+/* Expressions that always evaluate to 0 or 1. */
+static int rule_guard_int(ASTNode *node)
+{
+    return node->result_type == TYPE_INT && !is_boolean_value(node, NULL);
+}
+
+static int rule_guard_bool(ASTNode *node)
+{
+    return is_boolean_value(node, NULL);
+}
+
+/* Division by anything but a literal other than 0 and -1 may fault at run time. */
+static int rule_guard_pure(ASTNode *node)
+{
+    long long divisor;
+    switch (node->type)
+    {
+    case AST_BINARY_EXPR:
+        if ((node->binary_expr.op == TOKEN_SLASH || node->binary_expr.op == TOKEN_PERCENT) &&
+            (!rule_int_literal(node->binary_expr.right, &divisor) || divisor == 0 || divisor == -1))
+            return 0;
+        return rule_guard_pure(node->binary_expr.left) && rule_guard_pure(node->binary_expr.right);
+    case AST_UNARY_EXPR:
+        return rule_guard_pure(node->unary_expr.operand);
+    case AST_INDEX:
+        return rule_guard_pure(node->index.index);
+    default:
+        return 1;
+    }
+}
+
+static int rule_guard_nonconst(ASTNode *node)
+{
+    return node->type != AST_LITERAL;
+}
+
+/* Building primitives; new nodes take the source position of the rewritten node */
+
+static ASTNode *rule_clone(ASTNode *node)
+{
+    ASTNode *copy;
+    switch (node->type)
+    {
+    case AST_LITERAL:
+        copy = create_literal_node(node->literal.value, node->result_type);
+        break;
+    case AST_IDENTIFIER:
+        copy = create_identifier_node(node->identifier.name);
+        break;
+    case AST_BINARY_EXPR:
+        copy = create_binary_expr_node(node->binary_expr.op, rule_clone(node->binary_expr.left),
+                                       rule_clone(node->binary_expr.right));
+        break;
+    case AST_UNARY_EXPR:
+        copy = create_unary_expr_node(node->unary_expr.op, rule_clone(node->unary_expr.operand));
+        break;
+    case AST_INDEX:
+        copy = create_index_node(node->index.name, rule_clone(node->index.index));
+        break;
+    default:
+        fprintf(stderr, "[Simplify Error] Unexpected node in expression: %d\n", node->type);
+        exit(1);
+    }
+    copy->result_type = node->result_type;
+    return set_node_location(copy, node->line, node->column);
+}
+
+static ASTNode *literal_of_type(long long value, VarType type, ASTNode *origin)
+{
+    char buffer[32];
+    if (type == TYPE_BOOL)
+        snprintf(buffer, sizeof(buffer), "%s", value ? "true" : "false");
+    else
+        snprintf(buffer, sizeof(buffer), "%lld", value);
+    return set_node_location(create_literal_node(buffer, type), origin->line, origin->column);
+}
+
+/* A constant replacing origin: boolean when origin is boolean-valued and the value is 0 or 1. */
+static ASTNode *rule_constant(long long value, ASTNode *origin)
+{
+    int boolean = (is_boolean_value(origin, NULL) || origin->result_type == TYPE_BOOL) && (value == 0 || value == 1);
+    return literal_of_type(value, boolean ? TYPE_BOOL : TYPE_INT, origin);
+}
+
+static ASTNode *rule_integer(long long value, ASTNode *origin)
+{
+    return literal_of_type(value, TYPE_INT, origin);
+}
+
+static ASTNode *rule_boolean(long long value, ASTNode *origin)
+{
+    return literal_of_type(value, TYPE_BOOL, origin);
+}
+
+static ASTNode *rule_binary(TokenType op, ASTNode *left, ASTNode *right, ASTNode *origin)
+{
+    ASTNode *node = create_binary_expr_node(op, left, right);
+    set_node_location(node, origin->line, origin->column);
+    node->result_type = is_boolean_value(node, NULL) ? TYPE_BOOL : TYPE_INT;
+    return node;
+}
+
+static ASTNode *rule_not(ASTNode *operand, ASTNode *origin)
+{
+    ASTNode *node = create_unary_expr_node(TOKEN_NOT, operand);
+    set_node_location(node, origin->line, origin->column);
+    node->result_type = TYPE_BOOL;
+    return node;
+}
+
+static long long rule_wrap_add(long long a, long long b)
+{
+    return (long long)((unsigned long long)a + (unsigned long long)b);
+}
+
+static long long rule_wrap_sub(long long a, long long b)
+{
+    return (long long)((unsigned long long)a - (unsigned long long)b);
+}
+
+static long long rule_wrap_mul(long long a, long long b)
+{
+    return (long long)((unsigned long long)a * (unsigned long long)b);
+}
+
+#include "simplify_rules.inc"
+
+static int simplify_expression(ASTNode **link)
+{
+    ASTNode *node = *link;
+    int changes = 0;
+
+    if (!node)
+        return 0;
+    if (node->type == AST_BINARY_EXPR)
+    {
+        changes += simplify_expression(&node->binary_expr.left);
+        changes += simplify_expression(&node->binary_expr.right);
+    }
+    else if (node->type == AST_UNARY_EXPR)
+    {
+        changes += simplify_expression(&node->unary_expr.operand);
+    }
+    else if (node->type == AST_INDEX)
+    {
+        changes += simplify_expression(&node->index.index);
+    }
+
+    for (int i = 0; i < SIMPLIFY_MAX_REWRITES; i++)
+    {
+        RuleBindings bindings;
+        int rule = match_rules(node, &bindings);
+        if (rule < 0)
+            break;
+
+        ASTNode *replacement = build_rule(rule, node, &bindings);
+        remark(REMARK_PASSED, "simplify", rule_names[rule], node->line, "%s", rule_texts[rule]);
+        free_ast(node);
+        *link = node = replacement;
+        changes++;
+    }
+    return changes;
+}
+
+static int simplify_statements(ASTNode *node)
+{
+    int changes = 0;
+    for (; node; node = node->next)
+    {
+        if (node->type == AST_VAR_DECL)
+        {
+            changes += simplify_expression(&node->var_decl.value);
+        }
+        else if (node->type == AST_IF_STATEMENT)
+        {
+            changes += simplify_expression(&node->if_statement.condition);
+            changes += simplify_statements(node->if_statement.then_branch);
+            changes += simplify_statements(node->if_statement.else_branch);
+        }
+        else if (node->type == AST_LOOP)
+        {
+            changes += simplify_statements(node->loop.init);
+            changes += simplify_expression(&node->loop.condition);
+            changes += simplify_statements(node->loop.update);
+            changes += simplify_statements(node->loop.body);
+        }
+        else if (node->type == AST_ARRAY_DECL)
+        {
+            for (int i = 0; i < node->array_decl.value_count; i++)
+                changes += simplify_expression(&node->array_decl.values[i]);
+        }
+        else if (node->type == AST_ELEMENT_ASSIGN)
+        {
+            changes += simplify_expression(&node->element_assign.index);
+            changes += simplify_expression(&node->element_assign.value);
+        }
+    }
+    return changes;
+}
+
+int run_simplify(ASTNode **program, PassContext *ctx)
+{
+    (void)ctx;
+    return simplify_statements(*program);
+}
@@ -0,0 +1,532 @@
+/**
+ * @file strength.c
+ * @brief Strength reduction on the machine IR of the SEG compiler.
+ *        Tracks registers (and pushed stack slots) holding known constants, and rewrites
+ *        imul and cqo/idiv whose right operand is one: multiplies become lea/shift/add
+ *        sequences, divides and remainders by powers of two become shifts with a sign
+ *        fix-up, and divides by other constants become a multiply by a "magic" reciprocal
+ *        taking the high half of the product. Operations on two constants are folded.
+ * @author Dario Romandini
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+
+#define STRENGTH_MAX_STACK 64
+#define MAX_MULTIPLY_SEQUENCE 3
+
+typedef struct
+{
+    int known[MREG_COUNT];
+    long long value[MREG_COUNT];
+    int stack_known[STRENGTH_MAX_STACK];
+    long long stack_value[STRENGTH_MAX_STACK];
+    int stack_depth;
+} ConstState;
+
+static void forget_all(ConstState *state)
+{
+    memset(state, 0, sizeof(*state));
+}
+
+static int is_reg64(const MOperand *op, MReg reg)
+{
+    return op->kind == MOPND_REG && op->reg == reg && op->size == 8;
+}
+
+/* Known constant value of an operand. */
+static int operand_constant(const ConstState *state, const MOperand *op, long long *value)
+{
+    if (op->kind == MOPND_IMM)
+    {
+        *value = op->imm;
+        return 1;
+    }
+    if (mir_is_gpr64(op) && state->known[op->reg])
+    {
+        *value = state->value[op->reg];
+        return 1;
+    }
+    return 0;
+}
+
+static void track(ConstState *state, const MInstr *instr)
+{
+    long long value = 0;
+
+    switch (instr->op)
+    {
+    case MI_LABEL:
+    case MI_DIRECTIVE:
+        return;
+    case MI_MOV:
+        if (mir_is_gpr64(&instr->ops[0]))
+        {
+            MReg dest = instr->ops[0].reg;
+            state->known[dest] = operand_constant(state, &instr->ops[1], &value);
+            state->value[dest] = value;
+            return;
+        }
+        break;
+    case MI_XOR:
+        if (mir_is_gpr64(&instr->ops[0]) && mir_operand_equal(&instr->ops[0], &instr->ops[1]))
+        {
+            state->known[instr->ops[0].reg] = 1;
+            state->value[instr->ops[0].reg] = 0;
+            return;
+        }
+        break;
+    case MI_PUSH:
+        if (state->stack_depth == STRENGTH_MAX_STACK)
+        {
+            state->stack_depth = 0;
+            return;
+        }
+        state->stack_known[state->stack_depth] = operand_constant(state, &instr->ops[0], &value);
+        state->stack_value[state->stack_depth++] = value;
+        return;
+    case MI_POP:
+        if (mir_is_gpr64(&instr->ops[0]) && state->stack_depth > 0)
+        {
+            state->stack_depth--;
+            state->known[instr->ops[0].reg] = state->stack_known[state->stack_depth];
+            state->value[instr->ops[0].reg] = state->stack_value[state->stack_depth];
+            return;
+        }
+        break;
+    case MI_CALL:
+    case MI_JMP:
+    case MI_RET:
+        forget_all(state);
+        return;
+    default:
+        break;
+    }
+
+    for (MReg reg = MREG_RAX; reg <= MREG_R15; reg++)
+    {
+        if (mir_writes_reg(instr, reg))
+            state->known[reg] = 0;
+    }
+    int writes = 0;
+    if (mir_writes_reg(instr, MREG_RSP) || (mir_accesses_memory(instr, &writes) && writes))
+        state->stack_depth = 0;
+}
+
+/* Inserts a newly emitted instruction before another one, stamped with its location. */
+static MInstr *insert_before(MFunction *fn, MInstr *at, MInstr *instr)
+{
+    mir_unlink(fn, instr);
+    instr->line = at->line;
+    instr->column = at->column;
+    mir_insert_before(fn, at, instr);
+    return instr;
+}
+
+static int log2_exact(unsigned long long value)
+{
+    if (value == 0 || (value & (value - 1)) != 0)
+        return -1;
+    int shift = 0;
+    while (value > 1)
+    {
+        value >>= 1;
+        shift++;
+    }
+    return shift;
+}
+
+static MOperand scaled_rax(int scale)
+{
+    MOperand op = mop_mem(MREG_RAX, 0, 8);
+    op.index = MREG_RAX;
+    op.scale = scale;
+    return op;
+}
+
+/*
+ * Emits rax *= factor before at, using temp (which must hold a copy of rax when
+ * temp_holds_rax is set, or be free otherwise; MREG_NONE if no register is free).
+ * With emit unset only counts the instructions. Returns -1 if no short sequence exists.
+ */
+static int emit_multiply(MFunction *fn, MInstr *at, long long factor, MReg temp, int temp_holds_rax, int emit)
+{
+    if (factor == (long long)(1ULL << 63))
+        return -1;
+
+    unsigned long long magnitude = factor < 0 ? 0 - (unsigned long long)factor : (unsigned long long)factor;
+    int count = 0;
+    int shift = log2_exact(magnitude);
+    int odd_shift = 0;
+    unsigned long long odd = magnitude;
+    while (odd && (odd & 1) == 0)
+    {
+        odd >>= 1;
+        odd_shift++;
+    }
+
+    if (magnitude == 0)
+    {
+        if (emit)
+            insert_before(fn, at, mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_imm(0)));
+        return 1;
+    }
+    if (shift >= 0)
+    {
+        if (shift > 0 && emit)
+            insert_before(fn, at, mir_emit(fn, MI_SHL, 2, mop_reg(MREG_RAX), mop_imm(shift)));
+        count = shift > 0;
+    }
+    else if (odd == 3 || odd == 5 || odd == 9)
+    {
+        /* lea rax, [rax + rax*2|4|8], then shift out the power of two. */
+        if (emit)
+        {
+            insert_before(fn, at, mir_emit(fn, MI_LEA, 2, mop_reg(MREG_RAX), scaled_rax((int)odd - 1)));
+            if (odd_shift > 0)
+                insert_before(fn, at, mir_emit(fn, MI_SHL, 2, mop_reg(MREG_RAX), mop_imm(odd_shift)));
+        }
+        count = 1 + (odd_shift > 0);
+    }
+    else if (log2_exact(magnitude - 1) > 0 || log2_exact(magnitude + 1) > 0)
+    {
+        /* 2^k + 1 and 2^k - 1: shift and add or subtract the original value. */
+        int plus = log2_exact(magnitude - 1) > 0;
+        int k = plus ? log2_exact(magnitude - 1) : log2_exact(magnitude + 1);
+        if (temp == MREG_NONE || k >= 63)
+            return -1;
+        if (emit)
+        {
+            if (!temp_holds_rax)
+                insert_before(fn, at, mir_emit(fn, MI_MOV, 2, mop_reg(temp), mop_reg(MREG_RAX)));
+            insert_before(fn, at, mir_emit(fn, MI_SHL, 2, mop_reg(MREG_RAX), mop_imm(k)));
+            insert_before(fn, at, mir_emit(fn, plus ? MI_ADD : MI_SUB, 2, mop_reg(MREG_RAX), mop_reg(temp)));
+        }
+        count = 2 + !temp_holds_rax;
+    }
+    else
+        return -1;
+
+    if (factor < 0)
+    {
+        if (emit)
+            insert_before(fn, at, mir_emit(fn, MI_NEG, 1, mop_reg(MREG_RAX)));
+        count++;
+    }
+    return count;
+}
+
+static MReg find_scratch(MFunction *fn, MInstr *after);
+
+/* imul rax, rax, imm: the factor is the immediate, and any free register is the temporary. */
+static int reduce_multiply_immediate(MFunction *fn, PassContext *ctx, ConstState *state, MInstr *mul)
+{
+    long long factor = mul->ops[2].imm;
+    if (state->known[MREG_RAX])
+    {
+        long long product = (long long)((unsigned long long)state->value[MREG_RAX] * (unsigned long long)factor);
+        remark(REMARK_PASSED, "strength", "MultiplyFolded", mul->line, "multiply of constants folded to %lld", product);
+        insert_before(fn, mul, mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_imm(product)));
+        mir_remove(fn, mul);
+        return 1;
+    }
+
+    MReg temp = find_scratch(fn, mul);
+    int limit = ctx->level == OPT_OS ? 1 : MAX_MULTIPLY_SEQUENCE;
+    int count = emit_multiply(fn, mul, factor, temp, 0, 0);
+    if (count < 0 || count > limit)
+    {
+        remark(REMARK_MISSED, "strength", "MultiplyNotReduced", mul->line,
+               "imul by %lld kept: no sequence of at most %d instructions", factor, limit);
+        return 0;
+    }
+
+    emit_multiply(fn, mul, factor, temp, 0, 1);
+    remark(REMARK_PASSED, "strength", "MultiplyReduced", mul->line,
+           "imul by %lld replaced by %d shift/lea/add instructions", factor, count);
+    mir_remove(fn, mul);
+    return 1;
+}
+
+/*
+ * imul rax, rbx with rbx (or rax) a known constant, or imul rax, rax, imm.
+ */
+static int reduce_multiply(MFunction *fn, PassContext *ctx, ConstState *state, MInstr *mul)
+{
+    if (mul->op == MI_IMUL && mul->nops == 3 && is_reg64(&mul->ops[0], MREG_RAX) &&
+        is_reg64(&mul->ops[1], MREG_RAX) && mul->ops[2].kind == MOPND_IMM)
+    {
+        if (!mir_reg_dead_after(fn, mul, MREG_NONE))
+            return 0;
+        return reduce_multiply_immediate(fn, ctx, state, mul);
+    }
+    if (mul->op != MI_IMUL || mul->nops != 2 || !is_reg64(&mul->ops[0], MREG_RAX) || !mir_is_gpr64(&mul->ops[1]))
+        return 0;
+    if (!mir_reg_dead_after(fn, mul, MREG_NONE))
+        return 0;
+
+    MReg other = mul->ops[1].reg;
+    long long left = 0, right = 0;
+    int left_known = state->known[MREG_RAX], right_known = state->known[other];
+    left = state->value[MREG_RAX];
+    right = state->value[other];
+    if (!left_known && !right_known)
+        return 0;
+
+    if (left_known && right_known)
+    {
+        long long product = (long long)((unsigned long long)left * (unsigned long long)right);
+        remark(REMARK_PASSED, "strength", "MultiplyFolded", mul->line, "multiply of constants folded to %lld", product);
+        insert_before(fn, mul, mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_imm(product)));
+        mir_remove(fn, mul);
+        return 1;
+    }
+
+    /*
+     * The variable operand is multiplied in rax. When it came from the other register,
+     * that register keeps a copy to add or subtract; otherwise it may be used as a
+     * temporary if its constant is not needed afterwards.
+     */
+    long long factor = right_known ? right : left;
+    int temp_holds_rax = !right_known;
+    MReg temp = temp_holds_rax || mir_reg_dead_after(fn, mul, other) ? other : MREG_NONE;
+    int limit = ctx->level == OPT_OS ? 1 : MAX_MULTIPLY_SEQUENCE;
+    int count = emit_multiply(fn, mul, factor, temp, temp_holds_rax, 0);
+    if (count >= 0)
+        count += !right_known;
+    if (count < 0 || count > limit)
+    {
+        remark(REMARK_MISSED, "strength", "MultiplyNotReduced", mul->line,
+               "imul by %lld kept: no sequence of at most %d instructions", factor, limit);
+        return 0;
+    }
+
+    if (!right_known)
+        insert_before(fn, mul, mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_reg(other)));
+    emit_multiply(fn, mul, factor, temp, temp_holds_rax, 1);
+    remark(REMARK_PASSED, "strength", "MultiplyReduced", mul->line,
+           "imul by %lld replaced by %d shift/lea/add instructions", factor, count);
+    mir_remove(fn, mul);
+    return 1;
+}
+
+/*
+ * Signed magic number for division by d >= 2 (Hacker's Delight, 10-1):
+ * x / d == (mulhi(x, magic) [+ x]) >> shift, plus one when the result is negative.
+ */
+static void signed_magic(unsigned long long d, long long *magic, int *shift)
+{
+    const unsigned long long two63 = 1ULL << 63;
+    unsigned long long anc = two63 - 1 - two63 % d;
+    unsigned long long q1 = two63 / anc, r1 = two63 - q1 * anc;
+    unsigned long long q2 = two63 / d, r2 = two63 - q2 * d;
+    unsigned long long delta;
+    int p = 63;
+
+    do
+    {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc)
+        {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= d)
+        {
+            q2++;
+            r2 -= d;
+        }
+        delta = d - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    *magic = (long long)(q2 + 1);
+    *shift = p - 64;
+}
+
+/* A register other than rax, rdx and rsp that is dead after an instruction. */
+static MReg find_scratch(MFunction *fn, MInstr *after)
+{
+    static const MReg candidates[] = {MREG_RBX, MREG_RCX, MREG_RSI, MREG_RDI,
+                                      MREG_R8, MREG_R9, MREG_R10, MREG_R11};
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++)
+    {
+        if (mir_reg_dead_after(fn, after, candidates[i]))
+            return candidates[i];
+    }
+    return MREG_NONE;
+}
+
+#define EMIT(op, ...) insert_before(fn, at, mir_emit(fn, op, __VA_ARGS__))
+
+/* rax = rax / 2^k (rounding toward zero), or rax % 2^k; clobbers rdx. */
+static void emit_power_of_two(MFunction *fn, MInstr *at, int k, int remainder)
+{
+    /* rdx = 2^k - 1 for negative dividends, 0 otherwise. */
+    EMIT(MI_MOV, 2, mop_reg(MREG_RDX), mop_reg(MREG_RAX));
+    if (k > 1)
+        EMIT(MI_SAR, 2, mop_reg(MREG_RDX), mop_imm(63));
+    EMIT(MI_SHR, 2, mop_reg(MREG_RDX), mop_imm(64 - k));
+    if (remainder)
+    {
+        EMIT(MI_ADD, 2, mop_reg(MREG_RDX), mop_reg(MREG_RAX));
+        EMIT(MI_AND, 2, mop_reg(MREG_RDX), mop_imm(-(1LL << k)));
+        EMIT(MI_SUB, 2, mop_reg(MREG_RAX), mop_reg(MREG_RDX));
+    }
+    else
+    {
+        EMIT(MI_ADD, 2, mop_reg(MREG_RAX), mop_reg(MREG_RDX));
+        EMIT(MI_SAR, 2, mop_reg(MREG_RAX), mop_imm(k));
+    }
+}
+
+/* rax = rax / d (d >= 3, not a power of two), or rax % d; clobbers rdx and scratch. */
+static void emit_magic(MFunction *fn, MInstr *at, unsigned long long d, MReg scratch, int remainder)
+{
+    long long magic;
+    int shift;
+    signed_magic(d, &magic, &shift);
+
+    EMIT(MI_MOV, 2, mop_reg(scratch), mop_reg(MREG_RAX));
+    EMIT(MI_MOV, 2, mop_reg(MREG_RAX), mop_imm(magic));
+    EMIT(MI_IMUL, 1, mop_reg(scratch));
+    if (magic < 0)
+        EMIT(MI_ADD, 2, mop_reg(MREG_RDX), mop_reg(scratch));
+    if (shift > 0)
+        EMIT(MI_SAR, 2, mop_reg(MREG_RDX), mop_imm(shift));
+    EMIT(MI_MOV, 2, mop_reg(MREG_RAX), mop_reg(MREG_RDX));
+    EMIT(MI_SHR, 2, mop_reg(MREG_RAX), mop_imm(63));
+    EMIT(MI_ADD, 2, mop_reg(MREG_RAX), mop_reg(MREG_RDX));
+    if (remainder)
+    {
+        EMIT(MI_IMUL, 3, mop_reg(MREG_RAX), mop_reg(MREG_RAX), mop_imm((long long)d));
+        EMIT(MI_SUB, 2, mop_reg(scratch), mop_reg(MREG_RAX));
+        EMIT(MI_MOV, 2, mop_reg(MREG_RAX), mop_reg(scratch));
+    }
+}
+
+#undef EMIT
+
+/*
+ * cqo / idiv rbx [/ mov rax, rdx] with rbx a known constant.
+ */
+static int reduce_divide(MFunction *fn, PassContext *ctx, ConstState *state, MInstr *cqo)
+{
+    MInstr *div = cqo->next;
+    if (cqo->op != MI_CQO || !div || div->op != MI_IDIV || !mir_is_gpr64(&div->ops[0]))
+        return 0;
+
+    MReg divisor_reg = div->ops[0].reg;
+    if (!state->known[divisor_reg] || divisor_reg == MREG_RAX || divisor_reg == MREG_RDX)
+        return 0;
+
+    /* The remainder is moved into rax right away; the quotient leaves rdx unused. */
+    MInstr *move = div->next;
+    int remainder = move && move->op == MI_MOV && is_reg64(&move->ops[0], MREG_RAX) &&
+                    is_reg64(&move->ops[1], MREG_RDX);
+    MInstr *last = remainder ? move : div;
+    MInstr *at = last->next;
+    if (!at || !mir_reg_dead_after(fn, last, MREG_RDX) || !mir_reg_dead_after(fn, last, MREG_NONE))
+        return 0;
+
+    long long d = state->value[divisor_reg];
+    const char *what = remainder ? "remainder" : "divide";
+
+    /* idiv faults on these; keep the instruction so the program still does. */
+    if (d == 0 || d == -1 || d == (long long)(1ULL << 63))
+        return 0;
+
+    if (state->known[MREG_RAX])
+    {
+        long long x = state->value[MREG_RAX];
+        if (x == (long long)(1ULL << 63) && d == -1)
+            return 0;
+        long long result = remainder ? x % d : x / d;
+        remark(REMARK_PASSED, "strength", "DivideFolded", div->line, "%s of constants folded to %lld", what, result);
+        insert_before(fn, at, mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_imm(result)));
+    }
+    else
+    {
+        unsigned long long magnitude = d < 0 ? 0 - (unsigned long long)d : (unsigned long long)d;
+        int k = log2_exact(magnitude);
+        MReg scratch = MREG_NONE;
+
+        if (magnitude == 1)
+        {
+            if (remainder)
+                insert_before(fn, at, mir_emit(fn, MI_MOV, 2, mop_reg(MREG_RAX), mop_imm(0)));
+        }
+        else if (k >= 0)
+        {
+            if (remainder && k > 31)
+                return 0;
+            emit_power_of_two(fn, at, k, remainder);
+        }
+        else
+        {
+            if (ctx->level == OPT_OS)
+            {
+                remark(REMARK_MISSED, "strength", "DivideNotReduced", div->line,
+                       "%s by %lld kept as idiv: the multiply sequence is larger", what, d);
+                return 0;
+            }
+            scratch = find_scratch(fn, last);
+            if (scratch == MREG_NONE || (remainder && magnitude > 0x7fffffffULL))
+            {
+                remark(REMARK_MISSED, "strength", "DivideNotReduced", div->line,
+                       "%s by %lld kept as idiv: no free register for the dividend", what, d);
+                return 0;
+            }
+            emit_magic(fn, at, magnitude, scratch, remainder);
+        }
+        /* The remainder takes the sign of the dividend only, so only quotients are negated. */
+        if (d < 0 && !remainder)
+            insert_before(fn, at, mir_emit(fn, MI_NEG, 1, mop_reg(MREG_RAX)));
+
+        if (scratch != MREG_NONE)
+            remark(REMARK_PASSED, "strength", "DivideByMagicNumber", div->line,
+                   "%s by %lld replaced by a multiply-high sequence", what, d);
+        else
+            remark(REMARK_PASSED, "strength", "DivideByPowerOfTwo", div->line,
+                   "%s by %lld replaced by shifts", what, d);
+    }
+
+    mir_remove(fn, cqo);
+    mir_remove(fn, div);
+    if (remainder)
+        mir_remove(fn, move);
+    return 1;
+}
+
+int run_strength_reduction(MFunction *fn, PassContext *ctx)
+{
+    ConstState state;
+    int changes = 0;
+    forget_all(&state);
+
+    for (MInstr *instr = fn->head; instr;)
+    {
+        if (instr->op == MI_LABEL && mir_label_is_referenced(fn, instr))
+            forget_all(&state);
+
+        /* A rewrite inserts its replacement before the next instruction; resume there. */
+        MInstr *prev = instr->prev;
+        if (reduce_multiply(fn, ctx, &state, instr) || reduce_divide(fn, ctx, &state, instr))
+        {
+            changes++;
+            instr = prev ? prev->next : fn->head;
+            continue;
+        }
+        track(&state, instr);
+        instr = instr->next;
+    }
+
+    if (changes > 0)
+        mir_remove_dead_code(fn);
+    return changes;
+}
@@ -0,0 +1,210 @@
+/**
+ * @file superopt.c
+ * @brief Selection of superoptimized expression kernels for the SEG compiler.
+ *        Each kernel of src/superopt.def pairs a small expression pattern over the
+ *        operands x and y with the shortest instruction sequence tools/superopt.c found
+ *        for it. The code generator asks for a match before lowering an expression; on
+ *        a hit it evaluates y into rbx and x into rax and emits the table's sequence
+ *        instead of the generic cmp/setcc and push/pop code.
+ * @author Dario Romandini
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "remarks.h"
+#include "superopt.h"
+#include "token.h"
+
+#define SUPEROPT_MAX_LENGTH 4
+#define SUPEROPT_X_BOOL 1 ///< x must be 0 or 1
+#define SUPEROPT_Y_BOOL 2 ///< y must be 0 or 1
+
+typedef struct
+{
+    MOpcode op;
+    MReg dst;
+    MReg src;      ///< Source register, or MREG_NONE for the immediate
+    long long imm;
+} SuperoptInsn;
+
+struct SuperoptKernel
+{
+    const char *name;
+    const char *pattern;
+    int preconditions;
+    int length;
+    SuperoptInsn insns[SUPEROPT_MAX_LENGTH];
+};
+
+#define SUPEROPT_INSN(op, dst, src, imm) {op, dst, src, imm}
+#define SUPEROPT_KERNEL(name, pattern, preconditions, length, ...) \
+    {#name, pattern, preconditions, length, {__VA_ARGS__}},
+
+static const SuperoptKernel kernels[] = {
+#include "superopt.def"
+};
+
+#define KERNEL_COUNT (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static const struct
+{
+    const char *symbol;
+    TokenType op;
+} operators[] = {
+    {"+", TOKEN_PLUS}, {"-", TOKEN_MINUS}, {"*", TOKEN_STAR}, {"==", TOKEN_EQ},  {"!=", TOKEN_NEQ},
+    {"<", TOKEN_LT},   {"<=", TOKEN_LEQ},  {">", TOKEN_GT},   {">=", TOKEN_GEQ}, {"&", TOKEN_AND},
+    {"|", TOKEN_OR},   {"^", TOKEN_XOR},   {"!", TOKEN_NOT},
+};
+
+#define OPERATOR_COUNT (int)(sizeof(operators) / sizeof(operators[0]))
+
+/* Expressions whose value is a 64-bit integer in rax (no float or string anywhere). */
+static int is_integer(ASTNode *node, Symbol *symbols)
+{
+    switch (node->type)
+    {
+    case AST_LITERAL:
+        return node->result_type != TYPE_FLOAT && node->result_type != TYPE_STRING;
+    case AST_IDENTIFIER:
+    {
+        Symbol *sym = lookup_symbol(symbols, node->identifier.name);
+        return sym && sym->type != TYPE_FLOAT && sym->type != TYPE_STRING;
+    }
+    case AST_INDEX:
+    {
+        Symbol *sym = lookup_symbol(symbols, node->index.name);
+        return sym && sym->type == TYPE_INT;
+    }
+    case AST_BINARY_EXPR:
+        return is_integer(node->binary_expr.left, symbols) && is_integer(node->binary_expr.right, symbols);
+    case AST_UNARY_EXPR:
+        return is_integer(node->unary_expr.operand, symbols);
+    default:
+        return 0;
+    }
+}
+
+/* Expressions that always evaluate to 0 or 1. */
+static void skip_spaces(const char **p)
+{
+    while (**p == ' ')
+        (*p)++;
+}
+
+static size_t atom_length(const char *p)
+{
+    size_t length = 0;
+    while (p[length] && p[length] != ' ' && p[length] != '(' && p[length] != ')')
+        length++;
+    return length;
+}
+
+/*
+ * Matches node against the pattern text at *p, binding the operands x and y. An
+ * operand used twice must be the same variable both times, so evaluating it once
+ * is enough.
+ */
+static int match(const char **p, ASTNode *node, ASTNode **bound)
+{
+    skip_spaces(p);
+    size_t length;
+
+    if (**p != '(')
+    {
+        length = atom_length(*p);
+        if (length == 1 && (**p == 'x' || **p == 'y'))
+        {
+            ASTNode **slot = &bound[**p - 'x'];
+            *p += length;
+            if (!*slot)
+            {
+                *slot = node;
+                return 1;
+            }
+            return (*slot)->type == AST_IDENTIFIER && node->type == AST_IDENTIFIER &&
+                   strcmp((*slot)->identifier.name, node->identifier.name) == 0;
+        }
+        long long value = strtoll(*p, NULL, 10);
+        *p += length;
+        return node->type == AST_LITERAL && node->result_type == TYPE_INT &&
+               strtoll(node->literal.value, NULL, 10) == value;
+    }
+
+    (*p)++;
+    length = atom_length(*p);
+    int op = -1;
+    for (int i = 0; i < OPERATOR_COUNT; i++)
+    {
+        if (strlen(operators[i].symbol) == length && strncmp(operators[i].symbol, *p, length) == 0)
+            op = operators[i].op;
+    }
+    *p += length;
+
+    int matched;
+    if (op == TOKEN_NOT)
+        matched = node->type == AST_UNARY_EXPR && node->unary_expr.op == TOKEN_NOT &&
+                  match(p, node->unary_expr.operand, bound);
+    else
+        matched = node->type == AST_BINARY_EXPR && (int)node->binary_expr.op == op &&
+                  match(p, node->binary_expr.left, bound) && match(p, node->binary_expr.right, bound);
+    if (!matched)
+        return 0;
+    skip_spaces(p);
+    (*p)++; /* ')' */
+    return 1;
+}
+
+const SuperoptKernel *superopt_match(ASTNode *node, Symbol *symbols, ASTNode **x, ASTNode **y)
+{
+    if ((node->type != AST_BINARY_EXPR && node->type != AST_UNARY_EXPR) || node->result_type == TYPE_FLOAT ||
+        node->result_type == TYPE_STRING)
+        return NULL;
+
+    for (int i = 0; i < KERNEL_COUNT; i++)
+    {
+        const SuperoptKernel *kernel = &kernels[i];
+        const char *p = kernel->pattern;
+        ASTNode *bound[2] = {NULL, NULL};
+
+        if (!match(&p, node, bound))
+            continue;
+        if (!is_integer(bound[0], symbols) || (bound[1] && !is_integer(bound[1], symbols)))
+            continue;
+        if ((kernel->preconditions & SUPEROPT_X_BOOL) && !is_boolean_value(bound[0], symbols))
+            continue;
+        if ((kernel->preconditions & SUPEROPT_Y_BOOL) && !is_boolean_value(bound[1], symbols))
+            continue;
+        *x = bound[0];
+        *y = bound[1];
+        return kernel;
+    }
+    return NULL;
+}
+
+int superopt_length(const SuperoptKernel *kernel)
+{
+    return kernel->length;
+}
+
+void superopt_emit(const SuperoptKernel *kernel, MFunction *fn, int line)
+{
+    for (int i = 0; i < kernel->length; i++)
+    {
+        const SuperoptInsn *insn = &kernel->insns[i];
+        switch (insn->op)
+        {
+        case MI_NEG:
+        case MI_NOT:
+        case MI_INC:
+        case MI_DEC:
+            mir_emit(fn, insn->op, 1, mop_reg(insn->dst));
+            break;
+        default:
+            mir_emit(fn, insn->op, 2, mop_reg(insn->dst),
+                     insn->src != MREG_NONE ? mop_reg(insn->src) : mop_imm(insn->imm));
+            break;
+        }
+    }
+    remark(REMARK_PASSED, "superopt", "KernelSelected", line, "%s %s lowered to %d instruction%s from the table",
+           kernel->name, kernel->pattern, kernel->length, kernel->length == 1 ? "" : "s");
+}
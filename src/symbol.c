@@ -6,6 +6,7 @@
  * @author Dario Romandini
  */
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include "symbol.h"
@@ -15,6 +16,8 @@ Symbol *add_symbol(Symbol *table, const char *name, VarType type)
     Symbol *new_symbol = malloc(sizeof(Symbol));
     new_symbol->name = strdup(name);
     new_symbol->type = type;
+    new_symbol->length = 0;
+    new_symbol->frame_offset = 0;
     new_symbol->next = table;
     return new_symbol;
 }
@@ -41,3 +44,26 @@ void free_symbol_table(Symbol *table)
         table = next;
     }
 }
+
+int symbol_size(VarType type)
+{
+    return type == TYPE_BOOL || type == TYPE_CHAR ? 1 : 8;
+}
+
+int symbol_storage_size(const Symbol *sym)
+{
+    return sym->length ? 8 * sym->length : symbol_size(sym->type);
+}
+
+int symbol_is_block_scoped(const char *name)
+{
+    return strchr(name, '.') != NULL;
+}
+
+const char *symbol_pointer_target(const char *name)
+{
+    if (strncmp(name, "ivopt", 5) != 0 || !isdigit((unsigned char)name[5]))
+        return NULL;
+    const char *dot = name + 5 + strspn(name + 5, "0123456789");
+    return *dot == '.' ? dot + 1 : NULL;
+}
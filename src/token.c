@@ -45,6 +45,8 @@ const char *token_type_to_string(TokenType type)
         return "STAR";
     case TOKEN_SLASH:
         return "SLASH";
+    case TOKEN_PERCENT:
+        return "PERCENT";
     case TOKEN_AND:
         return "AND";
     case TOKEN_OR:
@@ -69,8 +71,14 @@ const char *token_type_to_string(TokenType type)
         return "IF";
     case TOKEN_ELSE:
         return "ELSE";
+    case TOKEN_WHILE:
+        return "WHILE";
+    case TOKEN_FOR:
+        return "FOR";
     case TOKEN_SEMICOLON:
         return "SEMICOLON";
+    case TOKEN_COMMA:
+        return "COMMA";
     case TOKEN_LPAREN:
         return "LPAREN";
     case TOKEN_RPAREN:
@@ -79,6 +87,12 @@ const char *token_type_to_string(TokenType type)
         return "LBRACE";
     case TOKEN_RBRACE:
         return "RBRACE";
+    case TOKEN_LBRACKET:
+        return "LBRACKET";
+    case TOKEN_RBRACKET:
+        return "RBRACKET";
+    case TOKEN_PRAGMA:
+        return "PRAGMA";
     case TOKEN_ERROR:
         return "ERROR";
     default:
@@ -86,6 +100,23 @@ const char *token_type_to_string(TokenType type)
     }
 }
 
+TokenType mirror_comparison(TokenType op)
+{
+    switch (op)
+    {
+    case TOKEN_LT:
+        return TOKEN_GT;
+    case TOKEN_LEQ:
+        return TOKEN_GEQ;
+    case TOKEN_GT:
+        return TOKEN_LT;
+    case TOKEN_GEQ:
+        return TOKEN_LEQ;
+    default:
+        return op;
+    }
+}
+
 void token_free(Token *token)
 {
     if (token->lexeme)
@@ -0,0 +1,713 @@
+/**
+ * @file unroll.c
+ * @brief Loop unrolling for the SEG language compiler.
+ *        Works on counted loops: the loop variable steps by a constant, the condition
+ *        compares it with a bound the loop does not change, and nothing else writes it.
+ *        A loop with a small constant trip count is replaced by copies of its body, with the
+ *        variable replaced by its value in each; another counted loop runs several copies of
+ *        the body per test, and the iterations left over run in a remainder loop, or in
+ *        straight-line copies when the trip count is constant. "#pragma unroll" overrides
+ *        the cost model.
+ * @author Dario Romandini
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "remarks.h"
+#include "token.h"
+
+/* Cost model, in AST nodes of the unrolled code. -O2 only removes loops that run a few times. */
+#define FULL_UNROLL_TRIPS_O2 8
+#define FULL_UNROLL_SIZE_O2 64
+#define FULL_UNROLL_TRIPS_O3 16
+#define FULL_UNROLL_SIZE_O3 256
+#define PARTIAL_UNROLL_SIZE_O3 64
+
+/* Limits for "#pragma unroll", which keep a hint from blowing up the program. */
+#define PRAGMA_UNROLL_TRIPS 1024
+#define PRAGMA_UNROLL_SIZE 16384
+
+/* Block variables declared in the body; each copy after the first gets its own. */
+typedef struct
+{
+    char **names;
+    char **copies;
+    int count;
+    int capacity;
+} Renaming;
+
+/* What replaces the loop variable in a copy of the body: a constant, or the variable plus an offset. */
+typedef struct
+{
+    const char *counter;
+    int constant;             ///< Replace the variable by value
+    long long value;          ///< Constant, or offset added to the variable
+    const char *temp;         ///< Variable holding the variable plus the offset, or NULL
+    const Renaming *renaming; ///< Block variables to rename, or NULL
+} Substitution;
+
+static int copy_counter = 0;
+
+static int declares_variable(const ASTNode *node)
+{
+    for (; node; node = node->next)
+    {
+        if (node->type == AST_VAR_DECL)
+            return 1;
+    }
+    return 0;
+}
+
+static int count_nodes(const ASTNode *node, const ASTNode *stop)
+{
+    int count = 0;
+    for (; node && node != stop; node = node->next)
+    {
+        count++;
+        switch (node->type)
+        {
+        case AST_VAR_DECL:
+            count += count_nodes(node->var_decl.value, NULL);
+            break;
+        case AST_BINARY_EXPR:
+            count += count_nodes(node->binary_expr.left, NULL) + count_nodes(node->binary_expr.right, NULL);
+            break;
+        case AST_UNARY_EXPR:
+            count += count_nodes(node->unary_expr.operand, NULL);
+            break;
+        case AST_IF_STATEMENT:
+            count += count_nodes(node->if_statement.condition, NULL) +
+                     count_nodes(node->if_statement.then_branch, NULL) +
+                     count_nodes(node->if_statement.else_branch, NULL);
+            break;
+        case AST_LOOP:
+            count += count_nodes(node->loop.init, NULL) + count_nodes(node->loop.preheader, NULL) +
+                     count_nodes(node->loop.condition, NULL) + count_nodes(node->loop.update, NULL) +
+                     count_nodes(node->loop.body, NULL) + count_nodes(node->loop.exit, NULL);
+            break;
+        case AST_INDEX:
+            count += count_nodes(node->index.index, NULL);
+            break;
+        case AST_ELEMENT_ASSIGN:
+            count += count_nodes(node->element_assign.index, NULL) + count_nodes(node->element_assign.value, NULL);
+            break;
+        default:
+            break;
+        }
+    }
+    return count;
+}
+
+static int declares_array(const ASTNode *node)
+{
+    for (; node; node = node->next)
+    {
+        if (node->type == AST_ARRAY_DECL)
+            return 1;
+        if (node->type == AST_IF_STATEMENT &&
+            (declares_array(node->if_statement.then_branch) || declares_array(node->if_statement.else_branch)))
+            return 1;
+        if (node->type == AST_LOOP && (declares_array(node->loop.init) || declares_array(node->loop.body)))
+            return 1;
+    }
+    return 0;
+}
+
+static int contains_loop(const ASTNode *node)
+{
+    for (; node; node = node->next)
+    {
+        if (node->type == AST_LOOP)
+            return 1;
+        if (node->type == AST_IF_STATEMENT &&
+            (contains_loop(node->if_statement.then_branch) || contains_loop(node->if_statement.else_branch)))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Recognizes a counted loop that unroll can copy: licm has not given it a preheader or an
+ * exit yet, and the body declares no array.
+ */
+static const char *recognize(ASTNode *node, const ASTNode *previous, CountedLoop *loop)
+{
+    const char *reason = recognize_counted_loop(node, previous, loop);
+    if (node->loop.preheader || node->loop.exit)
+        return "it was already transformed";
+    if (reason)
+        return reason;
+    if (declares_array(node->loop.body))
+        return "the body declares an array";
+
+    loop->size = count_nodes(node->loop.body, node->loop.update ? NULL : loop->update);
+    loop->nested = contains_loop(node->loop.body);
+    return NULL;
+}
+
+/* Runs the loop at compile time; -1 if the bound is not constant or it runs more than limit times. */
+static long long count_trips(const CountedLoop *loop, long long limit)
+{
+    long long bound, value = loop->start, holds;
+    if (!loop->known_start || !integer_literal_value(loop->bound, &bound))
+        return -1;
+    for (long long trips = 0; trips <= limit; trips++)
+    {
+        fold_binary_operator(loop->op, value, bound, &holds);
+        if (!holds)
+            return trips;
+        /* A variable that wraps around is left alone. */
+        if ((loop->step > 0 && value > LLONG_MAX - loop->step) || (loop->step < 0 && value < LLONG_MIN - loop->step))
+            return -1;
+        value += loop->step;
+    }
+    return -1;
+}
+
+/*
+ * A block variable only used inside the loop is declared by the body. Copies of a body with
+ * a nested loop, and the remainder loop, declare their own, so that code generation gives
+ * them their own stack slots: a temporary hoisted out of the loop in a later copy could
+ * otherwise take a slot the variables of the earlier copy already hold. Other copies share
+ * the variables, and with them the register promote picks.
+ */
+static void collect_locals(Renaming *renaming, const ASTNode *node, const ASTNode *program, const ASTNode *loop)
+{
+    for (; node; node = node->next)
+    {
+        if (node->type == AST_VAR_DECL && symbol_is_block_scoped(node->var_decl.name) &&
+            !occurs_outside(program, loop, node->var_decl.name))
+        {
+            int known = 0;
+            for (int i = 0; i < renaming->count; i++)
+                known |= strcmp(renaming->names[i], node->var_decl.name) == 0;
+            if (!known)
+            {
+                if (renaming->count == renaming->capacity)
+                {
+                    renaming->capacity = renaming->capacity ? 2 * renaming->capacity : 8;
+                    renaming->names = realloc(renaming->names, renaming->capacity * sizeof(char *));
+                    renaming->copies = realloc(renaming->copies, renaming->capacity * sizeof(char *));
+                }
+                renaming->names[renaming->count] = strdup_safe(node->var_decl.name);
+                renaming->copies[renaming->count++] = NULL;
+            }
+        }
+        else if (node->type == AST_IF_STATEMENT)
+        {
+            collect_locals(renaming, node->if_statement.then_branch, program, loop);
+            collect_locals(renaming, node->if_statement.else_branch, program, loop);
+        }
+        else if (node->type == AST_LOOP)
+        {
+            collect_locals(renaming, node->loop.init, program, loop);
+            collect_locals(renaming, node->loop.preheader, program, loop);
+            collect_locals(renaming, node->loop.body, program, loop);
+            collect_locals(renaming, node->loop.exit, program, loop);
+        }
+    }
+}
+
+/* Picks fresh names for the next copy: "t.3" becomes "t.3.N", which the parser never produces. */
+static void rename_locals(Renaming *renaming)
+{
+    char buffer[128];
+    copy_counter++;
+    for (int i = 0; i < renaming->count; i++)
+    {
+        free(renaming->copies[i]);
+        snprintf(buffer, sizeof(buffer), "%s.%d", renaming->names[i], copy_counter);
+        renaming->copies[i] = strdup_safe(buffer);
+    }
+}
+
+static void free_renaming(Renaming *renaming)
+{
+    for (int i = 0; i < renaming->count; i++)
+    {
+        free(renaming->names[i]);
+        free(renaming->copies[i]);
+    }
+    free(renaming->names);
+    free(renaming->copies);
+}
+
+static const char *renamed(const Substitution *sub, const char *name)
+{
+    for (int i = 0; sub->renaming && i < sub->renaming->count; i++)
+    {
+        if (sub->renaming->copies[i] && strcmp(sub->renaming->names[i], name) == 0)
+            return sub->renaming->copies[i];
+    }
+    return name;
+}
+
+static ASTNode *integer_literal(long long value, const ASTNode *origin)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%lld", value);
+    ASTNode *node = create_literal_node(buffer, TYPE_INT);
+    return set_node_location(node, origin->line, origin->column);
+}
+
+static ASTNode *variable_reference(const char *name, const ASTNode *origin)
+{
+    ASTNode *node = create_identifier_node(name);
+    node->result_type = TYPE_INT;
+    return set_node_location(node, origin->line, origin->column);
+}
+
+/* "name + offset", written as a subtraction for a negative offset. */
+static ASTNode *offset_expression(ASTNode *base, long long offset, const ASTNode *origin)
+{
+    ASTNode *node = offset < 0 ? create_binary_expr_node(TOKEN_MINUS, base, integer_literal(-offset, origin))
+                               : create_binary_expr_node(TOKEN_PLUS, base, integer_literal(offset, origin));
+    node->result_type = TYPE_INT;
+    return set_node_location(node, origin->line, origin->column);
+}
+
+static ASTNode *clone_list(const ASTNode *node, const ASTNode *stop, const Substitution *sub);
+
+static ASTNode *clone_node(const ASTNode *node, const Substitution *sub)
+{
+    ASTNode *copy;
+    if (!node)
+        return NULL;
+    switch (node->type)
+    {
+    case AST_VAR_DECL:
+        copy = create_var_decl_node(node->var_decl.var_type, renamed(sub, node->var_decl.name),
+                                    clone_node(node->var_decl.value, sub));
+        break;
+    case AST_LITERAL:
+        copy = create_literal_node(node->literal.value, node->result_type);
+        break;
+    case AST_IDENTIFIER:
+        if (sub->counter && strcmp(node->identifier.name, sub->counter) == 0)
+        {
+            if (sub->constant)
+                return integer_literal(sub->value, node);
+            if (sub->temp)
+                return variable_reference(sub->temp, node);
+            if (sub->value)
+                return offset_expression(variable_reference(sub->counter, node), sub->value, node);
+        }
+        copy = create_identifier_node(renamed(sub, node->identifier.name));
+        break;
+    case AST_BINARY_EXPR:
+        copy = create_binary_expr_node(node->binary_expr.op, clone_node(node->binary_expr.left, sub),
+                                       clone_node(node->binary_expr.right, sub));
+        break;
+    case AST_UNARY_EXPR:
+        copy = create_unary_expr_node(node->unary_expr.op, clone_node(node->unary_expr.operand, sub));
+        break;
+    case AST_IF_STATEMENT:
+        copy = create_if_statement_node(clone_node(node->if_statement.condition, sub),
+                                        clone_list(node->if_statement.then_branch, NULL, sub),
+                                        clone_list(node->if_statement.else_branch, NULL, sub));
+        break;
+    case AST_LOOP:
+        copy = create_loop_node(clone_list(node->loop.init, NULL, sub), clone_node(node->loop.condition, sub),
+                                clone_list(node->loop.update, NULL, sub), clone_list(node->loop.body, NULL, sub));
+        copy->loop.preheader = clone_list(node->loop.preheader, NULL, sub);
+        copy->loop.exit = clone_list(node->loop.exit, NULL, sub);
+        copy->loop.unroll = node->loop.unroll;
+        break;
+    case AST_INDEX:
+        copy = create_index_node(node->index.name, clone_node(node->index.index, sub));
+        break;
+    case AST_ELEMENT_ASSIGN:
+        copy = create_element_assign_node(node->element_assign.name, clone_node(node->element_assign.index, sub),
+                                          clone_node(node->element_assign.value, sub));
+        break;
+    default:
+        fprintf(stderr, "[Unroll Error] Unexpected node in loop body: %d\n", node->type);
+        exit(1);
+    }
+    copy->result_type = node->result_type;
+    return set_node_location(copy, node->line, node->column);
+}
+
+static ASTNode *clone_list(const ASTNode *node, const ASTNode *stop, const Substitution *sub)
+{
+    ASTNode *head = NULL, **tail = &head;
+    for (; node && node != stop; node = node->next)
+    {
+        *tail = clone_node(node, sub);
+        tail = &(*tail)->next;
+    }
+    return head;
+}
+
+static ASTNode **append_list(ASTNode **tail, ASTNode *list)
+{
+    *tail = list;
+    while (*tail)
+        tail = &(*tail)->next;
+    return tail;
+}
+
+/* Appends a copy of the body, with the loop variable replaced as sub says. */
+static ASTNode **append_copy(ASTNode **tail, const CountedLoop *loop, Substitution *sub, Renaming *renaming,
+                             int fresh_names)
+{
+    if (fresh_names)
+        rename_locals(renaming);
+    sub->renaming = fresh_names ? renaming : NULL;
+    const ASTNode *stop = loop->node->loop.update ? NULL : loop->update;
+    return append_list(tail, clone_list(loop->node->loop.body, stop, sub));
+}
+
+static ASTNode *assign_counter(const CountedLoop *loop, ASTNode *value)
+{
+    ASTNode *node = create_var_decl_node(TYPE_INT, loop->counter, value);
+    return set_node_location(node, loop->node->line, loop->node->column);
+}
+
+/* Replaces the loop in the list with the statements built for it. */
+static ASTNode **splice(ASTNode **link, ASTNode *statements)
+{
+    ASTNode *node = *link, *rest = node->next;
+    node->next = NULL;
+    free_ast(node);
+    ASTNode **tail = append_list(link, statements);
+    *tail = rest;
+    return tail;
+}
+
+/*
+ * The statements that set the loop variable before the loop: the init statement, or nothing
+ * when the variable is declared by the init statement and only used in the loop, which the
+ * copies no longer need.
+ */
+static int counter_is_local(const CountedLoop *loop, const ASTNode *program)
+{
+    return symbol_is_block_scoped(loop->counter) && !occurs_outside(program, loop->node, loop->counter);
+}
+
+static int init_sets_counter(const CountedLoop *loop)
+{
+    const ASTNode *init = loop->node->loop.init;
+    return init && init->type == AST_VAR_DECL && strcmp(init->var_decl.name, loop->counter) == 0;
+}
+
+static ASTNode *take_init(CountedLoop *loop)
+{
+    ASTNode *init = loop->node->loop.init;
+    loop->node->loop.init = NULL;
+    return init;
+}
+
+/* Replaces the loop by trips copies of its body. Returns the link after them. */
+static ASTNode **unroll_fully(ASTNode **link, CountedLoop *loop, long long trips, const ASTNode *program)
+{
+    ASTNode *statements = NULL, **tail = &statements;
+    int local = counter_is_local(loop, program);
+    int drop_init = init_sets_counter(loop);
+    ASTNode *init = take_init(loop);
+
+    if (!drop_init)
+        tail = append_list(tail, init);
+    else
+        free_ast(init);
+
+    Renaming renaming = {0};
+    collect_locals(&renaming, loop->node->loop.body, program, loop->node);
+    Substitution sub = {loop->counter, 1, loop->start, NULL, NULL};
+    for (long long k = 0; k < trips; k++, sub.value += loop->step)
+        tail = append_copy(tail, loop, &sub, &renaming, k > 0 && loop->nested);
+    free_renaming(&renaming);
+
+    if (!local)
+        tail = append_list(tail, assign_counter(loop, integer_literal(sub.value, loop->node)));
+    return splice(link, statements);
+}
+
+/*
+ * The loop running factor copies of the body per test. Copy k reads the variable plus k
+ * steps; a body reading the variable more than once gets that value in a temporary.
+ */
+static ASTNode *main_loop(CountedLoop *loop, ASTNode *condition, int factor, const ASTNode *program)
+{
+    ASTNode *body = NULL, **tail = &body;
+    const ASTNode *stop = loop->node->loop.update ? NULL : loop->update;
+    char *temp = count_reads(loop->node->loop.body, stop, loop->counter) > 1 ? new_temp("unroll") : NULL;
+    Renaming renaming = {0};
+    collect_locals(&renaming, loop->node->loop.body, program, loop->node);
+    Substitution sub = {loop->counter, 0, 0, NULL, NULL};
+    for (int k = 0; k < factor; k++, sub.value += loop->step)
+    {
+        if (k > 0 && temp)
+        {
+            ASTNode *offset = offset_expression(variable_reference(loop->counter, loop->node), sub.value, loop->node);
+            ASTNode *set = create_var_decl_node(TYPE_INT, temp, offset);
+            tail = append_list(tail, set_node_location(set, loop->node->line, loop->node->column));
+            sub.temp = temp;
+        }
+        tail = append_copy(tail, loop, &sub, &renaming, k > 0 && loop->nested);
+    }
+    free_renaming(&renaming);
+    free(temp);
+
+    ASTNode *update = assign_counter(loop, offset_expression(variable_reference(loop->counter, loop->node),
+                                                             loop->step * factor, loop->node));
+    ASTNode *node = create_loop_node(NULL, condition, update, body);
+    node->loop.unroll = 1;
+    return set_node_location(node, loop->node->line, loop->node->column);
+}
+
+static ASTNode *comparison(TokenType op, ASTNode *left, ASTNode *right, const ASTNode *origin)
+{
+    ASTNode *node = create_binary_expr_node(op, left, right);
+    node->result_type = TYPE_BOOL;
+    return set_node_location(node, origin->line, origin->column);
+}
+
+/*
+ * Unrolls a loop whose trip count is known by factor: the main loop runs trips / factor
+ * times, and the remaining iterations follow as straight-line copies.
+ */
+static ASTNode **unroll_with_epilogue(ASTNode **link, CountedLoop *loop, long long trips, int factor,
+                                      const ASTNode *program)
+{
+    ASTNode *statements = NULL, **tail = &statements;
+    long long main_trips = trips / factor * factor;
+    long long limit = loop->start + main_trips * loop->step;
+    int local = counter_is_local(loop, program);
+
+    tail = append_list(tail, take_init(loop));
+    ASTNode *condition = comparison(loop->step > 0 ? TOKEN_LT : TOKEN_GT, variable_reference(loop->counter, loop->node),
+                                    integer_literal(limit, loop->node), loop->node->loop.condition);
+    tail = append_list(tail, main_loop(loop, condition, factor, program));
+
+    Renaming renaming = {0};
+    collect_locals(&renaming, loop->node->loop.body, program, loop->node);
+    Substitution sub = {loop->counter, 1, limit, NULL, NULL};
+    for (long long k = main_trips; k < trips; k++, sub.value += loop->step)
+        tail = append_copy(tail, loop, &sub, &renaming, loop->nested);
+    free_renaming(&renaming);
+
+    if (!local && main_trips < trips)
+        tail = append_list(tail, assign_counter(loop, integer_literal(sub.value, loop->node)));
+    return splice(link, statements);
+}
+
+/*
+ * Unrolls a loop whose trip count is only known at run time. The main loop runs while all
+ * factor copies would: its limit is the bound moved back by factor - 1 steps. A bound only
+ * known at run time gets its limit in the preheader, where a limit that wraps around is
+ * replaced by the start, which skips the main loop. The remainder loop is the original loop.
+ */
+static ASTNode **unroll_with_remainder(ASTNode **link, CountedLoop *loop, int factor, const ASTNode *program)
+{
+    ASTNode *statements = NULL, **tail = &statements;
+    const ASTNode *origin = loop->node, *bound = loop->bound;
+    Substitution plain = {NULL, 0, 0, NULL, NULL};
+
+    /* The main loop compares strictly: "i <= n" holds for the last copy while i + back < n + 1. */
+    TokenType op = loop->step > 0 ? TOKEN_LT : TOKEN_GT;
+    long long back = loop->step * (factor - 1) - (loop->op == TOKEN_LEQ) + (loop->op == TOKEN_GEQ);
+
+    /* The init statement moves out so that the variable it declares stays in scope for both loops. */
+    tail = append_list(tail, take_init(loop));
+
+    ASTNode *condition, *preheader = NULL;
+    long long value;
+    if (back == 0)
+    {
+        condition = comparison(op, variable_reference(loop->counter, origin), clone_node(bound, &plain),
+                               loop->node->loop.condition);
+    }
+    else if (integer_literal_value(bound, &value) && (back > 0 ? value >= LLONG_MIN + back : value <= LLONG_MAX + back))
+    {
+        condition = comparison(op, variable_reference(loop->counter, origin), integer_literal(value - back, origin),
+                               loop->node->loop.condition);
+    }
+    else
+    {
+        char *limit = new_temp("unroll");
+        ASTNode *distance = offset_expression(clone_node(bound, &plain), -back, origin);
+        preheader = set_node_location(create_var_decl_node(TYPE_INT, limit, distance), origin->line, origin->column);
+        ASTNode *wrapped = comparison(op == TOKEN_LT ? TOKEN_GT : TOKEN_LT, variable_reference(limit, origin),
+                                      clone_node(bound, &plain), origin);
+        ASTNode *reset = create_var_decl_node(TYPE_INT, limit, variable_reference(loop->counter, origin));
+        set_node_location(reset, origin->line, origin->column);
+        preheader->next = set_node_location(create_if_statement_node(wrapped, reset, NULL), origin->line, origin->column);
+        condition = comparison(op, variable_reference(loop->counter, origin), variable_reference(limit, origin),
+                               loop->node->loop.condition);
+        free(limit);
+    }
+    ASTNode *unrolled = main_loop(loop, condition, factor, program);
+    unrolled->loop.preheader = preheader;
+    tail = append_list(tail, unrolled);
+
+    Renaming renaming = {0};
+    collect_locals(&renaming, loop->node->loop.body, program, loop->node);
+    rename_locals(&renaming);
+    plain.renaming = &renaming;
+    const ASTNode *stop = loop->node->loop.update ? NULL : loop->update;
+    ASTNode *remainder = create_loop_node(NULL, clone_node(loop->node->loop.condition, &plain),
+                                          clone_node(loop->update, &plain),
+                                          clone_list(loop->node->loop.body, stop, &plain));
+    remainder->loop.unroll = 1;
+    set_node_location(remainder, origin->line, origin->column);
+    free_renaming(&renaming);
+    tail = append_list(tail, remainder);
+    return splice(link, statements);
+}
+
+/* Unroll factor the cost model picks for a loop that is not unrolled fully; 1 for none. */
+static int pick_factor(const CountedLoop *loop, const PassContext *ctx)
+{
+    if (ctx->level != OPT_O3 || loop->nested)
+        return 1;
+    for (int factor = 4; factor > 1; factor /= 2)
+    {
+        if (factor * loop->size <= PARTIAL_UNROLL_SIZE_O3)
+            return factor;
+    }
+    return 1;
+}
+
+static void missed(const CountedLoop *loop, const char *format, const char *reason)
+{
+    remark(REMARK_MISSED, "unroll", "NotUnrolled", loop->node->line, format, reason);
+}
+
+/* Unrolls the loop at *link if the hint or the cost model asks for it. Returns the link after the result. */
+static ASTNode **unroll_loop(ASTNode **link, const ASTNode *previous, int top_level, ASTNode **program,
+                             const PassContext *ctx, int *changes)
+{
+    ASTNode *node = *link;
+    int hint = node->loop.unroll;
+    CountedLoop loop;
+
+    if (hint == 1)
+        return &node->next;
+    const char *reason = recognize(node, previous, &loop);
+    if (reason)
+    {
+        if (hint)
+            missed(&loop, "loop not unrolled as #pragma unroll asks: %s", reason);
+        return &node->next;
+    }
+
+    long long trips = count_trips(&loop, PRAGMA_UNROLL_TRIPS);
+    int full = 0, factor = 1;
+    if (hint == LOOP_UNROLL_FULL)
+    {
+        if (trips < 0)
+        {
+            missed(&loop, "loop not unrolled as #pragma unroll asks: %s",
+                   "its trip count is not a small constant");
+            return &node->next;
+        }
+        full = trips * loop.size <= PRAGMA_UNROLL_SIZE;
+        if (!full)
+        {
+            missed(&loop, "loop not unrolled as #pragma unroll asks: %s", "the unrolled body would be too large");
+            return &node->next;
+        }
+    }
+    else if (hint > 1)
+    {
+        full = trips >= 0 && trips <= hint;
+        factor = hint;
+    }
+    else if (ctx->level == OPT_O2 && trips >= 0)
+        full = trips <= FULL_UNROLL_TRIPS_O2 && trips * loop.size <= FULL_UNROLL_SIZE_O2;
+    else if (ctx->level == OPT_O3)
+    {
+        full = trips >= 0 && trips <= FULL_UNROLL_TRIPS_O3 && trips * loop.size <= FULL_UNROLL_SIZE_O3;
+        factor = pick_factor(&loop, ctx);
+    }
+
+    ASTNode *rest = node->next;
+    if (full)
+    {
+        /* The last top-level declaration is the exit code; the copies must not change which one it is. */
+        if (top_level && !declares_variable(rest) &&
+            (declares_variable(node->loop.body) || !counter_is_local(&loop, *program) ||
+             (declares_variable(node->loop.init) && !init_sets_counter(&loop))))
+        {
+            missed(&loop, "loop not unrolled: %s", "its copies would declare the exit value");
+            return &node->next;
+        }
+        remark(REMARK_PASSED, "unroll", "FullyUnrolled", node->line, "loop over '%.*s' fully unrolled: %lld iterations",
+               source_length(loop.counter), loop.counter, trips);
+        (*changes)++;
+        return unroll_fully(link, &loop, trips, *program);
+    }
+    if (factor <= 1 || (trips >= 0 && trips < factor))
+        return &node->next;
+
+    if (top_level && !declares_variable(rest) &&
+        (declares_variable(node->loop.init) ||
+         (trips >= 0 && trips % factor && (declares_variable(node->loop.body) || !counter_is_local(&loop, *program)))))
+    {
+        missed(&loop, "loop not unrolled: %s", "the statements moved out of it would declare the exit value");
+        return &node->next;
+    }
+
+    if (trips >= 0)
+    {
+        remark(REMARK_PASSED, "unroll", "Unrolled", node->line,
+               "loop over '%.*s' unrolled by %d%s: %lld iterations, %lld after the loop", source_length(loop.counter),
+               loop.counter, factor, hint > 1 ? " as #pragma unroll asks" : "", trips, trips % factor);
+        (*changes)++;
+        return unroll_with_epilogue(link, &loop, trips, factor, *program);
+    }
+
+    /* At run time the main loop needs an ordered comparison the variable moves towards. */
+    if (!(((loop.op == TOKEN_LT || loop.op == TOKEN_LEQ) && loop.step > 0) ||
+          ((loop.op == TOKEN_GT || loop.op == TOKEN_GEQ) && loop.step < 0)))
+    {
+        if (hint)
+            missed(&loop, "loop not unrolled as #pragma unroll asks: %s",
+                   "its condition is not a bound the variable moves towards");
+        return &node->next;
+    }
+
+    remark(REMARK_PASSED, "unroll", "Unrolled", node->line, "loop over '%.*s' unrolled by %d%s, with a remainder loop",
+           source_length(loop.counter), loop.counter, factor, hint > 1 ? " as #pragma unroll asks" : "");
+    (*changes)++;
+    return unroll_with_remainder(link, &loop, factor, *program);
+}
+
+static int unroll_statements(ASTNode **link, int top_level, ASTNode **program, const PassContext *ctx)
+{
+    int changes = 0;
+    const ASTNode *previous = NULL;
+    while (*link)
+    {
+        ASTNode *node = *link;
+        if (node->type == AST_IF_STATEMENT)
+        {
+            changes += unroll_statements(&node->if_statement.then_branch, 0, program, ctx);
+            changes += unroll_statements(&node->if_statement.else_branch, 0, program, ctx);
+        }
+        else if (node->type == AST_LOOP)
+        {
+            /* Inner loops go first, so that the size of an outer body is the size after unrolling them. */
+            changes += unroll_statements(&node->loop.body, 0, program, ctx);
+            ASTNode **after = unroll_loop(link, previous, top_level, program, ctx, &changes);
+            if (after != &node->next)
+            {
+                previous = NULL;
+                link = after;
+                continue;
+            }
+        }
+        previous = node;
+        link = &node->next;
+    }
+    return changes;
+}
+
+int run_unroll(ASTNode **program, PassContext *ctx)
+{
+    return unroll_statements(program, 1, program, ctx);
+}
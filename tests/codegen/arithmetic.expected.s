@@ -0,0 +1,38 @@
+    .intel_syntax noprefix
+    .bss
+    .p2align 6
+a: .zero 8
+b: .zero 8
+c: .zero 8
+d: .zero 8
+check: .zero 8
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    mov rax, 10
+    mov [rip + a], rax
+    mov rax, [rip + a]
+    lea rax, [rax*2 + 3]
+    sub rax, 1
+    mov [rip + b], rax
+    mov rax, [rip + a]
+    add rax, [rip + b]
+    mov rbx, 3
+    cqo
+    idiv rbx
+    mov [rip + c], rax
+    mov rax, [rip + c]
+    imul rax, [rip + c]
+    sub rax, [rip + a]
+    mov [rip + d], rax
+    mov rax, [rip + d]
+    sub rax, [rip + b]
+    mov [rip + check], rax
+    mov rax, [rip + check]
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
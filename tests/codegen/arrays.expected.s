@@ -0,0 +1,88 @@
+    .intel_syntax noprefix
+    .section .rodata.cst8,"aM",@progbits,8
+    .p2align 3
+L_literal_1: .double 1.5
+L_literal_0: .double 0.5
+    .bss
+    .p2align 5
+squares: .zero 64
+    .p2align 5
+weights: .zero 32
+    .p2align 5
+window.3: .zero 24
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    movsd xmm0, [rip + L_literal_0]
+    xor eax, eax
+    mov r9d, 1
+    mov r10d, 4
+    mov [rip + squares], rax
+    mov eax, 3
+    mov [rip + squares + 8], r9
+    mov r8, rax
+    cmp rax, 6
+    mov [rip + squares + 16], r10
+    movsd [rip + weights], xmm0
+    movsd xmm0, [rip + L_literal_1]
+    movsd [rip + weights + 8], xmm0
+    jge L_loop_end_0
+    .p2align 4,,15
+L_loop_body_0:
+    imul rax, rax
+    mov rcx, r8
+    lea rdx, [rip + squares]
+    mov [rdx + rcx*8], rax
+    mov rax, rcx
+    add rax, 1
+    mov r8, rax
+    cmp rax, 6
+    jl L_loop_body_0
+L_loop_end_0:
+    xor eax, eax
+    mov rdi, rax
+    mov rsi, rax
+    cmp rax, 6
+    jge L_loop_end_1
+    .p2align 4,,15
+L_loop_body_1:
+    lea rcx, [rip + squares]
+    mov r9, rsi
+    mov rax, [rcx + rax*8]
+    push rax
+    mov rax, rsi
+    mov r9, [rcx + r9*8 + 8]
+    pop rbx
+    add r9, rdi
+    add r9, rbx
+    add rax, 1
+    mov rdi, r9
+    mov rsi, rax
+    cmp rax, 6
+    jl L_loop_body_1
+L_loop_end_1:
+    cmp rdi, 20
+    jle L_if_end_2
+L_if_true_2:
+    mov rax, rdi
+    mov qword ptr [rip + window.3 + 8], 0
+    mov r9, [rip + squares + 16]
+    mov [rip + window.3], rax
+    mov r10, [rip + window.3]
+    mov qword ptr [rip + window.3 + 16], 0
+    mov [rip + window.3 + 16], r9
+    add r10, [rip + window.3 + 8]
+    add r10, [rip + window.3 + 16]
+    mov rdi, r10
+L_if_end_2:
+    movsd xmm0, [rip + weights + 8]
+    mov rax, rdi
+    add rax, [rip + squares + 40]
+    movsd [rip + weights + 24], xmm0
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
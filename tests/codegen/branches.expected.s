@@ -0,0 +1,68 @@
+    .intel_syntax noprefix
+    .bss
+    .p2align 6
+a: .zero 8
+sum: .zero 8
+check: .zero 8
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbp
+    mov rbp, rsp
+    sub rsp, 16
+    mov rax, 10
+    mov [rip + a], rax
+    mov rax, [rip + a]
+    add rax, 5
+    mov [rip + sum], rax
+    cmp qword ptr [rip + a], 10
+    setg al
+    movzx rax, al
+    cmp rax, 0
+    je L_if_else_0
+L_if_true_0:
+    mov rax, 1
+    mov [rbp - 8], rax
+    jmp L_if_end_0
+L_if_else_0:
+    cmp qword ptr [rip + a], 10
+    sete al
+    movzx rax, al
+    cmp rax, 0
+    je L_if_else_1
+L_if_true_1:
+    mov rax, 2
+    mov [rbp - 8], rax
+    jmp L_if_end_1
+L_if_else_1:
+    mov rax, 3
+    mov [rbp - 8], rax
+L_if_end_1:
+L_if_end_0:
+    mov rax, [rip + a]
+    add rax, [rip + sum]
+    cmp rax, 20
+    setg al
+    movzx rax, al
+    cmp rax, 0
+    je L_if_else_2
+L_if_true_2:
+    mov rax, [rip + sum]
+    imul rax, rax, 2
+    mov [rbp - 8], rax
+    jmp L_if_end_2
+L_if_else_2:
+    mov rax, [rip + sum]
+    sub rax, 5
+    mov [rbp - 8], rax
+L_if_end_2:
+    mov rax, [rip + sum]
+    mov [rip + check], rax
+    mov rax, [rip + check]
+    mov rsp, rbp
+    pop rbp
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
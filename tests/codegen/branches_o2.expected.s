@@ -0,0 +1,28 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    mov eax, 10
+    cmp rax, 10
+    jle L_if_else_0
+L_if_true_0:
+L_if_else_1:
+L_if_end_1:
+L_if_end_0:
+    mov eax, 25
+    cmp rax, 20
+    jle L_if_else_2
+L_if_true_2:
+L_if_else_2:
+L_if_end_2:
+    mov eax, 15
+    ret
+L_if_else_0:
+    cmp rax, 10
+    jne L_if_else_1
+L_if_true_1:
+    jmp L_if_end_1
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,43 @@
+    .intel_syntax noprefix
+    .bss
+    .p2align 6
+a: .zero 8
+twice: .zero 8
+nine: .zero 8
+quarter: .zero 8
+seventh: .zero 8
+check: .zero 8
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    mov rax, 100
+    mov [rip + a], rax
+    mov rax, [rip + a]
+    imul rax, rax, 2
+    mov [rip + twice], rax
+    mov rax, [rip + a]
+    imul rax, rax, 9
+    mov [rip + nine], rax
+    mov rax, [rip + a]
+    mov rbx, 4
+    cqo
+    idiv rbx
+    mov [rip + quarter], rax
+    mov rax, [rip + a]
+    mov rbx, 7
+    cqo
+    idiv rbx
+    mov [rip + seventh], rax
+    mov rax, [rip + twice]
+    add rax, [rip + nine]
+    sub rax, [rip + quarter]
+    sub rax, [rip + seventh]
+    mov [rip + check], rax
+    mov rax, [rip + check]
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
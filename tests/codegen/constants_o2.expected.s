@@ -0,0 +1,10 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    mov eax, 1061
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
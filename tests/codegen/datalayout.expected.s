@@ -0,0 +1,82 @@
+    .intel_syntax noprefix
+    .bss
+    .p2align 6
+total: .zero 8
+c1: .zero 8
+c2: .zero 8
+c3: .zero 8
+c4: .zero 8
+sum: .zero 8
+result: .zero 8
+ready: .zero 1
+grade: .zero 1
+late: .zero 1
+    .p2align 3
+c5: .zero 8
+c6: .zero 8
+c7: .zero 8
+c8: .zero 8
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    mov rax, 1
+    mov [rip + ready], al
+    mov rax, 3
+    mov [rip + total], rax
+    mov rax, 66
+    mov [rip + grade], al
+    mov rax, 1
+    mov [rip + c1], rax
+    mov rax, 2
+    mov [rip + c2], rax
+    mov rax, 3
+    mov [rip + c3], rax
+    mov rax, 4
+    mov [rip + c4], rax
+    mov rax, 5
+    mov [rip + c5], rax
+    mov rax, 6
+    mov [rip + c6], rax
+    mov rax, 7
+    mov [rip + c7], rax
+    mov rax, 8
+    mov [rip + c8], rax
+    cmp qword ptr [rip + total], 2
+    setg al
+    movzx rax, al
+    mov [rip + late], al
+    mov rax, [rip + total]
+    add rax, [rip + total]
+    mov [rip + sum], rax
+    movzx eax, byte ptr [rip + ready]
+    cmp rax, 0
+    je L_if_end_0
+L_if_true_0:
+    mov rax, [rip + sum]
+    add rax, [rip + total]
+    mov [rip + sum], rax
+    jmp L_if_end_0
+L_if_end_0:
+    movzx eax, byte ptr [rip + late]
+    cmp rax, 0
+    je L_if_end_1
+L_if_true_1:
+    movzx eax, byte ptr [rip + grade]
+    push rax
+    mov rax, [rip + sum]
+    pop rbx
+    add rax, rbx
+    mov [rip + sum], rax
+    jmp L_if_end_1
+L_if_end_1:
+    mov rax, [rip + sum]
+    sub rax, [rip + total]
+    mov [rip + result], rax
+    mov rax, [rip + result]
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
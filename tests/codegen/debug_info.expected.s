@@ -0,0 +1,92 @@
+    .intel_syntax noprefix
+    .file 1 "/root/repo/tests/codegen/debug_info.seg"
+    .text
+    .global main
+    .type main, @function
+main:
+    .loc 1 1 1
+    mov eax, 10
+    .loc 1 4 1
+    cmp rax, 10
+    jle L_if_else_0
+L_if_true_0:
+L_if_else_1:
+L_if_end_1:
+L_if_end_0:
+    .loc 1 12 1
+    mov eax, 25
+    cmp rax, 20
+    jle L_if_else_2
+L_if_true_2:
+L_if_else_2:
+L_if_end_2:
+    .loc 1 18 1
+    mov eax, 15
+    ret
+L_if_else_0:
+    .loc 1 6 8
+    cmp rax, 10
+    jne L_if_else_1
+L_if_true_1:
+    .loc 1 7 5
+    jmp L_if_end_1
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .debug_abbrev,"",@progbits
+.Ldebug_abbrev0:
+    .uleb128 1
+    .uleb128 0x11
+    .byte 1
+    .uleb128 0x25
+    .uleb128 0x8
+    .uleb128 0x13
+    .uleb128 0x5
+    .uleb128 0x3
+    .uleb128 0x8
+    .uleb128 0x1b
+    .uleb128 0x8
+    .uleb128 0x11
+    .uleb128 0x1
+    .uleb128 0x12
+    .uleb128 0x7
+    .uleb128 0x10
+    .uleb128 0x17
+    .byte 0
+    .byte 0
+    .uleb128 2
+    .uleb128 0x2e
+    .byte 0
+    .uleb128 0x3
+    .uleb128 0x8
+    .uleb128 0x3f
+    .uleb128 0x19
+    .uleb128 0x11
+    .uleb128 0x1
+    .uleb128 0x12
+    .uleb128 0x7
+    .byte 0
+    .byte 0
+    .byte 0
+    .section .debug_info,"",@progbits
+    .long .Ldebug_info_end - .Ldebug_info_start
+.Ldebug_info_start:
+    .value 4
+    .long .Ldebug_abbrev0
+    .byte 8
+    .uleb128 1
+    .string "SEG compiler"
+    .value 0xc
+    .string "/root/repo/tests/codegen/debug_info.seg"
+    .string "/root/repo/_gate_build/codegen"
+    .quad main
+    .quad .Lmain_end - main
+    .long .Ldebug_line0
+    .uleb128 2
+    .string "main"
+    .quad main
+    .quad .Lmain_end - main
+    .byte 0
+.Ldebug_info_end:
+    .section .debug_line,"",@progbits
+.Ldebug_line0:
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,22 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    mov rax, -41
+    cmp rax, 7
+    mov eax, 7
+    cmp rax, 12
+    setne al
+    movzx eax, al
+    push rax
+    mov rax, -41
+    cmp rax, 12
+    pop rbx
+    mov rax, -6161
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,30 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    mov eax, 7
+    mov rsi, rax
+    mov eax, 7
+    mov rdi, rax
+    mov eax, 1
+    mov r8, rax
+    mov rax, rsi
+    add rax, rdi
+    mov r10, rax
+    mov rax, r8
+    test rax, rax
+    je L_if_end_0
+L_if_true_0:
+    mov rax, rsi
+    sub rax, 1
+    mov r11, rax
+L_if_end_0:
+    mov rax, rdi
+    add rax, rsi
+    mov r9, rax
+    mov rax, r9
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
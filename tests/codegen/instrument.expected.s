@@ -0,0 +1,125 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    inc qword ptr [rip + __seg_counters]
+    mov eax, 10
+    inc qword ptr [rip + __seg_counters + 8]
+    inc qword ptr [rip + __seg_counters + 16]
+    cmp rax, 10
+    jle L_if_else_0
+L_if_true_0:
+    inc qword ptr [rip + __seg_counters + 24]
+L_if_end_1:
+L_if_end_0:
+    inc qword ptr [rip + __seg_counters + 56]
+    mov eax, 25
+    cmp rax, 20
+    jle L_if_else_2
+L_if_true_2:
+    inc qword ptr [rip + __seg_counters + 64]
+    jmp L_if_end_2
+L_if_else_0:
+    inc qword ptr [rip + __seg_counters + 32]
+    cmp rax, 10
+    jne L_if_else_1
+L_if_true_1:
+    inc qword ptr [rip + __seg_counters + 40]
+    jmp L_if_end_1
+L_if_else_1:
+    inc qword ptr [rip + __seg_counters + 48]
+    jmp L_if_end_1
+L_if_else_2:
+    inc qword ptr [rip + __seg_counters + 72]
+L_if_end_2:
+    inc qword ptr [rip + __seg_counters + 80]
+    mov eax, 15
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .bss
+    .p2align 3
+__seg_counters: .zero 88
+    .section .rodata.str1.1,"aMS",@progbits,1
+L_profile_env: .string "SEG_PROFILE_FILE"
+L_profile_path: .string "codegen_instrument.profile"
+L_profile_mode: .string "w"
+L_profile_header: .string "# seg-profile v1\n# source: %s\n# id line kind count\n"
+L_profile_source: .string "/root/repo/tests/codegen/instrument.seg"
+L_profile_record: .string "%ld %d %.4s %lu\n"
+    .section .rodata
+    .p2align 2
+L_profile_sites:
+    .long 1
+    .ascii "stmt"
+    .long 2
+    .ascii "stmt"
+    .long 4
+    .ascii "stmt"
+    .long 5
+    .ascii "then"
+    .long 6
+    .ascii "else"
+    .long 7
+    .ascii "then"
+    .long 9
+    .ascii "else"
+    .long 12
+    .ascii "stmt"
+    .long 13
+    .ascii "then"
+    .long 15
+    .ascii "else"
+    .long 18
+    .ascii "stmt"
+    .text
+    .type __seg_profile_dump, @function
+__seg_profile_dump:
+    push rbx
+    push r12
+    push r13
+    lea rdi, [rip + L_profile_env]
+    call getenv@PLT
+    test rax, rax
+    jne L_profile_open
+    lea rax, [rip + L_profile_path]
+L_profile_open:
+    mov rdi, rax
+    lea rsi, [rip + L_profile_mode]
+    call fopen@PLT
+    test rax, rax
+    je L_profile_done
+    mov r12, rax
+    mov rdi, r12
+    lea rsi, [rip + L_profile_header]
+    lea rdx, [rip + L_profile_source]
+    xor eax, eax
+    call fprintf@PLT
+    lea r13, [rip + L_profile_sites]
+    xor ebx, ebx
+L_profile_loop:
+    mov rdi, r12
+    lea rsi, [rip + L_profile_record]
+    mov rdx, rbx
+    mov ecx, [r13 + rbx*8]
+    lea r8, [r13 + rbx*8 + 4]
+    lea rax, [rip + __seg_counters]
+    mov r9, [rax + rbx*8]
+    xor eax, eax
+    call fprintf@PLT
+    inc rbx
+    cmp rbx, 11
+    jb L_profile_loop
+    mov rdi, r12
+    call fclose@PLT
+L_profile_done:
+    pop r13
+    pop r12
+    pop rbx
+    ret
+    .size __seg_profile_dump, . - __seg_profile_dump
+    .section .fini_array,"aw"
+    .p2align 3
+    .quad __seg_profile_dump
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,61 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbp
+    mov rbp, rsp
+    sub rsp, 16
+    push r12
+    push r13
+    push r14
+    push r15
+    mov eax, 13
+    mov rsi, rax
+    mov rax, rsi
+    lea rax, [rax*8 + 3]
+    mov r8, rax
+    mov rax, rsi
+    shl rax, 2
+    add rax, r8
+    mov r9, rax
+    mov rax, rsi
+    lea rax, [rax + rax*2]
+    shl rax, 1
+    mov r10, rax
+    mov eax, 100
+    sub rax, rsi
+    mov r11, rax
+    cmp rsi, 4
+    setg al
+    movzx eax, al
+    mov rcx, rax
+    cmp rsi, 10
+    setg al
+    movzx eax, al
+    mov r13, rax
+    mov eax, 1
+    mov rdi, rax
+    mov rax, rdi
+    xor eax, 1
+    mov r14, rax
+    mov rax, rcx
+    and eax, edi
+    mov r15, rax
+    mov eax, 107
+    mov [rbp - 8], rax
+    mov rax, r9
+    add rax, r10
+    add rax, r11
+    mov r12, rax
+    mov rax, r12
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    mov rsp, rbp
+    pop rbp
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,177 @@
+    .intel_syntax noprefix
+    .section .rodata.cst8,"aM",@progbits,8
+    .p2align 3
+L_literal_7: .double 4.0
+L_literal_6: .double 3.5
+L_literal_5: .double 3.0
+L_literal_4: .double 2.5
+L_literal_3: .double 2.0
+L_literal_2: .double 1.5
+L_literal_1: .double 1.0
+L_literal_0: .double 0.5
+    .bss
+    .p2align 5
+pairs: .zero 128
+    .p2align 5
+samples: .zero 64
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    push r12
+    push r13
+    push r14
+    push r15
+    mov eax, 9
+    movsd xmm0, [rip + L_literal_0]
+    movsd xmm1, [rip + L_literal_1]
+    mov [rip + pairs], rax
+    mov eax, 2
+    movsd xmm2, [rip + L_literal_2]
+    movsd xmm3, [rip + L_literal_3]
+    mov [rip + pairs + 8], rax
+    mov eax, 8
+    movsd xmm4, [rip + L_literal_4]
+    movsd xmm5, [rip + L_literal_5]
+    mov [rip + pairs + 16], rax
+    mov eax, 3
+    movsd xmm6, [rip + L_literal_6]
+    mov [rip + pairs + 24], rax
+    mov eax, 7
+    mov [rip + pairs + 32], rax
+    mov eax, 1
+    mov [rip + pairs + 40], rax
+    mov eax, 6
+    mov [rip + pairs + 48], rax
+    mov eax, 4
+    mov [rip + pairs + 56], rax
+    mov eax, 5
+    mov [rip + pairs + 64], rax
+    mov [rip + pairs + 72], rax
+    mov eax, 4
+    movsd [rip + samples], xmm0
+    movsd xmm0, [rip + L_literal_7]
+    mov [rip + pairs + 80], rax
+    mov eax, 2
+    mov [rip + pairs + 88], rax
+    xor eax, eax
+    mov rdi, rax
+    lea rax, [rip + pairs]
+    movsd [rip + samples + 8], xmm1
+    mov r11, rax
+    mov eax, 6
+    movsd [rip + samples + 16], xmm2
+    mov r12, rax
+    xor eax, eax
+    movsd [rip + samples + 24], xmm3
+    movsd [rip + samples + 32], xmm4
+    cmp rax, 6
+    movsd [rip + samples + 40], xmm5
+    movsd [rip + samples + 48], xmm6
+    movsd [rip + samples + 56], xmm0
+    jge L_loop_end_0
+    .p2align 4,,15
+L_loop_body_0:
+    mov rcx, r11
+    mov rax, [rcx + 8]
+    push rax
+    mov rax, [rcx]
+    pop rbx
+    add rax, rdi
+    sub rax, rbx
+    mov rdi, rax
+    mov rax, rcx
+    add rax, 16
+    mov r11, rax
+    mov rax, r12
+    sub rax, 1
+    mov r12, rax
+    jne L_loop_body_0
+L_loop_end_0:
+    xor eax, eax
+    mov r8, rax
+    mov r13, rax
+    .p2align 4,,15
+L_loop_body_1:
+    add rax, 1
+    lea rcx, [rip + pairs]
+    mov rax, [rcx + rax*8]
+    add rax, r8
+    mov r8, rax
+    mov rax, r13
+    add rax, 1
+    mov r13, rax
+    cmp rax, 7
+    jl L_loop_body_1
+L_loop_end_1:
+    xor eax, eax
+    mov r14, rax
+    .p2align 4,,15
+L_loop_body_2:
+    shl rax, 1
+    lea rcx, [rip + samples]
+    lea rdx, [rip + samples]
+    movsd xmm0, [rcx + rax*8]
+    mov rcx, r14
+    mov rax, rcx
+    add rax, 1
+    mov r14, rax
+    cmp rax, 4
+    movsd [rdx + rcx*8], xmm0
+    jl L_loop_body_2
+L_loop_end_2:
+    xor eax, eax
+    mov r9, rax
+    mov eax, 1
+    mov rsi, rax
+    cmp rax, 6
+    jge L_loop_end_3
+    .p2align 4,,15
+L_loop_body_3:
+    lea rax, [rax + rax*2]
+    lea rcx, [rip + pairs]
+    mov rax, [rcx + rax*8 + 8]
+    push rax
+    mov rax, rsi
+    lea rax, [rax + rax*2]
+    pop rbx
+    mov rax, [rcx + rax*8]
+    add rax, r9
+    add rax, rbx
+    mov r9, rax
+    mov rax, rsi
+    add rax, 2
+    mov rsi, rax
+    cmp rax, 6
+    jl L_loop_body_3
+L_loop_end_3:
+    xor eax, eax
+    mov r10, rax
+    mov r15, rax
+    cmp rax, 6
+    jge L_loop_end_4
+L_loop_body_4:
+    lea rcx, [rip + pairs]
+    mov rax, [rcx + rax*8]
+    add rax, r10
+    mov r10, rax
+    mov rax, r15
+    add rax, 1
+    mov r15, rax
+    cmp rax, 6
+    jl L_loop_body_4
+L_loop_end_4:
+    mov rax, rdi
+    add rax, r8
+    add rax, r9
+    add rax, r10
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
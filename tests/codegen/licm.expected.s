@@ -0,0 +1,72 @@
+    .intel_syntax noprefix
+    .bss
+    .p2align 5
+hist: .zero 32
+    .text
+    .global main
+    .type main, @function
+main:
+    mov eax, 1
+    mov [rip + hist], rax
+    mov eax, 2
+    mov [rip + hist + 8], rax
+    mov eax, 3
+    mov [rip + hist + 16], rax
+    mov eax, 4
+    mov [rip + hist + 24], rax
+    xor eax, eax
+    mov rdi, rax
+    mov rax, [rip + hist + 8]
+    mov r10, rax
+    mov eax, 8
+    mov r11, rax
+    .p2align 4,,15
+L_loop_body_0:
+    mov rax, rdi
+    mov rdx, r10
+    add rax, 6
+    add rdx, 4
+    mov rdi, rax
+    mov rax, r11
+    mov r10, rdx
+    sub rax, 1
+    mov r11, rax
+    jne L_loop_body_0
+L_loop_end_0:
+    mov rax, r10
+    xor edx, edx
+    mov [rip + hist + 8], rax
+    mov r9, rdx
+    .p2align 4,,15
+L_loop_body_1:
+    mov edx, 3
+    xor eax, eax
+    add rdx, r9
+    mov rsi, rax
+    mov r8, rdx
+    .p2align 4,,15
+L_loop_body_2:
+    mov rax, rsi
+    lea rcx, [rip + hist]
+    mov rdx, rsi
+    mov rax, [rcx + rax*8]
+    sub rax, r8
+    add rax, rdi
+    add rdx, 1
+    mov rdi, rax
+    mov rsi, rdx
+    cmp rdx, 4
+    jl L_loop_body_2
+L_loop_end_2:
+    mov rax, r9
+    add rax, 1
+    mov r9, rax
+    cmp rax, 3
+    jl L_loop_body_1
+L_loop_end_1:
+    mov rax, rdi
+    add rax, [rip + hist + 8]
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,39 @@
+    .intel_syntax noprefix
+    .section .rodata.str1.1,"aMS",@progbits,1
+L_literal_2: .string "Hello SEG"
+    .section .rodata.cst8,"aM",@progbits,8
+    .p2align 3
+L_literal_1: .double 2.71
+L_literal_0: .double 3.14
+    .bss
+    .p2align 6
+pi: .zero 8
+e: .zero 8
+greeting: .zero 8
+again: .zero 8
+check: .zero 8
+letter: .zero 1
+flag: .zero 1
+    .text
+    .global main
+    .type main, @function
+main:
+    movsd xmm0, [rip + L_literal_0]
+    movsd [rip + pi], xmm0
+    movsd xmm0, [rip + L_literal_1]
+    movsd [rip + e], xmm0
+    mov rax, 120
+    mov [rip + letter], al
+    lea rax, [rip + L_literal_2]
+    mov [rip + greeting], rax
+    lea rax, [rip + L_literal_2]
+    mov [rip + again], rax
+    mov rax, 0
+    mov [rip + flag], al
+    mov rax, 7
+    mov [rip + check], rax
+    mov rax, [rip + check]
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,54 @@
+    .intel_syntax noprefix
+    .bss
+    .p2align 6
+a: .zero 8
+c: .zero 8
+result1: .zero 8
+result2: .zero 8
+result3: .zero 8
+check: .zero 1
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    mov rax, 10
+    mov [rip + a], rax
+    mov rax, 1
+    mov [rip + c], rax
+    cmp qword ptr [rip + c], 1
+    sete al
+    movzx rax, al
+    push rax
+    cmp qword ptr [rip + a], 20
+    setl al
+    movzx rax, al
+    pop rbx
+    and rax, rbx
+    mov [rip + result1], rax
+    cmp qword ptr [rip + c], 0
+    sete al
+    movzx rax, al
+    push rax
+    cmp qword ptr [rip + a], 5
+    setg al
+    movzx rax, al
+    pop rbx
+    or rax, rbx
+    mov [rip + result2], rax
+    cmp qword ptr [rip + result1], 0
+    sete al
+    movzx rax, al
+    xor rax, [rip + result2]
+    mov [rip + result3], rax
+    cmp qword ptr [rip + result3], 0
+    sete al
+    movzx rax, al
+    and rax, [rip + result1]
+    mov [rip + check], al
+    movzx eax, byte ptr [rip + check]
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
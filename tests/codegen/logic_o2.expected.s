@@ -0,0 +1,32 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    mov eax, 10
+    mov ecx, 1
+    mov rsi, rax
+    cmp rsi, 20
+    setl cl
+    movzx ecx, cl
+    and ecx, 1
+    xor eax, eax
+    cmp rsi, 5
+    push rax
+    setg al
+    mov rdi, rcx
+    pop rbx
+    movzx eax, al
+    or rax, rbx
+    mov r8, rax
+    mov rax, rdi
+    xor eax, 1
+    xor rax, r8
+    xor rax, 1
+    and eax, edi
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
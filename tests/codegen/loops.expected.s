@@ -0,0 +1,22 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    mov eax, 1
+    mov rsi, rax
+    cmp rax, 6
+    jge L_loop_end_0
+    .p2align 4,,15
+L_loop_body_0:
+    add rax, rax
+    mov rsi, rax
+    cmp rax, 6
+    jl L_loop_body_0
+L_loop_end_0:
+    mov eax, 6
+    add rax, rsi
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,21 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    mov eax, 1
+    test rax, rax
+    je L_if_else_0
+L_if_true_0:
+    mov eax, 10
+    jmp L_if_end_0
+L_if_else_0:
+    mov eax, 20
+L_if_end_0:
+    add rax, rax
+    add rax, 3
+    sub rax, 1
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
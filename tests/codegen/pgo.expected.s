@@ -0,0 +1,55 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    mov eax, 10
+    mov edx, 3
+    xor r11d, r11d
+    mov r8, rax
+    mov r9, rdx
+    mov rsi, r11
+    mov rdi, r11
+    cmp r8, 20
+    jg L_if_true_0
+L_if_else_0:
+    mov eax, 9
+    mov rsi, rax
+L_if_end_0:
+    cmp r9, 5
+    jge L_if_else_1
+L_if_true_1:
+    mov eax, 4
+    mov rdi, rax
+L_if_end_1:
+    mov eax, 10
+    mov edx, 3
+    cmp rax, 3
+    mov rcx, rdx
+    setg al
+    movzx eax, al
+    push rax
+    mov eax, 10
+    push rax
+    pop rax
+    cmp qword ptr [rsp], 0
+    cmove rax, rcx
+    pop rcx
+    mov r10, rax
+    mov rax, rsi
+    add rax, rdi
+    add rax, r10
+    ret
+    .pushsection .text.unlikely,"ax",@progbits
+    .type main.cold, @function
+main.cold:
+L_if_true_0:
+    jmp L_if_end_0
+L_if_else_1:
+    jmp L_if_end_1
+.Lmain_cold_end:
+    .size main.cold, .Lmain_cold_end - main.cold
+    .popsection
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,15 @@
+# seg-profile v1
+# source: pgo.seg
+# id line kind count
+0 1 stmt 100
+1 2 stmt 100
+2 4 stmt 100
+3 5 then 0
+4 7 else 100
+5 10 stmt 100
+6 11 then 100
+7 13 else 0
+8 16 stmt 100
+9 17 then 55
+10 19 else 45
+11 22 stmt 100
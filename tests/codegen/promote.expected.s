@@ -0,0 +1,51 @@
+    .intel_syntax noprefix
+    .section .rodata.cst8,"aM",@progbits,8
+    .p2align 3
+L_literal_1: .double 0.5
+L_literal_0: .double 1.5
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbp
+    mov rbp, rsp
+    sub rsp, 16
+    mov eax, 12
+    mov rdi, rax
+    movsd xmm0, [rip + L_literal_0]
+    movsd [rbp - 8], xmm0
+    xor eax, eax
+    mov rsi, rax
+    cmp rdi, 10
+    jle L_if_else_0
+L_if_true_0:
+    mov rax, rdi
+    shl rax, 1
+    mov rsi, rax
+    jmp L_if_end_0
+L_if_else_0:
+    movsd xmm0, [rip + L_literal_1]
+    movsd [rbp - 8], xmm0
+L_if_end_0:
+    xor eax, eax
+    mov r8, rax
+    cmp rsi, 20
+    jle L_if_end_1
+L_if_true_1:
+    mov rax, rsi
+    sub rax, 20
+    mov r8, rax
+L_if_end_1:
+    mov eax, 9
+    mov r10, rax
+    mov rax, rdi
+    add rax, rsi
+    add rax, r8
+    mov r9, rax
+    mov rax, r9
+    mov rsp, rbp
+    pop rbp
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,54 @@
+    .intel_syntax noprefix
+    .bss
+    .p2align 6
+a: .zero 8
+sum: .zero 8
+x: .zero 8
+y: .zero 8
+z: .zero 8
+check: .zero 8
+big: .zero 1
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    mov rax, 6
+    mov [rip + a], rax
+    mov rax, [rip + a]
+    add rax, 4
+    mov [rip + sum], rax
+    mov rax, [rip + a]
+    imul rax, rax, 2
+    mov [rip + x], rax
+    mov rax, [rip + a]
+    add rax, [rip + sum]
+    push rax
+    mov rax, [rip + a]
+    pop rbx
+    lea rax, [rbx + rax*2]
+    mov [rip + y], rax
+    mov rax, [rip + a]
+    imul rax, rax, 2
+    push rax
+    mov rax, [rip + a]
+    add rax, [rip + sum]
+    pop rbx
+    imul rax, rbx
+    mov [rip + z], rax
+    mov rax, [rip + a]
+    add rax, [rip + sum]
+    cmp rax, 10
+    setg al
+    movzx rax, al
+    mov [rip + big], al
+    mov rax, [rip + z]
+    sub rax, [rip + y]
+    sub rax, [rip + x]
+    mov [rip + check], rax
+    mov rax, [rip + check]
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
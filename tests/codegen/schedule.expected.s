@@ -0,0 +1,38 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    mov eax, 7
+    mov ecx, 9
+    mov r11d, 4
+    mov rsi, rax
+    mov eax, 7
+    mov rdi, rcx
+    mov r8, r11
+    cmp rax, 9
+    jle L_if_else_0
+L_if_true_0:
+    mov rax, -2
+    mov rsi, rax
+    jmp L_if_end_0
+L_if_else_0:
+    mov eax, 2
+    mov rdi, rax
+L_if_end_0:
+    mov rax, rsi
+    mov ecx, 4
+    imul rax, rdi
+    imul rcx, rsi
+    mov r9, rax
+    mov rax, rdi
+    cqo
+    mov r10, rcx
+    idiv r8
+    mov rax, r9
+    add rax, r10
+    sub rax, rdx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
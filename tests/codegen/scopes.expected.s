@@ -0,0 +1,79 @@
+    .intel_syntax noprefix
+    .bss
+    .p2align 6
+a: .zero 8
+b: .zero 8
+result: .zero 8
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbp
+    mov rbp, rsp
+    sub rsp, 32
+    mov rax, 7
+    mov [rip + a], rax
+    mov rax, 5
+    mov [rip + b], rax
+    mov rax, 0
+    mov [rip + result], rax
+    mov rax, [rip + a]
+    cmp rax, [rip + b]
+    setg al
+    movzx rax, al
+    cmp rax, 0
+    je L_if_else_0
+L_if_true_0:
+    mov rax, [rip + a]
+    sub rax, [rip + b]
+    mov [rbp - 8], rax
+    mov rax, [rbp - 8]
+    add rax, [rbp - 8]
+    mov [rbp - 16], rax
+    cmp qword ptr [rbp - 16], 3
+    setg al
+    movzx rax, al
+    cmp rax, 0
+    je L_if_end_1
+L_if_true_1:
+    mov rax, [rbp - 16]
+    sub rax, 3
+    mov [rbp - 24], rax
+    mov rax, [rip + result]
+    add rax, [rbp - 24]
+    mov [rip + result], rax
+    jmp L_if_end_1
+L_if_end_1:
+    mov rax, [rip + result]
+    add rax, [rbp - 16]
+    mov [rip + result], rax
+    jmp L_if_end_0
+L_if_else_0:
+    mov rax, [rip + b]
+    sub rax, [rip + a]
+    mov [rbp - 8], rax
+    mov rax, [rip + result]
+    add rax, [rbp - 8]
+    mov [rip + result], rax
+L_if_end_0:
+    cmp qword ptr [rip + b], 2
+    setg al
+    movzx rax, al
+    cmp rax, 0
+    je L_if_end_2
+L_if_true_2:
+    mov rax, [rip + b]
+    sub rax, 2
+    mov [rbp - 8], rax
+    mov rax, [rip + result]
+    add rax, [rbp - 8]
+    mov [rip + result], rax
+    jmp L_if_end_2
+L_if_end_2:
+    mov rax, [rip + result]
+    mov rsp, rbp
+    pop rbp
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
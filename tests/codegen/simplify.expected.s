@@ -0,0 +1,45 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    push r12
+    push r13
+    mov rax, -41
+    mov rsi, rax
+    mov rax, rsi
+    shr rax, 63
+    mov rdi, rax
+    mov rax, rsi
+    add rax, rsi
+    mov r8, rax
+    mov rax, rdi
+    mov rcx, rax
+    cmp rsi, 3
+    setl al
+    movzx eax, al
+    mov r12, rax
+    mov rax, rsi
+    add rax, 8
+    mov r9, rax
+    mov rax, rsi
+    lea rax, [rax + rax*2]
+    shl rax, 2
+    mov r10, rax
+    mov rax, rsi
+    add rax, 2
+    cmp rax, 10
+    setg al
+    movzx eax, al
+    mov r13, rax
+    mov rax, r8
+    add rax, r9
+    add rax, r10
+    mov r11, rax
+    mov rax, r11
+    pop r13
+    pop r12
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
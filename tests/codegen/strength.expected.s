@@ -0,0 +1,72 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    push r12
+    push r13
+    mov rax, -77
+    mov rsi, rax
+    mov eax, 1000003
+    mov rdi, rax
+    mov rax, rsi
+    mov rbx, rax
+    mov rax, 5270498306774157605
+    imul rbx
+    sar rdx, 1
+    mov rax, rdx
+    shr rax, 63
+    add rax, rdx
+    mov r8, rax
+    mov rax, rdi
+    mov rbx, rax
+    mov rax, 7378697629483820647
+    imul rbx
+    sar rdx, 2
+    mov rax, rdx
+    shr rax, 63
+    add rax, rdx
+    lea rax, [rax + rax*4]
+    shl rax, 1
+    sub rbx, rax
+    mov rax, rbx
+    mov r9, rax
+    mov rax, rsi
+    mov rdx, rax
+    shr rdx, 63
+    add rax, rdx
+    sar rax, 1
+    mov r10, rax
+    mov rax, rsi
+    mov rdx, rax
+    sar rdx, 63
+    shr rdx, 61
+    add rdx, rax
+    and rdx, -8
+    sub rax, rdx
+    mov r11, rax
+    mov rax, rsi
+    lea rax, [rax + rax*4]
+    shl rax, 1
+    mov rcx, rax
+    mov rax, rdi
+    mov rbx, rax
+    shl rax, 3
+    sub rax, rbx
+    mov r12, rax
+    mov rax, r8
+    add rax, r9
+    add rax, r10
+    add rax, r11
+    add rax, rcx
+    add rax, r12
+    mov r13, rax
+    mov rax, r13
+    pop r13
+    pop r12
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,74 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+    .type main, @function
+main:
+    push rbx
+    push r12
+    push r13
+    push r14
+    push r15
+    mov rax, -41
+    mov r9, rax
+    mov eax, 7
+    mov r10, rax
+    mov rax, r9
+    shr rax, 63
+    mov rsi, rax
+    test r10, r10
+    setge al
+    movzx eax, al
+    mov rdi, rax
+    mov rax, rsi
+    xor eax, 1
+    mov r8, rax
+    mov rax, rsi
+    cmp rax, rdi
+    setne al
+    movzx eax, al
+    mov r11, rax
+    mov rax, r8
+    cmp rax, rdi
+    sete al
+    movzx eax, al
+    mov rcx, rax
+    mov rax, r8
+    cmp rax, rdi
+    setl al
+    movzx eax, al
+    mov r12, rax
+    mov rax, rsi
+    cmp rax, r8
+    setle al
+    movzx eax, al
+    mov r13, rax
+    mov rbx, r10
+    mov rax, r9
+    xor rax, rbx
+    shr rax, 63
+    mov r14, rax
+    mov rax, r13
+    xor eax, 1
+    push rax
+    mov rax, rcx
+    xor eax, 1
+    push rax
+    mov rax, r11
+    xor eax, 1
+    pop rbx
+    and rax, rbx
+    and eax, r12d
+    pop rbx
+    and rax, rbx
+    and eax, r14d
+    mov r15, rax
+    mov rax, r15
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbx
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
@@ -0,0 +1,161 @@
+    .intel_syntax noprefix
+    .bss
+    .p2align 5
+data: .zero 64
+    .text
+    .global main
+    .type main, @function
+main:
+    push r12
+    push r13
+    push r14
+    push r15
+    mov eax, 3
+    mov edx, 1
+    mov [rip + data], rax
+    mov eax, 4
+    mov [rip + data + 16], rax
+    mov eax, 1
+    mov [rip + data + 24], rax
+    mov eax, 5
+    mov [rip + data + 32], rax
+    mov eax, 9
+    mov [rip + data + 40], rax
+    mov eax, 2
+    mov [rip + data + 48], rax
+    mov eax, 6
+    mov [rip + data + 56], rax
+    mov rax, [rip + data + 40]
+    mov [rip + data + 8], rdx
+    mov r13, rax
+    xor eax, eax
+    add rax, [rip + data]
+    add rax, [rip + data + 8]
+    add rax, [rip + data + 16]
+    add rax, [rip + data + 24]
+    add rax, [rip + data + 32]
+    add rax, r13
+    add rax, [rip + data + 48]
+    add rax, 6
+    mov r15, rax
+    xor eax, eax
+    mov rsi, rax
+    mov rdi, rax
+    mov rax, r13
+    sub rax, 3
+    mov r14, rax
+    cmp rax, r13
+    jle L_if_end_1
+L_if_true_1:
+    xor eax, eax
+    mov r14, rax
+L_if_end_1:
+    xor eax, eax
+    cmp rax, r14
+    jge L_loop_end_0
+    .p2align 4,,15
+L_loop_body_0:
+    mov rax, rdi
+    mov rdx, rsi
+    imul rax, rax
+    mov r8, rax
+    mov rax, rdi
+    add rdx, r8
+    add rax, 1
+    imul rax, rax
+    mov rsi, rdx
+    mov r8, rax
+    mov rax, rsi
+    add rax, r8
+    mov rsi, rax
+    mov rax, rdi
+    add rax, 2
+    imul rax, rax
+    mov r8, rax
+    mov rax, rsi
+    add rax, r8
+    mov rsi, rax
+    mov rax, rdi
+    add rax, 3
+    imul rax, rax
+    mov r8, rax
+    mov rax, rsi
+    add rax, r8
+    mov rsi, rax
+    mov rax, rdi
+    add rax, 4
+    mov rdi, rax
+    cmp rax, r14
+    jl L_loop_body_0
+L_loop_end_0:
+    mov rax, rdi
+    cmp rax, r13
+    jge L_loop_end_2
+    .p2align 4,,15
+L_loop_body_2:
+    imul rax, rax
+    mov rdx, rsi
+    mov r12, rax
+    mov rax, rdi
+    add rdx, r12
+    add rax, 1
+    mov rsi, rdx
+    mov rdi, rax
+    cmp rax, r13
+    jl L_loop_body_2
+L_loop_end_2:
+    xor eax, eax
+    mov edx, 10
+    mov r9, rax
+    mov r10, rdx
+    cmp rdx, 1
+    jle L_loop_end_3
+    .p2align 4,,15
+L_loop_body_3:
+    mov rax, r9
+    add rax, r10
+    mov r9, rax
+    mov rax, r10
+    sub rax, 1
+    add rax, r9
+    mov r9, rax
+    mov rax, r10
+    sub rax, 2
+    add rax, r9
+    mov r9, rax
+    mov rax, r10
+    sub rax, 3
+    mov r10, rax
+    cmp rax, 1
+    jg L_loop_body_3
+L_loop_end_3:
+    mov rax, r9
+    add rax, 1
+    xor edx, edx
+    mov r9, rax
+    mov rcx, rdx
+    mov r11, rdx
+    .p2align 4,,15
+L_loop_body_4:
+    mov rax, rcx
+    mov rdx, r11
+    add rax, r11
+    add rdx, 1
+    mov rcx, rax
+    mov r11, rdx
+    cmp rdx, 4
+    jl L_loop_body_4
+L_loop_end_4:
+    mov rax, r15
+    add rax, rsi
+    add rax, r9
+    add rax, rcx
+    add rax, 0
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    ret
+.Lmain_end:
+    .size main, .Lmain_end - main
+    .section .note.GNU-stack,"",@progbits
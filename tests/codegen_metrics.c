@@ -0,0 +1,554 @@
+/**
+ * @file codegen_metrics.c
+ * @brief Code-quality regression test for the SEG code generator.
+ *        Compiles every snippet in a directory, measures the emitted assembly
+ *        (instructions, loads, stores, push/pop, branches, data bytes outside debug
+ *        sections) and compares
+ *        the numbers with the checked-in baselines. Any metric that grows fails the
+ *        test and prints a diff of the offending assembly against the baseline.
+ *
+ *        Usage: codegen_metrics <seg> <snippet-dir> [--cc <compiler>] [--work <dir>] [--update]
+ *
+ *        For each <name>.seg the directory holds <name>.metrics (key/value lines) and
+ *        <name>.expected.s (the assembly the metrics were taken from). An optional
+ *        <name>.flags file holds extra compiler options (e.g. -O2), where %S stands for
+ *        the snippet directory (e.g. -fprofile-use=%S/<name>.profile). When a compiler
+ *        is given, the output is also linked and run and its exit status compared with
+ *        the optional "exit_code" baseline entry; the same program run in-process by
+ *        "seg --jit" must exit with the same status. The emitted assembly, logs, binaries
+ *        and any files the programs write go to the work directory, a new temporary
+ *        directory unless --work names one; the test runs with it as current directory.
+ * @author Dario Romandini
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_SNIPPETS 256
+
+typedef enum
+{
+    METRIC_INSTRUCTIONS,
+    METRIC_LOADS,
+    METRIC_STORES,
+    METRIC_PUSH_POP,
+    METRIC_BRANCHES,
+    METRIC_DATA_BYTES,
+    METRIC_COUNT
+} MetricKind;
+
+static const char *metric_names[METRIC_COUNT] = {
+    "instructions", "loads", "stores", "push_pop", "branches", "data_bytes"};
+
+typedef struct
+{
+    long values[METRIC_COUNT];
+    int exit_code; /**< Expected exit status, -1 when not recorded */
+} Metrics;
+
+static char *trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+static int starts_with(const char *s, const char *prefix)
+{
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+/* Counts the bytes a .string/.ascii operand occupies, honouring escapes. */
+static long string_directive_size(const char *operand, int terminated)
+{
+    const char *p = strchr(operand, '"');
+    long size = 0;
+    if (!p)
+        return 0;
+    for (p++; *p && *p != '"'; p++)
+    {
+        if (*p == '\\' && p[1])
+            p++;
+        size++;
+    }
+    return size + (terminated ? 1 : 0);
+}
+
+static long data_directive_size(const char *line)
+{
+    char directive[32] = {0};
+    sscanf(line, "%31s", directive);
+    const char *operand = line + strlen(directive);
+
+    if (strcmp(directive, ".quad") == 0 || strcmp(directive, ".double") == 0)
+        return 8;
+    if (strcmp(directive, ".long") == 0 || strcmp(directive, ".float") == 0 || strcmp(directive, ".int") == 0)
+        return 4;
+    if (strcmp(directive, ".word") == 0 || strcmp(directive, ".short") == 0 || strcmp(directive, ".value") == 0)
+        return 2;
+    if (strcmp(directive, ".byte") == 0)
+        return 1;
+    if (strcmp(directive, ".string") == 0 || strcmp(directive, ".asciz") == 0)
+        return string_directive_size(operand, 1);
+    if (strcmp(directive, ".ascii") == 0)
+        return string_directive_size(operand, 0);
+    if (strcmp(directive, ".zero") == 0 || strcmp(directive, ".skip") == 0 || strcmp(directive, ".space") == 0)
+        return strtol(operand, NULL, 0);
+    return 0;
+}
+
+/* Instructions whose first operand is only read, never written. */
+static int reads_first_operand_only(const char *mnemonic)
+{
+    return strcmp(mnemonic, "cmp") == 0 || strcmp(mnemonic, "test") == 0 ||
+           strcmp(mnemonic, "ucomisd") == 0 || strcmp(mnemonic, "comisd") == 0;
+}
+
+/* Instructions that overwrite their first operand without reading it. */
+static int writes_first_operand_only(const char *mnemonic)
+{
+    return starts_with(mnemonic, "mov") || starts_with(mnemonic, "set") ||
+           starts_with(mnemonic, "cvt") || strcmp(mnemonic, "lea") == 0;
+}
+
+static void count_instruction(const char *line, Metrics *metrics)
+{
+    char mnemonic[32] = {0};
+    sscanf(line, "%31s", mnemonic);
+    const char *operands = line + strlen(mnemonic);
+
+    metrics->values[METRIC_INSTRUCTIONS]++;
+
+    if (strcmp(mnemonic, "push") == 0 || strcmp(mnemonic, "pop") == 0)
+    {
+        metrics->values[METRIC_PUSH_POP]++;
+        return;
+    }
+    if (mnemonic[0] == 'j')
+    {
+        metrics->values[METRIC_BRANCHES]++;
+        return;
+    }
+    if (strcmp(mnemonic, "lea") == 0 || !strchr(operands, '['))
+        return;
+
+    /* Memory operand present: decide whether it is the destination. */
+    const char *comma = strchr(operands, ',');
+    const char *bracket = strchr(operands, '[');
+    int memory_is_first = !comma || bracket < comma;
+
+    if (!memory_is_first || reads_first_operand_only(mnemonic))
+    {
+        metrics->values[METRIC_LOADS]++;
+    }
+    else if (writes_first_operand_only(mnemonic))
+    {
+        metrics->values[METRIC_STORES]++;
+    }
+    else
+    {
+        /* Read-modify-write such as "add [x], rax" or "inc qword ptr [x]". */
+        metrics->values[METRIC_LOADS]++;
+        metrics->values[METRIC_STORES]++;
+    }
+}
+
+static int measure_assembly(const char *path, Metrics *metrics)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return 0;
+
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->exit_code = -1;
+
+    int in_text = 0, in_debug = 0;
+    char buffer[1024];
+    while (fgets(buffer, sizeof(buffer), file))
+    {
+        char *comment = strchr(buffer, '#');
+        if (comment && !strchr(buffer, '"'))
+            *comment = '\0';
+        char *line = trim(buffer);
+        if (*line == '\0' || line[strlen(line) - 1] == ':')
+            continue;
+
+        /* A label may share its line with a data directive ("x: .quad 0"). */
+        char *colon = strchr(line, ':');
+        if (colon && !strchr(line, '"') && !strchr(line, '['))
+            line = trim(colon + 1);
+        else if (colon && strchr(line, '"') && colon < strchr(line, '"'))
+            line = trim(colon + 1);
+
+        if (line[0] == '.')
+        {
+            if (strcmp(line, ".text") == 0 || starts_with(line, ".section .text"))
+                in_text = 1, in_debug = 0;
+            else if (strcmp(line, ".data") == 0 || strcmp(line, ".bss") == 0 || starts_with(line, ".section"))
+                in_text = 0, in_debug = starts_with(line, ".section .debug");
+            else if (!in_text && !in_debug)
+                metrics->values[METRIC_DATA_BYTES] += data_directive_size(line);
+            continue;
+        }
+
+        if (in_text)
+            count_instruction(line, metrics);
+    }
+
+    fclose(file);
+    return 1;
+}
+
+static int read_baseline(const char *path, Metrics *metrics)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return 0;
+
+    for (int i = 0; i < METRIC_COUNT; i++)
+        metrics->values[i] = -1;
+    metrics->exit_code = -1;
+
+    char key[64];
+    long value;
+    while (fscanf(file, "%63s %ld", key, &value) == 2)
+    {
+        if (strcmp(key, "exit_code") == 0)
+        {
+            metrics->exit_code = (int)value;
+            continue;
+        }
+        for (int i = 0; i < METRIC_COUNT; i++)
+        {
+            if (strcmp(key, metric_names[i]) == 0)
+                metrics->values[i] = value;
+        }
+    }
+
+    fclose(file);
+    return 1;
+}
+
+static int write_baseline(const char *path, const Metrics *metrics, int exit_code)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return 0;
+    for (int i = 0; i < METRIC_COUNT; i++)
+        fprintf(file, "%s %ld\n", metric_names[i], metrics->values[i]);
+    if (exit_code >= 0)
+        fprintf(file, "exit_code %d\n", exit_code);
+    fclose(file);
+    return 1;
+}
+
+static int copy_file(const char *from, const char *to)
+{
+    FILE *in = fopen(from, "r");
+    FILE *out = in ? fopen(to, "w") : NULL;
+    if (!out)
+    {
+        if (in)
+            fclose(in);
+        return 0;
+    }
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        fwrite(buffer, 1, n, out);
+    fclose(in);
+    fclose(out);
+    return 1;
+}
+
+static int run_command(const char *command)
+{
+    int status = system(command);
+    if (status == -1 || !WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+/* Reads the optional one-line flags file of a snippet, replacing %S with the snippet directory. */
+static void read_flags(const char *path, const char *dir, char *flags, size_t size)
+{
+    char line[256] = {0};
+    flags[0] = '\0';
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return;
+    if (fgets(line, sizeof(line), file))
+        line[strcspn(line, "\r\n")] = '\0';
+    fclose(file);
+
+    size_t used = 0;
+    for (const char *p = line; *p && used + 1 < size; p++)
+    {
+        if (p[0] == '%' && p[1] == 'S')
+        {
+            used += snprintf(flags + used, size - used, "%s", dir);
+            if (used >= size)
+                used = size - 1;
+            p++;
+        }
+        else
+        {
+            flags[used++] = *p;
+        }
+    }
+    flags[used] = '\0';
+}
+
+/* snprintf that reports whether the text fit, so that no cut-off path or command is used. */
+static int format(char *out, size_t size, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(out, size, fmt, args);
+    va_end(args);
+    return length >= 0 && (size_t)length < size;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Compiles, measures and (optionally) runs a single snippet. Returns 1 on success. */
+static int check_snippet(const char *seg, const char *dir, const char *name, const char *cc, int update)
+{
+    char source[PATH_MAX], baseline[PATH_MAX], expected_asm[PATH_MAX], flags_path[PATH_MAX];
+    char output[PATH_MAX], jit_output[PATH_MAX], log[PATH_MAX], binary[PATH_MAX];
+    char flags[2 * PATH_MAX], command[6 * PATH_MAX];
+
+    if (!format(source, sizeof(source), "%s/%s.seg", dir, name) ||
+        !format(baseline, sizeof(baseline), "%s/%s.metrics", dir, name) ||
+        !format(expected_asm, sizeof(expected_asm), "%s/%s.expected.s", dir, name) ||
+        !format(flags_path, sizeof(flags_path), "%s/%s.flags", dir, name) ||
+        !format(output, sizeof(output), "codegen_%s.s", name) ||
+        !format(jit_output, sizeof(jit_output), "codegen_%s.jit.s", name) ||
+        !format(log, sizeof(log), "codegen_%s.log", name) ||
+        !format(binary, sizeof(binary), "./codegen_%s.bin", name))
+    {
+        printf("FAIL %s: path too long\n", name);
+        return 0;
+    }
+    read_flags(flags_path, dir, flags, sizeof(flags));
+
+    if (!format(command, sizeof(command), "\"%s\" %s -o \"%s\" \"%s\" > \"%s\" 2>&1", seg, flags, output,
+                source, log))
+    {
+        printf("FAIL %s: command too long\n", name);
+        return 0;
+    }
+    if (run_command(command) != 0)
+    {
+        printf("FAIL %s: compiler exited with an error (see %s)\n", name, log);
+        return 0;
+    }
+
+    Metrics actual;
+    if (!measure_assembly(output, &actual))
+    {
+        printf("FAIL %s: cannot read %s\n", name, output);
+        return 0;
+    }
+
+    int exit_code = -1;
+    if (cc)
+    {
+        if (!format(command, sizeof(command), "%s \"%s\" -o \"%s\" >> \"%s\" 2>&1", cc, output, binary, log) ||
+            run_command(command) != 0)
+        {
+            printf("FAIL %s: emitted assembly does not assemble/link (see %s)\n", name, log);
+            return 0;
+        }
+        exit_code = run_command(binary);
+
+        int jit_exit_code = -1;
+        if (format(command, sizeof(command), "\"%s\" %s --jit -o \"%s\" \"%s\" >> \"%s\" 2>&1", seg, flags,
+                   jit_output, source, log))
+            jit_exit_code = run_command(command);
+        if (jit_exit_code != exit_code)
+        {
+            printf("FAIL %s: program exited with %d in-process (--jit) but %d when linked (see %s)\n",
+                   name, jit_exit_code, exit_code, log);
+            return 0;
+        }
+    }
+
+    Metrics expected;
+    int have_baseline = read_baseline(baseline, &expected);
+
+    if (update)
+    {
+        if (!have_baseline || expected.exit_code < 0 || exit_code == expected.exit_code)
+        {
+            int recorded = have_baseline && expected.exit_code >= 0 ? expected.exit_code : exit_code;
+            write_baseline(baseline, &actual, recorded);
+            copy_file(output, expected_asm);
+            printf("UPDATED %s\n", name);
+            return 1;
+        }
+        printf("FAIL %s: refusing to update, exit code %d differs from recorded %d\n",
+               name, exit_code, expected.exit_code);
+        return 0;
+    }
+
+    if (!have_baseline)
+    {
+        printf("FAIL %s: missing baseline %s (run with --update)\n", name, baseline);
+        return 0;
+    }
+
+    int ok = 1, improved = 0;
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        if (expected.values[i] < 0)
+            continue;
+        if (actual.values[i] > expected.values[i])
+        {
+            printf("FAIL %s: %s regressed %ld -> %ld\n", name, metric_names[i], expected.values[i], actual.values[i]);
+            ok = 0;
+        }
+        else if (actual.values[i] < expected.values[i])
+        {
+            improved = 1;
+        }
+    }
+
+    if (cc && expected.exit_code >= 0 && exit_code != expected.exit_code)
+    {
+        printf("FAIL %s: program exited with %d, expected %d\n", name, exit_code, expected.exit_code);
+        ok = 0;
+    }
+
+    if (!ok)
+    {
+        printf("---- diff %s %s ----\n", expected_asm, output);
+        fflush(stdout);
+        if (!format(command, sizeof(command), "diff -u \"%s\" \"%s\"", expected_asm, output) ||
+            run_command(command) < 0)
+        {
+            if (format(command, sizeof(command), "cat \"%s\"", output))
+                run_command(command);
+        }
+        return 0;
+    }
+
+    printf("ok   %s%s\n", name, improved ? " (improved; refresh the baseline with --update)" : "");
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s <seg> <snippet-dir> [--cc <compiler>] [--work <dir>] [--update]\n", argv[0]);
+        return 1;
+    }
+
+    /* The paths given may be relative to the directory the test was started from. */
+    char seg[PATH_MAX], dir[PATH_MAX], cc_path[PATH_MAX], work[PATH_MAX];
+    if (!realpath(argv[1], seg) || !realpath(argv[2], dir))
+    {
+        perror("Failed to resolve the compiler or snippet directory");
+        return 1;
+    }
+    const char *cc = NULL;
+    const char *work_arg = NULL;
+    int update = 0;
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+            update = 1;
+        else if (strcmp(argv[i], "--cc") == 0 && i + 1 < argc)
+            cc = argv[++i];
+        else if (strcmp(argv[i], "--work") == 0 && i + 1 < argc)
+            work_arg = argv[++i];
+    }
+    /* A compiler given as a path rather than a name looked up in PATH. */
+    if (cc && strchr(cc, '/'))
+    {
+        if (!realpath(cc, cc_path))
+        {
+            perror("Failed to resolve the C compiler");
+            return 1;
+        }
+        cc = cc_path;
+    }
+
+    if (work_arg)
+    {
+        if (mkdir(work_arg, 0777) != 0 && errno != EEXIST)
+        {
+            perror("Failed to create the work directory");
+            return 1;
+        }
+        format(work, sizeof(work), "%s", work_arg);
+    }
+    else
+    {
+        const char *tmp = getenv("TMPDIR");
+        if (!format(work, sizeof(work), "%s/codegen_metrics.XXXXXX", tmp && *tmp ? tmp : "/tmp") || !mkdtemp(work))
+        {
+            perror("Failed to create a work directory");
+            return 1;
+        }
+    }
+    if (chdir(work) != 0)
+    {
+        perror("Failed to enter the work directory");
+        return 1;
+    }
+
+    DIR *directory = opendir(dir);
+    if (!directory)
+    {
+        perror("Failed to open snippet directory");
+        return 1;
+    }
+
+    char *names[MAX_SNIPPETS];
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(directory)) && count < MAX_SNIPPETS)
+    {
+        size_t len = strlen(entry->d_name);
+        if (len > 4 && strcmp(entry->d_name + len - 4, ".seg") == 0)
+        {
+            names[count] = malloc(len - 3);
+            memcpy(names[count], entry->d_name, len - 4);
+            names[count][len - 4] = '\0';
+            count++;
+        }
+    }
+    closedir(directory);
+    qsort(names, count, sizeof(char *), compare_names);
+
+    int failures = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (!check_snippet(seg, dir, names[i], cc, update))
+            failures++;
+        free(names[i]);
+    }
+
+    printf("%d snippet(s), %d failure(s); output in %s\n", count, failures, work);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,679 @@
+/**
+ * @file rulegen.c
+ * @brief Build-time generator for the algebraic simplifier of the SEG compiler.
+ *        Reads the declarative rewrite rules of src/simplify.rules and writes C code
+ *        that matches them: one straight-line matcher per rule and operand order (the
+ *        orders of commutative operators are expanded here, so matching never
+ *        backtracks), a builder per rule, and a dispatcher switching on the root operator.
+ * @author Dario Romandini
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_RULES 256
+#define MAX_VARIANTS 16
+#define MAX_NAMES 8
+#define MAX_GUARDS 8
+#define MAX_LINE 512
+#define MAX_ATOM 32
+
+typedef enum
+{
+    PAT_OP,      ///< Operator node
+    PAT_VAR,     ///< Expression variable (x, y, b)
+    PAT_CONST,   ///< Integer literal variable (c1, c2)
+    PAT_INT,     ///< Integer literal with a value
+    PAT_BOOL,    ///< Boolean literal
+    PAT_COMPUTE  ///< Constant computed from bound constants (replacements only)
+} PatternKind;
+
+typedef struct Pattern
+{
+    PatternKind kind;
+    const char *token;          ///< TOKEN_* name of an operator
+    int commutative;            ///< Operator is commutative
+    int arity;                  ///< 1 or 2 for operators
+    struct Pattern *child[2];
+    char name[MAX_ATOM];        ///< Variable name
+    long long value;            ///< Literal value
+    char compute_op;            ///< '+', '-', '*' or 'n' (negate) for PAT_COMPUTE
+    char compute_args[2][MAX_ATOM];
+} Pattern;
+
+typedef struct
+{
+    char function[MAX_ATOM]; ///< int, bool, pure or nonconst
+    char name[MAX_ATOM];
+} Guard;
+
+typedef struct
+{
+    char name[64];
+    char text[MAX_LINE];
+    Pattern *pattern;
+    Pattern *replacement;
+    Guard guards[MAX_GUARDS];
+    int guard_count;
+    int exact;
+    Pattern *variants[MAX_VARIANTS];
+    int variant_count;
+    char expr_names[MAX_NAMES][MAX_ATOM];
+    int expr_count;
+    char const_names[MAX_NAMES][MAX_ATOM];
+    int const_count;
+} Rule;
+
+static const struct
+{
+    const char *symbol;
+    const char *token;
+    int arity;
+    int commutative;
+} operators[] = {
+    {"+", "TOKEN_PLUS", 2, 1},   {"-", "TOKEN_MINUS", 2, 0}, {"*", "TOKEN_STAR", 2, 1},
+    {"/", "TOKEN_SLASH", 2, 0},  {"%", "TOKEN_PERCENT", 2, 0}, {"==", "TOKEN_EQ", 2, 1},
+    {"!=", "TOKEN_NEQ", 2, 1},   {"<", "TOKEN_LT", 2, 0},    {"<=", "TOKEN_LEQ", 2, 0},
+    {">", "TOKEN_GT", 2, 0},     {">=", "TOKEN_GEQ", 2, 0},  {"&", "TOKEN_AND", 2, 1},
+    {"|", "TOKEN_OR", 2, 1},     {"^", "TOKEN_XOR", 2, 1},   {"!", "TOKEN_NOT", 1, 0},
+};
+
+#define OPERATOR_COUNT (int)(sizeof(operators) / sizeof(operators[0]))
+
+static Rule rules[MAX_RULES];
+static int rule_count;
+static const char *rules_path;
+static int line_number;
+
+static void fail(const char *message, const char *detail)
+{
+    fprintf(stderr, "[Rulegen Error] %s:%d: %s%s%s\n", rules_path, line_number, message,
+            detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+static void skip_spaces(const char **p)
+{
+    while (isspace((unsigned char)**p))
+        (*p)++;
+}
+
+/* Reads a run of non-space, non-parenthesis characters into a buffer of MAX_ATOM bytes. */
+static void read_atom(const char **p, char *atom)
+{
+    size_t length = 0;
+    while (**p && !isspace((unsigned char)**p) && **p != '(' && **p != ')' && **p != '{' && **p != '}')
+    {
+        if (length + 1 == MAX_ATOM)
+            fail("name or literal too long", *p - length);
+        atom[length++] = **p;
+        (*p)++;
+    }
+    atom[length] = '\0';
+}
+
+static Pattern *new_pattern(PatternKind kind)
+{
+    Pattern *pattern = calloc(1, sizeof(Pattern));
+    pattern->kind = kind;
+    return pattern;
+}
+
+static int is_const_name(const char *name)
+{
+    return name[0] == 'c' && isdigit((unsigned char)name[1]);
+}
+
+static Pattern *parse_pattern(const char **p, int replacement)
+{
+    char atom[MAX_ATOM];
+    skip_spaces(p);
+
+    if (**p == '(')
+    {
+        (*p)++;
+        skip_spaces(p);
+        read_atom(p, atom);
+        Pattern *node = new_pattern(PAT_OP);
+        for (int i = 0; i < OPERATOR_COUNT; i++)
+        {
+            if (strcmp(operators[i].symbol, atom) == 0)
+            {
+                node->token = operators[i].token;
+                node->arity = operators[i].arity;
+                node->commutative = operators[i].commutative;
+            }
+        }
+        if (!node->token)
+            fail("unknown operator", atom);
+        for (int i = 0; i < node->arity; i++)
+            node->child[i] = parse_pattern(p, replacement);
+        skip_spaces(p);
+        if (**p != ')')
+            fail("expected ')'", *p);
+        (*p)++;
+        return node;
+    }
+
+    if (**p == '{')
+    {
+        if (!replacement)
+            fail("computed constants are only allowed in replacements", NULL);
+        (*p)++;
+        Pattern *node = new_pattern(PAT_COMPUTE);
+        skip_spaces(p);
+        if (**p == '-')
+        {
+            (*p)++;
+            node->compute_op = 'n';
+            read_atom(p, node->compute_args[0]);
+        }
+        else
+        {
+            read_atom(p, node->compute_args[0]);
+            skip_spaces(p);
+            node->compute_op = **p;
+            if (node->compute_op != '+' && node->compute_op != '-' && node->compute_op != '*')
+                fail("computed constants support +, - and *", *p);
+            (*p)++;
+            skip_spaces(p);
+            read_atom(p, node->compute_args[1]);
+        }
+        skip_spaces(p);
+        if (**p != '}')
+            fail("expected '}'", *p);
+        (*p)++;
+        return node;
+    }
+
+    read_atom(p, atom);
+    if (atom[0] == '\0')
+        fail("expected an expression", *p);
+
+    Pattern *node;
+    if (strcmp(atom, "true") == 0 || strcmp(atom, "false") == 0)
+    {
+        node = new_pattern(PAT_BOOL);
+        node->value = atom[0] == 't';
+    }
+    else if (isdigit((unsigned char)atom[0]) || atom[0] == '-')
+    {
+        char *end;
+        node = new_pattern(PAT_INT);
+        node->value = strtoll(atom, &end, 10);
+        if (*end)
+            fail("bad integer literal", atom);
+    }
+    else
+    {
+        node = new_pattern(is_const_name(atom) ? PAT_CONST : PAT_VAR);
+        snprintf(node->name, sizeof(node->name), "%s", atom);
+    }
+    return node;
+}
+
+static Pattern *copy_pattern(const Pattern *pattern)
+{
+    Pattern *copy = malloc(sizeof(Pattern));
+    *copy = *pattern;
+    for (int i = 0; i < pattern->arity; i++)
+        copy->child[i] = copy_pattern(pattern->child[i]);
+    return copy;
+}
+
+static void pattern_string(const Pattern *pattern, char *out, size_t size)
+{
+    char left[MAX_LINE], right[MAX_LINE];
+    int length;
+    switch (pattern->kind)
+    {
+    case PAT_OP:
+        pattern_string(pattern->child[0], left, sizeof(left));
+        if (pattern->arity == 2)
+        {
+            pattern_string(pattern->child[1], right, sizeof(right));
+            length = snprintf(out, size, "(%s %s %s)", pattern->token, left, right);
+        }
+        else
+            length = snprintf(out, size, "(%s %s)", pattern->token, left);
+        /* Variants are told apart by this text, so it must not be cut short. */
+        if (length < 0 || (size_t)length >= size)
+            fail("pattern too long", NULL);
+        break;
+    case PAT_INT:
+        snprintf(out, size, "%lld", pattern->value);
+        break;
+    case PAT_BOOL:
+        snprintf(out, size, "%s", pattern->value ? "true" : "false");
+        break;
+    default:
+        snprintf(out, size, "%s", pattern->name);
+        break;
+    }
+}
+
+/* Expands every operand order of the commutative operators in a pattern. */
+static int expand_orders(const Pattern *pattern, int exact, Pattern **out, int max)
+{
+    if (pattern->kind != PAT_OP)
+    {
+        out[0] = copy_pattern(pattern);
+        return 1;
+    }
+
+    Pattern *lefts[MAX_VARIANTS], *rights[MAX_VARIANTS] = {NULL};
+    int left_count = expand_orders(pattern->child[0], exact, lefts, max);
+    int right_count = pattern->arity == 2 ? expand_orders(pattern->child[1], exact, rights, max) : 1;
+    int count = 0;
+
+    for (int swap = 0; swap <= (pattern->commutative && !exact); swap++)
+    {
+        for (int l = 0; l < left_count; l++)
+        {
+            for (int r = 0; r < right_count; r++)
+            {
+                if (count == max)
+                    fail("too many operand orders", NULL);
+                Pattern *node = copy_pattern(pattern);
+                node->child[0] = copy_pattern(swap ? rights[r] : lefts[l]);
+                if (pattern->arity == 2)
+                    node->child[1] = copy_pattern(swap ? lefts[l] : rights[r]);
+                out[count++] = node;
+            }
+        }
+    }
+    return count;
+}
+
+static int name_index(char names[][MAX_ATOM], int *count, const char *name, int add)
+{
+    for (int i = 0; i < *count; i++)
+    {
+        if (strcmp(names[i], name) == 0)
+            return i;
+    }
+    if (!add)
+        return -1;
+    if (*count == MAX_NAMES)
+        fail("too many variables", name);
+    snprintf(names[*count], MAX_ATOM, "%s", name);
+    return (*count)++;
+}
+
+static void collect_names(Rule *rule, const Pattern *pattern)
+{
+    if (pattern->kind == PAT_VAR)
+        name_index(rule->expr_names, &rule->expr_count, pattern->name, 1);
+    else if (pattern->kind == PAT_CONST)
+        name_index(rule->const_names, &rule->const_count, pattern->name, 1);
+    for (int i = 0; i < (pattern->kind == PAT_OP ? pattern->arity : 0); i++)
+        collect_names(rule, pattern->child[i]);
+}
+
+static void check_bound(Rule *rule, const Pattern *pattern)
+{
+    if (pattern->kind == PAT_VAR && name_index(rule->expr_names, &rule->expr_count, pattern->name, 0) < 0)
+        fail("replacement uses an unbound variable", pattern->name);
+    if (pattern->kind == PAT_CONST && name_index(rule->const_names, &rule->const_count, pattern->name, 0) < 0)
+        fail("replacement uses an unbound constant", pattern->name);
+    if (pattern->kind == PAT_COMPUTE)
+    {
+        for (int i = 0; i < (pattern->compute_op == 'n' ? 1 : 2); i++)
+        {
+            if (name_index(rule->const_names, &rule->const_count, pattern->compute_args[i], 0) < 0)
+                fail("computed constant uses an unbound constant", pattern->compute_args[i]);
+        }
+    }
+    for (int i = 0; i < (pattern->kind == PAT_OP ? pattern->arity : 0); i++)
+        check_bound(rule, pattern->child[i]);
+}
+
+static void parse_guards(Rule *rule, const char *p)
+{
+    char word[MAX_ATOM];
+    for (;;)
+    {
+        skip_spaces(&p);
+        if (!*p)
+            return;
+        if (*p == ',')
+        {
+            p++;
+            continue;
+        }
+        read_atom(&p, word);
+        if (strcmp(word, "exact") == 0)
+        {
+            rule->exact = 1;
+            continue;
+        }
+        if (strcmp(word, "if") == 0)
+            continue;
+        if (*p != '(')
+            fail("expected a guard", word);
+        if (strcmp(word, "int") != 0 && strcmp(word, "bool") != 0 && strcmp(word, "pure") != 0 &&
+            strcmp(word, "nonconst") != 0)
+            fail("unknown guard", word);
+        if (rule->guard_count == MAX_GUARDS)
+            fail("too many guards", NULL);
+        Guard *guard = &rule->guards[rule->guard_count++];
+        snprintf(guard->function, sizeof(guard->function), "%s", word);
+        p++;
+        read_atom(&p, guard->name);
+        if (*p != ')')
+            fail("expected ')' after the guard argument", p);
+        p++;
+        if (name_index(rule->expr_names, &rule->expr_count, guard->name, 0) < 0)
+            fail("guard uses an unbound variable", guard->name);
+    }
+}
+
+static void parse_rule(const char *line)
+{
+    if (rule_count == MAX_RULES)
+        fail("too many rules", NULL);
+    Rule *rule = &rules[rule_count];
+    memset(rule, 0, sizeof(*rule));
+
+    const char *colon = strchr(line, ':');
+    const char *arrow = strstr(line, "=>");
+    if (!colon || !arrow || arrow < colon)
+        fail("expected 'Name: pattern => replacement'", line);
+
+    const char *p = line;
+    skip_spaces(&p);
+    if (colon - p >= (long)sizeof(rule->name))
+        fail("rule name too long", line);
+    snprintf(rule->name, sizeof(rule->name), "%.*s", (int)(colon - p), p);
+    for (char *c = rule->name; *c; c++)
+    {
+        if (!isalnum((unsigned char)*c) && *c != '_')
+            fail("rule names must be identifiers", rule->name);
+    }
+    for (int i = 0; i < rule_count; i++)
+    {
+        if (strcmp(rules[i].name, rule->name) == 0)
+            fail("duplicate rule name", rule->name);
+    }
+
+    p = colon + 1;
+    rule->pattern = parse_pattern(&p, 0);
+    if (rule->pattern->kind != PAT_OP)
+        fail("a pattern must start with an operator", NULL);
+    skip_spaces(&p);
+    if (p != arrow)
+        fail("unexpected text before '=>'", p);
+    p = arrow + 2;
+    rule->replacement = parse_pattern(&p, 1);
+
+    collect_names(rule, rule->pattern);
+    check_bound(rule, rule->replacement);
+    parse_guards(rule, p);
+
+    /* The readable form used in remarks: pattern => replacement. */
+    const char *guard = strstr(arrow, " if ");
+    const char *end = guard ? guard : arrow + strlen(arrow);
+    while (end > arrow && isspace((unsigned char)end[-1]))
+        end--;
+    const char *start = colon + 1;
+    skip_spaces(&start);
+    int length = 0;
+    for (const char *c = start; c < end && length + 1 < (int)sizeof(rule->text); c++)
+    {
+        if (isspace((unsigned char)*c) && length > 0 && rule->text[length - 1] == ' ')
+            continue;
+        rule->text[length++] = isspace((unsigned char)*c) ? ' ' : *c;
+    }
+    rule->text[length] = '\0';
+    if (strstr(rule->text, " exact"))
+        *strstr(rule->text, " exact") = '\0';
+
+    /* Expand operand orders, dropping duplicates such as (== x x) swapped. */
+    Pattern *variants[MAX_VARIANTS];
+    int count = expand_orders(rule->pattern, rule->exact, variants, MAX_VARIANTS);
+    for (int i = 0; i < count; i++)
+    {
+        char text[MAX_LINE], other[MAX_LINE];
+        int duplicate = 0;
+        pattern_string(variants[i], text, sizeof(text));
+        for (int j = 0; j < rule->variant_count; j++)
+        {
+            pattern_string(rule->variants[j], other, sizeof(other));
+            duplicate |= strcmp(text, other) == 0;
+        }
+        if (!duplicate)
+            rule->variants[rule->variant_count++] = variants[i];
+    }
+    rule_count++;
+}
+
+/* Emits the checks matching pattern against the C expression path. */
+static void emit_match(FILE *out, Rule *rule, const Pattern *pattern, const char *path, int *bound_exprs,
+                       int *bound_consts)
+{
+    char child[MAX_LINE];
+    switch (pattern->kind)
+    {
+    case PAT_OP:
+        if (pattern->arity == 2)
+        {
+            fprintf(out, "    if (!rule_binary_op(%s, %s))\n        return 0;\n", path, pattern->token);
+            snprintf(child, sizeof(child), "%s->binary_expr.left", path);
+            emit_match(out, rule, pattern->child[0], child, bound_exprs, bound_consts);
+            snprintf(child, sizeof(child), "%s->binary_expr.right", path);
+            emit_match(out, rule, pattern->child[1], child, bound_exprs, bound_consts);
+        }
+        else
+        {
+            fprintf(out, "    if (!rule_unary_op(%s, %s))\n        return 0;\n", path, pattern->token);
+            snprintf(child, sizeof(child), "%s->unary_expr.operand", path);
+            emit_match(out, rule, pattern->child[0], child, bound_exprs, bound_consts);
+        }
+        break;
+    case PAT_VAR:
+    {
+        int index = name_index(rule->expr_names, &rule->expr_count, pattern->name, 0);
+        if (bound_exprs[index])
+            fprintf(out, "    if (!rule_same(b->expr[%d], %s))\n        return 0;\n", index, path);
+        else
+            fprintf(out, "    b->expr[%d] = %s;\n", index, path);
+        bound_exprs[index] = 1;
+        break;
+    }
+    case PAT_CONST:
+    {
+        int index = name_index(rule->const_names, &rule->const_count, pattern->name, 0);
+        if (bound_consts[index])
+            fprintf(out, "    if (!rule_int_value(%s, b->value[%d]))\n        return 0;\n", path, index);
+        else
+            fprintf(out, "    if (!rule_int_literal(%s, &b->value[%d]))\n        return 0;\n", path, index);
+        bound_consts[index] = 1;
+        break;
+    }
+    case PAT_INT:
+        fprintf(out, "    if (!rule_int_value(%s, %lldLL))\n        return 0;\n", path, pattern->value);
+        break;
+    case PAT_BOOL:
+        fprintf(out, "    if (!rule_bool_value(%s, %lld))\n        return 0;\n", path, pattern->value);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Emits a C expression building the replacement; nested constants are integers. */
+static void emit_build(FILE *out, Rule *rule, const Pattern *pattern, int top)
+{
+    const char *constant = top ? "rule_constant" : "rule_integer";
+    switch (pattern->kind)
+    {
+    case PAT_OP:
+        if (pattern->arity == 2)
+        {
+            fprintf(out, "rule_binary(%s, ", pattern->token);
+            emit_build(out, rule, pattern->child[0], 0);
+            fprintf(out, ", ");
+            emit_build(out, rule, pattern->child[1], 0);
+            fprintf(out, ", n)");
+        }
+        else
+        {
+            fprintf(out, "rule_not(");
+            emit_build(out, rule, pattern->child[0], 0);
+            fprintf(out, ", n)");
+        }
+        break;
+    case PAT_VAR:
+        fprintf(out, "rule_clone(b->expr[%d])",
+                name_index(rule->expr_names, &rule->expr_count, pattern->name, 0));
+        break;
+    case PAT_CONST:
+        fprintf(out, "%s(b->value[%d], n)", constant,
+                name_index(rule->const_names, &rule->const_count, pattern->name, 0));
+        break;
+    case PAT_INT:
+        fprintf(out, "%s(%lldLL, n)", constant, pattern->value);
+        break;
+    case PAT_BOOL:
+        fprintf(out, "rule_boolean(%lld, n)", pattern->value);
+        break;
+    case PAT_COMPUTE:
+    {
+        int a = name_index(rule->const_names, &rule->const_count, pattern->compute_args[0], 0);
+        if (pattern->compute_op == 'n')
+        {
+            fprintf(out, "%s(rule_wrap_sub(0, b->value[%d]), n)", constant, a);
+            break;
+        }
+        int c = name_index(rule->const_names, &rule->const_count, pattern->compute_args[1], 0);
+        const char *helper = pattern->compute_op == '+' ? "rule_wrap_add" :
+                             pattern->compute_op == '-' ? "rule_wrap_sub" : "rule_wrap_mul";
+        fprintf(out, "%s(%s(b->value[%d], b->value[%d]), n)", constant, helper, a, c);
+        break;
+    }
+    }
+}
+
+static void emit_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (const char *c = text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', out);
+        fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+static void emit(FILE *out)
+{
+    const char *base = strrchr(rules_path, '/');
+    fprintf(out, "/* Generated by tools/rulegen.c from %s. Do not edit. */\n\n", base ? base + 1 : rules_path);
+    fprintf(out, "#define RULE_COUNT %d\n", rule_count);
+    fprintf(out, "#define RULE_MAX_EXPRS %d\n#define RULE_MAX_CONSTS %d\n\n", MAX_NAMES, MAX_NAMES);
+    fprintf(out, "typedef struct\n{\n    ASTNode *expr[RULE_MAX_EXPRS];\n    long long value[RULE_MAX_CONSTS];\n} RuleBindings;\n\n");
+
+    fprintf(out, "static const char *const rule_names[RULE_COUNT] = {\n");
+    for (int i = 0; i < rule_count; i++)
+        fprintf(out, "    \"%s\",\n", rules[i].name);
+    fprintf(out, "};\n\nstatic const char *const rule_texts[RULE_COUNT] = {\n");
+    for (int i = 0; i < rule_count; i++)
+    {
+        fprintf(out, "    ");
+        emit_string(out, rules[i].text);
+        fprintf(out, ",\n");
+    }
+    fprintf(out, "};\n");
+
+    for (int i = 0; i < rule_count; i++)
+    {
+        Rule *rule = &rules[i];
+        for (int v = 0; v < rule->variant_count; v++)
+        {
+            int bound_exprs[MAX_NAMES] = {0}, bound_consts[MAX_NAMES] = {0};
+            char text[MAX_LINE];
+            pattern_string(rule->variants[v], text, sizeof(text));
+            fprintf(out, "\n/* %s: %s */\nstatic int match_%s_%d(ASTNode *n, RuleBindings *b)\n{\n", rule->name, text,
+                    rule->name, v);
+            emit_match(out, rule, rule->variants[v], "n", bound_exprs, bound_consts);
+            for (int g = 0; g < rule->guard_count; g++)
+            {
+                fprintf(out, "    if (!rule_guard_%s(b->expr[%d]))\n        return 0;\n", rule->guards[g].function,
+                        name_index(rule->expr_names, &rule->expr_count, rule->guards[g].name, 0));
+            }
+            fprintf(out, "    return 1;\n}\n");
+        }
+        fprintf(out, "\nstatic ASTNode *build_%s(ASTNode *n, RuleBindings *b)\n{\n    (void)n;\n    (void)b;\n    return ", rule->name);
+        emit_build(out, rule, rule->replacement, 1);
+        fprintf(out, ";\n}\n");
+    }
+
+    /* Dispatch on the root operator, trying rules in table order. */
+    fprintf(out, "\n/* Returns the index of the first rule matching n, or -1. */\n");
+    fprintf(out, "static int match_rules(ASTNode *n, RuleBindings *b)\n{\n    switch (rule_root_operator(n))\n    {\n");
+    for (int o = 0; o < OPERATOR_COUNT; o++)
+    {
+        int any = 0;
+        for (int i = 0; i < rule_count; i++)
+        {
+            if (strcmp(rules[i].pattern->token, operators[o].token) != 0)
+                continue;
+            if (!any)
+                fprintf(out, "    case %s:\n", operators[o].token);
+            any = 1;
+            for (int v = 0; v < rules[i].variant_count; v++)
+                fprintf(out, "        if (match_%s_%d(n, b))\n            return %d;\n", rules[i].name, v, i);
+        }
+        if (any)
+            fprintf(out, "        break;\n");
+    }
+    fprintf(out, "    default:\n        break;\n    }\n    return -1;\n}\n");
+
+    fprintf(out, "\nstatic ASTNode *build_rule(int rule, ASTNode *n, RuleBindings *b)\n{\n    switch (rule)\n    {\n");
+    for (int i = 0; i < rule_count; i++)
+        fprintf(out, "    case %d:\n        return build_%s(n, b);\n", i, rules[i].name);
+    fprintf(out, "    default:\n        return NULL;\n    }\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <rules file> <output.inc>\n", argv[0]);
+        return 1;
+    }
+    rules_path = argv[1];
+
+    FILE *input = fopen(argv[1], "r");
+    if (!input)
+    {
+        fprintf(stderr, "[Rulegen Error] Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), input))
+    {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        const char *p = line;
+        skip_spaces(&p);
+        if (*p)
+            parse_rule(p);
+    }
+    fclose(input);
+
+    FILE *output = fopen(argv[2], "w");
+    if (!output)
+    {
+        fprintf(stderr, "[Rulegen Error] Cannot write %s\n", argv[2]);
+        return 1;
+    }
+    emit(output);
+    fclose(output);
+    return 0;
+}
@@ -0,0 +1,799 @@
+/**
+ * @file superopt.c
+ * @brief Offline superoptimizer for small expression kernels of the SEG compiler.
+ *        For every kernel listed below it enumerates x86-64 instruction sequences over
+ *        a small alphabet (mov, add, sub, adc, sbb, and, or, xor, cmp, neg, not, inc,
+ *        dec and shifts by 1 or by the sign position; registers rax, rbx, rcx;
+ *        immediates 0, 1 and -1) in order of length. Each candidate runs on a handful
+ *        of edge-case test vectors while it is being built; a survivor is then checked
+ *        on thousands of 64-bit vectors and exhaustively at 8-bit width, where both the
+ *        kernel and the sequence are evaluated with every width-dependent constant
+ *        scaled down (exhaustively at full width when the inputs are booleans). The
+ *        shortest sequence that passes and is shorter than what the code generator
+ *        emits for the kernel is written to the table src/superopt.def, which the
+ *        instruction selector of the compiler includes.
+ *
+ *        Usage: superopt <output.def>
+ * @author Dario Romandini
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LENGTH 4
+#define MAX_ALPHABET 256
+#define SEARCH_VECTORS 8
+#define RANDOM_VECTORS 4096
+#define NARROW_WIDTH 8
+
+/* Kernels to search; patterns use the syntax of src/simplify.rules with the inputs x and y. */
+typedef struct
+{
+    const char *name;
+    const char *pattern;
+    int bool_x; ///< x is known to be 0 or 1
+    int bool_y; ///< y is known to be 0 or 1
+} Kernel;
+
+static const Kernel kernels[] = {
+    {"NotBool", "(! x)", 1, 0},
+    {"Not", "(! x)", 0, 0},
+    {"NonZero", "(!= x 0)", 0, 0},
+    {"Negative", "(< x 0)", 0, 0},
+    {"NonNegative", "(>= x 0)", 0, 0},
+    {"Positive", "(> x 0)", 0, 0},
+    {"NonPositive", "(<= x 0)", 0, 0},
+    {"EqualBool", "(== x y)", 1, 1},
+    {"NotEqualBool", "(!= x y)", 1, 1},
+    {"LessBool", "(< x y)", 1, 1},
+    {"LessEqualBool", "(<= x y)", 1, 1},
+    {"GreaterBool", "(> x y)", 1, 1},
+    {"GreaterEqualBool", "(>= x y)", 1, 1},
+    {"EitherNegative", "(| (< x 0) (< y 0))", 0, 0},
+    {"BothNegative", "(& (< x 0) (< y 0))", 0, 0},
+    {"EitherNonNegative", "(| (>= x 0) (>= y 0))", 0, 0},
+    {"BothNonNegative", "(& (>= x 0) (>= y 0))", 0, 0},
+    {"SignsDiffer", "(^ (< x 0) (< y 0))", 0, 0},
+    {"SignsAgree", "(== (< x 0) (< y 0))", 0, 0},
+    {"BothZero", "(& (== x 0) (== y 0))", 0, 0},
+    {"EitherNonZero", "(| (!= x 0) (!= y 0))", 0, 0},
+    {"Negate", "(- 0 x)", 0, 0},
+    {"Complement", "(- (- 0 x) 1)", 0, 0},
+    {"Increment", "(+ x 1)", 0, 0},
+    {"Double", "(+ x x)", 0, 0},
+    {"MaskIfNegative", "(* (< x 0) y)", 0, 0},
+    {"MaskUnless", "(* (! x) y)", 1, 0},
+};
+
+#define KERNEL_COUNT (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+/* Kernel expressions */
+
+typedef enum
+{
+    EXPR_X,
+    EXPR_Y,
+    EXPR_CONST,
+    EXPR_ADD,
+    EXPR_SUB,
+    EXPR_MUL,
+    EXPR_EQ,
+    EXPR_NE,
+    EXPR_LT,
+    EXPR_LE,
+    EXPR_GT,
+    EXPR_GE,
+    EXPR_AND,
+    EXPR_OR,
+    EXPR_XOR,
+    EXPR_NOT
+} ExprKind;
+
+typedef struct Expr
+{
+    ExprKind kind;
+    long long value;
+    struct Expr *left;
+    struct Expr *right;
+} Expr;
+
+static const struct
+{
+    const char *symbol;
+    ExprKind kind;
+    int compare; ///< Generated as cmp/setcc/movzx
+} operators[] = {
+    {"+", EXPR_ADD, 0}, {"-", EXPR_SUB, 0}, {"*", EXPR_MUL, 0}, {"==", EXPR_EQ, 1}, {"!=", EXPR_NE, 1},
+    {"<", EXPR_LT, 1},  {"<=", EXPR_LE, 1}, {">", EXPR_GT, 1},  {">=", EXPR_GE, 1}, {"&", EXPR_AND, 0},
+    {"|", EXPR_OR, 0},  {"^", EXPR_XOR, 0}, {"!", EXPR_NOT, 1},
+};
+
+#define OPERATOR_COUNT (int)(sizeof(operators) / sizeof(operators[0]))
+
+static const char *current_kernel;
+
+static void fail(const char *message, const char *detail)
+{
+    fprintf(stderr, "[Superopt Error] %s: %s%s%s\n", current_kernel, message, detail ? ": " : "",
+            detail ? detail : "");
+    exit(1);
+}
+
+static void skip_spaces(const char **p)
+{
+    while (isspace((unsigned char)**p))
+        (*p)++;
+}
+
+static Expr *new_expr(ExprKind kind)
+{
+    Expr *expr = calloc(1, sizeof(Expr));
+    expr->kind = kind;
+    return expr;
+}
+
+static Expr *parse_expr(const char **p)
+{
+    char atom[16];
+    size_t length = 0;
+
+    skip_spaces(p);
+    int open = **p == '(';
+    if (open)
+    {
+        (*p)++;
+        skip_spaces(p);
+    }
+    while (**p && !isspace((unsigned char)**p) && **p != '(' && **p != ')')
+    {
+        if (length + 1 < sizeof(atom))
+            atom[length++] = **p;
+        (*p)++;
+    }
+    atom[length] = '\0';
+
+    if (!open)
+    {
+        if (strcmp(atom, "x") == 0)
+            return new_expr(EXPR_X);
+        if (strcmp(atom, "y") == 0)
+            return new_expr(EXPR_Y);
+        if (!isdigit((unsigned char)atom[0]))
+            fail("unknown leaf", atom);
+        Expr *constant = new_expr(EXPR_CONST);
+        constant->value = strtoll(atom, NULL, 10);
+        return constant;
+    }
+
+    Expr *node = NULL;
+    for (int i = 0; i < OPERATOR_COUNT; i++)
+    {
+        if (strcmp(operators[i].symbol, atom) == 0)
+            node = new_expr(operators[i].kind);
+    }
+    if (!node)
+        fail("unknown operator", atom);
+    node->left = parse_expr(p);
+    if (node->kind != EXPR_NOT)
+        node->right = parse_expr(p);
+    skip_spaces(p);
+    if (**p != ')')
+        fail("expected ')'", NULL);
+    (*p)++;
+    return node;
+}
+
+static int uses(const Expr *expr, ExprKind leaf)
+{
+    if (!expr)
+        return 0;
+    return expr->kind == leaf || uses(expr->left, leaf) || uses(expr->right, leaf);
+}
+
+static int is_compare(ExprKind kind)
+{
+    for (int i = 0; i < OPERATOR_COUNT; i++)
+    {
+        if (operators[i].kind == kind)
+            return operators[i].compare;
+    }
+    return 0;
+}
+
+/*
+ * Instructions the code generator emits for an expression once the peephole pass has
+ * turned literal right operands into immediates: operand loads, push/pop around the
+ * right operand, and one instruction per operator (three for comparisons and !).
+ */
+static int baseline_cost(const Expr *expr)
+{
+    switch (expr->kind)
+    {
+    case EXPR_X:
+    case EXPR_Y:
+    case EXPR_CONST:
+        return 1;
+    case EXPR_NOT:
+        return baseline_cost(expr->left) + 3;
+    default:
+    {
+        int op = is_compare(expr->kind) ? 3 : 1;
+        if (expr->right->kind == EXPR_CONST)
+            return baseline_cost(expr->left) + op;
+        return baseline_cost(expr->right) + 1 + baseline_cost(expr->left) + 1 + op;
+    }
+    }
+}
+
+/* Evaluation at a given width: values are kept sign-extended from that width. */
+
+static uint64_t width_mask(int width)
+{
+    return width == 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+}
+
+static int64_t sign_extend(uint64_t value, int width)
+{
+    value &= width_mask(width);
+    if (width < 64 && (value >> (width - 1)) & 1)
+        value |= ~width_mask(width);
+    return (int64_t)value;
+}
+
+static int64_t evaluate(const Expr *expr, int64_t x, int64_t y, int width)
+{
+    int64_t a = 0, b = 0;
+    if (expr->left)
+        a = evaluate(expr->left, x, y, width);
+    if (expr->right)
+        b = evaluate(expr->right, x, y, width);
+
+    switch (expr->kind)
+    {
+    case EXPR_X:
+        return x;
+    case EXPR_Y:
+        return y;
+    case EXPR_CONST:
+        return sign_extend((uint64_t)expr->value, width);
+    case EXPR_ADD:
+        return sign_extend((uint64_t)a + (uint64_t)b, width);
+    case EXPR_SUB:
+        return sign_extend((uint64_t)a - (uint64_t)b, width);
+    case EXPR_MUL:
+        return sign_extend((uint64_t)a * (uint64_t)b, width);
+    case EXPR_EQ:
+        return a == b;
+    case EXPR_NE:
+        return a != b;
+    case EXPR_LT:
+        return a < b;
+    case EXPR_LE:
+        return a <= b;
+    case EXPR_GT:
+        return a > b;
+    case EXPR_GE:
+        return a >= b;
+    case EXPR_AND:
+        return a & b;
+    case EXPR_OR:
+        return a | b;
+    case EXPR_XOR:
+        return a ^ b;
+    case EXPR_NOT:
+        return a == 0;
+    }
+    return 0;
+}
+
+/* Machine model */
+
+/* Enumeration order: among sequences of equal length, the first found has the shortest encodings. */
+typedef enum
+{
+    OP_NOT,
+    OP_NEG,
+    OP_INC,
+    OP_DEC,
+    OP_SHR,
+    OP_SAR,
+    OP_SHL,
+    OP_MOV,
+    OP_ADD,
+    OP_SUB,
+    OP_AND,
+    OP_OR,
+    OP_XOR,
+    OP_ADC,
+    OP_SBB,
+    OP_CMP,
+    OP_COUNT
+} Op;
+
+static const struct
+{
+    const char *mnemonic;
+    const char *opcode; ///< MOpcode of the compiler
+    int unary;
+    int shift;
+    int reads_dest;
+    int reads_carry;
+    int sets_carry; ///< Leaves a defined carry flag (inc and dec clobber it as far as the compiler knows)
+    int writes_flags;
+} op_info[OP_COUNT] = {
+    [OP_MOV] = {"mov", "MI_MOV", 0, 0, 0, 0, 0, 0},  [OP_ADD] = {"add", "MI_ADD", 0, 0, 1, 0, 1, 1},
+    [OP_SUB] = {"sub", "MI_SUB", 0, 0, 1, 0, 1, 1},  [OP_AND] = {"and", "MI_AND", 0, 0, 1, 0, 1, 1},
+    [OP_OR] = {"or", "MI_OR", 0, 0, 1, 0, 1, 1},     [OP_XOR] = {"xor", "MI_XOR", 0, 0, 1, 0, 1, 1},
+    [OP_NEG] = {"neg", "MI_NEG", 1, 0, 1, 0, 1, 1},  [OP_NOT] = {"not", "MI_NOT", 1, 0, 1, 0, 0, 0},
+    [OP_INC] = {"inc", "MI_INC", 1, 0, 1, 0, 0, 1},  [OP_DEC] = {"dec", "MI_DEC", 1, 0, 1, 0, 0, 1},
+    [OP_SHL] = {"shl", "MI_SHL", 0, 1, 1, 0, 1, 1},  [OP_SHR] = {"shr", "MI_SHR", 0, 1, 1, 0, 1, 1},
+    [OP_SAR] = {"sar", "MI_SAR", 0, 1, 1, 0, 1, 1},  [OP_ADC] = {"adc", "MI_ADC", 0, 0, 1, 1, 1, 1},
+    [OP_SBB] = {"sbb", "MI_SBB", 0, 0, 1, 1, 1, 1},  [OP_CMP] = {"cmp", "MI_CMP", 0, 0, 1, 0, 1, 1},
+};
+
+enum
+{
+    REG_RAX,
+    REG_RBX,
+    REG_RCX,
+    REG_COUNT,
+    SRC_IMM = REG_COUNT
+};
+
+static const char *reg_names[REG_COUNT] = {"rax", "rbx", "rcx"};
+static const char *reg_enums[REG_COUNT] = {"MREG_RAX", "MREG_RBX", "MREG_RCX"};
+
+typedef enum
+{
+    IMM_ZERO,
+    IMM_ONE,
+    IMM_MINUS_ONE,
+    IMM_SIGN ///< Width - 1: shifts that isolate or smear the sign bit
+} ImmKind;
+
+typedef struct
+{
+    Op op;
+    int dst;
+    int src; ///< Register, or SRC_IMM
+    ImmKind imm;
+} Insn;
+
+typedef struct
+{
+    uint64_t reg[REG_COUNT];
+    int carry;
+} MachineState;
+
+static uint64_t immediate(ImmKind kind, int width)
+{
+    switch (kind)
+    {
+    case IMM_ZERO:
+        return 0;
+    case IMM_ONE:
+        return 1;
+    case IMM_MINUS_ONE:
+        return width_mask(width);
+    case IMM_SIGN:
+        return (uint64_t)width - 1;
+    }
+    return 0;
+}
+
+static void execute(const Insn *insn, MachineState *state, int width)
+{
+    uint64_t mask = width_mask(width);
+    uint64_t a = state->reg[insn->dst];
+    uint64_t b = insn->src == SRC_IMM ? immediate(insn->imm, width) : state->reg[insn->src];
+    uint64_t result = a;
+    int carry = state->carry;
+
+    switch (insn->op)
+    {
+    case OP_MOV:
+        result = b;
+        break;
+    case OP_ADD:
+        result = (a + b) & mask;
+        carry = result < a;
+        break;
+    case OP_ADC:
+        result = (a + b + (uint64_t)carry) & mask;
+        carry = result < a || (carry && result == a);
+        break;
+    case OP_SUB:
+    case OP_CMP:
+        result = (a - b) & mask;
+        carry = a < b;
+        break;
+    case OP_SBB:
+        result = (a - b - (uint64_t)carry) & mask;
+        carry = a < b || (carry && a == b);
+        break;
+    case OP_AND:
+        result = a & b;
+        carry = 0;
+        break;
+    case OP_OR:
+        result = a | b;
+        carry = 0;
+        break;
+    case OP_XOR:
+        result = a ^ b;
+        carry = 0;
+        break;
+    case OP_NEG:
+        result = (0 - a) & mask;
+        carry = a != 0;
+        break;
+    case OP_NOT:
+        result = ~a & mask;
+        break;
+    case OP_INC:
+        result = (a + 1) & mask;
+        break;
+    case OP_DEC:
+        result = (a - 1) & mask;
+        break;
+    case OP_SHL:
+        result = (a << b) & mask;
+        carry = (a >> (width - b)) & 1;
+        break;
+    case OP_SHR:
+        result = a >> b;
+        carry = (a >> (b - 1)) & 1;
+        break;
+    case OP_SAR:
+        result = (uint64_t)(sign_extend(a, width) >> b) & mask;
+        carry = (a >> (b - 1)) & 1;
+        break;
+    case OP_COUNT:
+        break;
+    }
+    if (insn->op != OP_CMP)
+        state->reg[insn->dst] = result;
+    state->carry = carry;
+}
+
+/* The alphabet of the search, without instructions that never change anything. */
+
+static Insn alphabet[MAX_ALPHABET];
+static int alphabet_size;
+
+static void add_insn(Op op, int dst, int src, ImmKind imm)
+{
+    Insn insn = {op, dst, src, imm};
+    alphabet[alphabet_size++] = insn;
+}
+
+static void build_alphabet(void)
+{
+    for (Op op = 0; op < OP_COUNT; op++)
+    {
+        for (int dst = 0; dst < REG_COUNT; dst++)
+        {
+            if (op_info[op].unary)
+            {
+                add_insn(op, dst, SRC_IMM, IMM_ZERO);
+                continue;
+            }
+            if (op_info[op].shift)
+            {
+                add_insn(op, dst, SRC_IMM, IMM_ONE);
+                add_insn(op, dst, SRC_IMM, IMM_SIGN);
+                continue;
+            }
+            for (int src = 0; src < REG_COUNT; src++)
+            {
+                int same = src == dst;
+                if (same && (op == OP_MOV || op == OP_AND || op == OP_OR))
+                    continue;
+                add_insn(op, dst, src, IMM_ZERO);
+            }
+            for (ImmKind imm = IMM_ZERO; imm <= IMM_MINUS_ONE; imm++)
+            {
+                int identity = (imm == IMM_ZERO && op != OP_MOV && op != OP_AND && op != OP_ADC &&
+                                op != OP_SBB && op != OP_CMP) ||
+                               (imm == IMM_MINUS_ONE && op == OP_AND);
+                if (!identity)
+                    add_insn(op, dst, SRC_IMM, imm);
+            }
+        }
+    }
+}
+
+/* Test vectors */
+
+typedef struct
+{
+    int64_t x;
+    int64_t y;
+} Vector;
+
+static const int64_t edge_values[] = {
+    0, 1, 2, 3, -1, -2, -3, INT64_MAX, INT64_MIN, INT64_MIN + 1, INT64_MAX - 1,
+    0x5555555555555555LL, (int64_t)0xAAAAAAAAAAAAAAAAULL, 1LL << 32, -(1LL << 32), 63, 64, 127, 128, 255, 256,
+};
+
+#define EDGE_COUNT (int)(sizeof(edge_values) / sizeof(edge_values[0]))
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+/* Random inputs, biased towards small magnitudes where comparisons change their answer. */
+static int64_t random_value(void)
+{
+    uint64_t bits = next_random();
+    switch (bits & 3)
+    {
+    case 0:
+        return (int64_t)(bits >> 2) % 17 - 8;
+    case 1:
+        return (int64_t)((bits >> 2) | (1ULL << 63));
+    default:
+        return (int64_t)bits;
+    }
+}
+
+static Vector make_vector(const Kernel *kernel, int64_t x, int64_t y)
+{
+    Vector vector = {kernel->bool_x ? x & 1 : x, kernel->bool_y ? y & 1 : y};
+    return vector;
+}
+
+/* A search in progress */
+
+typedef struct
+{
+    const Kernel *kernel;
+    Expr *expr;
+    int uses_y;
+    Vector search[SEARCH_VECTORS];
+    int64_t search_expected[SEARCH_VECTORS];
+    Vector *checks;
+    int check_count;
+    Insn sequence[MAX_LENGTH];
+    MachineState states[MAX_LENGTH + 1][SEARCH_VECTORS];
+    long long candidates;
+    const char *verification;
+} Search;
+
+static MachineState initial_state(int64_t x, int64_t y, int width)
+{
+    MachineState state = {{(uint64_t)x & width_mask(width), (uint64_t)y & width_mask(width), 0}, 0};
+    return state;
+}
+
+static int runs_correctly(Search *search, int length, int64_t x, int64_t y, int width)
+{
+    MachineState state = initial_state(x, y, width);
+    for (int i = 0; i < length; i++)
+        execute(&search->sequence[i], &state, width);
+    return state.reg[REG_RAX] == ((uint64_t)evaluate(search->expr, x, y, width) & width_mask(width));
+}
+
+/* Checks a candidate that passed the search vectors on every other vector and, exhaustively, at 8 bits. */
+static int verify(Search *search, int length)
+{
+    for (int i = 0; i < search->check_count; i++)
+    {
+        if (!runs_correctly(search, length, search->checks[i].x, search->checks[i].y, 64))
+            return 0;
+    }
+
+    if (search->kernel->bool_x && (search->kernel->bool_y || !search->uses_y))
+    {
+        search->verification = "exhaustive over the boolean inputs";
+        return 1;
+    }
+
+    int x_count = search->kernel->bool_x ? 2 : 1 << NARROW_WIDTH;
+    int y_count = !search->uses_y ? 1 : search->kernel->bool_y ? 2 : 1 << NARROW_WIDTH;
+    for (int x = 0; x < x_count; x++)
+    {
+        for (int y = 0; y < y_count; y++)
+        {
+            if (!runs_correctly(search, length, sign_extend((uint64_t)x, NARROW_WIDTH),
+                                sign_extend((uint64_t)y, NARROW_WIDTH), NARROW_WIDTH))
+                return 0;
+        }
+    }
+    search->verification = "exhaustive at 8 bits, test vectors at 64 bits";
+    return 1;
+}
+
+/*
+ * Depth-first enumeration of sequences of exactly length instructions. Registers and
+ * the carry flag are only read once defined (x is in rax and y in rbx on entry), and
+ * the last instruction must write the result to rax. The machine states of the prefix
+ * are kept per search vector, so each candidate costs one instruction per vector.
+ */
+static int enumerate(Search *search, int depth, int length, int defined, int carry_defined)
+{
+    for (int i = 0; i < alphabet_size; i++)
+    {
+        const Insn *insn = &alphabet[i];
+        int src_reg = insn->src != SRC_IMM ? insn->src : -1;
+
+        if (op_info[insn->op].reads_dest && !(defined & (1 << insn->dst)))
+            continue;
+        if (src_reg >= 0 && !(defined & (1 << src_reg)))
+            continue;
+        if (op_info[insn->op].reads_carry && !carry_defined)
+            continue;
+        if (depth == length - 1 && (insn->op == OP_CMP || insn->dst != REG_RAX))
+            continue;
+
+        search->sequence[depth] = *insn;
+        search->candidates++;
+        if (depth == length - 1)
+        {
+            int correct = 1;
+            for (int v = 0; v < SEARCH_VECTORS && correct; v++)
+            {
+                MachineState state = search->states[depth][v];
+                execute(insn, &state, 64);
+                correct = state.reg[REG_RAX] == (uint64_t)search->search_expected[v];
+            }
+            if (correct && verify(search, length))
+                return 1;
+            continue;
+        }
+
+        for (int v = 0; v < SEARCH_VECTORS; v++)
+        {
+            search->states[depth + 1][v] = search->states[depth][v];
+            execute(insn, &search->states[depth + 1][v], 64);
+        }
+        int now_defined = defined | (insn->op == OP_CMP ? 0 : 1 << insn->dst);
+        int now_carry = op_info[insn->op].sets_carry ||
+                        (carry_defined && !op_info[insn->op].writes_flags);
+        if (enumerate(search, depth + 1, length, now_defined, now_carry))
+            return 1;
+    }
+    return 0;
+}
+
+/* Emission */
+
+static void print_insn(FILE *output, const Insn *insn)
+{
+    fprintf(output, "%s %s", op_info[insn->op].mnemonic, reg_names[insn->dst]);
+    if (op_info[insn->op].unary)
+        return;
+    if (insn->src == SRC_IMM)
+        fprintf(output, ", %lld", (long long)sign_extend(immediate(insn->imm, 64), 64));
+    else
+        fprintf(output, ", %s", reg_names[insn->src]);
+}
+
+static void emit_kernel(FILE *output, Search *search, int length, int baseline, int fixed)
+{
+    const Kernel *kernel = search->kernel;
+    fprintf(output, "/* %s: %d instruction%s instead of %d (%s)\n", kernel->pattern, length,
+            length == 1 ? "" : "s", baseline - fixed, search->verification);
+    for (int i = 0; i < length; i++)
+    {
+        fprintf(output, " *     ");
+        print_insn(output, &search->sequence[i]);
+        fprintf(output, "\n");
+    }
+    fprintf(output, " */\n");
+
+    const char *preconditions = kernel->bool_x && kernel->bool_y ? "SUPEROPT_X_BOOL | SUPEROPT_Y_BOOL"
+                                : kernel->bool_x                 ? "SUPEROPT_X_BOOL"
+                                : kernel->bool_y                 ? "SUPEROPT_Y_BOOL"
+                                                                 : "0";
+    fprintf(output, "SUPEROPT_KERNEL(%s, \"%s\", %s, %d", kernel->name, kernel->pattern, preconditions, length);
+    for (int i = 0; i < length; i++)
+    {
+        const Insn *insn = &search->sequence[i];
+        long long imm = insn->src == SRC_IMM && !op_info[insn->op].unary
+                            ? (long long)sign_extend(immediate(insn->imm, 64), 64)
+                            : 0;
+        fprintf(output, ",\n                SUPEROPT_INSN(%s, %s, %s, %lld)", op_info[insn->op].opcode,
+                reg_enums[insn->dst], insn->src == SRC_IMM ? "MREG_NONE" : reg_enums[insn->src], imm);
+    }
+    fprintf(output, ")\n\n");
+}
+
+static void search_kernel(FILE *output, const Kernel *kernel)
+{
+    Search search;
+    memset(&search, 0, sizeof(search));
+    current_kernel = kernel->name;
+
+    const char *p = kernel->pattern;
+    search.kernel = kernel;
+    search.expr = parse_expr(&p);
+    search.uses_y = uses(search.expr, EXPR_Y);
+
+    /* Loads of the inputs and the push/pop that put y in rbx are paid either way. */
+    int fixed = uses(search.expr, EXPR_X) + (search.uses_y ? 3 : 0);
+    int baseline = baseline_cost(search.expr);
+    int max_length = baseline - fixed - 1 < MAX_LENGTH ? baseline - fixed - 1 : MAX_LENGTH;
+
+    for (int v = 0; v < SEARCH_VECTORS; v++)
+    {
+        int64_t x = kernel->bool_x ? v & 1 : edge_values[v * 5 % EDGE_COUNT];
+        int64_t y = kernel->bool_y ? (v >> 1) & 1 : edge_values[(v * 3 + 4) % EDGE_COUNT];
+        search.search[v] = make_vector(kernel, x, y);
+        search.search_expected[v] = evaluate(search.expr, search.search[v].x, search.search[v].y, 64);
+        search.states[0][v] = initial_state(search.search[v].x, search.search[v].y, 64);
+    }
+
+    search.checks = malloc(sizeof(Vector) * (EDGE_COUNT * EDGE_COUNT + RANDOM_VECTORS));
+    for (int i = 0; i < EDGE_COUNT; i++)
+    {
+        for (int j = 0; j < EDGE_COUNT; j++)
+            search.checks[search.check_count++] = make_vector(kernel, edge_values[i], edge_values[j]);
+    }
+    for (int i = 0; i < RANDOM_VECTORS; i++)
+    {
+        int64_t x = random_value();
+        search.checks[search.check_count++] = make_vector(kernel, x, random_value());
+    }
+
+    int defined = 1 << REG_RAX | (search.uses_y ? 1 << REG_RBX : 0);
+    int found = 0;
+    for (int length = 1; length <= max_length && !found; length++)
+    {
+        found = enumerate(&search, 0, length, defined, 0);
+        if (found)
+        {
+            emit_kernel(output, &search, length, baseline, fixed);
+            fprintf(stderr, "%-18s %-24s %d instruction(s), %lld candidates\n", kernel->name, kernel->pattern,
+                    length, search.candidates);
+        }
+    }
+    if (!found)
+    {
+        fprintf(output, "/* %s: no sequence shorter than %d instruction%s */\n\n", kernel->pattern,
+                baseline - fixed, baseline - fixed == 1 ? "" : "s");
+        fprintf(stderr, "%-18s %-24s not improved, %lld candidates\n", kernel->name, kernel->pattern,
+                search.candidates);
+    }
+    free(search.checks);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <output.def>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *output = fopen(argv[1], "w");
+    if (!output)
+    {
+        fprintf(stderr, "[Superopt Error] Cannot write %s\n", argv[1]);
+        return 1;
+    }
+
+    build_alphabet();
+    fprintf(output, "/*\n"
+                    " * Superoptimized expression kernels for the SEG compiler, generated by tools/superopt.c\n"
+                    " * (cmake --build <dir> --target update_superopt_table); do not edit by hand.\n"
+                    " *\n"
+                    " * SUPEROPT_KERNEL(name, pattern, preconditions, length, instructions...)\n"
+                    " * On entry x is in rax and y in rbx; the result is left in rax and rcx is\n"
+                    " * scratch. SUPEROPT_INSN(opcode, destination, source register, immediate)\n"
+                    " * takes the immediate when the source register is MREG_NONE.\n"
+                    " */\n\n");
+    for (int i = 0; i < KERNEL_COUNT; i++)
+        search_kernel(output, &kernels[i]);
+    fclose(output);
+    return 0;
+}